@@ -561,6 +561,8 @@ def main(tf_config=None, server=None):
         '''Smart staged Feature'''
         next_element = tf.staged(next_element, num_threads=4, capacity=40)
         sess_config.graph_options.optimizer_options.do_smart_stage = True
+        if args.ev and args.ev_prefetch:
+            sess_config.graph_options.optimizer_options.do_smart_stage_ev_prefetch = True
         hooks.append(tf.make_prefetch_hook())
     if args.op_fusion and not args.tf:
         '''Auto Graph Fusion'''
@@ -685,6 +687,10 @@ def get_arg_parser():
                         help='Whether to enable smart staged feature of DeepRec, Default to True.',
                         type=boolean_string,
                         default=True)
+    parser.add_argument('--ev_prefetch',
+                        help='Whether to prefetch EmbeddingVariable ids of the next batch in smart stage. Default False.',
+                        type=boolean_string,
+                        default=False)
     parser.add_argument('--emb_fusion',
                         help='Whether to enable embedding fusion, Default to True.',
                         type=boolean_string,
@@ -209,6 +209,7 @@ class WDL():
                  bf16=False,
                  input_layer_partitioner=None,
                  dense_layer_partitioner=None,
+                 ev_value_dtype=tf.float32,
                  saved_model=False):
         if saved_model:
             if not inputs:
@@ -222,6 +223,7 @@ class WDL():
             self.deep_learning_rate = deep_learning_rate
             self.input_layer_partitioner = input_layer_partitioner
             self.dense_layer_partitioner = dense_layer_partitioner
+            self.ev_value_dtype = ev_value_dtype
             self.global_step = tf.train.get_or_create_global_step()
 
             self.feature = inputs
@@ -242,6 +244,7 @@ class WDL():
             self.deep_learning_rate = deep_learning_rate
             self.input_layer_partitioner = input_layer_partitioner
             self.dense_layer_partitioner = dense_layer_partitioner
+            self.ev_value_dtype = ev_value_dtype
 
             self.feature = inputs[0]
             self.label = inputs[1]
@@ -280,8 +283,11 @@ class WDL():
         # input features
         self.dnn_parent_scope = 'dnn'
         with tf.variable_scope(self.dnn_parent_scope):
+            # EmbeddingVariables of the deep columns take the dtype of the
+            # scope, bfloat16 and float16 are looked up as float32.
             with tf.variable_scope("input_from_feature_columns",
                                    partitioner=self.input_layer_partitioner,
+                                   dtype=self.ev_value_dtype,
                                    reuse=tf.AUTO_REUSE) as dnn_inputs_scope:
                 net = tf.feature_column.input_layer(
                     features=self.feature, feature_columns=self.deep_column)
@@ -469,6 +475,11 @@ def get_arg_parser():
                         type=int,
                         default=512,
                         help='size of ev_storage, only useful for pmem_libpmem and dram_pmem now')
+    parser.add_argument('--ev_value_dtype',
+                        type=str,
+                        choices=['float32', 'bfloat16', 'float16'],
+                        default='float32',
+                        help='dtype to store the values of the deep EmbeddingVariables')
     return parser
 
 
@@ -567,6 +578,7 @@ def main(tf_config=None, server=None):
                 inputs=real_input,
                 input_layer_partitioner=input_layer_partitioner,
                 dense_layer_partitioner=dense_layer_partitioner,
+                ev_value_dtype=tf.as_dtype(args.ev_value_dtype),
                 saved_model=is_saved_model)
 
     sess_config = tf.ConfigProto()
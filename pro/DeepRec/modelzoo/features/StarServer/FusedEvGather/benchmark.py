@@ -0,0 +1,68 @@
+import os
+import time
+
+import numpy as np
+import tensorflow as tf
+
+FLAGS = tf.app.flags.FLAGS
+tf.app.flags.DEFINE_string("ps_hosts", None, "")
+tf.app.flags.DEFINE_string("worker_hosts", '127.0.0.1:8860', "")
+tf.app.flags.DEFINE_string("job_name", 'worker', "")
+tf.app.flags.DEFINE_integer("task_index", 0, "")
+tf.app.flags.DEFINE_string("protocol", 'star_server', "")
+tf.app.flags.DEFINE_integer("num_evs", 16, "")
+tf.app.flags.DEFINE_integer("dim_size", 16, "")
+tf.app.flags.DEFINE_integer("batch_size", 2048, "")
+tf.app.flags.DEFINE_integer("num_steps", 500, "")
+tf.app.flags.DEFINE_integer("warmup_steps", 50, "")
+
+
+def main(_):
+  cluster_dict = {}
+  cluster_dict['ps'] = FLAGS.ps_hosts.split(',')
+  cluster_dict['worker'] = FLAGS.worker_hosts.split(',')
+  cluster_spec = tf.train.ClusterSpec(cluster_dict)
+  num_ps = len(cluster_dict['ps'])
+  server = tf.train.Server(
+      cluster_spec,
+      job_name=FLAGS.job_name,
+      task_index=FLAGS.task_index,
+      protocol=FLAGS.protocol)
+  if FLAGS.job_name == "ps":
+    server.join()
+    return
+
+  with tf.device(tf.train.replica_device_setter(cluster=cluster_spec)):
+    ids = tf.random.uniform([FLAGS.batch_size, FLAGS.num_evs],
+                            maxval=FLAGS.batch_size * 100, dtype=tf.int64)
+    loss = 0.0
+    for i in range(FLAGS.num_evs):
+      ev = tf.get_embedding_variable(
+          name='ev{}'.format(i),
+          embedding_dim=FLAGS.dim_size,
+          key_dtype=tf.int64,
+          initializer=tf.ones_initializer(tf.float32),
+          partitioner=tf.fixed_size_partitioner(num_shards=num_ps))
+      loss += tf.reduce_sum(tf.nn.embedding_lookup(ev, ids[:, i]))
+    global_step = tf.train.get_or_create_global_step()
+    train_op = tf.train.AdagradOptimizer(0.01).minimize(
+        loss, global_step=global_step)
+
+  latencies = []
+  with tf.train.MonitoredTrainingSession(
+      master=server.target, is_chief=(FLAGS.task_index == 0)) as sess:
+    for step in range(FLAGS.warmup_steps + FLAGS.num_steps):
+      start = time.time()
+      sess.run(train_op)
+      if step >= FLAGS.warmup_steps:
+        latencies.append((time.time() - start) * 1000)
+
+  print('num_ps: {}, num_evs: {}, TF_STAR_FUSE_EV_GATHER: {}, '
+        'step latency(ms) mean: {:.3f}, p50: {:.3f}, p99: {:.3f}'.format(
+            num_ps, FLAGS.num_evs, os.environ.get('TF_STAR_FUSE_EV_GATHER', '0'),
+            np.mean(latencies), np.percentile(latencies, 50),
+            np.percentile(latencies, 99)))
+
+
+if __name__ == "__main__":
+  tf.app.run()
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Usage: ./launch.sh <num_ps> <num_evs> [benchmark flags]
+NUM_PS=${1:-2}
+NUM_EVS=${2:-16}
+shift $(( $# < 2 ? $# : 2 ))
+
+PS_HOSTS=""
+for ((i = 0; i < NUM_PS; i++)); do
+  PS_HOSTS="${PS_HOSTS:+${PS_HOSTS},}127.0.0.1:$((8890 + i))"
+done
+CLUSTER="--ps_hosts=${PS_HOSTS} --worker_hosts=127.0.0.1:8860 --num_evs=${NUM_EVS}"
+
+export TASK_INDEX=0
+
+# launch ps
+pids=""
+for ((i = 0; i < NUM_PS; i++)); do
+  python ./benchmark.py $CLUSTER --job_name=ps --task_index=$i $@ > bench-ps-$i.log 2>&1 &
+  pids="$pids $!"
+done
+# launch worker
+python ./benchmark.py $CLUSTER --job_name=worker --task_index=0 $@ 2>&1 | tee bench-worker.log | grep "step latency"
+# clean procs
+kill -9 $pids
+wait
@@ -13,12 +13,16 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <map>
 #include <queue>
 #include <unordered_set>
 
 #include "serving/processor/framework/graph_optimizer.h"
 #include "serving/processor/framework/util/utils.h"
+#include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/protobuf/meta_graph.pb.h"
 #include "tensorflow/core/graph/graph_constructor.h"
 
@@ -93,9 +97,14 @@ void StaticShapeCluteringStrategy::GetStaticGraphOps(
     const GraphDef& gdef,
     std::vector<std::string>& inputs,
     std::vector<std::string>& outputs,
-    std::unordered_set<std::string>* static_ops_name) {
+    std::unordered_set<std::string>* static_ops_name,
+    bool ignore_batch_dim) {
+  std::unordered_set<std::string> batch_major_nodes;
+  if (ignore_batch_dim) {
+    batch_major_nodes = GetBatchMajorNodes(gdef, inputs);
+  }
   std::unordered_map<std::string, bool> dynamic_ops_map =
-      GetNodesHasDynamicShapeMap(gdef);
+      GetNodesHasDynamicShapeMap(gdef, batch_major_nodes);
 
   std::unordered_map<std::string, bool> has_control_flow_input =
       GetNodesHasControlFlowInputs(gdef);
@@ -543,6 +552,21 @@ const std::string& GetDenseRestoreAllNameSuffix() {
   return suffix;
 }
 
+const std::string& GetSharedInputsCollectionKey() {
+  static std::string key("GlobalODL/SharedInputs");
+  return key;
+}
+
+const std::string& GetSharedOutputsCollectionKey() {
+  static std::string key("GlobalODL/SharedOutputs");
+  return key;
+}
+
+const std::string& GetStaticSubgraphXlaScope() {
+  static std::string scope("GlobalODL/StaticSubgraph");
+  return scope;
+}
+
 GraphOptimizer::GraphOptimizer(
     const std::string& signature_name,
     MetaGraphDef* mgdef,
@@ -606,6 +630,15 @@ Status SavedModelOptimizer::RunNativeTFGraphPass() {
     TF_RETURN_IF_ERROR(RewriteEmbeddingLookupGraph(var_parts, import_nodes));
   }
 
+  // Before hoisting, the nodes added by it have no static shapes.
+  if (option_.compile_static_subgraph) {
+    TF_RETURN_IF_ERROR(MarkStaticSubgraphForCompilation());
+  }
+
+  if (!option_.shared_input_names.empty()) {
+    TF_RETURN_IF_ERROR(HoistSharedSubgraph());
+  }
+
   // Add other passes here
 
   // replace the graph def in saved_model_bundle
@@ -649,6 +682,16 @@ Status SavedModelOptimizer::RunODLGraphPass() {
   s = RewriteDefaultValueOp();
   if (!s.ok()) return s;
 
+  if (option_.compile_static_subgraph) {
+    s = MarkStaticSubgraphForCompilation();
+    if (!s.ok()) return s;
+  }
+
+  if (!option_.shared_input_names.empty()) {
+    s = HoistSharedSubgraph();
+    if (!s.ok()) return s;
+  }
+
   // replace the graph def in saved_model_bundle
   graph_.ToGraphDef(meta_graph_def_->mutable_graph_def());
 
@@ -2355,6 +2398,487 @@ Node* SavedModelOptimizer::UpdateRestoreShardNodeInputs(
   return shard_node;
 }
 
+namespace {
+
+enum class RowKind {
+  // Has the batch dimension of the request.
+  kBatch,
+  // Computed from shared inputs, the same in every row of the batch.
+  kShared,
+  // Without batch dimension, constants and variables for example.
+  kFree
+};
+
+// Row i of the output of these ops only depends on row i of their inputs.
+const std::unordered_set<std::string>& GetRowWiseUnaryOps() {
+  static std::unordered_set<std::string> ops = {
+      "Identity", "Cast", "Relu", "Relu6", "Elu", "Selu", "LeakyRelu",
+      "Sigmoid", "Tanh", "Softplus", "Neg", "Abs", "Sign", "Exp", "Log",
+      "Sqrt", "Rsqrt", "Square", "Reciprocal", "Floor"};
+  return ops;
+}
+
+const std::unordered_set<std::string>& GetRowWiseBinaryOps() {
+  static std::unordered_set<std::string> ops = {
+      "Add", "AddV2", "Sub", "Mul", "RealDiv", "Div", "Maximum", "Minimum",
+      "SquaredDifference", "Pow", "BiasAdd"};
+  return ops;
+}
+
+const std::unordered_set<std::string>& GetReductionOps() {
+  static std::unordered_set<std::string> ops = {
+      "Sum", "Mean", "Max", "Min", "Prod"};
+  return ops;
+}
+
+const std::unordered_set<std::string>& GetVariableOps() {
+  static std::unordered_set<std::string> ops = {
+      "Variable", "VariableV2", "VarHandleOp", "KvVarHandleOp"};
+  return ops;
+}
+
+std::vector<const Edge*> GetDataInputs(const Node* node) {
+  std::vector<const Edge*> inputs(node->num_inputs(), nullptr);
+  for (const Edge* edge : node->in_edges()) {
+    if (!edge->IsControlEdge()) {
+      inputs[edge->dst_input()] = edge;
+    }
+  }
+  return inputs;
+}
+
+bool GetConstInts(const Node* node, std::vector<int64>* values) {
+  if (node->type_string() != "Const") return false;
+  const AttrValue* attr = node->attrs().Find("value");
+  Tensor t;
+  if (attr == nullptr || !t.FromProto(attr->tensor())) return false;
+  if (t.dtype() == DT_INT32) {
+    auto flat = t.flat<int32>();
+    for (int64 i = 0; i < flat.size(); ++i) values->push_back(flat(i));
+  } else if (t.dtype() == DT_INT64) {
+    auto flat = t.flat<int64>();
+    for (int64 i = 0; i < flat.size(); ++i) values->push_back(flat(i));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// All values of the const 'node' are positive, so none of the
+// dimensions it names is the batch dimension.
+bool IsPositiveConst(const Node* node) {
+  std::vector<int64> values;
+  if (!GetConstInts(node, &values)) return false;
+  for (int64 v : values) {
+    if (v <= 0) return false;
+  }
+  return true;
+}
+
+// Rank of a tensor without batch dimension, -1 if unknown.
+int GetFreeRank(const Node* node) {
+  if (node->type_string() == "Const") {
+    const AttrValue* attr = node->attrs().Find("value");
+    return attr == nullptr ? -1 : attr->tensor().tensor_shape().dim_size();
+  }
+  if (GetVariableOps().count(node->type_string()) > 0) {
+    const AttrValue* attr = node->attrs().Find("shape");
+    if (attr == nullptr || attr->shape().unknown_rank()) return -1;
+    return attr->shape().dim_size();
+  }
+  if (node->type_string() == "Identity" ||
+      node->type_string() == "ReadVariableOp") {
+    const Node* input = nullptr;
+    if (node->input_node(0, &input).ok()) return GetFreeRank(input);
+  }
+  return -1;
+}
+
+// Whether 'node' still has the batch at dimension 0, when its inputs of
+// kind kShared have one row only. No input of 'node' is of kind kBatch.
+bool IsRowWise(const Node* node, const std::vector<const Edge*>& inputs,
+               const std::vector<RowKind>& kinds) {
+  auto kind = [&](int i) { return kinds[inputs[i]->src()->id()]; };
+  const std::string& op = node->type_string();
+  const int num = inputs.size();
+
+  if (GetRowWiseUnaryOps().count(op) > 0) {
+    return num == 1;
+  }
+  if (GetRowWiseBinaryOps().count(op) > 0) {
+    // A free operand of rank 0 or 1 is broadcast to every row, higher
+    // ranks could move the batch dimension.
+    for (int i = 0; i < num; ++i) {
+      if (kind(i) == RowKind::kFree) {
+        int rank = GetFreeRank(inputs[i]->src());
+        if (rank < 0 || rank > 1) return false;
+      }
+    }
+    return true;
+  }
+  if (op == "MatMul") {
+    bool transpose_a = false;
+    tensorflow::GetNodeAttr(node->attrs(), "transpose_a", &transpose_a);
+    return num == 2 && !transpose_a && kind(0) == RowKind::kShared &&
+           kind(1) == RowKind::kFree;
+  }
+  // Embedding lookups, the ids are shared and the params are free.
+  if (op == "Gather" || op == "ResourceGather" || op == "KvResourceGather") {
+    int batch_dims = 0;
+    tensorflow::GetNodeAttr(node->attrs(), "batch_dims", &batch_dims);
+    for (int i = 0; i < num; ++i) {
+      if (kind(i) != (i == 1 ? RowKind::kShared : RowKind::kFree)) {
+        return false;
+      }
+    }
+    return batch_dims == 0;
+  }
+  if (op == "GatherV2") {
+    std::vector<int64> axis;
+    return num == 3 && kind(0) == RowKind::kFree &&
+           kind(1) == RowKind::kShared &&
+           GetConstInts(inputs[2]->src(), &axis) && axis.size() == 1 &&
+           axis[0] == 0;
+  }
+  if (op == "KvLookup") {
+    for (int i = 1; i < num; ++i) {
+      if (kind(i) != RowKind::kFree) return false;
+    }
+    return kind(0) == RowKind::kShared;
+  }
+  if (GetReductionOps().count(op) > 0) {
+    return num == 2 && kind(0) == RowKind::kShared &&
+           IsPositiveConst(inputs[1]->src());
+  }
+  if (op == "ConcatV2") {
+    for (int i = 0; i < num - 1; ++i) {
+      if (kind(i) != RowKind::kShared) return false;
+    }
+    return IsPositiveConst(inputs[num - 1]->src());
+  }
+  if (op == "ExpandDims") {
+    return num == 2 && kind(0) == RowKind::kShared &&
+           IsPositiveConst(inputs[1]->src());
+  }
+  if (op == "Squeeze") {
+    std::vector<int32> dims;
+    tensorflow::GetNodeAttr(node->attrs(), "squeeze_dims", &dims);
+    for (int32 d : dims) {
+      if (d <= 0) return false;
+    }
+    return num == 1 && !dims.empty();
+  }
+  return false;
+}
+
+Status AddInt32ConstNode(const std::string& name,
+                         const std::vector<int32>& values,
+                         bool scalar, const std::string& device,
+                         Graph* graph, Node** node) {
+  Tensor value(DT_INT32, scalar ? TensorShape({})
+                                : TensorShape({(int64)values.size()}));
+  for (size_t i = 0; i < values.size(); ++i) {
+    value.flat<int32>()(i) = values[i];
+  }
+  return NodeBuilder(name, "Const")
+      .Attr("dtype", DT_INT32)
+      .Attr("value", value)
+      .Device(device)
+      .Finalize(graph, node);
+}
+
+struct DataEdge {
+  Node* src;
+  int src_output;
+  Node* dst;
+  int dst_input;
+};
+
+} // namespace
+
+// In a one-user-many-items ranking request, the user features are
+// replicated in every row, and the user tower would be computed once per
+// item. The nodes which only depend on the shared inputs are marked
+// kShared, the inputs are sliced to their first row before these nodes,
+// and the results are broadcast back to the batch where a node of the
+// item side reads them.
+//
+// Only ops that keep the batch at dimension 0 are hoisted, the others stay
+// on the item side and read the broadcast result.
+Status SavedModelOptimizer::HoistSharedSubgraph() {
+  auto sdef = meta_graph_def_->signature_def().find(signature_name_);
+  if (sdef == meta_graph_def_->signature_def().end()) {
+    return tensorflow::errors::Internal(
+        "Not found the signature_def with user specified signature name.",
+        signature_name_);
+  }
+
+  std::unordered_map<std::string, Node*> name_to_node;
+  for (Node* node : graph_.op_nodes()) {
+    name_to_node[node->name()] = node;
+  }
+  // convert "input_example_tensor:0" to "input_example_tensor"
+  auto find_node = [&name_to_node](const TensorInfo& info) -> Node* {
+    auto it = name_to_node.find(info.name().substr(0, info.name().find(":")));
+    return it == name_to_node.end() ? nullptr : it->second;
+  };
+
+  std::unordered_set<const Node*> input_nodes;
+  for (auto input : sdef->second.inputs()) {
+    Node* node = find_node(input.second);
+    if (node != nullptr) input_nodes.insert(node);
+  }
+  std::unordered_set<const Node*> output_nodes;
+  for (auto output : sdef->second.outputs()) {
+    Node* node = find_node(output.second);
+    if (node != nullptr) output_nodes.insert(node);
+  }
+  std::unordered_set<const Node*> shared_inputs;
+  std::vector<std::string> shared_input_tensors;
+  Node* batch_input = nullptr;
+  for (const std::string& name : option_.shared_input_names) {
+    auto input = sdef->second.inputs().find(name);
+    Node* node = input == sdef->second.inputs().end() ?
+        nullptr : find_node(input->second);
+    if (node == nullptr || node->type_string() != "Placeholder") {
+      return tensorflow::errors::InvalidArgument(
+          "Shared input ", name, " is not a placeholder input of the "
+          "signature_def ", signature_name_);
+    }
+    shared_inputs.insert(node);
+    shared_input_tensors.push_back(input->second.name());
+    // Every shared input has the batch size of the request.
+    if (batch_input == nullptr) batch_input = node;
+  }
+
+  std::vector<RowKind> kinds(graph_.num_node_ids(), RowKind::kFree);
+  std::vector<Node*> order;
+  GetReversePostOrder(graph_, &order);
+  int num_shared = 0;
+  for (Node* node : order) {
+    if (!node->IsOp()) continue;
+    RowKind kind = RowKind::kFree;
+    if (input_nodes.count(node) > 0) {
+      kind = shared_inputs.count(node) > 0 ? RowKind::kShared
+                                           : RowKind::kBatch;
+    } else {
+      std::vector<const Edge*> inputs = GetDataInputs(node);
+      bool all_free = true;
+      bool has_batch = false;
+      for (const Edge* edge : inputs) {
+        RowKind k = edge == nullptr ? RowKind::kBatch
+                                    : kinds[edge->src()->id()];
+        all_free = all_free && k == RowKind::kFree;
+        has_batch = has_batch || k == RowKind::kBatch;
+      }
+      if (all_free) {
+        kind = RowKind::kFree;
+      } else if (!has_batch && output_nodes.count(node) == 0 &&
+                 IsRowWise(node, inputs, kinds)) {
+        // Fetched nodes keep the batch, their inputs are broadcast.
+        kind = RowKind::kShared;
+        ++num_shared;
+      } else {
+        kind = RowKind::kBatch;
+      }
+    }
+    kinds[node->id()] = kind;
+  }
+
+  if (num_shared == 0) {
+    LOG(INFO) << "No subgraph of the shared inputs to hoist.";
+    return Status::OK();
+  }
+
+  // Edges are collected before the graph is changed.
+  std::vector<DataEdge> slice_edges;
+  std::vector<DataEdge> broadcast_edges;
+  for (Node* node : graph_.op_nodes()) {
+    if (kinds[node->id()] != RowKind::kShared) continue;
+    const bool is_input = shared_inputs.count(node) > 0;
+    for (const Edge* edge : node->out_edges()) {
+      if (edge->IsControlEdge()) continue;
+      const bool dst_shared = kinds[edge->dst()->id()] == RowKind::kShared;
+      DataEdge e = {edge->src(), edge->src_output(),
+                    edge->dst(), edge->dst_input()};
+      if (is_input && dst_shared) {
+        slice_edges.push_back(e);
+      } else if (!is_input && !dst_shared) {
+        broadcast_edges.push_back(e);
+      }
+    }
+  }
+
+  const std::string& device = batch_input->requested_device();
+  const std::string prefix = "HoistSharedSubgraph/";
+  Node* axis = nullptr;
+  Node* first_row = nullptr;
+  Node* begin = nullptr;
+  Node* size = nullptr;
+  Node* zero = nullptr;
+  TF_RETURN_IF_ERROR(AddInt32ConstNode(prefix + "axis", {0}, true,
+                                       device, &graph_, &axis));
+  TF_RETURN_IF_ERROR(AddInt32ConstNode(prefix + "begin", {0}, false,
+                                       device, &graph_, &begin));
+  TF_RETURN_IF_ERROR(AddInt32ConstNode(prefix + "size", {1}, false,
+                                       device, &graph_, &size));
+  TF_RETURN_IF_ERROR(AddInt32ConstNode(prefix + "zero", {0}, true,
+                                       device, &graph_, &zero));
+
+  // Indices [0, 0, ..., 0] of the batch size.
+  Node* shape = nullptr;
+  Node* batch_size = nullptr;
+  Node* broadcast_indices = nullptr;
+  TF_RETURN_IF_ERROR(NodeBuilder(prefix + "shape", "Shape")
+                         .Input(batch_input, 0)
+                         .Attr("out_type", DT_INT32)
+                         .Device(device)
+                         .Finalize(&graph_, &shape));
+  TF_RETURN_IF_ERROR(NodeBuilder(prefix + "batch_size", "Slice")
+                         .Input(shape)
+                         .Input(begin)
+                         .Input(size)
+                         .Device(device)
+                         .Finalize(&graph_, &batch_size));
+  TF_RETURN_IF_ERROR(NodeBuilder(prefix + "broadcast_indices", "Fill")
+                         .Input(batch_size)
+                         .Input(zero)
+                         .Device(device)
+                         .Finalize(&graph_, &broadcast_indices));
+
+  // Indices [0] of the first row, [] if the batch is empty, index 0 of
+  // an empty input is out of range.
+  Node* num_rows = nullptr;
+  TF_RETURN_IF_ERROR(NodeBuilder(prefix + "num_rows", "Minimum")
+                         .Input(batch_size)
+                         .Input(size)
+                         .Device(device)
+                         .Finalize(&graph_, &num_rows));
+  TF_RETURN_IF_ERROR(NodeBuilder(prefix + "first_row", "Fill")
+                         .Input(num_rows)
+                         .Input(zero)
+                         .Device(device)
+                         .Finalize(&graph_, &first_row));
+
+  // One gather for each sliced or broadcast output.
+  std::map<std::pair<int, int>, Node*> gathers;
+  auto get_gather = [&](const DataEdge& e, Node* indices,
+                        const std::string& suffix, Node** gather) {
+    Node*& node = gathers[{e.src->id(), e.src_output}];
+    if (node == nullptr) {
+      TF_RETURN_IF_ERROR(NodeBuilder(
+          graph_.NewName(strings::StrCat(e.src->name(), suffix)), "GatherV2")
+          .Input(e.src, e.src_output)
+          .Input(indices)
+          .Input(axis)
+          .Device(e.src->requested_device())
+          .Finalize(&graph_, &node));
+    }
+    *gather = node;
+    return Status::OK();
+  };
+  for (const DataEdge& e : slice_edges) {
+    Node* gather = nullptr;
+    TF_RETURN_IF_ERROR(get_gather(e, first_row, "/SharedRow", &gather));
+    TF_RETURN_IF_ERROR(graph_.UpdateEdge(gather, 0, e.dst, e.dst_input));
+  }
+  for (const DataEdge& e : broadcast_edges) {
+    Node* gather = nullptr;
+    TF_RETURN_IF_ERROR(get_gather(e, broadcast_indices, "/Broadcast",
+                                  &gather));
+    TF_RETURN_IF_ERROR(graph_.UpdateEdge(gather, 0, e.dst, e.dst_input));
+  }
+
+  // The results can be cached across requests and fed back, see
+  // SharedSubgraphCache.
+  auto* collections = meta_graph_def_->mutable_collection_def();
+  auto* inputs = (*collections)[GetSharedInputsCollectionKey()]
+                     .mutable_node_list();
+  inputs->Clear();
+  for (const std::string& name : shared_input_tensors) {
+    inputs->add_value(name);
+  }
+  auto* outputs = (*collections)[GetSharedOutputsCollectionKey()]
+                      .mutable_node_list();
+  outputs->Clear();
+  for (auto& it : gathers) {
+    Node* src = graph_.FindNodeId(it.first.first);
+    if (shared_inputs.count(src) == 0) {
+      outputs->add_value(strings::StrCat(src->name(), ":", it.first.second));
+    }
+  }
+
+  LOG(INFO) << "Hoist " << num_shared << " nodes of the shared inputs, "
+            << slice_edges.size() << " inputs are sliced and "
+            << broadcast_edges.size() << " outputs are broadcast.";
+  return Status::OK();
+}
+
+// The static-shape subgraph, mostly the dense towers after the embedding
+// concat, runs op by op in the executor. Its nodes are marked with the
+// _XlaCompile attr and one _XlaScope, so that the mark_for_compilation pass
+// clusters the compilable ones into XlaCompile/XlaRun kernels for CPU.
+//
+// Only the batch dimension may be unknown, XLA compiles the cluster once
+// for every batch size it sees, which BatchBucketing bounds to its buckets.
+// An unknown dimension 0 is the batch only if it is propagated from the
+// dense signature inputs, see GetBatchMajorNodes.
+// The nodes come from the _output_shapes attrs of the exported graph,
+// nothing is marked if the graph has none.
+Status SavedModelOptimizer::MarkStaticSubgraphForCompilation() {
+  auto sdef = meta_graph_def_->signature_def().find(signature_name_);
+  if (sdef == meta_graph_def_->signature_def().end()) {
+    return tensorflow::errors::Internal(
+        "Not found the signature_def with user specified signature name.",
+        signature_name_);
+  }
+
+  std::unordered_set<std::string> names;
+  for (Node* node : graph_.op_nodes()) {
+    names.insert(node->name());
+  }
+  // convert "Reshape_2:0" to "Reshape_2", the dense inputs are the batch,
+  // dimension 0 of the components of sparse inputs is not.
+  std::vector<std::string> inputs;
+  for (auto input : sdef->second.inputs()) {
+    if (input.second.name().empty()) continue;
+    inputs.push_back(input.second.name().substr(
+        0, input.second.name().find(":")));
+  }
+  std::vector<std::string> outputs;
+  for (auto output : sdef->second.outputs()) {
+    std::string name = output.second.name().substr(
+        0, output.second.name().find(":"));
+    if (names.count(name) == 0) {
+      return tensorflow::errors::InvalidArgument(
+          "Not found the output node ", name, " of the signature_def ",
+          signature_name_);
+    }
+    outputs.push_back(name);
+  }
+
+  GraphDef gdef;
+  graph_.ToGraphDef(&gdef);
+  std::unordered_set<std::string> static_ops_name;
+  StaticShapeCluteringStrategy strategy;
+  strategy.GetStaticGraphOps(gdef, inputs, outputs, &static_ops_name,
+                             /*ignore_batch_dim=*/true);
+
+  int num_marked = 0;
+  for (Node* node : graph_.op_nodes()) {
+    if (static_ops_name.count(node->name()) == 0) continue;
+    // The placeholders are fed, not compiled.
+    if (node->type_string() == "Placeholder") continue;
+    node->AddAttr("_XlaCompile", true);
+    node->AddAttr("_XlaScope", GetStaticSubgraphXlaScope());
+    ++num_marked;
+  }
+
+  LOG(INFO) << "Mark " << num_marked << " nodes of the static-shape "
+            << "subgraph for XLA compilation.";
+  return Status::OK();
+}
+
 } // namespace processor
 } // namespace tensorflow
 
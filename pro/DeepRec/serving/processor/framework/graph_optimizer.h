@@ -72,12 +72,14 @@ class StaticShapeCluteringStrategy
            std::vector<std::string>& outputs,
            ClusteredGraphInfo*);
 
-  // Function will return static ops set
+  // Function will return static ops set, dimension 0 may be unknown
+  // if 'ignore_batch_dim' and it is the batch of 'inputs'.
   void GetStaticGraphOps(
       const GraphDef& gdef,
       std::vector<std::string>& inputs,
       std::vector<std::string>& outputs,
-      std::unordered_set<std::string>* static_ops_name);
+      std::unordered_set<std::string>* static_ops_name,
+      bool ignore_batch_dim = false);
   // Get dynamic and static signature def
   void GetDynamicAndStaticSignatureDef(
       const MetaGraphDef&,
@@ -122,6 +124,12 @@ const std::string& GetIncrCkptNodeName();
 const std::string& GetKvRestoreAllNameSuffix();
 const std::string& GetKvIncrRestoreAllNameSuffix();
 const std::string& GetDenseRestoreAllNameSuffix();
+// Collections of the meta graph, tensors of the shared inputs and the
+// results of their hoisted subgraph.
+const std::string& GetSharedInputsCollectionKey();
+const std::string& GetSharedOutputsCollectionKey();
+// _XlaScope of the nodes marked by compile_static_subgraph
+const std::string& GetStaticSubgraphXlaScope();
  
 struct GraphOptimizerOption {
   // Convert EV ops to HashTable ops
@@ -144,6 +152,18 @@ struct GraphOptimizerOption {
   // current instance partition id
   int partition_id = -1;
   int shard_instance_count = 0;
+
+  // Signature inputs which have the same value in every row of a
+  // request, the features of the user in a one-user-many-items ranking
+  // request for example. The subgraph which only depends on them is
+  // computed on the first row, and its result is broadcast to the batch.
+  std::vector<std::string> shared_input_names;
+
+  // Mark the static-shape subgraph found by StaticShapeCluteringStrategy,
+  // batch dimension excepted, to be compiled by XLA into one kernel.
+  // The batch of a request should be padded to a few sizes, see
+  // BatchBucketing, or XLA compiles it again for every batch size.
+  bool compile_static_subgraph = false;
 };
 
 struct SrcInfo {
@@ -254,6 +274,12 @@ class SavedModelOptimizer : public GraphOptimizer {
 
   Node* FindRestoreShardNode();
 
+  // Compute the subgraph of the shared inputs on one row.
+  Status HoistSharedSubgraph();
+
+  // Mark the static-shape subgraph for XLA compilation.
+  Status MarkStaticSubgraphForCompilation();
+
   Node* UpdateRestoreShardNodeInputs(
       std::unordered_map<std::string, std::vector<Node*>>& origin_import_nodes,
       std::vector<Node*>& new_kv_import_nodes);
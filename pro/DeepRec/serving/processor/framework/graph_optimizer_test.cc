@@ -1784,5 +1784,303 @@ TEST(GraphOptimizerTest, ShardEmbeddingOptimizer2) {
   EXPECT_TRUE(1);
 }
 
+/*
+    user   w             user   w
+      \   /                |   /
+      MatMul          SharedRow
+        |                  \  /
+       Relu   item  ==>   MatMul
+         \   /              |
+          Add             Relu
+           |                |
+          out           Broadcast  item
+                               \  /
+                               Add
+*/
+TEST(GraphOptimizerTest, HoistSharedSubgraph) {
+  GraphDef graph_def;
+
+  NodeDef* n_user = graph_def.add_node();
+  n_user->set_name("user");
+  n_user->set_op("Placeholder");
+  (*n_user->mutable_attr())["dtype"].set_type(DT_FLOAT);
+
+  NodeDef* n_item = graph_def.add_node();
+  n_item->set_name("item");
+  n_item->set_op("Placeholder");
+  (*n_item->mutable_attr())["dtype"].set_type(DT_FLOAT);
+
+  NodeDef* n_w = graph_def.add_node();
+  n_w->set_name("w");
+  n_w->set_op("Const");
+  (*n_w->mutable_attr())["dtype"].set_type(DT_FLOAT);
+  Tensor w_tensor(DT_FLOAT, TensorShape({4, 4}));
+  w_tensor.flat<float>().setConstant(1.0);
+  w_tensor.AsProtoTensorContent(
+      (*n_w->mutable_attr())["value"].mutable_tensor());
+
+  NodeDef* n_matmul = graph_def.add_node();
+  n_matmul->set_name("MatMul");
+  n_matmul->set_op("MatMul");
+  (*n_matmul->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_matmul->add_input("user");
+  n_matmul->add_input("w");
+
+  NodeDef* n_relu = graph_def.add_node();
+  n_relu->set_name("Relu");
+  n_relu->set_op("Relu");
+  (*n_relu->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_relu->add_input("MatMul");
+
+  NodeDef* n_add = graph_def.add_node();
+  n_add->set_name("Add");
+  n_add->set_op("Add");
+  (*n_add->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_add->add_input("Relu");
+  n_add->add_input("item");
+
+  NodeDef* n_out = graph_def.add_node();
+  n_out->set_name("out");
+  n_out->set_op("Identity");
+  (*n_out->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_out->add_input("Add");
+
+  SignatureDef sdef;
+  TensorInfo tinfo_user;
+  tinfo_user.set_name("user:0");
+  tinfo_user.set_dtype(DT_FLOAT);
+  (*sdef.mutable_inputs())["user"] = tinfo_user;
+  TensorInfo tinfo_item;
+  tinfo_item.set_name("item:0");
+  tinfo_item.set_dtype(DT_FLOAT);
+  (*sdef.mutable_inputs())["item"] = tinfo_item;
+  TensorInfo tinfo_out;
+  tinfo_out.set_name("out:0");
+  tinfo_out.set_dtype(DT_FLOAT);
+  (*sdef.mutable_outputs())["out"] = tinfo_out;
+
+  {
+    MetaGraphDef mgdef;
+    *(mgdef.mutable_graph_def()) = graph_def;
+    (*mgdef.mutable_signature_def())["serving_default"] = sdef;
+
+    GraphOptimizerOption option;
+    option.native_tf_mode = true;
+    option.shared_input_names.push_back("user");
+    SavedModelOptimizer opt("serving_default", &mgdef, option);
+    EXPECT_TRUE(opt.Optimize().ok());
+
+    std::unordered_map<std::string, NodeDef> nodes;
+    for (auto n : mgdef.graph_def().node()) {
+      nodes[n.name()] = n;
+    }
+    // MatMul and Relu run on the first row of 'user'.
+    const NodeDef& row = nodes[nodes["MatMul"].input(0)];
+    EXPECT_EQ(row.op(), "GatherV2");
+    EXPECT_EQ(row.input(0), "user");
+    EXPECT_EQ(row.input(1), "HoistSharedSubgraph/first_row");
+    EXPECT_EQ(nodes["MatMul"].input(1), "w");
+    // An empty batch has no first row, the indices are [0] only if the
+    // batch size is at least 1, otherwise [].
+    const NodeDef& first_row = nodes["HoistSharedSubgraph/first_row"];
+    EXPECT_EQ(first_row.op(), "Fill");
+    const NodeDef& num_rows = nodes[first_row.input(0)];
+    EXPECT_EQ(num_rows.op(), "Minimum");
+    EXPECT_EQ(num_rows.input(0), "HoistSharedSubgraph/batch_size");
+    EXPECT_EQ(num_rows.input(1), "HoistSharedSubgraph/size");
+    EXPECT_EQ(first_row.input(1), "HoistSharedSubgraph/zero");
+    EXPECT_EQ(nodes["Relu"].input(0), "MatMul");
+
+    // Add reads Relu broadcast to the batch of the request.
+    const NodeDef& broadcast = nodes[nodes["Add"].input(0)];
+    EXPECT_EQ(broadcast.op(), "GatherV2");
+    EXPECT_EQ(broadcast.input(0), "Relu");
+    EXPECT_EQ(broadcast.input(1), "HoistSharedSubgraph/broadcast_indices");
+    EXPECT_EQ(nodes["Add"].input(1), "item");
+    EXPECT_EQ(nodes["out"].input(0), "Add");
+
+    const auto& collections = mgdef.collection_def();
+    EXPECT_EQ(collections.at(GetSharedInputsCollectionKey())
+                  .node_list().value(0), "user:0");
+    EXPECT_EQ(collections.at(GetSharedOutputsCollectionKey())
+                  .node_list().value(0), "Relu:0");
+  }
+
+  {
+    // Nothing is hoisted when every path from 'item' is item side.
+    MetaGraphDef mgdef;
+    *(mgdef.mutable_graph_def()) = graph_def;
+    (*mgdef.mutable_signature_def())["serving_default"] = sdef;
+
+    GraphOptimizerOption option;
+    option.native_tf_mode = true;
+    option.shared_input_names.push_back("item");
+    SavedModelOptimizer opt("serving_default", &mgdef, option);
+    EXPECT_TRUE(opt.Optimize().ok());
+    EXPECT_EQ(mgdef.graph_def().node_size(), graph_def.node_size());
+  }
+
+  {
+    MetaGraphDef mgdef;
+    *(mgdef.mutable_graph_def()) = graph_def;
+    (*mgdef.mutable_signature_def())["serving_default"] = sdef;
+
+    GraphOptimizerOption option;
+    option.native_tf_mode = true;
+    option.shared_input_names.push_back("unknown");
+    SavedModelOptimizer opt("serving_default", &mgdef, option);
+    EXPECT_FALSE(opt.Optimize().ok());
+  }
+}
+
+TEST(GraphOptimizerTest, MarkStaticSubgraphForCompilation) {
+  GraphDef graph_def;
+  auto set_shape = [](NodeDef* node, const std::vector<int64>& dims) {
+    TensorShapeProto* shape =
+        (*node->mutable_attr())["_output_shapes"].mutable_list()->add_shape();
+    for (int64 d : dims) {
+      shape->add_dim()->set_size(d);
+    }
+  };
+
+  NodeDef* n_x = graph_def.add_node();
+  n_x->set_name("x");
+  n_x->set_op("Placeholder");
+  (*n_x->mutable_attr())["dtype"].set_type(DT_FLOAT);
+  set_shape(n_x, {-1, 4});
+
+  NodeDef* n_w = graph_def.add_node();
+  n_w->set_name("w");
+  n_w->set_op("Const");
+  (*n_w->mutable_attr())["dtype"].set_type(DT_FLOAT);
+  Tensor w_tensor(DT_FLOAT, TensorShape({4, 2}));
+  w_tensor.flat<float>().setConstant(1.0);
+  w_tensor.AsProtoTensorContent(
+      (*n_w->mutable_attr())["value"].mutable_tensor());
+  set_shape(n_w, {4, 2});
+
+  NodeDef* n_matmul = graph_def.add_node();
+  n_matmul->set_name("MatMul");
+  n_matmul->set_op("MatMul");
+  (*n_matmul->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_matmul->add_input("x");
+  n_matmul->add_input("w");
+  set_shape(n_matmul, {-1, 2});
+
+  NodeDef* n_relu = graph_def.add_node();
+  n_relu->set_name("Relu");
+  n_relu->set_op("Relu");
+  (*n_relu->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_relu->add_input("MatMul");
+  set_shape(n_relu, {-1, 2});
+
+  // Unknown beyond the batch dimension.
+  NodeDef* n_y = graph_def.add_node();
+  n_y->set_name("y");
+  n_y->set_op("Placeholder");
+  (*n_y->mutable_attr())["dtype"].set_type(DT_FLOAT);
+  set_shape(n_y, {-1, -1});
+
+  NodeDef* n_dynamic = graph_def.add_node();
+  n_dynamic->set_name("dynamic");
+  n_dynamic->set_op("Relu");
+  (*n_dynamic->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_dynamic->add_input("y");
+  set_shape(n_dynamic, {-1, -1});
+
+  // A sparse input, dimension 0 of its segment sum changes with the ids
+  // of every request, it is not compiled.
+  NodeDef* n_values = graph_def.add_node();
+  n_values->set_name("sp_values");
+  n_values->set_op("Placeholder");
+  (*n_values->mutable_attr())["dtype"].set_type(DT_FLOAT);
+  set_shape(n_values, {-1, 4});
+
+  NodeDef* n_indices = graph_def.add_node();
+  n_indices->set_name("sp_indices");
+  n_indices->set_op("Placeholder");
+  (*n_indices->mutable_attr())["dtype"].set_type(DT_INT32);
+  set_shape(n_indices, {-1});
+
+  NodeDef* n_dense_shape = graph_def.add_node();
+  n_dense_shape->set_name("sp_dense_shape");
+  n_dense_shape->set_op("Placeholder");
+  (*n_dense_shape->mutable_attr())["dtype"].set_type(DT_INT32);
+  set_shape(n_dense_shape, {1});
+
+  NodeDef* n_segment_sum = graph_def.add_node();
+  n_segment_sum->set_name("SparseSegmentSum");
+  n_segment_sum->set_op("SparseSegmentSum");
+  (*n_segment_sum->mutable_attr())["T"].set_type(DT_FLOAT);
+  (*n_segment_sum->mutable_attr())["Tidx"].set_type(DT_INT32);
+  n_segment_sum->add_input("sp_values");
+  n_segment_sum->add_input("sp_indices");
+  n_segment_sum->add_input("sp_indices");
+  set_shape(n_segment_sum, {-1, 4});
+
+  NodeDef* n_sparse_matmul = graph_def.add_node();
+  n_sparse_matmul->set_name("SparseMatMul");
+  n_sparse_matmul->set_op("MatMul");
+  (*n_sparse_matmul->mutable_attr())["T"].set_type(DT_FLOAT);
+  n_sparse_matmul->add_input("SparseSegmentSum");
+  n_sparse_matmul->add_input("w");
+  set_shape(n_sparse_matmul, {-1, 2});
+
+  SignatureDef sdef;
+  TensorInfo tinfo_sparse;
+  tinfo_sparse.mutable_coo_sparse()->set_values_tensor_name("sp_values:0");
+  tinfo_sparse.mutable_coo_sparse()->set_indices_tensor_name(
+      "sp_indices:0");
+  tinfo_sparse.mutable_coo_sparse()->set_dense_shape_tensor_name(
+      "sp_dense_shape:0");
+  tinfo_sparse.set_dtype(DT_FLOAT);
+  (*sdef.mutable_inputs())["sparse"] = tinfo_sparse;
+  TensorInfo tinfo_sparse_out;
+  tinfo_sparse_out.set_name("SparseMatMul:0");
+  tinfo_sparse_out.set_dtype(DT_FLOAT);
+  (*sdef.mutable_outputs())["sparse_out"] = tinfo_sparse_out;
+  TensorInfo tinfo_x;
+  tinfo_x.set_name("x:0");
+  tinfo_x.set_dtype(DT_FLOAT);
+  (*sdef.mutable_inputs())["x"] = tinfo_x;
+  TensorInfo tinfo_y;
+  tinfo_y.set_name("y:0");
+  tinfo_y.set_dtype(DT_FLOAT);
+  (*sdef.mutable_inputs())["y"] = tinfo_y;
+  TensorInfo tinfo_relu;
+  tinfo_relu.set_name("Relu:0");
+  tinfo_relu.set_dtype(DT_FLOAT);
+  (*sdef.mutable_outputs())["relu"] = tinfo_relu;
+  TensorInfo tinfo_dynamic;
+  tinfo_dynamic.set_name("dynamic:0");
+  tinfo_dynamic.set_dtype(DT_FLOAT);
+  (*sdef.mutable_outputs())["dynamic"] = tinfo_dynamic;
+
+  MetaGraphDef mgdef;
+  *(mgdef.mutable_graph_def()) = graph_def;
+  (*mgdef.mutable_signature_def())["serving_default"] = sdef;
+
+  GraphOptimizerOption option;
+  option.native_tf_mode = true;
+  option.compile_static_subgraph = true;
+  SavedModelOptimizer opt("serving_default", &mgdef, option);
+  EXPECT_TRUE(opt.Optimize().ok());
+
+  std::unordered_set<std::string> marked;
+  for (auto n : mgdef.graph_def().node()) {
+    auto compile = n.attr().find("_XlaCompile");
+    if (compile == n.attr().end()) continue;
+    EXPECT_TRUE(compile->second.b());
+    EXPECT_EQ(n.attr().at("_XlaScope").s(), GetStaticSubgraphXlaScope());
+    marked.insert(n.name());
+  }
+  EXPECT_EQ(marked.size(), 3);
+  EXPECT_EQ(marked.count("w"), 1);
+  EXPECT_EQ(marked.count("MatMul"), 1);
+  EXPECT_EQ(marked.count("Relu"), 1);
+  EXPECT_EQ(marked.count("SparseSegmentSum"), 0);
+  EXPECT_EQ(marked.count("SparseMatMul"), 0);
+}
+
 } // namespace processor
 } // namespace tensorflow
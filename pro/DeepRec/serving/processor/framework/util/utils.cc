@@ -14,6 +14,9 @@ limitations under the License.
 ==============================================================================*/
 
 #include "serving/processor/framework/util/utils.h"
+
+#include <string>
+
 #include "tensorflow/core/platform/logging.h"
 
 namespace tensorflow {
@@ -35,33 +38,40 @@ GetNodesHasControlFlowInputs(const GraphDef& gdef) {
   return has_control_flow_input;
 }
 
-bool HasDynamicShapeOutput(NodeDef* node_def) {
+bool HasDynamicShapeOutput(NodeDef* node_def, bool ignore_batch_dim) {
   AttrValue attr_value = (*node_def->mutable_attr())["_output_shapes"];
 
   Status s = AttrValueHasType(attr_value, "list(shape)");
   if (!s.ok()) {
     s = AttrValueHasType(attr_value, "shape");
     if (!s.ok()) return true;
-    for (auto d : attr_value.shape().dim()) {
-      if (d.size() == -1) return true;
+    if (attr_value.shape().unknown_rank()) return true;
+    for (int i = ignore_batch_dim ? 1 : 0;
+         i < attr_value.shape().dim_size(); ++i) {
+      if (attr_value.shape().dim(i).size() == -1) return true;
     }
     return false;
   }
 
   for (const auto& v : attr_value.list().shape()) {
-    for (auto d : v.dim()) {
-      if (d.size() == -1) return true;
+    if (v.unknown_rank()) return true;
+    for (int i = ignore_batch_dim ? 1 : 0; i < v.dim_size(); ++i) {
+      if (v.dim(i).size() == -1) return true;
     }
   }
 
   return false;
 }
 
-std::unordered_map<std::string, bool> GetNodesHasDynamicShapeMap(const GraphDef& gdef) {
+std::unordered_map<std::string, bool> GetNodesHasDynamicShapeMap(
+    const GraphDef& gdef,
+    const std::unordered_set<std::string>& batch_major_nodes) {
   // NOTE(jiankeng.pt): should be optimized via topological sort algorithm later
   std::unordered_map<std::string, bool> output_shapes;
   for (const NodeDef& node : gdef.node()) {
-    output_shapes[node.name()] = HasDynamicShapeOutput(const_cast<NodeDef*>(&node));
+    output_shapes[node.name()] = HasDynamicShapeOutput(
+        const_cast<NodeDef*>(&node),
+        batch_major_nodes.count(node.name()) > 0);
   }
 
   // True when node has dynamic input or output, false else.
@@ -92,6 +102,155 @@ std::unordered_map<std::string, bool> GetNodesHasDynamicShapeMap(const GraphDef&
   return result;
 }
 
+namespace {
+
+// Dimension 0 of the outputs depends on the values of the inputs.
+bool IsValueDependentDim0Op(const std::string& op) {
+  static const std::unordered_set<std::string> ops = {
+      "Unique", "UniqueV2", "UniqueWithCounts", "UniqueWithCountsV2",
+      "Where", "DynamicPartition", "DynamicStitch", "ParallelDynamicStitch",
+      "SegmentSum", "SegmentMean", "SegmentMax", "SegmentMin", "SegmentProd",
+      "UnsortedSegmentSum", "UnsortedSegmentMax", "UnsortedSegmentMin",
+      "UnsortedSegmentProd"};
+  // SparseSegmentSum, SparseTensorDenseMatMul, SparseReshape ...
+  return ops.count(op) > 0 || op.compare(0, 6, "Sparse") == 0;
+}
+
+// The shape of the output is the value of an input beyond the first.
+bool IsShapeFromValueOp(const std::string& op) {
+  static const std::unordered_set<std::string> ops = {
+      "Fill", "Tile", "Slice", "StridedSlice", "Pad", "PadV2", "MirrorPad",
+      "BroadcastTo", "Range", "ScatterNd"};
+  return ops.count(op) > 0;
+}
+
+const TensorShapeProto* GetOutputShape(const NodeDef& node, int port) {
+  auto it = node.attr().find("_output_shapes");
+  if (it == node.attr().end()) return nullptr;
+  if (it->second.has_shape()) {
+    return port == 0 ? &it->second.shape() : nullptr;
+  }
+  if (port >= it->second.list().shape_size()) return nullptr;
+  return &it->second.list().shape(port);
+}
+
+bool HasUnknownDim0(const NodeDef& node) {
+  auto it = node.attr().find("_output_shapes");
+  if (it == node.attr().end()) return true;
+  if (it->second.has_shape()) {
+    const TensorShapeProto& shape = it->second.shape();
+    return shape.unknown_rank() ||
+           (shape.dim_size() > 0 && shape.dim(0).size() == -1);
+  }
+  for (const auto& shape : it->second.list().shape()) {
+    if (shape.unknown_rank() ||
+        (shape.dim_size() > 0 && shape.dim(0).size() == -1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Dimensions beyond the first are all known.
+bool HasKnownInnerDims(const TensorShapeProto* shape) {
+  if (shape == nullptr || shape->unknown_rank() || shape->dim_size() == 0) {
+    return false;
+  }
+  for (int i = 1; i < shape->dim_size(); ++i) {
+    if (shape->dim(i).size() < 0) return false;
+  }
+  return true;
+}
+
+void ParseInput(const std::string& input, std::string* name, int* port) {
+  size_t offset = input.find(":");
+  *name = input.substr(0, offset);
+  *port = offset == std::string::npos ? 0 : std::stoi(input.substr(offset + 1));
+}
+
+} // namespace
+
+std::unordered_set<std::string> GetBatchMajorNodes(
+    const GraphDef& gdef, const std::vector<std::string>& batch_inputs) {
+  std::unordered_map<std::string, const NodeDef*> nodes;
+  for (const NodeDef& node : gdef.node()) {
+    nodes[node.name()] = &node;
+  }
+
+  // Visit the nodes in topological order of the data edges, the nodes in
+  // a cycle are never visited.
+  std::unordered_map<std::string, int> pending;
+  std::unordered_map<std::string, std::vector<const NodeDef*>> consumers;
+  std::vector<const NodeDef*> ready;
+  for (const NodeDef& node : gdef.node()) {
+    int num_inputs = 0;
+    for (const std::string& input : node.input()) {
+      if (input[0] == '^') continue;
+      std::string name;
+      int port;
+      ParseInput(input, &name, &port);
+      if (nodes.count(name) == 0) continue;
+      consumers[name].push_back(&node);
+      ++num_inputs;
+    }
+    pending[node.name()] = num_inputs;
+    if (num_inputs == 0) ready.push_back(&node);
+  }
+
+  std::unordered_set<std::string> batch_major(batch_inputs.begin(),
+                                              batch_inputs.end());
+  while (!ready.empty()) {
+    const NodeDef* node = ready.back();
+    ready.pop_back();
+    for (const NodeDef* consumer : consumers[node->name()]) {
+      if (--pending[consumer->name()] == 0) ready.push_back(consumer);
+    }
+    if (batch_major.count(node->name()) > 0 ||
+        IsValueDependentDim0Op(node->op())) {
+      continue;
+    }
+
+    // Every input with an unknown dimension 0 is batch major, and the
+    // values of the inputs don't change dimension 0 of the outputs.
+    bool has_batch_input = false;
+    bool is_batch_major = true;
+    for (int i = 0; i < node->input_size() && is_batch_major; ++i) {
+      const std::string& input = node->input(i);
+      if (input[0] == '^') continue;
+      std::string name;
+      int port;
+      ParseInput(input, &name, &port);
+      auto it = nodes.find(name);
+      if (it == nodes.end()) {
+        is_batch_major = false;
+      } else if (batch_major.count(name) > 0) {
+        has_batch_input = true;
+      } else if (HasUnknownDim0(*it->second)) {
+        is_batch_major = false;
+      } else if (i > 0 && IsShapeFromValueOp(node->op()) &&
+                 it->second->op() != "Const") {
+        is_batch_major = false;
+      }
+    }
+    if (!is_batch_major || !has_batch_input) continue;
+
+    if (node->op() == "Reshape") {
+      // The unknown dimension 0 is batch * a constant if the others are
+      // known, whatever the shape input is.
+      std::string name;
+      int port;
+      ParseInput(node->input(0), &name, &port);
+      if (batch_major.count(name) == 0 ||
+          !HasKnownInnerDims(GetOutputShape(*nodes[name], port)) ||
+          !HasKnownInnerDims(GetOutputShape(*node, 0))) {
+        continue;
+      }
+    }
+    batch_major.insert(node->name());
+  }
+  return batch_major;
+}
+
 // Sets any parameters not specified in a node to their defaults.
 Status AddDefaultAttributes(const GraphDef& input_graph_def,
                             GraphDef* output_graph_def) {
@@ -17,6 +17,8 @@ limitations under the License.
 #define SERVING_PROCESSOR_FRAMEWORK_UTIL_UTILS_H_
 
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/graph.pb.h"
@@ -29,13 +31,25 @@ namespace tensorflow {
 namespace processor {
 
 // Return true when node has dynamic shape at any input or output, false else.
-std::unordered_map<std::string, bool> GetNodesHasDynamicShapeMap(const GraphDef& gdef);
+// An unknown dimension 0 of the nodes in 'batch_major_nodes' is the batch,
+// which is not dynamic.
+std::unordered_map<std::string, bool> GetNodesHasDynamicShapeMap(
+    const GraphDef& gdef,
+    const std::unordered_set<std::string>& batch_major_nodes =
+        std::unordered_set<std::string>());
+
+// Return the nodes whose unknown dimension 0 only depends on the batch of
+// 'batch_inputs', e.g. the dense inputs of the signature. It is propagated
+// from the inputs through the ops which keep dimension 0 a function of the
+// batch, the nnz of sparse inputs or the size of Unique is not a batch.
+std::unordered_set<std::string> GetBatchMajorNodes(
+    const GraphDef& gdef, const std::vector<std::string>& batch_inputs);
 
 // Return true when node has control input edge, false else.
 std::unordered_map<std::string, bool> GetNodesHasControlFlowInputs(const GraphDef& gdef);
 
 // Whether any output has a dynamic shape
-bool HasDynamicShapeOutput(NodeDef* node);
+bool HasDynamicShapeOutput(NodeDef* node, bool ignore_batch_dim = false);
 
 Status AddDefaultAttributes(const GraphDef& input_graph_def,
                             GraphDef* output_graph_def);
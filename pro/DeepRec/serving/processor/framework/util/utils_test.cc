@@ -163,5 +163,105 @@ TEST(UtilsTest, GetNodesHasDynamicShapeMap2) {
   EXPECT_FALSE(m["D"]);
 }
 
+TEST(UtilsTest, GetNodesHasDynamicShapeMapIgnoreBatchDim) {
+  GraphDef graph_def;
+  NodeDef* n0 = graph_def.add_node();
+  n0->set_name("A");
+  n0->set_op("A");
+  AttrValue value0;
+  TensorShapeProto* tshape0 = value0.mutable_list()->add_shape();
+  tshape0->add_dim()->set_size(-1);
+  tshape0->add_dim()->set_size(8);
+  (*n0->mutable_attr())["_output_shapes"] = value0;
+
+  NodeDef* n1 = graph_def.add_node();
+  n1->set_name("B");
+  n1->set_op("B");
+  AttrValue value1;
+  TensorShapeProto* tshape1 = value1.mutable_list()->add_shape();
+  tshape1->add_dim()->set_size(-1);
+  tshape1->add_dim()->set_size(-1);
+  (*n1->mutable_attr())["_output_shapes"] = value1;
+
+  NodeDef* n2 = graph_def.add_node();
+  n2->set_name("C");
+  n2->set_op("C");
+  AttrValue value2;
+  value2.mutable_list()->add_shape()->set_unknown_rank(true);
+  (*n2->mutable_attr())["_output_shapes"] = value2;
+
+  auto m = GetNodesHasDynamicShapeMap(
+      graph_def, GetBatchMajorNodes(graph_def, {"A", "B", "C"}));
+  EXPECT_FALSE(m["A"]);
+  EXPECT_TRUE(m["B"]);
+  EXPECT_TRUE(m["C"]);
+
+  m = GetNodesHasDynamicShapeMap(graph_def);
+  EXPECT_TRUE(m["A"]);
+}
+
+TEST(UtilsTest, GetBatchMajorNodes) {
+  GraphDef graph_def;
+  auto add_node = [&graph_def](const std::string& name, const std::string& op,
+                               const std::vector<std::string>& inputs,
+                               const std::vector<int64>& dims) {
+    NodeDef* node = graph_def.add_node();
+    node->set_name(name);
+    node->set_op(op);
+    for (const std::string& input : inputs) {
+      node->add_input(input);
+    }
+    TensorShapeProto* shape =
+        (*node->mutable_attr())["_output_shapes"].mutable_list()->add_shape();
+    for (int64 d : dims) {
+      shape->add_dim()->set_size(d);
+    }
+  };
+  // Dense input.
+  add_node("x", "Placeholder", {}, {-1, 4});
+  add_node("w", "Const", {}, {4, 2});
+  add_node("matmul", "MatMul", {"x", "w"}, {-1, 2});
+  add_node("shape", "Const", {}, {2});
+  add_node("reshape", "Reshape", {"matmul", "shape"}, {-1, 1});
+  add_node("flatten", "Reshape", {"matmul", "shape"}, {-1});
+  add_node("begin", "Const", {}, {2});
+  add_node("slice", "Slice", {"x", "begin", "shape"}, {-1, 4});
+  // Components of a sparse input, dimension 0 is the nnz.
+  add_node("values", "Placeholder", {}, {-1, 4});
+  add_node("indices", "Placeholder", {}, {-1});
+  add_node("segment_ids", "Placeholder", {}, {-1});
+  add_node("segment_sum", "SparseSegmentSum",
+           {"values", "indices", "segment_ids"}, {-1, 4});
+  add_node("sparse_matmul", "MatMul", {"segment_sum", "w"}, {-1, 2});
+  add_node("flatten_values", "Reshape", {"values", "shape"}, {-1});
+  add_node("concat_axis", "Const", {}, {});
+  add_node("concat", "ConcatV2", {"matmul", "sparse_matmul", "concat_axis"},
+           {-1, 4});
+  // Shape from a value which is not a constant.
+  add_node("dense_shape", "Placeholder", {}, {2});
+  add_node("tile", "Tile", {"x", "dense_shape"}, {-1, -1});
+
+  auto batch_major = GetBatchMajorNodes(graph_def, {"x"});
+  EXPECT_EQ(batch_major.count("x"), 1);
+  EXPECT_EQ(batch_major.count("matmul"), 1);
+  EXPECT_EQ(batch_major.count("reshape"), 1);
+  EXPECT_EQ(batch_major.count("slice"), 1);
+  // 2 * batch.
+  EXPECT_EQ(batch_major.count("flatten"), 1);
+  EXPECT_EQ(batch_major.count("flatten_values"), 0);
+  EXPECT_EQ(batch_major.count("values"), 0);
+  EXPECT_EQ(batch_major.count("segment_sum"), 0);
+  EXPECT_EQ(batch_major.count("sparse_matmul"), 0);
+  EXPECT_EQ(batch_major.count("concat"), 0);
+  EXPECT_EQ(batch_major.count("tile"), 0);
+
+  auto m = GetNodesHasDynamicShapeMap(graph_def, batch_major);
+  EXPECT_FALSE(m["matmul"]);
+  EXPECT_FALSE(m["reshape"]);
+  EXPECT_TRUE(m["segment_sum"]);
+  EXPECT_TRUE(m["sparse_matmul"]);
+  EXPECT_TRUE(m["concat"]);
+}
+
 } // namespace processor
 } // namespace tensorflow
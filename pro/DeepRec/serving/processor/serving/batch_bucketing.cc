@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cstring>
+
+#include "serving/processor/serving/batch_bucketing.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace processor {
+
+namespace {
+
+auto* bucketing_requests = monitoring::Counter<1>::New(
+    "/tensorflow/serving/processor/batch_bucketing/requests",
+    "Requests run with batch bucketing, by bucket.",
+    "bucket");
+
+auto* bucketing_run_micros = monitoring::Counter<1>::New(
+    "/tensorflow/serving/processor/batch_bucketing/run_micros",
+    "Run time of the requests with batch bucketing, by bucket.",
+    "bucket");
+
+auto* bucketing_padded_rows = monitoring::Counter<0>::New(
+    "/tensorflow/serving/processor/batch_bucketing/padded_rows",
+    "Rows added to the requests by padding.");
+
+// "input" and "input:0" are the same tensor.
+std::string TensorName(const std::string& name) {
+  if (name.find(':') == std::string::npos) {
+    return name + ":0";
+  }
+  return name;
+}
+
+// A dense tensor with an unknown dimension 0. The components of a sparse
+// input have no batch dimension, e.g. dimension 0 of the values is nnz.
+bool IsBatchMajor(const TensorInfo& info) {
+  if (info.encoding_case() != TensorInfo::kName) {
+    return false;
+  }
+  const TensorShapeProto& shape = info.tensor_shape();
+  return !shape.unknown_rank() && shape.dim_size() > 0 &&
+         shape.dim(0).size() == -1;
+}
+
+} // namespace
+
+BatchBucketing::BatchBucketing(
+    const std::vector<int64>& buckets,
+    const std::unordered_set<std::string>& batch_inputs,
+    const std::unordered_set<std::string>& batch_outputs)
+    : buckets_(buckets),
+      batch_inputs_(batch_inputs),
+      batch_outputs_(batch_outputs) {}
+
+Status BatchBucketing::Create(const MetaGraphDef& meta_graph_def,
+                              const ModelConfig* config,
+                              std::unique_ptr<BatchBucketing>* bucketing) {
+  bucketing->reset();
+  if (config->batch_buckets.empty()) {
+    return Status::OK();
+  }
+  std::vector<int64> buckets(config->batch_buckets.begin(),
+                             config->batch_buckets.end());
+  std::sort(buckets.begin(), buckets.end());
+  buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+  if (buckets[0] <= 0) {
+    return errors::InvalidArgument(
+        "[TensorFlow] batch_buckets should be positive.");
+  }
+  auto sdef = meta_graph_def.signature_def().find(config->signature_name);
+  if (sdef == meta_graph_def.signature_def().end()) {
+    return errors::InvalidArgument(
+        "[TensorFlow] Not found the signature_def ", config->signature_name,
+        " for batch_buckets.");
+  }
+  std::unordered_set<std::string> batch_inputs;
+  for (const auto& input : sdef->second.inputs()) {
+    if (IsBatchMajor(input.second)) {
+      batch_inputs.insert(TensorName(input.second.name()));
+    }
+  }
+  std::unordered_set<std::string> batch_outputs;
+  for (const auto& output : sdef->second.outputs()) {
+    if (IsBatchMajor(output.second)) {
+      batch_outputs.insert(TensorName(output.second.name()));
+    }
+  }
+  if (batch_inputs.empty()) {
+    LOG(WARNING) << "No dense input of the signature_def "
+                 << config->signature_name << " has an unknown dimension 0,"
+                 << " batch_buckets are disabled.";
+    return Status::OK();
+  }
+  bucketing->reset(new BatchBucketing(buckets, batch_inputs, batch_outputs));
+  return Status::OK();
+}
+
+int64 BatchBucketing::GetBatchSize(const Request& req) const {
+  int64 batch_size = -1;
+  for (const auto& input : req.inputs) {
+    if (batch_inputs_.count(TensorName(input.first)) == 0) {
+      continue;
+    }
+    const Tensor& t = input.second;
+    if (t.dims() == 0 ||
+        (batch_size >= 0 && t.dim_size(0) != batch_size)) {
+      return -1;
+    }
+    batch_size = t.dim_size(0);
+  }
+  return batch_size;
+}
+
+int64 BatchBucketing::GetBucket(int64 batch_size) const {
+  auto it = std::lower_bound(buckets_.begin(), buckets_.end(), batch_size);
+  return it == buckets_.end() ? batch_size : *it;
+}
+
+Status BatchBucketing::ResizeRows(const Tensor& in, int64 rows,
+                                  Tensor* out) {
+  if (in.dims() == 0 || in.dim_size(0) == 0) {
+    return errors::InvalidArgument(
+        "[TensorFlow] Can not resize the rows of an empty tensor.");
+  }
+  const int64 in_rows = in.dim_size(0);
+  const int64 row_elements = in.NumElements() / in_rows;
+  TensorShape shape(in.shape());
+  shape.set_dim(0, rows);
+  Tensor t(in.dtype(), shape);
+
+  if (in.dtype() == DT_STRING) {
+    auto src = in.flat<string>();
+    auto dst = t.flat<string>();
+    for (int64 i = 0; i < rows; ++i) {
+      const int64 src_row = std::min(i, in_rows - 1);
+      for (int64 j = 0; j < row_elements; ++j) {
+        dst(i * row_elements + j) = src(src_row * row_elements + j);
+      }
+    }
+  } else if (DataTypeCanUseMemcpy(in.dtype())) {
+    const int64 row_bytes = row_elements * DataTypeSize(in.dtype());
+    const char* src = in.tensor_data().data();
+    char* dst = const_cast<char*>(t.tensor_data().data());
+    const int64 copied = std::min(in_rows, rows);
+    std::memcpy(dst, src, copied * row_bytes);
+    for (int64 i = copied; i < rows; ++i) {
+      std::memcpy(dst + i * row_bytes, src + (in_rows - 1) * row_bytes,
+                  row_bytes);
+    }
+  } else {
+    return errors::Unimplemented(
+        "[TensorFlow] Can not resize the rows of a tensor of ",
+        DataTypeString(in.dtype()));
+  }
+  *out = t;
+  return Status::OK();
+}
+
+Status BatchBucketing::ResizeRequest(const Request& req, int64 rows,
+                                     Request* resized) const {
+  resized->output_tensor_names = req.output_tensor_names;
+  resized->inputs.clear();
+  for (const auto& input : req.inputs) {
+    if (batch_inputs_.count(TensorName(input.first)) == 0) {
+      resized->inputs.emplace_back(input);
+      continue;
+    }
+    Tensor value;
+    TF_RETURN_IF_ERROR(ResizeRows(input.second, rows, &value));
+    resized->inputs.emplace_back(input.first, value);
+  }
+  return Status::OK();
+}
+
+Status BatchBucketing::Run(Request& req, Response& resp, const RunFn& run) {
+  const int64 batch_size = GetBatchSize(req);
+  if (batch_size <= 0) {
+    return run(req, resp);
+  }
+  const int64 bucket = GetBucket(batch_size);
+  const std::string label = bucket > buckets_.back() ?
+      "overflow" : std::to_string(bucket);
+
+  const uint64 start = Env::Default()->NowMicros();
+  if (bucket == batch_size) {
+    TF_RETURN_IF_ERROR(run(req, resp));
+  } else {
+    Request padded;
+    if (!ResizeRequest(req, bucket, &padded).ok()) {
+      // Some input can not be padded, run the request as is.
+      return run(req, resp);
+    }
+    TF_RETURN_IF_ERROR(run(padded, resp));
+    for (size_t i = 0; i < resp.outputs.size(); ++i) {
+      Tensor& t = resp.outputs[i];
+      if (i < req.output_tensor_names.size() &&
+          batch_outputs_.count(TensorName(req.output_tensor_names[i])) > 0 &&
+          t.dims() > 0 && t.dim_size(0) == bucket) {
+        // Rows from 0 keep the buffer aligned.
+        t = t.Slice(0, batch_size);
+      }
+    }
+    bucketing_padded_rows->GetCell()->IncrementBy(bucket - batch_size);
+  }
+
+  bucketing_requests->GetCell(label)->IncrementBy(1);
+  bucketing_run_micros->GetCell(label)->IncrementBy(
+      Env::Default()->NowMicros() - start);
+  return Status::OK();
+}
+
+Status BatchBucketing::Warmup(const Request& req, const RunFn& run) {
+  const int64 batch_size = GetBatchSize(req);
+  if (batch_size <= 0) {
+    return Status::OK();
+  }
+  for (int64 bucket : buckets_) {
+    Request resized;
+    TF_RETURN_IF_ERROR(ResizeRequest(req, bucket, &resized));
+    Response resp;
+    TF_RETURN_IF_ERROR(run(resized, resp));
+  }
+  LOG(INFO) << "Warmup " << buckets_.size() << " batch buckets.";
+  return Status::OK();
+}
+
+} // processor
+} // tensorflow
@@ -0,0 +1,77 @@
+#ifndef SERVING_PROCESSOR_SERVING_BATCH_BUCKETING_H
+#define SERVING_PROCESSOR_SERVING_BATCH_BUCKETING_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "serving/processor/serving/model_config.h"
+#include "serving/processor/serving/model_message.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/protobuf/meta_graph.pb.h"
+
+namespace tensorflow {
+namespace processor {
+
+// Pads the batch of a request up to the smallest of a few batch sizes,
+// the buckets, and slices the outputs back to the batch of the request.
+// The subgraph compiled by XLA (see compile_static_subgraph) is compiled
+// again for every input shape, so with bucketing it is compiled once per
+// bucket instead of once per batch size.
+//
+// The batch-major inputs and outputs are the dense tensors of the
+// signature with an unknown dimension 0, the components of sparse inputs
+// and the other tensors are fed and returned as is. The batch is
+// dimension 0 of the batch-major inputs, the padding rows repeat the last
+// row.
+class BatchBucketing {
+ public:
+  using RunFn = std::function<Status(Request&, Response&)>;
+
+  // 'buckets' are sorted in increasing order, the names of the batch-major
+  // tensors are like "input:0".
+  BatchBucketing(const std::vector<int64>& buckets,
+                 const std::unordered_set<std::string>& batch_inputs,
+                 const std::unordered_set<std::string>& batch_outputs);
+
+  // *bucketing is nullptr if no buckets are set in 'config'.
+  static Status Create(const MetaGraphDef& meta_graph_def,
+                       const ModelConfig* config,
+                       std::unique_ptr<BatchBucketing>* bucketing);
+
+  // Runs 'req' padded to its bucket by 'run'.
+  Status Run(Request& req, Response& resp, const RunFn& run);
+
+  // Runs 'req' resized to every bucket, so that the kernels are compiled
+  // before serving.
+  Status Warmup(const Request& req, const RunFn& run);
+
+  // The smallest bucket not less than 'batch_size', or 'batch_size' if it
+  // is larger than every bucket.
+  int64 GetBucket(int64 batch_size) const;
+
+  // Copies the first 'rows' rows of 'in' to *out, repeating the last row
+  // of 'in' if it has less rows.
+  static Status ResizeRows(const Tensor& in, int64 rows, Tensor* out);
+
+ private:
+  // Dimension 0 of the batch-major inputs of 'req', -1 if there is none or
+  // they don't agree.
+  int64 GetBatchSize(const Request& req) const;
+
+  // Resizes the batch-major inputs of 'req' to 'rows'.
+  Status ResizeRequest(const Request& req, int64 rows,
+                       Request* resized) const;
+
+  const std::vector<int64> buckets_;
+  const std::unordered_set<std::string> batch_inputs_;
+  const std::unordered_set<std::string> batch_outputs_;
+};
+
+} // processor
+} // tensorflow
+
+#endif // SERVING_PROCESSOR_SERVING_BATCH_BUCKETING_H
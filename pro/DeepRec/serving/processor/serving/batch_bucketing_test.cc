@@ -0,0 +1,192 @@
+#include "gtest/gtest.h"
+#include "serving/processor/serving/batch_bucketing.h"
+
+namespace tensorflow {
+namespace processor {
+namespace {
+
+void AddTensorInfo(const std::string& name, std::vector<int64> dims,
+                   google::protobuf::Map<std::string, TensorInfo>* infos) {
+  TensorInfo& info = (*infos)[name];
+  info.set_name(name + ":0");
+  for (int64 dim : dims) {
+    info.mutable_tensor_shape()->add_dim()->set_size(dim);
+  }
+}
+
+// "ids" and "features" are batch-major, "scale" is a scalar and "sp" is a
+// SparseTensor with 2 dimensions.
+MetaGraphDef CreateMetaGraphDef() {
+  MetaGraphDef meta_graph_def;
+  SignatureDef& sdef =
+      (*meta_graph_def.mutable_signature_def())["serving_default"];
+  AddTensorInfo("ids", {-1, 2}, sdef.mutable_inputs());
+  AddTensorInfo("features", {-1}, sdef.mutable_inputs());
+  AddTensorInfo("scale", {}, sdef.mutable_inputs());
+  TensorInfo& sp = (*sdef.mutable_inputs())["sp"];
+  sp.mutable_coo_sparse()->set_indices_tensor_name("sp_indices:0");
+  sp.mutable_coo_sparse()->set_values_tensor_name("sp_values:0");
+  sp.mutable_coo_sparse()->set_dense_shape_tensor_name("sp_shape:0");
+  sp.mutable_tensor_shape()->add_dim()->set_size(-1);
+  sp.mutable_tensor_shape()->add_dim()->set_size(-1);
+  AddTensorInfo("out", {-1, 1}, sdef.mutable_outputs());
+  AddTensorInfo("global", {4}, sdef.mutable_outputs());
+  return meta_graph_def;
+}
+
+std::unique_ptr<BatchBucketing> CreateBatchBucketing() {
+  ModelConfig config;
+  config.signature_name = "serving_default";
+  config.batch_buckets = {4, 8};
+  std::unique_ptr<BatchBucketing> bucketing;
+  EXPECT_TRUE(BatchBucketing::Create(CreateMetaGraphDef(), &config,
+                                     &bucketing).ok());
+  return bucketing;
+}
+
+Request CreateRequest(int64 batch_size) {
+  Request req;
+  Tensor ids(DT_INT64, TensorShape({batch_size, 2}));
+  auto flat = ids.flat<int64>();
+  for (int64 i = 0; i < flat.size(); ++i) flat(i) = i;
+  req.inputs.emplace_back("ids", ids);
+  Tensor features(DT_STRING, TensorShape({batch_size}));
+  for (int64 i = 0; i < batch_size; ++i) {
+    features.flat<string>()(i) = std::to_string(i);
+  }
+  req.inputs.emplace_back("features", features);
+  // Not batched.
+  req.inputs.emplace_back("scale", Tensor(DT_FLOAT, TensorShape({})));
+  req.output_tensor_names.push_back("out:0");
+  req.output_tensor_names.push_back("global:0");
+  return req;
+}
+
+} // namespace
+
+TEST(BatchBucketingTest, Create) {
+  MetaGraphDef meta_graph_def = CreateMetaGraphDef();
+  ModelConfig config;
+  config.signature_name = "serving_default";
+  std::unique_ptr<BatchBucketing> bucketing;
+  EXPECT_TRUE(BatchBucketing::Create(meta_graph_def, &config,
+                                     &bucketing).ok());
+  EXPECT_TRUE(bucketing == nullptr);
+
+  config.batch_buckets = {64, 16, 16, 256};
+  EXPECT_TRUE(BatchBucketing::Create(meta_graph_def, &config,
+                                     &bucketing).ok());
+  EXPECT_TRUE(bucketing != nullptr);
+  EXPECT_EQ(bucketing->GetBucket(1), 16);
+  EXPECT_EQ(bucketing->GetBucket(16), 16);
+  EXPECT_EQ(bucketing->GetBucket(17), 64);
+  EXPECT_EQ(bucketing->GetBucket(300), 300);
+
+  config.batch_buckets = {0, 16};
+  EXPECT_FALSE(BatchBucketing::Create(meta_graph_def, &config,
+                                      &bucketing).ok());
+
+  config.batch_buckets = {16};
+  config.signature_name = "missing";
+  EXPECT_FALSE(BatchBucketing::Create(meta_graph_def, &config,
+                                      &bucketing).ok());
+}
+
+TEST(BatchBucketingTest, ResizeRows) {
+  Request req = CreateRequest(3);
+  Tensor out;
+  EXPECT_TRUE(BatchBucketing::ResizeRows(req.inputs[0].second, 5, &out).ok());
+  EXPECT_EQ(out.shape(), TensorShape({5, 2}));
+  auto ids = out.matrix<int64>();
+  EXPECT_EQ(ids(2, 1), 5);
+  // The last row is repeated.
+  EXPECT_EQ(ids(3, 0), 4);
+  EXPECT_EQ(ids(4, 1), 5);
+
+  EXPECT_TRUE(BatchBucketing::ResizeRows(req.inputs[1].second, 4, &out).ok());
+  EXPECT_EQ(out.flat<string>()(3), "2");
+
+  EXPECT_TRUE(BatchBucketing::ResizeRows(req.inputs[0].second, 1, &out).ok());
+  EXPECT_EQ(out.shape(), TensorShape({1, 2}));
+
+  EXPECT_FALSE(BatchBucketing::ResizeRows(req.inputs[2].second, 4, &out).ok());
+}
+
+TEST(BatchBucketingTest, Run) {
+  std::unique_ptr<BatchBucketing> bucketing = CreateBatchBucketing();
+  std::vector<int64> fed_batch_sizes;
+  auto run = [&fed_batch_sizes](Request& req, Response& resp) {
+    const int64 batch_size = req.inputs[0].second.dim_size(0);
+    fed_batch_sizes.push_back(batch_size);
+    EXPECT_EQ(req.inputs[1].second.dim_size(0), batch_size);
+    EXPECT_EQ(req.inputs[2].second.dims(), 0);
+    resp.outputs.clear();
+    resp.outputs.emplace_back(DT_FLOAT, TensorShape({batch_size, 1}));
+    resp.outputs.emplace_back(DT_FLOAT, TensorShape({4}));
+    return Status::OK();
+  };
+
+  Request req = CreateRequest(3);
+  Response resp;
+  EXPECT_TRUE(bucketing->Run(req, resp, run).ok());
+  EXPECT_EQ(fed_batch_sizes.back(), 4);
+  EXPECT_EQ(resp.outputs[0].shape(), TensorShape({3, 1}));
+  // Not batch-major although dimension 0 equals the bucket.
+  EXPECT_EQ(resp.outputs[1].shape(), TensorShape({4}));
+  // The request itself is not changed.
+  EXPECT_EQ(req.inputs[0].second.dim_size(0), 3);
+
+  req = CreateRequest(8);
+  EXPECT_TRUE(bucketing->Run(req, resp, run).ok());
+  EXPECT_EQ(fed_batch_sizes.back(), 8);
+  EXPECT_EQ(resp.outputs[0].shape(), TensorShape({8, 1}));
+
+  // Larger than every bucket.
+  req = CreateRequest(9);
+  EXPECT_TRUE(bucketing->Run(req, resp, run).ok());
+  EXPECT_EQ(fed_batch_sizes.back(), 9);
+
+  fed_batch_sizes.clear();
+  EXPECT_TRUE(bucketing->Warmup(CreateRequest(1), run).ok());
+  EXPECT_EQ(fed_batch_sizes, std::vector<int64>({4, 8}));
+}
+
+TEST(BatchBucketingTest, SparseInput) {
+  std::unique_ptr<BatchBucketing> bucketing = CreateBatchBucketing();
+  // nnz and the rank of the SparseTensor equal the batch size.
+  Request req = CreateRequest(2);
+  Tensor indices(DT_INT64, TensorShape({2, 2}));
+  indices.matrix<int64>().setValues({{0, 0}, {1, 1}});
+  Tensor values(DT_INT64, TensorShape({2}));
+  values.vec<int64>().setValues({7, 8});
+  Tensor dense_shape(DT_INT64, TensorShape({2}));
+  dense_shape.vec<int64>().setValues({2, 2});
+  req.inputs.emplace_back("sp_indices:0", indices);
+  req.inputs.emplace_back("sp_values:0", values);
+  req.inputs.emplace_back("sp_shape", dense_shape);
+
+  int64 fed_batch_size = 0;
+  auto run = [&](Request& r, Response& resp) {
+    fed_batch_size = r.inputs[0].second.dim_size(0);
+    EXPECT_EQ(r.inputs[1].second.dim_size(0), fed_batch_size);
+    // The components of the SparseTensor are fed as is.
+    EXPECT_EQ(r.inputs[3].second.shape(), TensorShape({2, 2}));
+    EXPECT_EQ(r.inputs[3].second.matrix<int64>()(1, 1), 1);
+    EXPECT_EQ(r.inputs[4].second.shape(), TensorShape({2}));
+    EXPECT_EQ(r.inputs[4].second.vec<int64>()(1), 8);
+    EXPECT_EQ(r.inputs[5].second.shape(), TensorShape({2}));
+    EXPECT_EQ(r.inputs[5].second.vec<int64>()(0), 2);
+    resp.outputs.clear();
+    resp.outputs.emplace_back(DT_FLOAT, TensorShape({fed_batch_size, 1}));
+    resp.outputs.emplace_back(DT_FLOAT, TensorShape({4}));
+    return Status::OK();
+  };
+  Response resp;
+  EXPECT_TRUE(bucketing->Run(req, resp, run).ok());
+  EXPECT_EQ(fed_batch_size, 4);
+  EXPECT_EQ(resp.outputs[0].shape(), TensorShape({2, 1}));
+  EXPECT_EQ(resp.outputs[1].shape(), TensorShape({4}));
+}
+
+} // processor
+} // tensorflow
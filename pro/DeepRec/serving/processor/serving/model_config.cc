@@ -183,7 +183,7 @@ Status ModelConfigFactory::Create(const char* model_config, ModelConfig** config
   }
 
   // @feature_store_type: 
-  // 'redis/cluster_redis' or 'local'
+  // 'redis/cluster_redis', 'compact' or 'local'
   if ((*config)->feature_store_type == "cluster_redis" ||
       (*config)->feature_store_type == "redis") {
     if (!json_config["redis_url"].isNull()) {
@@ -211,6 +211,25 @@ Status ModelConfigFactory::Create(const char* model_config, ModelConfig** config
       (*config)->read_thread_num = 4;
     }
 
+    if (!json_config["update_thread_num"].isNull()) {
+      (*config)->update_thread_num =
+        json_config["update_thread_num"].asInt();
+    } else {
+      (*config)->update_thread_num = 2;
+    }
+  } else if ((*config)->feature_store_type == "compact") {
+    if (!json_config["compact_storage_dir"].isNull()) {
+      (*config)->compact_storage_dir =
+        json_config["compact_storage_dir"].asString();
+    }
+
+    if (!json_config["read_thread_num"].isNull()) {
+      (*config)->read_thread_num =
+        json_config["read_thread_num"].asInt();
+    } else {
+      (*config)->read_thread_num = 4;
+    }
+
     if (!json_config["update_thread_num"].isNull()) {
       (*config)->update_thread_num =
         json_config["update_thread_num"].asInt();
@@ -338,6 +357,51 @@ Status ModelConfigFactory::Create(const char* model_config, ModelConfig** config
     (*config)->shard_embedding_names.push_back(embedding_names);
   }
 
+  // "user_id;user_age", inputs which are the same in every row
+  if (!json_config["shared_input_names"].isNull()) {
+    std::string input_names = json_config["shared_input_names"].asString();
+    auto idx = input_names.find(";");
+    while (idx != std::string::npos) {
+      (*config)->shared_input_names.push_back(input_names.substr(0, idx));
+      input_names = input_names.substr(idx+1);
+      idx = input_names.find(";");
+    }
+    if (!input_names.empty()) {
+      (*config)->shared_input_names.push_back(input_names);
+    }
+  }
+
+  if (!json_config["shared_subgraph_cache_bytes"].isNull()) {
+    (*config)->shared_subgraph_cache_bytes =
+        json_config["shared_subgraph_cache_bytes"].asInt64();
+  }
+
+  if (!json_config["shared_subgraph_cache_ttl_seconds"].isNull()) {
+    (*config)->shared_subgraph_cache_ttl_seconds =
+        json_config["shared_subgraph_cache_ttl_seconds"].asInt();
+  }
+
+  if (!json_config["compile_static_subgraph"].isNull()) {
+    (*config)->compile_static_subgraph =
+        json_config["compile_static_subgraph"].asBool();
+  }
+
+  // "16;64;256", batch sizes the requests are padded to
+  if (!json_config["batch_buckets"].isNull()) {
+    std::string buckets = json_config["batch_buckets"].asString();
+    auto idx = buckets.find(";");
+    while (idx != std::string::npos) {
+      (*config)->batch_buckets.push_back(
+          strtoll(buckets.substr(0, idx).c_str(), nullptr, 10));
+      buckets = buckets.substr(idx+1);
+      idx = buckets.find(";");
+    }
+    if (!buckets.empty()) {
+      (*config)->batch_buckets.push_back(
+          strtoll(buckets.c_str(), nullptr, 10));
+    }
+  }
+
   // enable trace timeline
   if (!json_config["timeline_start_step"].isNull() &&
       !json_config["timeline_interval_step"].isNull() &&
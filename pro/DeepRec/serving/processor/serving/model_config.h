@@ -30,6 +30,9 @@ struct ModelConfig {
   int lock_timeout = 15 * 60;
   int read_thread_num = 1;
   int update_thread_num = 1;
+  // feature_store_type 'compact', tables are mapped from files here
+  // if set, or kept in memory.
+  std::string compact_storage_dir = "";
 
   // OSS Config
   std::string model_store_type;
@@ -43,6 +46,20 @@ struct ModelConfig {
   bool shard_embedding = false;
   std::vector<std::string> shard_embedding_names;
 
+  // signature inputs which are the same in every row of a request,
+  // their subgraph is computed once per request
+  std::vector<std::string> shared_input_names;
+  // cache the results of their subgraph across requests,
+  // 0 means disabled
+  int64_t shared_subgraph_cache_bytes = 0;
+  int shared_subgraph_cache_ttl_seconds = 300;
+
+  // compile the static-shape subgraph by XLA
+  bool compile_static_subgraph = false;
+  // pad the batch of a request up to one of these sizes,
+  // empty means disabled
+  std::vector<int64_t> batch_buckets;
+
   // session num of session group,
   // default num is 1
   int session_num = 1;
@@ -236,6 +236,8 @@ Status LocalSessionInstance::Init(ModelConfig* config,
 
   GraphOptimizerOption option;
   option.native_tf_mode = true;
+  option.shared_input_names = config->shared_input_names;
+  option.compile_static_subgraph = config->compile_static_subgraph;
   if (config->shard_embedding) {
     option.shard_embedding = config->shard_embedding;
     option.shard_embedding_names = config->shard_embedding_names;
@@ -252,6 +254,8 @@ Status LocalSessionInstance::Init(ModelConfig* config,
 
   session_mgr_ = new ModelSessionMgr(meta_graph_def_,
       session_options_, run_options_);
+  TF_RETURN_IF_ERROR(session_mgr_->CreateSharedSubgraphCache(config));
+  TF_RETURN_IF_ERROR(session_mgr_->CreateBatchBucketing(config));
 
   // Load full model
   TF_RETURN_IF_ERROR(session_mgr_->CreateModelSession(version_,
@@ -308,12 +312,15 @@ Status LocalSessionInstance::Warmup(
   }
 
   if (warmup_session) {
-    return warmup_session->LocalPredict(
-        call.request, call.response);
+    TF_RETURN_IF_ERROR(warmup_session->LocalPredict(
+        call.request, call.response));
+  } else {
+    TF_RETURN_IF_ERROR(session_mgr_->LocalPredict(
+        call.request, call.response));
   }
 
-  return session_mgr_->LocalPredict(
-      call.request, call.response);
+  // Compile the kernels of every batch bucket before serving.
+  return session_mgr_->WarmupBatchBuckets(warmup_session, call.request);
 }
 
 std::string LocalSessionInstance::DebugString() {
@@ -433,12 +440,17 @@ Status RemoteSessionInstance::Init(ModelConfig* model_config,
 
   GraphOptimizerOption option;
   option.native_tf_mode = false;
+  option.shared_input_names = model_config->shared_input_names;
+  option.compile_static_subgraph = model_config->compile_static_subgraph;
   optimizer_ = new SavedModelOptimizer(model_config->signature_name,
       &meta_graph_def_, option);
   TF_RETURN_IF_ERROR(optimizer_->Optimize());
 
   session_mgr_ = new ModelSessionMgr(meta_graph_def_,
       session_options_, run_options_);
+  TF_RETURN_IF_ERROR(
+      session_mgr_->CreateSharedSubgraphCache(model_config));
+  TF_RETURN_IF_ERROR(session_mgr_->CreateBatchBucketing(model_config));
 
   TF_RETURN_IF_ERROR(ReadModelSignature(model_config));
 
@@ -479,13 +491,19 @@ Status RemoteSessionInstance::Warmup(
                               warmup_file_name_);
   }
 
+  // Predict appends the storage and version feeds to the request, the
+  // batch buckets are warmed up from the request without them.
+  Request bucket_request = call.request;
   if (warmup_session) {
-    return warmup_session->Predict(
-        call.request, call.response);
+    TF_RETURN_IF_ERROR(warmup_session->Predict(
+        call.request, call.response));
+  } else {
+    TF_RETURN_IF_ERROR(session_mgr_->Predict(
+        call.request, call.response));
   }
 
-  return session_mgr_->Predict(
-      call.request, call.response);
+  // Compile the kernels of every batch bucket before serving.
+  return session_mgr_->WarmupBatchBuckets(warmup_session, bucket_request);
 }
 
 Status RemoteSessionInstance::FullModelUpdate(
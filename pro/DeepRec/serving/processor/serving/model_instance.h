@@ -207,7 +207,8 @@ class ModelInstanceMgrFactory {
  public:
   static IModelInstanceMgr* Create(ModelConfig* config) {
     if (config->feature_store_type == "redis" ||
-        config->feature_store_type == "cluster_redis") {
+        config->feature_store_type == "cluster_redis" ||
+        config->feature_store_type == "compact") {
       return new RemoteSessionInstanceMgr(config);
     } else if (config->feature_store_type == "memory") {
       return new LocalSessionInstanceMgr(config);
@@ -190,6 +190,7 @@ Status BatchCall::BatchRequest() {
   }
 
   batched_request.output_tensor_names = request[0].output_tensor_names;
+  batched_request.merged = true;
   return Status::OK();
 }
 
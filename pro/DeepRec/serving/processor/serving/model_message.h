@@ -11,6 +11,8 @@ namespace processor {
 struct Request {
   std::vector<std::pair<std::string, Tensor>> inputs;
   std::vector<std::string> output_tensor_names;
+  // Stacked from several requests by BatchCall, each request is a row.
+  bool merged = false;
 };
 
 struct Response {
@@ -313,11 +313,62 @@ Status ModelSession::LocalPredict(Request& req, Response& resp) {
 }
 
 Status ModelSessionMgr::Predict(Request& req, Response& resp) {
-  return serving_session_->Predict(req, resp);
+  ModelSession* session = serving_session_;
+  return Run(session, req, resp,
+      [session](Request& r, Response& p) {
+        return session->Predict(r, p);
+      });
 }
 
 Status ModelSessionMgr::LocalPredict(Request& req, Response& resp) {
-  return serving_session_->LocalPredict(req, resp);
+  ModelSession* session = serving_session_;
+  return Run(session, req, resp,
+      [session](Request& r, Response& p) {
+        return session->LocalPredict(r, p);
+      });
+}
+
+Status ModelSessionMgr::Run(ModelSession* session, Request& req,
+    Response& resp, BatchBucketing::RunFn run) {
+  TF_RETURN_IF_ERROR(
+      SharedSubgraphCache::ValidateMergedRequest(shared_input_names_, req));
+  // The cached results are looked up by the request before padding.
+  if (batch_bucketing_) {
+    BatchBucketing* bucketing = batch_bucketing_.get();
+    run = [bucketing, run](Request& r, Response& p) {
+      return bucketing->Run(r, p, run);
+    };
+  }
+  if (shared_subgraph_cache_) {
+    return shared_subgraph_cache_->Run(session->GetVersion(), req, resp,
+                                       run);
+  }
+  return run(req, resp);
+}
+
+Status ModelSessionMgr::CreateSharedSubgraphCache(ModelConfig* config) {
+  shared_input_names_ = SharedSubgraphCache::GetInputNames(meta_graph_def_);
+  return SharedSubgraphCache::Create(meta_graph_def_, config,
+                                     &shared_subgraph_cache_);
+}
+
+Status ModelSessionMgr::CreateBatchBucketing(ModelConfig* config) {
+  return BatchBucketing::Create(meta_graph_def_, config, &batch_bucketing_);
+}
+
+Status ModelSessionMgr::WarmupBatchBuckets(ModelSession* session,
+                                           const Request& req) {
+  if (!batch_bucketing_) {
+    return Status::OK();
+  }
+  if (session == nullptr) {
+    session = serving_session_;
+  }
+  return batch_bucketing_->Warmup(req,
+      [session](Request& r, Response& p) {
+        return session->is_local_ ? session->LocalPredict(r, p)
+                                  : session->Predict(r, p);
+      });
 }
 
 Status ModelSessionMgr::CreateModelSession(
@@ -506,6 +557,10 @@ Status ModelSessionMgr::CleanupModelSession() {
 void ModelSessionMgr::ResetServingSession(ModelSession* model_session) {
   auto tmp = serving_session_;
   serving_session_ = model_session;
+  // Results of the previous model are never fed again.
+  if (shared_subgraph_cache_) {
+    shared_subgraph_cache_->Clear();
+  }
 
   if (tmp == nullptr) return;
 
@@ -2,8 +2,10 @@
 #define SERVING_PROCESSOR_SERVING_MODEL_SESSION_H
 
 #include "serving/processor/framework/model_version.h"
+#include "serving/processor/serving/batch_bucketing.h"
 #include "serving/processor/serving/model_config.h"
 #include "serving/processor/serving/model_message.h"
+#include "serving/processor/serving/shared_subgraph_cache.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/protobuf/meta_graph.pb.h"
 #include "tensorflow/core/framework/tensor.h"
@@ -92,6 +94,17 @@ class ModelSessionMgr {
 
   void ResetServingSession(ModelSession* model_session);
 
+  // Cache the results of the hoisted subgraph of shared inputs across
+  // requests, if enabled in 'config'.
+  Status CreateSharedSubgraphCache(ModelConfig* config);
+
+  // Pad the batch of requests to the batch_buckets in 'config', if set.
+  Status CreateBatchBucketing(ModelConfig* config);
+
+  // Run 'req' resized to every batch bucket on 'session',
+  // or the serving session if nullptr.
+  Status WarmupBatchBuckets(ModelSession* session, const Request& req);
+
   Status GetServingModelInfo(
       tensorflow::processor::ServingModelInfo& model_info);
 
@@ -109,6 +122,9 @@ class ModelSessionMgr {
   
   void ClearLoop();
 
+  Status Run(ModelSession* session, Request& req, Response& resp,
+             BatchBucketing::RunFn run);
+
  protected:
   ModelSession* serving_session_ = nullptr;
 
@@ -116,6 +132,10 @@ class ModelSessionMgr {
   SessionOptions* session_options_;
   RunOptions* run_options_;
   std::vector<AssetFileDef> asset_file_defs_;
+  std::unique_ptr<SharedSubgraphCache> shared_subgraph_cache_;
+  // Shared inputs of the hoisted subgraph, set with the cache.
+  std::vector<std::string> shared_input_names_;
+  std::unique_ptr<BatchBucketing> batch_bucketing_;
 
   std::thread* clear_session_thread_ = nullptr;
   std::vector<ModelSession*> sessions_;
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "serving/processor/serving/shared_subgraph_cache.h"
+#include "serving/processor/framework/graph_optimizer.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/monitoring/gauge.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace processor {
+
+namespace {
+
+auto* cache_requests = monitoring::Counter<1>::New(
+    "/tensorflow/serving/processor/shared_subgraph_cache/requests",
+    "Requests run with the shared subgraph cache, by hit or miss.",
+    "result");
+
+auto* cache_run_micros = monitoring::Counter<1>::New(
+    "/tensorflow/serving/processor/shared_subgraph_cache/run_micros",
+    "Run time of the requests with the shared subgraph cache, by hit or "
+    "miss.",
+    "result");
+
+auto* cache_saved_micros = monitoring::Counter<0>::New(
+    "/tensorflow/serving/processor/shared_subgraph_cache/saved_micros",
+    "Run time saved by the hits, estimated by the average run time of "
+    "the misses.");
+
+auto* cache_bytes = monitoring::Gauge<int64, 0>::New(
+    "/tensorflow/serving/processor/shared_subgraph_cache/bytes",
+    "Bytes of the tensors in the shared subgraph cache.");
+
+// "user" and "user:0" are the same tensor.
+std::string TensorName(const std::string& name) {
+  if (name.find(':') == std::string::npos) {
+    return name + ":0";
+  }
+  return name;
+}
+
+std::vector<std::string> GetNodeList(const MetaGraphDef& meta_graph_def,
+                                     const std::string& key) {
+  std::vector<std::string> names;
+  auto it = meta_graph_def.collection_def().find(key);
+  if (it != meta_graph_def.collection_def().end()) {
+    for (const auto& name : it->second.node_list().value()) {
+      names.push_back(name);
+    }
+  }
+  return names;
+}
+
+// Hash of the first row, the rows of a shared input are the same.
+bool HashFirstRow(const Tensor& t, uint64* hash) {
+  if (t.dims() == 0 || t.dim_size(0) == 0) return false;
+  const int64 row_elements = t.NumElements() / t.dim_size(0);
+  uint64 h = Hash64Combine(t.dtype(), row_elements);
+  if (t.dtype() == DT_STRING) {
+    auto flat = t.flat<string>();
+    for (int64 i = 0; i < row_elements; ++i) {
+      h = Hash64Combine(h, Hash64(flat(i)));
+    }
+  } else if (DataTypeCanUseMemcpy(t.dtype())) {
+    StringPiece data = t.tensor_data();
+    h = Hash64Combine(h, Hash64(data.data(),
+                                row_elements * DataTypeSize(t.dtype())));
+  } else {
+    return false;
+  }
+  *hash = h;
+  return true;
+}
+
+// Row 'i' of 't' equals row 0.
+bool SameAsFirstRow(const Tensor& t, int64 i) {
+  const int64 row_elements = t.NumElements() / t.dim_size(0);
+  if (t.dtype() == DT_STRING) {
+    auto flat = t.flat<string>();
+    for (int64 j = 0; j < row_elements; ++j) {
+      if (flat(i * row_elements + j) != flat(j)) return false;
+    }
+    return true;
+  }
+  const size_t row_bytes = row_elements * DataTypeSize(t.dtype());
+  StringPiece data = t.tensor_data();
+  return memcmp(data.data() + i * row_bytes, data.data(), row_bytes) == 0;
+}
+
+} // namespace
+
+SharedSubgraphCache::SharedSubgraphCache(
+    const std::vector<std::string>& input_names,
+    const std::vector<std::string>& output_names,
+    int64 capacity_bytes, int64 ttl_seconds)
+    : input_names_(input_names),
+      output_names_(output_names),
+      capacity_bytes_(capacity_bytes),
+      ttl_micros_(ttl_seconds * 1000000) {}
+
+Status SharedSubgraphCache::Create(
+    const MetaGraphDef& meta_graph_def, const ModelConfig* config,
+    std::unique_ptr<SharedSubgraphCache>* cache) {
+  cache->reset();
+  if (config->shared_subgraph_cache_bytes <= 0) {
+    return Status::OK();
+  }
+  if (config->shared_subgraph_cache_ttl_seconds <= 0) {
+    return errors::InvalidArgument(
+        "[TensorFlow] shared_subgraph_cache_ttl_seconds should be positive.");
+  }
+  std::vector<std::string> input_names = GetInputNames(meta_graph_def);
+  std::vector<std::string> output_names =
+      GetNodeList(meta_graph_def, GetSharedOutputsCollectionKey());
+  if (input_names.empty() || output_names.empty()) {
+    LOG(WARNING) << "No hoisted subgraph of shared inputs in the graph, "
+                 << "shared subgraph cache is disabled.";
+    return Status::OK();
+  }
+  cache->reset(new SharedSubgraphCache(
+      input_names, output_names, config->shared_subgraph_cache_bytes,
+      config->shared_subgraph_cache_ttl_seconds));
+  return Status::OK();
+}
+
+std::vector<std::string> SharedSubgraphCache::GetInputNames(
+    const MetaGraphDef& meta_graph_def) {
+  std::vector<std::string> input_names =
+      GetNodeList(meta_graph_def, GetSharedInputsCollectionKey());
+  for (auto& name : input_names) {
+    name = TensorName(name);
+  }
+  return input_names;
+}
+
+Status SharedSubgraphCache::ValidateMergedRequest(
+    const std::vector<std::string>& input_names, const Request& req) {
+  if (!req.merged) {
+    return Status::OK();
+  }
+  for (const auto& input : req.inputs) {
+    const Tensor& t = input.second;
+    if (std::find(input_names.begin(), input_names.end(),
+                  TensorName(input.first)) == input_names.end() ||
+        t.dims() == 0 || t.dim_size(0) == 0) {
+      continue;
+    }
+    if (t.dtype() != DT_STRING && !DataTypeCanUseMemcpy(t.dtype())) {
+      return errors::InvalidArgument(
+          "[TensorFlow] Can't compare the shared input ", input.first,
+          " of type ", DataTypeString(t.dtype()), " across merged requests.");
+    }
+    for (int64 i = 1; i < t.dim_size(0); ++i) {
+      if (!SameAsFirstRow(t, i)) {
+        return errors::InvalidArgument(
+            "[TensorFlow] The shared input ", input.first,
+            " of merged request ", i, " differs from request 0, "
+            "BatchPredict needs the same shared inputs in every request.");
+      }
+    }
+  }
+  return Status::OK();
+}
+
+bool SharedSubgraphCache::GetKey(const Version& version,
+                                 const Request& req, uint64* key) const {
+  uint64 h = Hash64Combine(version.full_ckpt_version,
+                           version.delta_ckpt_version);
+  for (const std::string& name : input_names_) {
+    const Tensor* value = nullptr;
+    for (const auto& input : req.inputs) {
+      if (TensorName(input.first) == name) {
+        value = &input.second;
+        break;
+      }
+    }
+    uint64 row_hash = 0;
+    if (value == nullptr || !HashFirstRow(*value, &row_hash)) {
+      return false;
+    }
+    h = Hash64Combine(h, row_hash);
+  }
+  *key = h;
+  return true;
+}
+
+bool SharedSubgraphCache::Lookup(uint64 key, std::vector<Tensor>* values) {
+  mutex_lock l(mu_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return false;
+  }
+  if (it->second->expire_micros < Env::Default()->NowMicros()) {
+    EraseLocked(it->second);
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  *values = it->second->values;
+  return true;
+}
+
+void SharedSubgraphCache::Insert(uint64 key,
+                                 const std::vector<Tensor>& values) {
+  int64 bytes = 0;
+  for (const Tensor& t : values) {
+    bytes += t.TotalBytes();
+  }
+  if (bytes > capacity_bytes_) {
+    return;
+  }
+
+  mutex_lock l(mu_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    EraseLocked(it->second);
+  }
+  lru_.push_front(
+      {key, values, bytes, Env::Default()->NowMicros() + ttl_micros_});
+  index_[key] = lru_.begin();
+  bytes_ += bytes;
+  while (bytes_ > capacity_bytes_) {
+    EraseLocked(std::prev(lru_.end()));
+  }
+  cache_bytes->GetCell()->Set(bytes_);
+}
+
+void SharedSubgraphCache::EraseLocked(std::list<Entry>::iterator it) {
+  bytes_ -= it->bytes;
+  index_.erase(it->key);
+  lru_.erase(it);
+}
+
+void SharedSubgraphCache::Clear() {
+  mutex_lock l(mu_);
+  lru_.clear();
+  index_.clear();
+  bytes_ = 0;
+  cache_bytes->GetCell()->Set(0);
+}
+
+int64 SharedSubgraphCache::size() {
+  mutex_lock l(mu_);
+  return lru_.size();
+}
+
+int64 SharedSubgraphCache::bytes() {
+  mutex_lock l(mu_);
+  return bytes_;
+}
+
+Status SharedSubgraphCache::Run(const Version& version, Request& req,
+                                Response& resp, const RunFn& run) {
+  uint64 key = 0;
+  if (!GetKey(version, req, &key)) {
+    return run(req, resp);
+  }
+
+  const uint64 start = Env::Default()->NowMicros();
+  // The tensors of 'req' are shared, not copied.
+  Request cached_req(req);
+  std::vector<Tensor> values;
+  if (Lookup(key, &values)) {
+    for (size_t i = 0; i < output_names_.size(); ++i) {
+      cached_req.inputs.emplace_back(output_names_[i], values[i]);
+    }
+    TF_RETURN_IF_ERROR(run(cached_req, resp));
+
+    const int64 micros = Env::Default()->NowMicros() - start;
+    cache_requests->GetCell("hit")->IncrementBy(1);
+    cache_run_micros->GetCell("hit")->IncrementBy(micros);
+    const int64 saved = miss_micros_.load(std::memory_order_relaxed) - micros;
+    if (saved > 0) {
+      cache_saved_micros->GetCell()->IncrementBy(saved);
+    }
+    return Status::OK();
+  }
+
+  // Results of the hoisted subgraph are fetched after the outputs.
+  const size_t num_outputs = req.output_tensor_names.size();
+  cached_req.output_tensor_names.insert(
+      cached_req.output_tensor_names.end(),
+      output_names_.begin(), output_names_.end());
+  TF_RETURN_IF_ERROR(run(cached_req, resp));
+  if (resp.outputs.size() != num_outputs + output_names_.size()) {
+    return errors::Internal(
+        "[TensorFlow] Shared subgraph cache expects ",
+        num_outputs + output_names_.size(), " outputs, got ",
+        resp.outputs.size());
+  }
+  values.assign(resp.outputs.begin() + num_outputs, resp.outputs.end());
+  resp.outputs.resize(num_outputs);
+  Insert(key, values);
+
+  const int64 micros = Env::Default()->NowMicros() - start;
+  cache_requests->GetCell("miss")->IncrementBy(1);
+  cache_run_micros->GetCell("miss")->IncrementBy(micros);
+  // Average of about the last 16 misses.
+  int64 avg = miss_micros_.load(std::memory_order_relaxed);
+  miss_micros_.store(avg == 0 ? micros : avg + (micros - avg) / 16,
+                     std::memory_order_relaxed);
+  return Status::OK();
+}
+
+} // processor
+} // tensorflow
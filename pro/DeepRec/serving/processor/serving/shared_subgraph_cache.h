@@ -0,0 +1,103 @@
+#ifndef SERVING_PROCESSOR_SERVING_SHARED_SUBGRAPH_CACHE_H
+#define SERVING_PROCESSOR_SERVING_SHARED_SUBGRAPH_CACHE_H
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "serving/processor/framework/model_version.h"
+#include "serving/processor/serving/model_config.h"
+#include "serving/processor/serving/model_message.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/protobuf/meta_graph.pb.h"
+
+namespace tensorflow {
+namespace processor {
+
+// Results of the subgraph of the shared inputs, which is hoisted by
+// SavedModelOptimizer::HoistSharedSubgraph, cached across requests.
+// The same user requests the service many times between two model
+// updates, a hit feeds the cached results to the session so the hoisted
+// subgraph (the user tower) is pruned from the run.
+//
+// Entries are keyed by the model version and the first row of the shared
+// inputs, bounded by bytes and evicted in LRU order or after a TTL.
+class SharedSubgraphCache {
+ public:
+  using RunFn = std::function<Status(Request&, Response&)>;
+
+  SharedSubgraphCache(const std::vector<std::string>& input_names,
+                      const std::vector<std::string>& output_names,
+                      int64 capacity_bytes, int64 ttl_seconds);
+
+  // *cache is nullptr if the cache is disabled by 'config' or the graph
+  // has no hoisted subgraph.
+  static Status Create(const MetaGraphDef& meta_graph_def,
+                       const ModelConfig* config,
+                       std::unique_ptr<SharedSubgraphCache>* cache);
+
+  // Names like "user:0" of the shared inputs of the hoisted subgraph.
+  static std::vector<std::string> GetInputNames(
+      const MetaGraphDef& meta_graph_def);
+
+  // The hoisted subgraph reads only row 0 of the shared inputs. A merged
+  // request has a row per request, so the shared inputs must be the same
+  // in every merged request.
+  static Status ValidateMergedRequest(
+      const std::vector<std::string>& input_names, const Request& req);
+
+  // Runs 'req' by 'run', feeding the cached results on a hit and caching
+  // the results on a miss.
+  Status Run(const Version& version, Request& req, Response& resp,
+             const RunFn& run);
+
+  // Drops all entries, called when the serving model changes.
+  void Clear();
+
+  // False if 'req' has no value of some shared input.
+  bool GetKey(const Version& version, const Request& req,
+              uint64* key) const;
+  bool Lookup(uint64 key, std::vector<Tensor>* values);
+  void Insert(uint64 key, const std::vector<Tensor>& values);
+
+  int64 size();
+  int64 bytes();
+
+ private:
+  struct Entry {
+    uint64 key;
+    std::vector<Tensor> values;
+    int64 bytes;
+    uint64 expire_micros;
+  };
+
+  void EraseLocked(std::list<Entry>::iterator it)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const std::vector<std::string> input_names_;
+  const std::vector<std::string> output_names_;
+  const int64 capacity_bytes_;
+  const uint64 ttl_micros_;
+
+  mutex mu_;
+  // Most recently used first.
+  std::list<Entry> lru_ GUARDED_BY(mu_);
+  std::unordered_map<uint64, std::list<Entry>::iterator> index_
+      GUARDED_BY(mu_);
+  int64 bytes_ GUARDED_BY(mu_) = 0;
+
+  // Moving average of the run time of misses, to estimate the time saved
+  // by a hit.
+  std::atomic<int64> miss_micros_{0};
+};
+
+} // processor
+} // tensorflow
+
+#endif // SERVING_PROCESSOR_SERVING_SHARED_SUBGRAPH_CACHE_H
@@ -0,0 +1,182 @@
+#include "gtest/gtest.h"
+#include "serving/processor/framework/graph_optimizer.h"
+#include "serving/processor/serving/shared_subgraph_cache.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace tensorflow {
+namespace processor {
+namespace {
+
+MetaGraphDef CreateMetaGraphDef() {
+  MetaGraphDef meta_graph_def;
+  auto* collections = meta_graph_def.mutable_collection_def();
+  (*collections)[GetSharedInputsCollectionKey()]
+      .mutable_node_list()->add_value("user:0");
+  (*collections)[GetSharedOutputsCollectionKey()]
+      .mutable_node_list()->add_value("Relu:0");
+  return meta_graph_def;
+}
+
+Request CreateRequest(int64 user, int64 batch_size) {
+  Request req;
+  Tensor t(DT_INT64, TensorShape({batch_size}));
+  t.flat<int64>().setConstant(user);
+  req.inputs.emplace_back("user", t);
+  req.inputs.emplace_back("item", t);
+  req.output_tensor_names.push_back("out:0");
+  return req;
+}
+
+Version CreateVersion(int64 full, int64 delta) {
+  Version version;
+  version.full_ckpt_version = full;
+  version.delta_ckpt_version = delta;
+  return version;
+}
+
+} // namespace
+
+TEST(SharedSubgraphCacheTest, Create) {
+  ModelConfig config;
+  std::unique_ptr<SharedSubgraphCache> cache;
+  EXPECT_TRUE(SharedSubgraphCache::Create(
+      CreateMetaGraphDef(), &config, &cache).ok());
+  EXPECT_TRUE(cache == nullptr);
+
+  config.shared_subgraph_cache_bytes = 1024;
+  EXPECT_TRUE(SharedSubgraphCache::Create(
+      MetaGraphDef(), &config, &cache).ok());
+  EXPECT_TRUE(cache == nullptr);
+
+  EXPECT_TRUE(SharedSubgraphCache::Create(
+      CreateMetaGraphDef(), &config, &cache).ok());
+  EXPECT_TRUE(cache != nullptr);
+
+  config.shared_subgraph_cache_ttl_seconds = 0;
+  EXPECT_FALSE(SharedSubgraphCache::Create(
+      CreateMetaGraphDef(), &config, &cache).ok());
+}
+
+TEST(SharedSubgraphCacheTest, GetKey) {
+  SharedSubgraphCache cache({"user:0"}, {"Relu:0"}, 1024, 60);
+  uint64 key0 = 0, key1 = 0;
+  EXPECT_TRUE(cache.GetKey(CreateVersion(1, 0), CreateRequest(7, 4), &key0));
+  // Only the first row is hashed.
+  EXPECT_TRUE(cache.GetKey(CreateVersion(1, 0), CreateRequest(7, 2), &key1));
+  EXPECT_EQ(key0, key1);
+  EXPECT_TRUE(cache.GetKey(CreateVersion(1, 0), CreateRequest(8, 4), &key1));
+  EXPECT_NE(key0, key1);
+  EXPECT_TRUE(cache.GetKey(CreateVersion(1, 2), CreateRequest(7, 4), &key1));
+  EXPECT_NE(key0, key1);
+
+  Request req;
+  req.inputs.emplace_back("item:0", Tensor(DT_INT64, TensorShape({4})));
+  EXPECT_FALSE(cache.GetKey(CreateVersion(1, 0), req, &key1));
+  req.inputs.emplace_back("user:0", Tensor(DT_INT64, TensorShape({0})));
+  EXPECT_FALSE(cache.GetKey(CreateVersion(1, 0), req, &key1));
+}
+
+TEST(SharedSubgraphCacheTest, Run) {
+  SharedSubgraphCache cache({"user:0"}, {"Relu:0"}, 1024, 60);
+  int runs = 0;
+  bool fed = false;
+  auto run = [&runs, &fed](Request& req, Response& resp) {
+    ++runs;
+    fed = false;
+    for (auto& input : req.inputs) {
+      fed = fed || input.first == "Relu:0";
+    }
+    resp.outputs.clear();
+    for (auto& name : req.output_tensor_names) {
+      Tensor t(DT_FLOAT, TensorShape({1, 4}));
+      t.flat<float>().setConstant(name == "Relu:0" ? 2.0 : 1.0);
+      resp.outputs.push_back(t);
+    }
+    return Status::OK();
+  };
+
+  Request req = CreateRequest(7, 4);
+  Response resp;
+  EXPECT_TRUE(cache.Run(CreateVersion(1, 0), req, resp, run).ok());
+  EXPECT_FALSE(fed);
+  EXPECT_EQ(resp.outputs.size(), 1);
+  EXPECT_EQ(req.output_tensor_names.size(), 1);
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_EQ(cache.bytes(), 16);
+
+  EXPECT_TRUE(cache.Run(CreateVersion(1, 0), req, resp, run).ok());
+  EXPECT_TRUE(fed);
+  EXPECT_EQ(resp.outputs.size(), 1);
+  EXPECT_EQ(req.inputs.size(), 2);
+
+  // A new model version misses.
+  EXPECT_TRUE(cache.Run(CreateVersion(2, 0), req, resp, run).ok());
+  EXPECT_FALSE(fed);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(runs, 3);
+
+  cache.Clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.bytes(), 0);
+}
+
+TEST(SharedSubgraphCacheTest, LRUAndTTL) {
+  SharedSubgraphCache cache({"user:0"}, {"Relu:0"}, 32, 1);
+  Tensor value(DT_FLOAT, TensorShape({1, 4}));
+  std::vector<Tensor> values;
+  cache.Insert(1, {value});
+  cache.Insert(2, {value});
+  EXPECT_TRUE(cache.Lookup(1, &values));
+  cache.Insert(3, {value});
+  // 2 is the least recently used.
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_TRUE(cache.Lookup(1, &values));
+  EXPECT_FALSE(cache.Lookup(2, &values));
+  EXPECT_TRUE(cache.Lookup(3, &values));
+
+  // Larger than the capacity.
+  cache.Insert(4, {Tensor(DT_FLOAT, TensorShape({1, 16}))});
+  EXPECT_FALSE(cache.Lookup(4, &values));
+
+  Env::Default()->SleepForMicroseconds(1100000);
+  EXPECT_FALSE(cache.Lookup(1, &values));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(SharedSubgraphCacheTest, ValidateMergedRequest) {
+  std::vector<std::string> input_names =
+      SharedSubgraphCache::GetInputNames(CreateMetaGraphDef());
+  EXPECT_EQ(input_names, std::vector<std::string>({"user:0"}));
+
+  // A merged request has a row per request.
+  Request req = CreateRequest(7, 3);
+  EXPECT_TRUE(
+      SharedSubgraphCache::ValidateMergedRequest(input_names, req).ok());
+  req.merged = true;
+  EXPECT_TRUE(
+      SharedSubgraphCache::ValidateMergedRequest(input_names, req).ok());
+
+  // Another user in request 2, only "user" is checked.
+  req.inputs[0].second.flat<int64>()(2) = 8;
+  req.inputs[1].second = req.inputs[0].second;
+  EXPECT_FALSE(
+      SharedSubgraphCache::ValidateMergedRequest(input_names, req).ok());
+  req.inputs[0].second = Tensor(DT_INT64, TensorShape({3}));
+  req.inputs[0].second.flat<int64>().setConstant(7);
+  EXPECT_TRUE(
+      SharedSubgraphCache::ValidateMergedRequest(input_names, req).ok());
+
+  Request strings;
+  strings.merged = true;
+  Tensor users(DT_STRING, TensorShape({2, 2}));
+  users.matrix<string>().setValues({{"u", "a"}, {"u", "b"}});
+  strings.inputs.emplace_back("user:0", users);
+  EXPECT_FALSE(
+      SharedSubgraphCache::ValidateMergedRequest(input_names, strings).ok());
+  users.matrix<string>()(1, 1) = "a";
+  EXPECT_TRUE(
+      SharedSubgraphCache::ValidateMergedRequest(input_names, strings).ok());
+}
+
+} // processor
+} // tensorflow
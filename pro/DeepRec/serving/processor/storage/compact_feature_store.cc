@@ -0,0 +1,649 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "serving/processor/storage/compact_feature_store.h"
+
+#include <cstring>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mem.h"
+#include "tensorflow/core/platform/prefetch.h"
+
+namespace tensorflow {
+namespace processor {
+
+namespace {
+
+const uint64 kCompactTableMagic = 0x3154424154434543ULL;  // "CECTABT1"
+const size_t kAlignment = 64;
+const size_t kPrefetchDistance = 8;
+// An overlay larger than 1/kOverlayRatio of its table is merged into a new
+// table when the delta model is sealed.
+const int64 kOverlayRatio = 8;
+
+inline size_t RoundUp(size_t n) {
+  return (n + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// The finalizer of murmur3, ids are often sequential or already hashed with
+// their low bits in use, both should spread over the slots.
+inline uint64 Mix(int64 key) {
+  uint64 h = static_cast<uint64>(key);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+Status ToKeys(const char* const keys, size_t bytes_per_key, size_t N,
+              std::vector<int64>* ids) {
+  ids->resize(N);
+  if (bytes_per_key == sizeof(int64)) {
+    memcpy(ids->data(), keys, N * sizeof(int64));
+  } else if (bytes_per_key == sizeof(int32)) {
+    const int32* keys32 = reinterpret_cast<const int32*>(keys);
+    for (size_t i = 0; i < N; ++i) {
+      (*ids)[i] = keys32[i];
+    }
+  } else {
+    return errors::InvalidArgument(
+        "[Compact] Only int32 and int64 keys are supported, got ",
+        bytes_per_key, " bytes per key.");
+  }
+  return Status::OK();
+}
+
+} // namespace
+
+struct CompactEmbeddingTable::Header {
+  uint64 magic;
+  uint64 num_rows;
+  uint64 capacity;
+  uint64 bytes_per_value;
+  uint64 slots_offset;
+  uint64 values_offset;
+  uint64 image_bytes;
+};
+
+// An empty slot has row -1.
+struct CompactEmbeddingTable::Slot {
+  int64 key;
+  int64 row;
+};
+
+CompactEmbeddingTable::~CompactEmbeddingTable() {
+  if (buffer_ != nullptr) {
+    port::AlignedFree(buffer_);
+  }
+}
+
+Status CompactEmbeddingTable::Build(
+    const std::vector<int64>& keys, const char* values,
+    size_t bytes_per_value, std::unique_ptr<CompactEmbeddingTable>* table) {
+  const uint64 N = keys.size();
+  // Load factor is at most 0.75, so a probe ends at an empty slot.
+  uint64 capacity = 2;
+  while (capacity * 3 < N * 4 + 4) {
+    capacity <<= 1;
+  }
+  const uint64 mask = capacity - 1;
+  std::vector<Slot> slots(capacity, Slot{0, -1});
+  // Input position of every row.
+  std::vector<uint64> sources;
+  sources.reserve(N);
+  for (uint64 i = 0; i < N; ++i) {
+    uint64 s = Mix(keys[i]) & mask;
+    while (slots[s].row >= 0 && slots[s].key != keys[i]) {
+      s = (s + 1) & mask;
+    }
+    if (slots[s].row < 0) {
+      slots[s].key = keys[i];
+      slots[s].row = sources.size();
+      sources.push_back(i);
+    } else {
+      sources[slots[s].row] = i;
+    }
+  }
+
+  const uint64 num_rows = sources.size();
+  const size_t slots_offset = RoundUp(sizeof(Header));
+  const size_t values_offset = RoundUp(slots_offset + capacity * sizeof(Slot));
+  const size_t image_bytes = values_offset + num_rows * bytes_per_value;
+  char* buffer = static_cast<char*>(port::AlignedMalloc(image_bytes,
+                                                        kAlignment));
+  if (buffer == nullptr) {
+    return errors::ResourceExhausted(
+        "[Compact] Allocate ", image_bytes, " bytes for a table failed.");
+  }
+  memset(buffer, 0, values_offset);
+  Header* header = reinterpret_cast<Header*>(buffer);
+  header->magic = kCompactTableMagic;
+  header->num_rows = num_rows;
+  header->capacity = capacity;
+  header->bytes_per_value = bytes_per_value;
+  header->slots_offset = slots_offset;
+  header->values_offset = values_offset;
+  header->image_bytes = image_bytes;
+  memcpy(buffer + slots_offset, slots.data(), capacity * sizeof(Slot));
+  for (uint64 r = 0; r < num_rows; ++r) {
+    memcpy(buffer + values_offset + r * bytes_per_value,
+           values + sources[r] * bytes_per_value, bytes_per_value);
+  }
+
+  table->reset(new CompactEmbeddingTable());
+  (*table)->buffer_ = buffer;
+  return (*table)->Init(buffer, image_bytes);
+}
+
+Status CompactEmbeddingTable::Load(
+    Env* env, const std::string& fname,
+    std::unique_ptr<CompactEmbeddingTable>* table) {
+  std::unique_ptr<ReadOnlyMemoryRegion> region;
+  TF_RETURN_IF_ERROR(env->NewReadOnlyMemoryRegionFromFile(fname, &region));
+  table->reset(new CompactEmbeddingTable());
+  const char* image = static_cast<const char*>(region->data());
+  const size_t image_bytes = region->length();
+  (*table)->region_ = std::move(region);
+  Status s = (*table)->Init(image, image_bytes);
+  if (!s.ok()) {
+    return errors::DataLoss("[Compact] Invalid table file ", fname, ": ",
+                            s.error_message());
+  }
+  return Status::OK();
+}
+
+Status CompactEmbeddingTable::Init(const char* image, size_t image_bytes) {
+  if (image_bytes < sizeof(Header)) {
+    return errors::InvalidArgument("[Compact] Table image is too small.");
+  }
+  header_ = reinterpret_cast<const Header*>(image);
+  const uint64 capacity = header_->capacity;
+  if (header_->magic != kCompactTableMagic ||
+      header_->image_bytes != image_bytes ||
+      capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+      header_->num_rows >= capacity ||
+      header_->slots_offset + capacity * sizeof(Slot) >
+          header_->values_offset ||
+      header_->values_offset +
+          header_->num_rows * header_->bytes_per_value != image_bytes) {
+    return errors::InvalidArgument("[Compact] Corrupted table header.");
+  }
+  slots_ = reinterpret_cast<const Slot*>(image + header_->slots_offset);
+  values_ = image + header_->values_offset;
+  mask_ = capacity - 1;
+  image_bytes_ = image_bytes;
+  return Status::OK();
+}
+
+Status CompactEmbeddingTable::Save(Env* env, const std::string& fname) const {
+  // Written to a temp file first, a half written table is never loaded.
+  const std::string tmp_fname = strings::StrCat(fname, ".tmp");
+  std::unique_ptr<WritableFile> file;
+  TF_RETURN_IF_ERROR(env->NewWritableFile(tmp_fname, &file));
+  TF_RETURN_IF_ERROR(file->Append(
+      StringPiece(reinterpret_cast<const char*>(header_), image_bytes_)));
+  TF_RETURN_IF_ERROR(file->Close());
+  return env->RenameFile(tmp_fname, fname);
+}
+
+const char* CompactEmbeddingTable::Find(int64 key) const {
+  uint64 s = Mix(key) & mask_;
+  while (true) {
+    const Slot& slot = slots_[s];
+    if (slot.row < 0) {
+      return nullptr;
+    }
+    if (slot.key == key) {
+      return values_ + slot.row * header_->bytes_per_value;
+    }
+    s = (s + 1) & mask_;
+  }
+}
+
+void CompactEmbeddingTable::BatchFind(const int64* keys, size_t N,
+                                      const char** rows) const {
+  for (size_t i = 0; i < N && i < kPrefetchDistance; ++i) {
+    port::prefetch<port::PREFETCH_HINT_T0>(&slots_[Mix(keys[i]) & mask_]);
+  }
+  for (size_t i = 0; i < N; ++i) {
+    if (i + kPrefetchDistance < N) {
+      port::prefetch<port::PREFETCH_HINT_T0>(
+          &slots_[Mix(keys[i + kPrefetchDistance]) & mask_]);
+    }
+    rows[i] = Find(keys[i]);
+  }
+}
+
+void CompactEmbeddingTable::ForEachRow(
+    const std::function<void(int64, const char*)>& fn) const {
+  for (uint64 s = 0; s <= mask_; ++s) {
+    if (slots_[s].row >= 0) {
+      fn(slots_[s].key, values_ + slots_[s].row * header_->bytes_per_value);
+    }
+  }
+}
+
+int64 CompactEmbeddingTable::size() const {
+  return header_->num_rows;
+}
+
+size_t CompactEmbeddingTable::bytes_per_value() const {
+  return header_->bytes_per_value;
+}
+
+size_t CompactEmbeddingTable::MemoryBytes() const {
+  return image_bytes_;
+}
+
+std::shared_ptr<CompactStorage> CompactStorage::Get(size_t db_idx,
+                                                    const std::string& dir) {
+  static mutex* mu = new mutex();
+  static auto* storages =
+      new std::unordered_map<std::string, std::weak_ptr<CompactStorage>>();
+  const std::string name = strings::StrCat(db_idx, ":", dir);
+  mutex_lock l(*mu);
+  std::shared_ptr<CompactStorage> storage = (*storages)[name].lock();
+  if (!storage) {
+    storage = std::make_shared<CompactStorage>(db_idx, dir);
+    (*storages)[name] = storage;
+  }
+  return storage;
+}
+
+CompactStorage::CompactStorage(size_t db_idx, const std::string& dir)
+    : db_idx_(db_idx), dir_(dir) {}
+
+Status CompactStorage::Cleanup() {
+  mutex_lock l(mu_);
+  features_.clear();
+  staging_.clear();
+  staging_version_ = -1;
+  full_version_ = -1;
+  latest_version_ = -1;
+  return Status::OK();
+}
+
+Status CompactStorage::SetActiveStatus(bool active) {
+  mutex_lock l(mu_);
+  active_ = active;
+  return Status::OK();
+}
+
+Status CompactStorage::GetModelVersion(int64_t* full_version,
+                                       int64_t* latest_version) {
+  mutex_lock l(mu_);
+  *full_version = full_version_;
+  *latest_version = latest_version_;
+  return Status::OK();
+}
+
+Status CompactStorage::SetModelVersion(int64_t full_version,
+                                       int64_t latest_version) {
+  std::unordered_map<uint64, Staging> staging;
+  std::unordered_map<uint64, std::shared_ptr<Feature>> features;
+  {
+    mutex_lock l(mu_);
+    if (staging_version_ == full_version) {
+      staging.swap(staging_);
+    }
+    staging_.clear();
+    staging_version_ = -1;
+    if (full_version_ == full_version) {
+      features = features_;
+    }
+  }
+
+  // Tables are built without the lock, the loading model is not served
+  // until its version is set.
+  for (auto& it : staging) {
+    TF_RETURN_IF_ERROR(Seal(it.first, &it.second, &features[it.first]));
+  }
+  for (auto& it : features) {
+    const Feature& feature = *it.second;
+    if (!feature.has_overlay) continue;
+    size_t overlay_size = 0;
+    {
+      tf_shared_lock l(feature.mu);
+      overlay_size = feature.overlay.size();
+    }
+    if (static_cast<int64>(overlay_size) * kOverlayRatio >
+        feature.table->size()) {
+      TF_RETURN_IF_ERROR(Compact(it.first, feature, &it.second));
+    }
+  }
+
+  size_t memory_bytes = 0;
+  for (auto& it : features) {
+    memory_bytes += it.second->table->MemoryBytes();
+  }
+  LOG(INFO) << "[Compact] db " << db_idx_ << " serves version "
+            << full_version << "," << latest_version << ", "
+            << features.size() << " features in " << memory_bytes
+            << " bytes.";
+
+  mutex_lock l(mu_);
+  features_.swap(features);
+  full_version_ = full_version;
+  latest_version_ = latest_version;
+  return Status::OK();
+}
+
+// The storage lives in this process, the lock only keeps a full and a
+// delta load of the same db apart.
+Status CompactStorage::GetStorageLock(int value, bool* success) {
+  mutex_lock l(mu_);
+  *success = !locked_;
+  if (*success) {
+    locked_ = true;
+    lock_value_ = value;
+  }
+  return Status::OK();
+}
+
+Status CompactStorage::ReleaseStorageLock(int value) {
+  mutex_lock l(mu_);
+  if (locked_ && lock_value_ == value) {
+    locked_ = false;
+  }
+  return Status::OK();
+}
+
+Status CompactStorage::BatchGet(uint64_t model_version,
+                                uint64_t feature2id,
+                                const char* const keys,
+                                char* const values,
+                                size_t bytes_per_key,
+                                size_t bytes_per_values,
+                                size_t N,
+                                const char* default_value) {
+  std::shared_ptr<Feature> feature;
+  {
+    tf_shared_lock l(mu_);
+    if (static_cast<int64_t>(model_version) == full_version_) {
+      auto it = features_.find(feature2id);
+      if (it != features_.end()) {
+        feature = it->second;
+      }
+    }
+  }
+  if (!feature) {
+    // Same as a redis without the keys of this version.
+    for (size_t i = 0; i < N; ++i) {
+      memcpy(values + i * bytes_per_values, default_value, bytes_per_values);
+    }
+    return Status::OK();
+  }
+  if (feature->table->bytes_per_value() != bytes_per_values) {
+    return errors::InvalidArgument(
+        "[Compact] Feature ", feature2id, " has ",
+        feature->table->bytes_per_value(), " bytes per value, got ",
+        bytes_per_values);
+  }
+
+  std::vector<int64> ids;
+  TF_RETURN_IF_ERROR(ToKeys(keys, bytes_per_key, N, &ids));
+  std::vector<const char*> rows(N);
+  feature->table->BatchFind(ids.data(), N, rows.data());
+
+  auto copy_rows = [&]() {
+    for (size_t i = 0; i < N; ++i) {
+      memcpy(values + i * bytes_per_values,
+             rows[i] != nullptr ? rows[i] : default_value,
+             bytes_per_values);
+    }
+  };
+  if (!feature->has_overlay) {
+    copy_rows();
+    return Status::OK();
+  }
+  tf_shared_lock l(feature->mu);
+  for (size_t i = 0; i < N; ++i) {
+    auto it = feature->overlay.find(ids[i]);
+    if (it != feature->overlay.end()) {
+      rows[i] = feature->overlay_values.data() + it->second;
+    }
+  }
+  copy_rows();
+  return Status::OK();
+}
+
+Status CompactStorage::BatchSet(uint64_t model_version,
+                                uint64_t feature2id,
+                                const char* const keys,
+                                const char* const values,
+                                size_t bytes_per_key,
+                                size_t bytes_per_values,
+                                size_t N) {
+  std::vector<int64> ids;
+  TF_RETURN_IF_ERROR(ToKeys(keys, bytes_per_key, N, &ids));
+
+  std::shared_ptr<Feature> feature;
+  {
+    mutex_lock l(mu_);
+    auto it = features_.find(feature2id);
+    if (static_cast<int64_t>(model_version) != full_version_ ||
+        it == features_.end()) {
+      return Stage(model_version, feature2id, ids, values, bytes_per_values,
+                   N);
+    }
+    feature = it->second;
+  }
+
+  // Rows of a delta model, the table keeps serving while they are added.
+  if (feature->table->bytes_per_value() != bytes_per_values) {
+    return errors::InvalidArgument(
+        "[Compact] Feature ", feature2id, " has ",
+        feature->table->bytes_per_value(), " bytes per value, got ",
+        bytes_per_values);
+  }
+  mutex_lock l(feature->mu);
+  for (size_t i = 0; i < N; ++i) {
+    auto ret = feature->overlay.emplace(ids[i],
+                                        feature->overlay_values.size());
+    if (ret.second) {
+      feature->overlay_values.resize(
+          feature->overlay_values.size() + bytes_per_values);
+    }
+    memcpy(feature->overlay_values.data() + ret.first->second,
+           values + i * bytes_per_values, bytes_per_values);
+  }
+  feature->has_overlay = true;
+  return Status::OK();
+}
+
+// Rows of a full model are staged until its version is set.
+Status CompactStorage::Stage(uint64_t model_version, uint64_t feature2id,
+                             const std::vector<int64>& ids,
+                             const char* const values,
+                             size_t bytes_per_values, size_t N) {
+  if (staging_version_ != static_cast<int64_t>(model_version)) {
+    staging_.clear();
+    staging_version_ = model_version;
+  }
+  Staging& staging = staging_[feature2id];
+  if (staging.keys.empty()) {
+    staging.bytes_per_value = bytes_per_values;
+  } else if (staging.bytes_per_value != bytes_per_values) {
+    return errors::InvalidArgument(
+        "[Compact] Feature ", feature2id, " has ", staging.bytes_per_value,
+        " bytes per value, got ", bytes_per_values);
+  }
+  staging.keys.insert(staging.keys.end(), ids.begin(), ids.end());
+  staging.values.insert(staging.values.end(), values,
+                        values + N * bytes_per_values);
+  return Status::OK();
+}
+
+Status CompactStorage::Seal(uint64 feature2id, Staging* staging,
+                            std::shared_ptr<Feature>* feature) {
+  std::unique_ptr<CompactEmbeddingTable> table;
+  TF_RETURN_IF_ERROR(CompactEmbeddingTable::Build(
+      staging->keys, staging->values.data(), staging->bytes_per_value,
+      &table));
+  // Staged rows are released as soon as their table is built.
+  std::vector<int64>().swap(staging->keys);
+  std::vector<char>().swap(staging->values);
+  TF_RETURN_IF_ERROR(MaybeMapFromFile(feature2id, &table));
+  feature->reset(new Feature());
+  (*feature)->table = std::move(table);
+  return Status::OK();
+}
+
+Status CompactStorage::Compact(uint64 feature2id, const Feature& feature,
+                               std::shared_ptr<Feature>* compacted) {
+  std::vector<int64> keys;
+  std::vector<char> values;
+  const size_t bytes_per_value = feature.table->bytes_per_value();
+  keys.reserve(feature.table->size());
+  values.reserve(feature.table->size() * bytes_per_value);
+  feature.table->ForEachRow([&keys, &values, bytes_per_value](
+      int64 key, const char* value) {
+    keys.push_back(key);
+    values.insert(values.end(), value, value + bytes_per_value);
+  });
+  {
+    // Overlay rows come last and win over the rows of the table.
+    tf_shared_lock l(feature.mu);
+    for (auto& it : feature.overlay) {
+      keys.push_back(it.first);
+      const char* value = feature.overlay_values.data() + it.second;
+      values.insert(values.end(), value, value + bytes_per_value);
+    }
+  }
+
+  std::unique_ptr<CompactEmbeddingTable> table;
+  TF_RETURN_IF_ERROR(CompactEmbeddingTable::Build(
+      keys, values.data(), bytes_per_value, &table));
+  TF_RETURN_IF_ERROR(MaybeMapFromFile(feature2id, &table));
+  compacted->reset(new Feature());
+  (*compacted)->table = std::move(table);
+  return Status::OK();
+}
+
+Status CompactStorage::MaybeMapFromFile(
+    uint64 feature2id, std::unique_ptr<CompactEmbeddingTable>* table) {
+  if (dir_.empty()) {
+    return Status::OK();
+  }
+  Env* env = Env::Default();
+  TF_RETURN_IF_ERROR(env->RecursivelyCreateDir(dir_));
+  const std::string fname = io::JoinPath(
+      dir_, strings::StrCat("db", db_idx_, "_feature", feature2id, "_",
+                            env->NowMicros(), ".table"));
+  TF_RETURN_IF_ERROR((*table)->Save(env, fname));
+  std::unique_ptr<CompactEmbeddingTable> mapped;
+  TF_RETURN_IF_ERROR(CompactEmbeddingTable::Load(env, fname, &mapped));
+  *table = std::move(mapped);
+  // The mapping keeps the file alive, its pages stay backed by the file
+  // and can be dropped from memory instead of swapped.
+  Status s = env->DeleteFile(fname);
+  if (!s.ok()) {
+    LOG(WARNING) << "[Compact] Delete table file " << fname
+                 << " failed: " << s.error_message();
+  }
+  return Status::OK();
+}
+
+CompactFeatureStore::CompactFeatureStore(size_t db_idx,
+                                         const std::string& dir)
+    : storage_(CompactStorage::Get(db_idx, dir)) {}
+
+Status CompactFeatureStore::SetActiveStatus(bool active) {
+  return storage_->SetActiveStatus(active);
+}
+
+Status CompactFeatureStore::GetModelVersion(int64_t* full_version,
+                                            int64_t* latest_version) {
+  return storage_->GetModelVersion(full_version, latest_version);
+}
+
+Status CompactFeatureStore::SetModelVersion(int64_t full_version,
+                                            int64_t latest_version) {
+  return storage_->SetModelVersion(full_version, latest_version);
+}
+
+Status CompactFeatureStore::GetStorageLock(int value, int timeout,
+                                           bool* success) {
+  return storage_->GetStorageLock(value, success);
+}
+
+Status CompactFeatureStore::ReleaseStorageLock(int value) {
+  return storage_->ReleaseStorageLock(value);
+}
+
+Status CompactFeatureStore::Cleanup() {
+  return storage_->Cleanup();
+}
+
+Status CompactFeatureStore::BatchGet(uint64_t model_version,
+                                     uint64_t feature2id,
+                                     const char* const keys,
+                                     char* const values,
+                                     size_t bytes_per_key,
+                                     size_t bytes_per_values,
+                                     size_t N,
+                                     const char* default_value) {
+  return storage_->BatchGet(model_version, feature2id, keys, values,
+                            bytes_per_key, bytes_per_values, N,
+                            default_value);
+}
+
+Status CompactFeatureStore::BatchSet(uint64_t model_version,
+                                     uint64_t feature2id,
+                                     const char* const keys,
+                                     const char* const values,
+                                     size_t bytes_per_key,
+                                     size_t bytes_per_values,
+                                     size_t N) {
+  return storage_->BatchSet(model_version, feature2id, keys, values,
+                            bytes_per_key, bytes_per_values, N);
+}
+
+Status CompactFeatureStore::BatchGetAsync(uint64_t model_version,
+                                          uint64_t feature2id,
+                                          const char* const keys,
+                                          char* const values,
+                                          size_t bytes_per_key,
+                                          size_t bytes_per_values,
+                                          size_t N,
+                                          const char* default_value,
+                                          BatchGetCallback cb) {
+  Status s = BatchGet(model_version, feature2id, keys, values,
+                      bytes_per_key, bytes_per_values, N, default_value);
+  cb(s);
+  return Status::OK();
+}
+
+Status CompactFeatureStore::BatchSetAsync(uint64_t model_version,
+                                          uint64_t feature2id,
+                                          const char* const keys,
+                                          const char* const values,
+                                          size_t bytes_per_key,
+                                          size_t bytes_per_values,
+                                          size_t N,
+                                          BatchSetCallback cb) {
+  Status s = BatchSet(model_version, feature2id, keys, values,
+                      bytes_per_key, bytes_per_values, N);
+  cb(s);
+  return Status::OK();
+}
+
+} // namespace processor
+} // namespace tensorflow
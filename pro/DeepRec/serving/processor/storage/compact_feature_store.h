@@ -0,0 +1,224 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef SERVING_PROCESSOR_STORAGE_COMPACT_FEATURE_STORE_H_
+#define SERVING_PROCESSOR_STORAGE_COMPACT_FEATURE_STORE_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "serving/processor/storage/feature_store.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace processor {
+
+// Read-only embedding table of one feature for serving. The rows never
+// change after the table is built, so there is no per-row header, lock or
+// allocation: the keys are kept in an open addressing index with linear
+// probing, each slot is a (key, row) pair, and the values are packed row
+// after row in one buffer.
+//
+// The whole table is a single image [header | slots | values], which can be
+// written to a file and mapped back by Load() without parsing.
+class CompactEmbeddingTable {
+ public:
+  ~CompactEmbeddingTable();
+
+  // Builds a table of 'N' rows, 'values' holds 'bytes_per_value' bytes for
+  // every key. The last row of a duplicated key wins.
+  static Status Build(const std::vector<int64>& keys, const char* values,
+                      size_t bytes_per_value,
+                      std::unique_ptr<CompactEmbeddingTable>* table);
+
+  // Maps a table written by Save() into memory.
+  static Status Load(Env* env, const std::string& fname,
+                     std::unique_ptr<CompactEmbeddingTable>* table);
+
+  Status Save(Env* env, const std::string& fname) const;
+
+  // Value of 'key', or nullptr if the key is not in the table.
+  const char* Find(int64 key) const;
+
+  // Find() of 'N' keys, the slots of the next keys are prefetched while the
+  // current one is probed.
+  void BatchFind(const int64* keys, size_t N, const char** rows) const;
+
+  void ForEachRow(const std::function<void(int64, const char*)>& fn) const;
+
+  int64 size() const;
+  size_t bytes_per_value() const;
+  // Bytes of the image, index and values included.
+  size_t MemoryBytes() const;
+
+ private:
+  struct Header;
+  struct Slot;
+
+  CompactEmbeddingTable() = default;
+  Status Init(const char* image, size_t image_bytes);
+
+  // Owned image of a built table, or the mapped file of a loaded one.
+  char* buffer_ = nullptr;
+  std::unique_ptr<ReadOnlyMemoryRegion> region_;
+
+  const Header* header_ = nullptr;
+  const Slot* slots_ = nullptr;
+  const char* values_ = nullptr;
+  uint64 mask_ = 0;
+  size_t image_bytes_ = 0;
+};
+
+// Tables of all features of one storage db, shared by the FeatureStores of
+// a FeatureStoreMgr and updated like a redis db: a full model is staged by
+// BatchSet and sealed into CompactEmbeddingTables by SetModelVersion, the
+// rows of a delta model are kept in an overlay over the tables.
+class CompactStorage {
+ public:
+  // The storage of 'db_idx', created on first use and released when the
+  // last FeatureStore of it is deleted. If 'dir' is not empty the sealed
+  // tables are written there and mapped back from the files.
+  static std::shared_ptr<CompactStorage> Get(size_t db_idx,
+                                             const std::string& dir);
+
+  CompactStorage(size_t db_idx, const std::string& dir);
+
+  Status Cleanup();
+  Status SetActiveStatus(bool active);
+  Status GetModelVersion(int64_t* full_version, int64_t* latest_version);
+  Status SetModelVersion(int64_t full_version, int64_t latest_version);
+  Status GetStorageLock(int value, bool* success);
+  Status ReleaseStorageLock(int value);
+
+  Status BatchGet(uint64_t model_version, uint64_t feature2id,
+                  const char* const keys, char* const values,
+                  size_t bytes_per_key, size_t bytes_per_values, size_t N,
+                  const char* default_value);
+  Status BatchSet(uint64_t model_version, uint64_t feature2id,
+                  const char* const keys, const char* const values,
+                  size_t bytes_per_key, size_t bytes_per_values, size_t N);
+
+ private:
+  // A sealed table and the rows of the delta models loaded after it.
+  struct Feature {
+    std::unique_ptr<CompactEmbeddingTable> table;
+    mutable mutex mu;
+    std::unordered_map<int64, size_t> overlay GUARDED_BY(mu);
+    std::vector<char> overlay_values GUARDED_BY(mu);
+    std::atomic<bool> has_overlay{false};
+  };
+
+  // Rows of a full model being loaded.
+  struct Staging {
+    std::vector<int64> keys;
+    std::vector<char> values;
+    size_t bytes_per_value = 0;
+  };
+
+  Status Stage(uint64_t model_version, uint64_t feature2id,
+               const std::vector<int64>& ids, const char* const values,
+               size_t bytes_per_values, size_t N)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  Status Seal(uint64 feature2id, Staging* staging,
+              std::shared_ptr<Feature>* feature);
+  // Rebuilds the table of 'feature' with its overlay merged.
+  Status Compact(uint64 feature2id, const Feature& feature,
+                 std::shared_ptr<Feature>* compacted);
+  // Moves 'table' into a file under dir_ and maps it, if dir_ is set.
+  Status MaybeMapFromFile(uint64 feature2id,
+                          std::unique_ptr<CompactEmbeddingTable>* table);
+
+  const size_t db_idx_;
+  const std::string dir_;
+
+  mutex mu_;
+  bool active_ GUARDED_BY(mu_) = false;
+  bool locked_ GUARDED_BY(mu_) = false;
+  int lock_value_ GUARDED_BY(mu_) = 0;
+  int64_t full_version_ GUARDED_BY(mu_) = -1;
+  int64_t latest_version_ GUARDED_BY(mu_) = -1;
+  std::unordered_map<uint64, std::shared_ptr<Feature>> features_
+      GUARDED_BY(mu_);
+  int64_t staging_version_ GUARDED_BY(mu_) = -1;
+  std::unordered_map<uint64, Staging> staging_ GUARDED_BY(mu_);
+};
+
+// FeatureStore of feature_store_type 'compact', the embeddings are kept in
+// the serving process in CompactEmbeddingTables instead of a remote redis.
+class CompactFeatureStore : public FeatureStore {
+ public:
+  CompactFeatureStore(size_t db_idx, const std::string& dir);
+  ~CompactFeatureStore() override {}
+
+  Status SetActiveStatus(bool active) override;
+  Status GetModelVersion(int64_t* full_version,
+                         int64_t* latest_version) override;
+  Status SetModelVersion(int64_t full_version,
+                         int64_t latest_version) override;
+  Status GetStorageLock(int value, int timeout, bool* success) override;
+  Status ReleaseStorageLock(int value) override;
+
+  Status Cleanup() override;
+
+  Status BatchGet(uint64_t model_version,
+                  uint64_t feature2id,
+                  const char* const keys,
+                  char* const values,
+                  size_t bytes_per_key,
+                  size_t bytes_per_values,
+                  size_t N,
+                  const char* default_value) override;
+
+  Status BatchSet(uint64_t model_version,
+                  uint64_t feature2id,
+                  const char* const keys,
+                  const char* const values,
+                  size_t bytes_per_key,
+                  size_t bytes_per_values,
+                  size_t N) override;
+
+  Status BatchGetAsync(uint64_t model_version,
+                       uint64_t feature2id,
+                       const char* const keys,
+                       char* const values,
+                       size_t bytes_per_key,
+                       size_t bytes_per_values,
+                       size_t N,
+                       const char* default_value,
+                       BatchGetCallback cb) override;
+
+  Status BatchSetAsync(uint64_t model_version,
+                       uint64_t feature2id,
+                       const char* const keys,
+                       const char* const values,
+                       size_t bytes_per_key,
+                       size_t bytes_per_values,
+                       size_t N,
+                       BatchSetCallback cb) override;
+
+ private:
+  std::shared_ptr<CompactStorage> storage_;
+};
+
+} // namespace processor
+} // namespace tensorflow
+
+#endif // SERVING_PROCESSOR_STORAGE_COMPACT_FEATURE_STORE_H_
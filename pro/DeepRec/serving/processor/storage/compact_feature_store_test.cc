@@ -0,0 +1,245 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "gtest/gtest.h"
+#include "serving/processor/storage/compact_feature_store.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace processor {
+
+namespace {
+
+const size_t kDim = 4;
+const size_t kBytes = kDim * sizeof(float);
+
+void MakeRows(int64 num, float base, std::vector<int64>* keys,
+              std::vector<float>* values) {
+  for (int64 i = 0; i < num; ++i) {
+    keys->push_back(i * 7);
+    for (size_t j = 0; j < kDim; ++j) {
+      values->push_back(base + i + j * 0.1f);
+    }
+  }
+}
+
+void ExpectRow(const char* row, float base, int64 i) {
+  ASSERT_NE(row, nullptr);
+  const float* v = reinterpret_cast<const float*>(row);
+  for (size_t j = 0; j < kDim; ++j) {
+    EXPECT_FLOAT_EQ(v[j], base + i + j * 0.1f);
+  }
+}
+
+} // namespace
+
+TEST(CompactEmbeddingTableTest, BuildAndFind) {
+  std::vector<int64> keys;
+  std::vector<float> values;
+  MakeRows(1000, 1.0, &keys, &values);
+  std::unique_ptr<CompactEmbeddingTable> table;
+  TF_ASSERT_OK(CompactEmbeddingTable::Build(
+      keys, reinterpret_cast<const char*>(values.data()), kBytes, &table));
+  EXPECT_EQ(table->size(), 1000);
+  EXPECT_EQ(table->bytes_per_value(), kBytes);
+
+  for (int64 i = 0; i < 1000; ++i) {
+    ExpectRow(table->Find(i * 7), 1.0, i);
+  }
+  EXPECT_EQ(table->Find(1), nullptr);
+  EXPECT_EQ(table->Find(-1), nullptr);
+
+  std::vector<int64> lookup = {7, 3, 6993, 0};
+  std::vector<const char*> rows(lookup.size());
+  table->BatchFind(lookup.data(), lookup.size(), rows.data());
+  ExpectRow(rows[0], 1.0, 1);
+  EXPECT_EQ(rows[1], nullptr);
+  ExpectRow(rows[2], 1.0, 999);
+  ExpectRow(rows[3], 1.0, 0);
+}
+
+TEST(CompactEmbeddingTableTest, DuplicatedKeys) {
+  std::vector<int64> keys = {5, 9, 5};
+  std::vector<float> values = {1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3};
+  std::unique_ptr<CompactEmbeddingTable> table;
+  TF_ASSERT_OK(CompactEmbeddingTable::Build(
+      keys, reinterpret_cast<const char*>(values.data()), kBytes, &table));
+  EXPECT_EQ(table->size(), 2);
+  EXPECT_FLOAT_EQ(reinterpret_cast<const float*>(table->Find(5))[0], 3);
+  EXPECT_FLOAT_EQ(reinterpret_cast<const float*>(table->Find(9))[0], 2);
+
+  int64 rows = 0;
+  table->ForEachRow([&rows](int64 key, const char* value) { ++rows; });
+  EXPECT_EQ(rows, 2);
+}
+
+TEST(CompactEmbeddingTableTest, SaveAndLoad) {
+  std::vector<int64> keys;
+  std::vector<float> values;
+  MakeRows(100, 2.0, &keys, &values);
+  std::unique_ptr<CompactEmbeddingTable> table;
+  TF_ASSERT_OK(CompactEmbeddingTable::Build(
+      keys, reinterpret_cast<const char*>(values.data()), kBytes, &table));
+
+  Env* env = Env::Default();
+  const std::string fname =
+      io::JoinPath(testing::TmpDir(), "compact_table_test.table");
+  TF_ASSERT_OK(table->Save(env, fname));
+  std::unique_ptr<CompactEmbeddingTable> loaded;
+  TF_ASSERT_OK(CompactEmbeddingTable::Load(env, fname, &loaded));
+  EXPECT_EQ(loaded->size(), 100);
+  EXPECT_EQ(loaded->MemoryBytes(), table->MemoryBytes());
+  for (int64 i = 0; i < 100; ++i) {
+    ExpectRow(loaded->Find(i * 7), 2.0, i);
+  }
+  EXPECT_EQ(loaded->Find(8), nullptr);
+
+  const std::string bad_fname =
+      io::JoinPath(testing::TmpDir(), "compact_table_test.bad");
+  TF_ASSERT_OK(WriteStringToFile(env, bad_fname, "not a compact table"));
+  EXPECT_FALSE(CompactEmbeddingTable::Load(env, bad_fname, &loaded).ok());
+}
+
+class CompactFeatureStoreTest : public ::testing::TestWithParam<bool> {
+ protected:
+  std::string Dir() {
+    return GetParam() ? io::JoinPath(testing::TmpDir(), "compact_store")
+                      : "";
+  }
+};
+
+TEST_P(CompactFeatureStoreTest, FullAndDeltaModel) {
+  CompactFeatureStore store(0, Dir());
+  TF_ASSERT_OK(store.Cleanup());
+  std::vector<int64> keys;
+  std::vector<float> values;
+  MakeRows(100, 1.0, &keys, &values);
+  std::vector<float> defaults(kDim, -1.0);
+
+  // Full model 10, written in two batches.
+  TF_ASSERT_OK(store.BatchSet(10, 1, reinterpret_cast<char*>(keys.data()),
+                              reinterpret_cast<char*>(values.data()),
+                              sizeof(int64), kBytes, 60));
+  TF_ASSERT_OK(store.BatchSet(10, 1,
+                              reinterpret_cast<char*>(keys.data() + 60),
+                              reinterpret_cast<char*>(values.data() +
+                                                      60 * kDim),
+                              sizeof(int64), kBytes, 40));
+
+  std::vector<int64> lookup = {0, 7, 693, 1};
+  std::vector<float> out(lookup.size() * kDim);
+  // Not served before its version is set.
+  TF_ASSERT_OK(store.BatchGet(10, 1, reinterpret_cast<char*>(lookup.data()),
+                              reinterpret_cast<char*>(out.data()),
+                              sizeof(int64), kBytes, lookup.size(),
+                              reinterpret_cast<char*>(defaults.data())));
+  EXPECT_FLOAT_EQ(out[0], -1.0);
+
+  TF_ASSERT_OK(store.SetModelVersion(10, 0));
+  int64_t full_version, latest_version;
+  TF_ASSERT_OK(store.GetModelVersion(&full_version, &latest_version));
+  EXPECT_EQ(full_version, 10);
+  EXPECT_EQ(latest_version, 0);
+
+  TF_ASSERT_OK(store.BatchGet(10, 1, reinterpret_cast<char*>(lookup.data()),
+                              reinterpret_cast<char*>(out.data()),
+                              sizeof(int64), kBytes, lookup.size(),
+                              reinterpret_cast<char*>(defaults.data())));
+  ExpectRow(reinterpret_cast<char*>(out.data()), 1.0, 0);
+  ExpectRow(reinterpret_cast<char*>(out.data() + kDim), 1.0, 1);
+  ExpectRow(reinterpret_cast<char*>(out.data() + 2 * kDim), 1.0, 99);
+  EXPECT_FLOAT_EQ(out[3 * kDim], -1.0);
+
+  // Delta model 11 of full model 10 updates key 7 and adds key 1.
+  std::vector<int32> delta_keys = {7, 1};
+  std::vector<float> delta_values(2 * kDim, 5.0);
+  TF_ASSERT_OK(store.BatchSet(10, 1,
+                              reinterpret_cast<char*>(delta_keys.data()),
+                              reinterpret_cast<char*>(delta_values.data()),
+                              sizeof(int32), kBytes, 2));
+  TF_ASSERT_OK(store.SetModelVersion(10, 11));
+  TF_ASSERT_OK(store.BatchGet(10, 1, reinterpret_cast<char*>(lookup.data()),
+                              reinterpret_cast<char*>(out.data()),
+                              sizeof(int64), kBytes, lookup.size(),
+                              reinterpret_cast<char*>(defaults.data())));
+  ExpectRow(reinterpret_cast<char*>(out.data()), 1.0, 0);
+  EXPECT_FLOAT_EQ(out[kDim], 5.0);
+  ExpectRow(reinterpret_cast<char*>(out.data() + 2 * kDim), 1.0, 99);
+  EXPECT_FLOAT_EQ(out[3 * kDim], 5.0);
+
+  // Another version or feature is not found.
+  TF_ASSERT_OK(store.BatchGet(9, 1, reinterpret_cast<char*>(lookup.data()),
+                              reinterpret_cast<char*>(out.data()),
+                              sizeof(int64), kBytes, lookup.size(),
+                              reinterpret_cast<char*>(defaults.data())));
+  EXPECT_FLOAT_EQ(out[0], -1.0);
+  TF_ASSERT_OK(store.BatchGet(10, 2, reinterpret_cast<char*>(lookup.data()),
+                              reinterpret_cast<char*>(out.data()),
+                              sizeof(int64), kBytes, lookup.size(),
+                              reinterpret_cast<char*>(defaults.data())));
+  EXPECT_FLOAT_EQ(out[0], -1.0);
+
+  // Wrong value size.
+  EXPECT_FALSE(store.BatchGet(10, 1, reinterpret_cast<char*>(lookup.data()),
+                              reinterpret_cast<char*>(out.data()),
+                              sizeof(int64), kBytes / 2, lookup.size(),
+                              reinterpret_cast<char*>(defaults.data()))
+                   .ok());
+
+  TF_ASSERT_OK(store.Cleanup());
+  TF_ASSERT_OK(store.GetModelVersion(&full_version, &latest_version));
+  EXPECT_EQ(full_version, -1);
+}
+
+TEST_P(CompactFeatureStoreTest, SharedStorageAndLock) {
+  CompactFeatureStore store0(1, Dir());
+  CompactFeatureStore store1(1, Dir());
+  TF_ASSERT_OK(store0.Cleanup());
+  std::vector<int64> keys = {3};
+  std::vector<float> values(kDim, 7.0);
+  TF_ASSERT_OK(store0.BatchSet(20, 1, reinterpret_cast<char*>(keys.data()),
+                               reinterpret_cast<char*>(values.data()),
+                               sizeof(int64), kBytes, 1));
+  TF_ASSERT_OK(store1.SetModelVersion(20, 0));
+
+  std::vector<float> out(kDim);
+  std::vector<float> defaults(kDim, -1.0);
+  TF_ASSERT_OK(store1.BatchGet(20, 1, reinterpret_cast<char*>(keys.data()),
+                               reinterpret_cast<char*>(out.data()),
+                               sizeof(int64), kBytes, 1,
+                               reinterpret_cast<char*>(defaults.data())));
+  EXPECT_FLOAT_EQ(out[0], 7.0);
+
+  bool success = false;
+  TF_ASSERT_OK(store0.GetStorageLock(1, 10, &success));
+  EXPECT_TRUE(success);
+  TF_ASSERT_OK(store1.GetStorageLock(2, 10, &success));
+  EXPECT_FALSE(success);
+  TF_ASSERT_OK(store1.ReleaseStorageLock(2));
+  TF_ASSERT_OK(store1.GetStorageLock(2, 10, &success));
+  EXPECT_FALSE(success);
+  TF_ASSERT_OK(store0.ReleaseStorageLock(1));
+  TF_ASSERT_OK(store1.GetStorageLock(2, 10, &success));
+  EXPECT_TRUE(success);
+  TF_ASSERT_OK(store1.ReleaseStorageLock(2));
+}
+
+INSTANTIATE_TEST_CASE_P(InMemoryAndMapped, CompactFeatureStoreTest,
+                        ::testing::Values(false, true));
+
+} // namespace processor
+} // namespace tensorflow
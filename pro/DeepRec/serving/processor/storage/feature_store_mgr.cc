@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 
 #include "serving/processor/storage/feature_store_mgr.h"
+#include "serving/processor/storage/compact_feature_store.h"
 #include "serving/processor/serving/model_config.h"
 #include "absl/synchronization/mutex.h"
 #include "tensorflow/core/platform/logging.h"
@@ -124,6 +125,9 @@ FeatureStore* CreateFeatureStore(ModelConfig* config) {
     redis_config.db_idx = config->redis_db_idx;
 
     return new LocalRedis(redis_config);
+  } else if (config->feature_store_type == "compact") {
+    return new CompactFeatureStore(config->redis_db_idx,
+                                   config->compact_storage_dir);
   } else {
     LOG(ERROR) << "Only LocalRedis backend now. type = "
                << config->feature_store_type;
@@ -444,6 +448,10 @@ void FeatureStoreMgr::GetStorageOptions(
                                   is_init_storage);
     *bak_opt = new StorageOptions(bak_db, bak_db,
                                   is_init_storage);
+  } else if (storage_type_ == "compact") {
+    // Compact storages live in this process and are empty at start.
+    *cur_opt = new StorageOptions(0, 0, true);
+    *bak_opt = new StorageOptions(1, 1, true);
   }
 }
 
@@ -120,8 +120,9 @@ seastar::future<> SeastarServer::Connection::ReapeatReadTensors(
           delete count;
           delete idx;
           if (!(*error)) {
-            tag->ParseTensor();
-            tag->RecvReqDone(tensorflow::Status());
+            // A feed that fails to decode fails the request, the error
+            // is sent back to the client.
+            tag->RecvReqDone(tag->ParseTensor());
           }
           delete error;
           return true;
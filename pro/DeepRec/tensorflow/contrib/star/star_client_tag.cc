@@ -94,6 +94,7 @@ void InitStarClientTag(protobuf::Message* request,
 
       response->SetIsDead(sm.is_dead_);
       response->SetDataType(sm.data_type_);
+      response->SetCodec(sm.codec_);
       bool can_memcpy = DataTypeCanUseMemcpy(sm.data_type_);
 
       if (can_memcpy) {
@@ -126,6 +127,7 @@ void InitStarClientTag(protobuf::Message* request,
 
           response->SetTensor(val);
         }
+        StarMessage::PrepareCompressedTensorBuf(sm, &tag->resp_tensor_bufs_[idx]);
       } else {
         // LOG(INFO) << "parse msg, could not memcpy, tensor bytes: " << sm.tensor_bytes_
         //          << ",request:" << request->DebugString();
@@ -149,6 +151,19 @@ void InitStarClientTag(protobuf::Message* request,
                     return;
                   }
 
+                  if (response->GetCodec() != kStarCodecNone) {
+                    Status status = StarMessage::DecompressTensor(
+                        response->GetCodec(), tag->resp_tensor_bufs_[0],
+                        response->GetTensor());
+                    if (!status.ok()) {
+                      LOG(ERROR) << "wrapper_done, decode tensor failed: "
+                                 << status.error_message();
+                      done(status);
+                      delete tag;
+                      return;
+                    }
+                  }
+
                   bool can_memcpy = DataTypeCanUseMemcpy(response->GetDataType());
                   if (can_memcpy) {
                     if (response->GetDevice()->tensorflow_gpu_device_info() &&
@@ -237,6 +252,7 @@ void InitStarClientTag(protobuf::Message* request,
 
       response->SetIsDeadByIndex(idx, sm.is_dead_);
       response->SetDataTypeByIndex(idx, sm.data_type_);
+      response->SetCodecByIndex(idx, sm.codec_);
       bool can_memcpy = DataTypeCanUseMemcpy(sm.data_type_);
 
       if (can_memcpy) {
@@ -263,6 +279,7 @@ void InitStarClientTag(protobuf::Message* request,
 
           response->SetTensorByIndex(idx, val);
         }
+        StarMessage::PrepareCompressedTensorBuf(sm, &tag->resp_tensor_bufs_[idx]);
       } else {
         tag->resp_tensor_bufs_[idx].len_ = sm.tensor_bytes_;
         tag->resp_tensor_bufs_[idx].data_ = new char[tag->resp_tensor_bufs_[idx].len_]();
@@ -284,6 +301,23 @@ void InitStarClientTag(protobuf::Message* request,
                   }
 
                   int resp_tensor_count = tag->resp_tensor_count_;
+                  for (int idx = 0; idx < resp_tensor_count; ++idx) {
+                    if (response->GetCodecByIndex(idx) == kStarCodecNone) {
+                      continue;
+                    }
+                    Status status = StarMessage::DecompressTensor(
+                        response->GetCodecByIndex(idx),
+                        tag->resp_tensor_bufs_[idx],
+                        response->GetTensorByIndex(idx));
+                    if (!status.ok()) {
+                      LOG(ERROR) << "wrapper_done, decode tensor failed: "
+                                 << status.error_message();
+                      done(status);
+                      delete tag;
+                      return;
+                    }
+                  }
+
                   int *resp_tensor_counter = new int(resp_tensor_count);
 
                   for (int idx = 0; idx < resp_tensor_count; ++idx) {
@@ -379,7 +413,9 @@ void InitStarClientTag(StarRunGraphRequest* request,
       += StarMessage::SerializeTensorMessage(request->feed_tensors_[i],
                                              tensor_proto, request->is_dead_[i],
                                              &tag->req_message_bufs_[i],
-                                             &tag->req_tensor_bufs_[i]);
+                                             &tag->req_tensor_bufs_[i],
+                                             StarTensorCompression::Get()->CodecForKey(
+                                                 request->feed_names_[i]));
   }
   memcpy(tag->req_header_buf_.data_ + StarClientTag::kPayloadLenIndex,
          &payload_size, 8);
@@ -409,6 +445,7 @@ void InitStarClientTag(StarRunGraphRequest* request,
 
     response->is_dead_.push_back(sm.is_dead_);
     response->data_type_.push_back(sm.data_type_);
+    response->codec_.push_back(sm.codec_);
 
     bool can_memcpy = DataTypeCanUseMemcpy(sm.data_type_);
     if (can_memcpy) {
@@ -419,6 +456,7 @@ void InitStarClientTag(StarRunGraphRequest* request,
       tag->resp_tensor_bufs_[idx].owned_ = false;
 
       response->fetch_tensors_[idx] = val;
+      StarMessage::PrepareCompressedTensorBuf(sm, &tag->resp_tensor_bufs_[idx]);
     } else {
       tag->resp_tensor_bufs_[idx].len_ = sm.tensor_bytes_;
       tag->resp_tensor_bufs_[idx].data_ = new char[tag->resp_tensor_bufs_[idx].len_]();
@@ -438,6 +476,18 @@ void InitStarClientTag(StarRunGraphRequest* request,
         bool can_memcpy = DataTypeCanUseMemcpy(response->data_type_[i]);
         if (can_memcpy) {
           // TODO: impl GPU device here
+          if (response->codec_[i] != kStarCodecNone) {
+            Status status = StarMessage::DecompressTensor(
+                response->codec_[i], tag->resp_tensor_bufs_[i],
+                response->fetch_tensors_[i]);
+            if (!status.ok()) {
+              LOG(ERROR) << "Failed to decode tensor, err msg: "
+                         << status.error_message().c_str();
+              done(status);
+              delete tag;
+              return;
+            }
+          }
         } else {
           TensorProto tensor_proto;
           ParseProtoUnlimited(&tensor_proto,
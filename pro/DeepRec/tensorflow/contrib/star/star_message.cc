@@ -12,6 +12,7 @@ void StarMessage::DeserializeMessage(StarMessage* sm, const char* message) {
          sizeof(sm->tensor_shape_));
   memcpy(&sm->tensor_bytes_, &message[kTensorBytesStartIndex],
          sizeof(sm->tensor_bytes_));
+  memcpy(&sm->codec_, &message[kCodecStartIndex], sizeof(sm->codec_));
 }
 
 void StarMessage::SerializeMessage(const StarMessage& sm, char* message) {
@@ -24,20 +25,33 @@ void StarMessage::SerializeMessage(const StarMessage& sm, char* message) {
          sizeof(sm.tensor_shape_));
   memcpy(&message[kTensorBytesStartIndex], &sm.tensor_bytes_,
            sizeof(sm.tensor_bytes_));
+  memcpy(&message[kCodecStartIndex], &sm.codec_, sizeof(sm.codec_));
 }
 
 uint64_t StarMessage::SerializeTensorMessage(
     const Tensor& in, const TensorProto& inp,
     bool is_dead, StarBuf* message_buf,
-    StarBuf* tensor_buf) {
+    StarBuf* tensor_buf,
+    StarTensorCodec codec) {
   StarMessage sm;
   sm.tensor_shape_ = in.shape();
   sm.data_type_ = in.dtype();
   sm.is_dead_ = is_dead;
 
   bool can_memcpy = DataTypeCanUseMemcpy(sm.data_type_);
+  StarTensorCompression* compression = StarTensorCompression::Get();
+  if (!is_dead) {
+    sm.codec_ = compression->CodecForTensor(codec, in);
+  }
+
+  if (sm.codec_ != kStarCodecNone) {
+    sm.tensor_bytes_ = StarTensorCompression::EncodedBytes(sm.codec_, in);
 
-  if (can_memcpy) {
+    tensor_buf->len_ = sm.tensor_bytes_;
+    tensor_buf->data_ = new char[tensor_buf->len_];
+    tensor_buf->owned_ = true;
+    compression->Encode(sm.codec_, in, tensor_buf->data_);
+  } else if (can_memcpy) {
     sm.tensor_bytes_ = in.TotalBytes();
 
     tensor_buf->len_ = sm.tensor_bytes_;
@@ -58,4 +72,22 @@ uint64_t StarMessage::SerializeTensorMessage(
   return StarMessage::kMessageTotalBytes + sm.tensor_bytes_;
 }
 
+void StarMessage::PrepareCompressedTensorBuf(const StarMessage& sm,
+                                             StarBuf* tensor_buf) {
+  if (sm.codec_ != kStarCodecNone) {
+    tensor_buf->len_ = sm.tensor_bytes_;
+    tensor_buf->data_ = new char[tensor_buf->len_];
+    tensor_buf->owned_ = true;
+  }
+}
+
+Status StarMessage::DecompressTensor(StarTensorCodec codec,
+                                     const StarBuf& tensor_buf,
+                                     const Tensor& out) {
+  // Tensor shares the buffer of `out`.
+  Tensor val(out);
+  return StarTensorCompression::Get()->Decode(codec, tensor_buf.data_,
+                                              tensor_buf.len_, &val);
+}
+
 } // namespace tensorflow
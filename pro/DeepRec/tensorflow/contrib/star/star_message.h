@@ -6,6 +6,7 @@
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/contrib/star/star_tensor_coding.h"
+#include "tensorflow/contrib/star/star_tensor_compression.h"
 
 
 namespace tensorflow {
@@ -17,11 +18,13 @@ struct StarMessage {
   DataType data_type_;
   TensorShape tensor_shape_;
   uint64_t tensor_bytes_;
+  // Wire codec of tensor_buffer, tensor_bytes is the encoded size.
+  StarTensorCodec codec_ = kStarCodecNone;
 
   // |is_dead|...
   // |    1B |...
-  // ...|data_type|tensor_shape|tensor_bytes|tensor_buffer
-  // ...|   XB    |    XB      |    8B      |...
+  // ...|data_type|tensor_shape|tensor_bytes|codec|tensor_buffer
+  // ...|   XB    |    XB      |    8B      | 1B  |...
 
   static const size_t kIsDeadStartIndex = 0;
   static const size_t kDataTypeStartIndex =
@@ -30,8 +33,10 @@ struct StarMessage {
       kDataTypeStartIndex + sizeof(data_type_);
   static const size_t kTensorBytesStartIndex =
       kTensorShapeStartIndex + sizeof(TensorShape);
-  static const size_t kTensorBufferStartIndex =
+  static const size_t kCodecStartIndex =
       kTensorBytesStartIndex + sizeof(tensor_bytes_);
+  static const size_t kTensorBufferStartIndex =
+      kCodecStartIndex + sizeof(codec_);
   static const size_t kMessageTotalBytes = kTensorBufferStartIndex;
   static const size_t kStarMessageBufferSize = kMessageTotalBytes;
   static void SerializeMessage(const StarMessage& rm, char* data);
@@ -39,7 +44,16 @@ struct StarMessage {
   static uint64_t SerializeTensorMessage(
       const Tensor& in, const TensorProto& inp,
       bool is_dead, StarBuf* message_buf,
-      StarBuf* tensor_buf);
+      StarBuf* tensor_buf,
+      StarTensorCodec codec = kStarCodecNone);
+  // Compressed tensor is received into an owned staging buffer instead of
+  // the tensor itself, DecompressTensor decodes it into the tensor once the
+  // whole buffer is received.
+  static void PrepareCompressedTensorBuf(const StarMessage& sm,
+                                         StarBuf* tensor_buf);
+  static Status DecompressTensor(StarTensorCodec codec,
+                                 const StarBuf& tensor_buf,
+                                 const Tensor& out);
 };
 
 } // namespace tensorflow
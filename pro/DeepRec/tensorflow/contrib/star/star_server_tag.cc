@@ -4,6 +4,7 @@
 #include "tensorflow/contrib/star/star_worker_service.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
 #include "tensorflow/core/framework/rendezvous.h"
+#include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/platform/logging.h"
 
 
@@ -81,7 +82,8 @@ void InitStarServerTag(protobuf::Message* request,
                                               response->GetTensorProto(),
                                               response->GetIsDead(),
                                               &tag->resp_message_bufs_[0],
-                                              &tag->resp_tensor_bufs_[0]);
+                                              &tag->resp_tensor_bufs_[0],
+                                              response->GetCodec());
       memcpy(tag->resp_header_buf_.data_ + StarServerTag::kPayloadLenIndex,
              &payload_len, 8);
 
@@ -130,7 +132,8 @@ void InitStarServerTag(protobuf::Message* request,
                                                  response->GetTensorProtoByIndex(idx),
                                                  response->GetIsDeadByIndex(idx),
                                                  &tag->resp_message_bufs_[idx],
-                                                 &tag->resp_tensor_bufs_[idx]);
+                                                 &tag->resp_tensor_bufs_[idx],
+                                                 response->GetCodecByIndex(idx));
       }
       memcpy(tag->resp_header_buf_.data_ + StarServerTag::kPayloadLenIndex,
              &payload_len, 8);
@@ -167,6 +170,7 @@ void InitStarServerTag(StarServerTag* tag) {
     StarMessage::DeserializeMessage(&sm, tensor_msg);
     tag->star_graph_request_.is_dead_.push_back(sm.is_dead_);
     tag->star_graph_request_.data_type_.push_back(sm.data_type_);
+    tag->star_graph_request_.codec_.push_back(sm.codec_);
     bool can_memcpy = DataTypeCanUseMemcpy(sm.data_type_);
     if (can_memcpy) {
       //TODO: Implement GPU device here
@@ -175,6 +179,7 @@ void InitStarServerTag(StarServerTag* tag) {
       tag->req_tensor_bufs_[idx].len_ =  sm.tensor_bytes_;
       tag->req_tensor_bufs_[idx].owned_ = false;
       tag->star_graph_request_.feed_tensors_[idx] = val;
+      StarMessage::PrepareCompressedTensorBuf(sm, &tag->req_tensor_bufs_[idx]);
     } else {
       tag->req_tensor_bufs_[idx].len_ = sm.tensor_bytes_;
       tag->req_tensor_bufs_[idx].data_ = new char[tag->req_tensor_bufs_[idx].len_]();
@@ -190,6 +195,17 @@ void InitStarServerTag(StarServerTag* tag) {
       bool can_memcpy = DataTypeCanUseMemcpy(tag->star_graph_request_.data_type_[i]);
       if (can_memcpy) {
         //TODO: Implement GPU device here
+        if (tag->star_graph_request_.codec_[i] != kStarCodecNone) {
+          Status s = StarMessage::DecompressTensor(
+              tag->star_graph_request_.codec_[i], tag->req_tensor_bufs_[i],
+              tag->star_graph_request_.feed_tensors_[i]);
+          if (!s.ok()) {
+            return errors::Internal(
+                "Decode tensor failed, feed name is : ",
+                tag->star_graph_request_.feed_names_[i], ", ",
+                s.error_message());
+          }
+        }
       } else {
         TensorProto tensor_proto;
         ParseProtoUnlimited(&tensor_proto,
@@ -201,12 +217,14 @@ void InitStarServerTag(StarServerTag* tag) {
         tag->star_worker_service_->GetWorker()->env() \
            ->device_mgr->LookupDevice(parsed_key.src_device, &device);
         if (device == nullptr) {
-          LOG(FATAL) << "Not found device, feed name is : " << tag->star_graph_request_.feed_names_[i];
+          return errors::Internal(
+              "Not found device, feed name is : ",
+              tag->star_graph_request_.feed_names_[i]);
         }
 
         Tensor val;
-        Status status = device->MakeTensorFromProto(
-          tensor_proto, AllocatorAttributes(), &val);
+        TF_RETURN_IF_ERROR(device->MakeTensorFromProto(
+          tensor_proto, AllocatorAttributes(), &val));
         tag->star_graph_request_.feed_tensors_[i] = val;
       }
     }
@@ -280,7 +298,9 @@ void StarServerTag::FillRespBody() {
                                              tensor_proto,
                                              star_graph_response_.is_dead_[i],
                                              &resp_message_bufs_[i],
-                                             &resp_tensor_bufs_[i]);
+                                             &resp_tensor_bufs_[i],
+                                             StarTensorCompression::Get()->CodecForKey(
+                                                 star_graph_response_.fetch_names_[i]));
   }
 
   memcpy(resp_header_buf_.data_ + StarServerTag::kPayloadLenIndex,
@@ -23,6 +23,7 @@ void StarTensorResponse::Clear() {
   allocator_ = nullptr;
   tensor_ = Tensor();
   tensor_proto_ = TensorProto();
+  codec_ = kStarCodecNone;
 }
 
 void StarFuseTensorResponse::Clear() {
@@ -31,6 +32,7 @@ void StarFuseTensorResponse::Clear() {
   tensors_.clear();
   tensor_protos_.clear();
   is_deads_.clear();
+  codecs_.clear();
 }
 
 void StarRunGraphRequest::EncodeRequest(StarBuf* star_buf) {
@@ -1,6 +1,7 @@
 #ifndef TENSORFLOW_CONTRIB_STAR_STAR_TENSOR_CODING_H_
 #define TENSORFLOW_CONTRIB_STAR_STAR_TENSOR_CODING_H_
 
+#include "tensorflow/contrib/star/star_tensor_compression.h"
 #include "tensorflow/core/common_runtime/device.h"
 #include "tensorflow/core/distributed_runtime/call_options.h"
 #include "tensorflow/core/framework/allocator.h"
@@ -41,6 +42,11 @@ public:
   void SetDataType(DataType data_type) { data_type_ = data_type; }
   DataType GetDataType() { return data_type_; }
 
+  // Wire codec, set from the rendezvous key by the sender and from the
+  // message by the receiver.
+  void SetCodec(StarTensorCodec codec) { codec_ = codec; }
+  StarTensorCodec GetCodec() const { return codec_; }
+
  private:
   bool is_dead_ = false;
   bool on_host_ = false;
@@ -53,6 +59,7 @@ public:
   Tensor tensor_;
   TensorProto tensor_proto_;
   DataType data_type_;
+  StarTensorCodec codec_ = kStarCodecNone;
 };
 
 class StarFuseTensorResponse : public StarTensorResponse {
@@ -66,6 +73,7 @@ class StarFuseTensorResponse : public StarTensorResponse {
     tensor_protos_.resize(fuse_count_);
     data_types_.resize(fuse_count_);
     is_deads_.resize(fuse_count_);
+    codecs_.resize(fuse_count_, kStarCodecNone);
   }
 
   int GetFuseCount() { return fuse_count_; }
@@ -85,12 +93,16 @@ class StarFuseTensorResponse : public StarTensorResponse {
   void SetDataTypeByIndex(int idx, DataType data_type) { data_types_[idx] = data_type; }
   DataType GetDataTypeByIndex(int idx) { return data_types_[idx]; }
 
+  void SetCodecByIndex(int idx, StarTensorCodec codec) { codecs_[idx] = codec; }
+  StarTensorCodec GetCodecByIndex(int idx) const { return codecs_[idx]; }
+
  private:
   int fuse_count_;
   std::vector<Tensor> tensors_;
   std::vector<TensorProto> tensor_protos_;
   std::vector<DataType> data_types_;
   std::vector<bool> is_deads_;
+  std::vector<StarTensorCodec> codecs_;
 };
 
 typedef int32 CounterType;
@@ -108,6 +120,7 @@ struct StarRunGraphRequest {
   std::vector<std::string> fetch_names_;
   std::vector<bool> is_dead_;
   std::vector<DataType> data_type_;
+  std::vector<StarTensorCodec> codec_;
   int ps_graph_count_;
   // Tracing: should tracing recv wait time
   bool should_tracing_;
@@ -126,6 +139,7 @@ struct StarRunGraphResponse {
   std::vector<Tensor> fetch_tensors_;
   std::vector<bool> is_dead_;
   std::vector<DataType> data_type_;
+  std::vector<StarTensorCodec> codec_;
 };
 
 }  // namespace tensorflow
@@ -0,0 +1,262 @@
+#include "tensorflow/contrib/star/star_tensor_compression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/bfloat16.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/env_var.h"
+
+
+namespace tensorflow {
+
+namespace {
+
+auto* star_compression_raw_bytes = monitoring::Counter<1>::New(
+    "/tensorflow/contrib/star/compression/raw_bytes",
+    "Bytes of the tensors before compression.", "codec");
+auto* star_compression_encoded_bytes = monitoring::Counter<1>::New(
+    "/tensorflow/contrib/star/compression/encoded_bytes",
+    "Bytes of the tensors after compression.", "codec");
+auto* star_compression_encode_micros = monitoring::Counter<1>::New(
+    "/tensorflow/contrib/star/compression/encode_micros",
+    "Time spent on encoding the tensors.", "codec");
+
+const int64 kLogEveryTensors = 10000;
+
+typedef Eigen::Array<float, Eigen::Dynamic, 1> FloatArray;
+typedef Eigen::Array<Eigen::half, Eigen::Dynamic, 1> HalfArray;
+typedef Eigen::Array<int8, Eigen::Dynamic, 1> Int8Array;
+
+// Rows of the int8 codec, each row has its own scale.
+void RowsOf(const Tensor& val, int64* rows, int64* row_size) {
+  const int64 n = val.NumElements();
+  if (val.dims() < 2 || val.dim_size(0) == 0) {
+    *rows = 1;
+    *row_size = n;
+  } else {
+    *rows = val.dim_size(0);
+    *row_size = n / *rows;
+  }
+}
+
+} // namespace
+
+StarTensorCompression* StarTensorCompression::Get() {
+  static StarTensorCompression* instance = new StarTensorCompression();
+  return instance;
+}
+
+StarTensorCompression::StarTensorCompression()
+    : codec_(kStarCodecNone), min_bytes_(1024) {
+  string codec;
+  ReadStringFromEnvVar("TF_STAR_TENSOR_COMPRESSION", "none", &codec);
+  if (codec == "fp16") {
+    codec_ = kStarCodecFp16;
+  } else if (codec == "bf16") {
+    codec_ = kStarCodecBf16;
+  } else if (codec == "int8") {
+    codec_ = kStarCodecInt8;
+  } else if (codec != "none") {
+    LOG(WARNING) << "Unknown TF_STAR_TENSOR_COMPRESSION: " << codec
+                 << ", tensor compression is disabled.";
+  }
+
+  string keys;
+  ReadStringFromEnvVar("TF_STAR_TENSOR_COMPRESSION_KEYS", "", &keys);
+  key_patterns_ = str_util::Split(keys, ',', str_util::SkipEmpty());
+
+  Status s = ReadInt64FromEnvVar("TF_STAR_TENSOR_COMPRESSION_MIN_BYTES",
+                                 1024, &min_bytes_);
+  if (!s.ok()) {
+    LOG(ERROR) << "Read TF_STAR_TENSOR_COMPRESSION_MIN_BYTES failed: " << s;
+  }
+
+  if (codec_ != kStarCodecNone) {
+    LOG(INFO) << "Star tensor compression enabled, codec: "
+              << CodecName(codec_) << ", key patterns: " << keys
+              << ", min bytes: " << min_bytes_;
+  }
+}
+
+const char* StarTensorCompression::CodecName(StarTensorCodec codec) {
+  switch (codec) {
+    case kStarCodecFp16:
+      return "fp16";
+    case kStarCodecBf16:
+      return "bf16";
+    case kStarCodecInt8:
+      return "int8";
+    default:
+      return "none";
+  }
+}
+
+StarTensorCodec StarTensorCompression::CodecForKey(const string& key) const {
+  if (codec_ == kStarCodecNone || key_patterns_.empty()) {
+    return codec_;
+  }
+  for (auto& pattern : key_patterns_) {
+    if (key.find(pattern) != string::npos) {
+      return codec_;
+    }
+  }
+  return kStarCodecNone;
+}
+
+StarTensorCodec StarTensorCompression::CodecForTensor(
+    StarTensorCodec codec, const Tensor& val) const {
+  if (codec == kStarCodecNone || val.dtype() != DT_FLOAT ||
+      static_cast<int64>(val.TotalBytes()) < min_bytes_) {
+    return kStarCodecNone;
+  }
+  return codec;
+}
+
+uint64 StarTensorCompression::EncodedBytes(StarTensorCodec codec,
+                                           const Tensor& val) {
+  const int64 n = val.NumElements();
+  switch (codec) {
+    case kStarCodecFp16:
+      return n * sizeof(Eigen::half);
+    case kStarCodecBf16:
+      return n * sizeof(bfloat16);
+    case kStarCodecInt8: {
+      int64 rows, row_size;
+      RowsOf(val, &rows, &row_size);
+      return rows * sizeof(float) + n * sizeof(int8);
+    }
+    default:
+      return val.TotalBytes();
+  }
+}
+
+void StarTensorCompression::Encode(StarTensorCodec codec, const Tensor& val,
+                                   char* out) {
+  const uint64 start = Env::Default()->NowMicros();
+  const int64 n = val.NumElements();
+  const float* src = reinterpret_cast<const float*>(val.tensor_data().data());
+  switch (codec) {
+    case kStarCodecFp16: {
+      Eigen::Map<HalfArray>(reinterpret_cast<Eigen::half*>(out), n) =
+          Eigen::Map<const FloatArray>(src, n).cast<Eigen::half>();
+      break;
+    }
+    case kStarCodecBf16: {
+      FloatToBFloat16(src, reinterpret_cast<bfloat16*>(out), n);
+      break;
+    }
+    case kStarCodecInt8: {
+      int64 rows, row_size;
+      RowsOf(val, &rows, &row_size);
+      float* scales = reinterpret_cast<float*>(out);
+      int8* values = reinterpret_cast<int8*>(out + rows * sizeof(float));
+      for (int64 r = 0; r < rows; ++r) {
+        const float* row = src + r * row_size;
+        int8* row_values = values + r * row_size;
+        // NaN and Inf are left out of the scale, otherwise the whole row
+        // decodes to NaN. NaN is sent as 0, Inf as the largest magnitude.
+        float max_abs = 0.0f;
+        for (int64 i = 0; i < row_size; ++i) {
+          if (std::isfinite(row[i])) {
+            max_abs = std::max(max_abs, std::abs(row[i]));
+          }
+        }
+        const float scale = max_abs / 127.0f;
+        const float inv_scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+        scales[r] = scale;
+        for (int64 i = 0; i < row_size; ++i) {
+          float q = std::round(row[i] * inv_scale);
+          // Casting NaN or a value out of the int8 range is undefined.
+          q = std::isnan(q) ? 0.0f : std::min(127.0f, std::max(-127.0f, q));
+          row_values[i] = static_cast<int8>(q);
+        }
+      }
+      break;
+    }
+    default:
+      memcpy(out, src, val.TotalBytes());
+      break;
+  }
+  Report(codec, val.TotalBytes(), EncodedBytes(codec, val),
+         Env::Default()->NowMicros() - start);
+}
+
+Status StarTensorCompression::Decode(StarTensorCodec codec, const char* in,
+                                     uint64 len, Tensor* val) {
+  if (val->dtype() != DT_FLOAT) {
+    return errors::Internal("Star tensor compression only supports float, ",
+                            "got ", DataTypeString(val->dtype()));
+  }
+  if (len != EncodedBytes(codec, *val)) {
+    return errors::Internal("Star tensor compression, codec ",
+                            CodecName(codec), " expects ",
+                            EncodedBytes(codec, *val), " bytes for shape ",
+                            val->shape().DebugString(), ", got ", len);
+  }
+  const int64 n = val->NumElements();
+  float* dst = reinterpret_cast<float*>(const_cast<char*>(
+      val->tensor_data().data()));
+  switch (codec) {
+    case kStarCodecFp16: {
+      Eigen::Map<FloatArray>(dst, n) =
+          Eigen::Map<const HalfArray>(
+              reinterpret_cast<const Eigen::half*>(in), n).cast<float>();
+      break;
+    }
+    case kStarCodecBf16: {
+      BFloat16ToFloat(reinterpret_cast<const bfloat16*>(in), dst, n);
+      break;
+    }
+    case kStarCodecInt8: {
+      int64 rows, row_size;
+      RowsOf(*val, &rows, &row_size);
+      const float* scales = reinterpret_cast<const float*>(in);
+      const int8* values =
+          reinterpret_cast<const int8*>(in + rows * sizeof(float));
+      for (int64 r = 0; r < rows; ++r) {
+        Eigen::Map<FloatArray>(dst + r * row_size, row_size) =
+            Eigen::Map<const Int8Array>(values + r * row_size, row_size)
+                .cast<float>() * scales[r];
+      }
+      break;
+    }
+    default:
+      memcpy(dst, in, len);
+      break;
+  }
+  return Status::OK();
+}
+
+void StarTensorCompression::Report(StarTensorCodec codec, uint64 raw_bytes,
+                                   uint64 encoded_bytes,
+                                   uint64 encode_micros) {
+  const char* name = CodecName(codec);
+  star_compression_raw_bytes->GetCell(name)->IncrementBy(raw_bytes);
+  star_compression_encoded_bytes->GetCell(name)->IncrementBy(encoded_bytes);
+  star_compression_encode_micros->GetCell(name)->IncrementBy(encode_micros);
+
+  static std::atomic<int64> tensors(0);
+  static std::atomic<int64> total_raw_bytes(0);
+  static std::atomic<int64> total_encoded_bytes(0);
+  static std::atomic<int64> total_encode_micros(0);
+  total_raw_bytes += raw_bytes;
+  total_encoded_bytes += encoded_bytes;
+  total_encode_micros += encode_micros;
+  if (++tensors % kLogEveryTensors == 0) {
+    VLOG(1) << "Star tensor compression, codec: " << name
+            << ", tensors: " << tensors
+            << ", raw bytes: " << total_raw_bytes
+            << ", encoded bytes: " << total_encoded_bytes
+            << ", saved bytes: " << total_raw_bytes - total_encoded_bytes
+            << ", encode micros: " << total_encode_micros;
+  }
+}
+
+} // namespace tensorflow
@@ -0,0 +1,72 @@
+#ifndef TENSORFLOW_CONTRIB_STAR_STAR_TENSOR_COMPRESSION_H_
+#define TENSORFLOW_CONTRIB_STAR_STAR_TENSOR_COMPRESSION_H_
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/types.h"
+
+
+namespace tensorflow {
+
+// Wire codec of a tensor buffer in StarMessage.
+//   kNone: raw tensor bytes.
+//   kFp16: float -> half.
+//   kBf16: float -> bfloat16 (truncation).
+//   kInt8: |float scale per row|int8 values|, row is the slice along dim 0.
+//          NaN is sent as 0, +-Inf as the largest finite magnitude of the
+//          row.
+enum StarTensorCodec : uint8 {
+  kStarCodecNone = 0,
+  kStarCodecFp16 = 1,
+  kStarCodecBf16 = 2,
+  kStarCodecInt8 = 3,
+};
+
+// Opt-in lossy compression of the float tensors sent by RecvTensor and
+// FuseRecvTensor, configured by env:
+//   TF_STAR_TENSOR_COMPRESSION: none(default) | fp16 | bf16 | int8
+//   TF_STAR_TENSOR_COMPRESSION_KEYS: comma separated substrings of the
+//     rendezvous key, e.g. the names of embedding lookups and their
+//     gradients. Empty means every float tensor.
+//   TF_STAR_TENSOR_COMPRESSION_MIN_BYTES: tensors smaller than this are
+//     sent raw, default 1024.
+class StarTensorCompression {
+ public:
+  static StarTensorCompression* Get();
+
+  // Codec for the tensor of the rendezvous key, kStarCodecNone when
+  // compression is disabled or the key does not match.
+  StarTensorCodec CodecForKey(const string& key) const;
+
+  // Codec actually applied to `val`, only float tensors that are large
+  // enough are compressed.
+  StarTensorCodec CodecForTensor(StarTensorCodec codec,
+                                 const Tensor& val) const;
+
+  static uint64 EncodedBytes(StarTensorCodec codec, const Tensor& val);
+  // Encode `val` into `out` which has EncodedBytes(codec, val) bytes.
+  void Encode(StarTensorCodec codec, const Tensor& val, char* out);
+  // Decode `len` bytes of `in` into `val`, which is already allocated with
+  // the dtype and shape of the original tensor.
+  Status Decode(StarTensorCodec codec, const char* in, uint64 len,
+                Tensor* val);
+
+  static const char* CodecName(StarTensorCodec codec);
+
+ private:
+  StarTensorCompression();
+
+  void Report(StarTensorCodec codec, uint64 raw_bytes, uint64 encoded_bytes,
+              uint64 encode_micros);
+
+  StarTensorCodec codec_;
+  std::vector<string> key_patterns_;
+  int64 min_bytes_;
+};
+
+} // namespace tensorflow
+
+#endif // TENSORFLOW_CONTRIB_STAR_STAR_TENSOR_COMPRESSION_H_
@@ -0,0 +1,148 @@
+#include "tensorflow/contrib/star/star_tensor_compression.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/test.h"
+
+
+namespace tensorflow {
+
+namespace {
+
+Tensor RandomTensor(const TensorShape& shape) {
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Tensor t(DT_FLOAT, shape);
+  auto flat = t.flat<float>();
+  for (int64 i = 0; i < flat.size(); ++i) {
+    // Magnitudes from 1e-3 to 1e3 with both signs.
+    flat(i) = (rnd.Uniform(2) ? 1.0f : -1.0f) *
+              std::pow(10.0f, rnd.RandFloat() * 6.0f - 3.0f);
+  }
+  return t;
+}
+
+// Encodes `val` with `codec` and decodes it into `out`.
+Status RoundTrip(StarTensorCodec codec, const Tensor& val, Tensor* out) {
+  StarTensorCompression* compression = StarTensorCompression::Get();
+  std::vector<char> buf(StarTensorCompression::EncodedBytes(codec, val));
+  compression->Encode(codec, val, buf.data());
+  *out = Tensor(DT_FLOAT, val.shape());
+  return compression->Decode(codec, buf.data(), buf.size(), out);
+}
+
+}  // namespace
+
+TEST(StarTensorCompressionTest, EncodedBytes) {
+  Tensor t(DT_FLOAT, TensorShape({4, 8}));
+  EXPECT_EQ(StarTensorCompression::EncodedBytes(kStarCodecNone, t), 128);
+  EXPECT_EQ(StarTensorCompression::EncodedBytes(kStarCodecFp16, t), 64);
+  EXPECT_EQ(StarTensorCompression::EncodedBytes(kStarCodecBf16, t), 64);
+  // A scale per row and a byte per value.
+  EXPECT_EQ(StarTensorCompression::EncodedBytes(kStarCodecInt8, t), 48);
+}
+
+TEST(StarTensorCompressionTest, Fp16RoundTrip) {
+  Tensor t = RandomTensor(TensorShape({16, 32}));
+  Tensor out;
+  TF_ASSERT_OK(RoundTrip(kStarCodecFp16, t, &out));
+  auto src = t.flat<float>();
+  auto dst = out.flat<float>();
+  for (int64 i = 0; i < src.size(); ++i) {
+    // 10 bits of mantissa, rounded to nearest.
+    EXPECT_LE(std::abs(dst(i) - src(i)), std::abs(src(i)) / 2048.0f);
+  }
+}
+
+TEST(StarTensorCompressionTest, Bf16RoundTrip) {
+  Tensor t = RandomTensor(TensorShape({16, 32}));
+  Tensor out;
+  TF_ASSERT_OK(RoundTrip(kStarCodecBf16, t, &out));
+  auto src = t.flat<float>();
+  auto dst = out.flat<float>();
+  for (int64 i = 0; i < src.size(); ++i) {
+    // 7 bits of mantissa, truncated towards zero.
+    EXPECT_LE(std::abs(dst(i)), std::abs(src(i)));
+    EXPECT_LE(std::abs(dst(i) - src(i)), std::abs(src(i)) / 128.0f);
+  }
+}
+
+TEST(StarTensorCompressionTest, Int8RoundTrip) {
+  const int64 rows = 16;
+  const int64 row_size = 32;
+  Tensor t = RandomTensor(TensorShape({rows, row_size}));
+  Tensor out;
+  TF_ASSERT_OK(RoundTrip(kStarCodecInt8, t, &out));
+  auto src = t.matrix<float>();
+  auto dst = out.matrix<float>();
+  for (int64 r = 0; r < rows; ++r) {
+    float max_abs = 0.0f;
+    for (int64 i = 0; i < row_size; ++i) {
+      max_abs = std::max(max_abs, std::abs(src(r, i)));
+    }
+    // Half a step of the row scale, plus the float rounding.
+    const float bound = max_abs / 127.0f / 2.0f * 1.001f;
+    for (int64 i = 0; i < row_size; ++i) {
+      EXPECT_LE(std::abs(dst(r, i) - src(r, i)), bound);
+    }
+  }
+}
+
+TEST(StarTensorCompressionTest, Int8ZeroAndEmptyRows) {
+  Tensor t(DT_FLOAT, TensorShape({2, 4}));
+  test::FillValues<float>(&t, {0, 0, 0, 0, 1, -2, 3, -4});
+  Tensor out;
+  TF_ASSERT_OK(RoundTrip(kStarCodecInt8, t, &out));
+  test::ExpectTensorNear<float>(t, out, 4.0f / 127.0f / 2.0f);
+
+  for (const TensorShape& shape :
+       {TensorShape({3, 0}), TensorShape({0, 4}), TensorShape({0})}) {
+    for (StarTensorCodec codec :
+         {kStarCodecFp16, kStarCodecBf16, kStarCodecInt8}) {
+      Tensor empty(DT_FLOAT, shape);
+      TF_ASSERT_OK(RoundTrip(codec, empty, &out));
+      EXPECT_EQ(out.shape(), shape);
+    }
+  }
+}
+
+TEST(StarTensorCompressionTest, Int8NonFinite) {
+  const float inf = std::numeric_limits<float>::infinity();
+  Tensor t(DT_FLOAT, TensorShape({2, 4}));
+  test::FillValues<float>(&t, {std::nanf(""), 1, -2, 4, inf, -inf, 0.5, 2});
+  Tensor out;
+  TF_ASSERT_OK(RoundTrip(kStarCodecInt8, t, &out));
+  Tensor expected(DT_FLOAT, TensorShape({2, 4}));
+  // NaN is sent as 0, Inf as the largest finite magnitude of its row.
+  test::FillValues<float>(&expected, {0, 1, -2, 4, 2, -2, 0.5, 2});
+  test::ExpectTensorNear<float>(expected, out, 4.0f / 127.0f / 2.0f);
+}
+
+TEST(StarTensorCompressionTest, DecodeLengthMismatch) {
+  Tensor t = RandomTensor(TensorShape({4, 8}));
+  for (StarTensorCodec codec : {kStarCodecNone, kStarCodecFp16,
+                                kStarCodecBf16, kStarCodecInt8}) {
+    std::vector<char> buf(StarTensorCompression::EncodedBytes(codec, t));
+    StarTensorCompression::Get()->Encode(codec, t, buf.data());
+    Tensor out(DT_FLOAT, t.shape());
+    Status s = StarTensorCompression::Get()->Decode(
+        codec, buf.data(), buf.size() - 1, &out);
+    EXPECT_TRUE(errors::IsInternal(s)) << s;
+    EXPECT_TRUE(str_util::StrContains(s.error_message(), "expects")) << s;
+  }
+
+  Tensor ints(DT_INT32, TensorShape({4, 8}));
+  Status s = StarTensorCompression::Get()->Decode(
+      kStarCodecFp16, nullptr, 64, &ints);
+  EXPECT_TRUE(errors::IsInternal(s)) << s;
+}
+
+} // namespace tensorflow
@@ -427,6 +427,7 @@ void StarWorker::RecvTensorAsync(CallOptions* opts,
       done(s);
       return;
     }
+    response->SetCodec(StarTensorCompression::Get()->CodecForKey(key));
 
     // TODO(rangeng.llb): make call opts useful.
     // opts->SetCancelCallback([this, step_id]() { AbortStep(step_id); });
@@ -547,6 +548,9 @@ void StarWorker::FuseRecvTensorAsync(CallOptions* opts,
 
           for (int idx = 0; idx < fuse_count; ++idx) {
             response->SetIsDeadByIndex(idx, is_deads[idx]);
+            response->SetCodecByIndex(idx,
+                StarTensorCompression::Get()->CodecForKey(
+                    request->rendezvous_key(idx)));
             bool can_memcpy = DataTypeCanUseMemcpy(vals[idx].dtype());
 
             if ((*src_devs)[idx]->tensorflow_gpu_device_info() &&
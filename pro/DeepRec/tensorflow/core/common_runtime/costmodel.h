@@ -16,35 +16,193 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_COMMON_RUNTIME_COSTMODEL_H_
 #define TENSORFLOW_CORE_COMMON_RUNTIME_COSTMODEL_H_
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "tensorflow/core/common_runtime/kernel_stat.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 namespace ExecutorInternal {
 
+namespace {
+static const std::string cost_model_percentile_env_name =
+    "EXECUTE_COST_MODEL_PERCENTILE";
+static const std::string cost_model_dump_path_env_name =
+    "EXECUTE_COST_MODEL_DUMP_PATH";
+}
+
 // TODO: consider integrate this to tensorflow/core/graph/costmodel.h
+//
+// The cost of a node is a percentile (median by default) of the execute
+// time distribution collected by KernelStats, which filters out the noise
+// of single slow runs. When KernelStats collects again online, the model
+// is rebuilt and the new cost is smoothed with the old one. The costs are
+// updated in place while other runs read them, so a reader which needs a
+// consistent order, e.g. to sort nodes, has to copy the costs first.
+// Building reads every node and may dump the model to a file, the
+// executor runs it in the background instead of in a step.
 class ExecuteCostModel {
  public:
-  ExecuteCostModel() {}
+  ExecuteCostModel() {
+    Status s = ReadInt64FromEnvVar(
+        cost_model_percentile_env_name, 50, &percentile_);
+    if (!s.ok()) {
+      LOG(WARNING) << "Read EXECUTE_COST_MODEL_PERCENTILE envrionment error. "
+                   << s.error_message();
+    }
+    percentile_ = std::min<int64>(std::max<int64>(percentile_, 1), 100);
+    s = ReadStringFromEnvVar(cost_model_dump_path_env_name, "", &dump_path_);
+    if (!s.ok()) {
+      LOG(WARNING) << "Read EXECUTE_COST_MODEL_DUMP_PATH envrionment error. "
+                   << s.error_message();
+    }
+  }
   ~ExecuteCostModel() {}
 
   void BuildCostModel(KernelStats* stats) {
     kernel_stats_ = stats;
+    kernel_stats_->RegisterReader();
     node_count_ = kernel_stats_->GetNodeCount();
-    // TODO: build actual cost model here
+    node_cost_ = absl::make_unique<std::atomic<int64_t>[]>(node_count_);
+    immutable_accumulative_cost_ =
+        absl::make_unique<std::atomic<int64_t>[]>(node_count_);
+    for (int64 i = 0; i < node_count_; ++i) {
+      node_cost_[i] = 0;
+      immutable_accumulative_cost_[i] = 0;
+    }
+    const int64 version = kernel_stats_->StatsVersion();
+    built_version_ = version;
+    UpdateCostModel(version);
+  }
+
+  // True if KernelStats finished a collection the model is not built from.
+  bool NeedsRebuild() const {
+    return kernel_stats_->StatsVersion() >
+           built_version_.load(std::memory_order_relaxed);
+  }
+
+  // Rebuilds the model when KernelStats finished a new collection,
+  // returns true if this call rebuilt it.
+  bool MaybeRebuildCostModel() {
+    int64 version = kernel_stats_->StatsVersion();
+    int64 built_version = built_version_.load(std::memory_order_relaxed);
+    if (version <= built_version ||
+        !built_version_.compare_exchange_strong(built_version, version)) {
+      return false;
+    }
+    mutex_lock l(build_mu_);
+    UpdateCostModel(version);
+    return true;
   }
 
   int64 GetNodeCost(const NodeItem* item) {
-    // TODO: return actual cost
-    return kernel_stats_->GetNodeCost(item);
+    return node_cost_[item->node_id].load(std::memory_order_relaxed);
+  }
+
+  int64 GetOpAccumulativeCost(const NodeItem* item) {
+    return immutable_accumulative_cost_[item->node_id].load(
+        std::memory_order_relaxed);
+  }
+
+  int64 BuildCount() const {
+    return build_count_.load(std::memory_order_relaxed);
+  }
+
+  // Human readable model, one node per line ordered by the
+  // accumulative cost, which is the critical path first.
+  std::string DebugString() const {
+    std::vector<int32_t> ids;
+    const Graph* g = kernel_stats_->graph();
+    for (Node* n : g->nodes()) {
+      if (n->id() < node_count_) ids.push_back(n->id());
+    }
+    std::sort(ids.begin(), ids.end(), [this](int32_t a, int32_t b) {
+      return immutable_accumulative_cost_[a] > immutable_accumulative_cost_[b];
+    });
+    std::string ret = strings::StrCat(
+        "ExecuteCostModel build_count: ", BuildCount(),
+        ", percentile: ", percentile_, ", nodes: ", ids.size(), "\n",
+        "node_id\tname\top\tsamples\tcost(ns)\taccumulative_cost(ns)\n");
+    for (int32_t id : ids) {
+      const Node* n = g->FindNodeId(id);
+      strings::StrAppend(&ret, id, "\t", n->name(), "\t", n->type_string(),
+                         "\t", kernel_stats_->GetNodeStatsCount(id), "\t",
+                         node_cost_[id].load(), "\t",
+                         immutable_accumulative_cost_[id].load(), "\n");
+    }
+    return ret;
   }
 
  private:
+  // Weight of the old cost when rebuilding, new cost is
+  // ((kCostDecay - 1) * old + sample) / kCostDecay.
+  static constexpr int64 kCostDecay = 4;
+
+  // Builds from the collection 'version' of KernelStats.
+  void UpdateCostModel(int64 version) {
+    std::vector<int64> cost(node_count_, 0);
+    for (int64 i = 0; i < node_count_; ++i) {
+      int64 old_cost = node_cost_[i];
+      int64 sample = kernel_stats_->GetNodeCostPercentile(i, percentile_);
+      if (sample < 0) {
+        // Not executed in the last collection.
+        cost[i] = old_cost;
+      } else if (build_count_ == 0) {
+        cost[i] = sample;
+      } else {
+        cost[i] = ((kCostDecay - 1) * old_cost + sample) / kCostDecay;
+      }
+    }
+
+    std::vector<int64> accumulative_cost;
+    kernel_stats_->CalculateAccumulativeCost(cost, &accumulative_cost);
+    for (int64 i = 0; i < node_count_; ++i) {
+      node_cost_[i].store(cost[i], std::memory_order_relaxed);
+      immutable_accumulative_cost_[i].store(accumulative_cost[i],
+                                            std::memory_order_relaxed);
+    }
+    const int64 build_count = build_count_.fetch_add(1) + 1;
+    VLOG(1) << "Build execute cost model, build_count: " << build_count;
+
+    if (!dump_path_.empty()) {
+      Status s = WriteStringToFile(
+          Env::Default(), strings::StrCat(dump_path_, ".", build_count),
+          DebugString());
+      if (!s.ok()) {
+        LOG(WARNING) << "Dump execute cost model failed. "
+                     << s.error_message();
+      }
+    }
+    // The next collection may reset the stats now.
+    kernel_stats_->MarkStatsRead(version);
+  }
+
   KernelStats* kernel_stats_ = nullptr; // not owned
-  int64 node_count_;
+  int64 node_count_ = 0;
+  // User can set envrionment 'EXECUTE_COST_MODEL_PERCENTILE'
+  // to modify the value.
+  int64 percentile_ = 50;
+  // Dump the model to '<dump_path_>.<build_count_>' after every build,
+  // user can set envrionment 'EXECUTE_COST_MODEL_DUMP_PATH'.
+  std::string dump_path_;
+  std::atomic<int64_t> built_version_{0};
+  // Serializes the rebuilds of overlapping collections.
+  mutex build_mu_;
+  std::atomic<int64> build_count_{0};
+  // Smoothed execution time of nodes
+  std::unique_ptr<std::atomic<int64_t>[]> node_cost_;
+  // The max total cost of the graph execute path from current node
+  // to the sink node, see KernelStats.
+  std::unique_ptr<std::atomic<int64_t>[]> immutable_accumulative_cost_;
 };
 
 }  // end namespace ExecutorInternal
 }  // end namespace tensorflow
 
 #endif  // TENSORFLOW_CORE_COMMON_RUNTIME_COSTMODEL_H_
-
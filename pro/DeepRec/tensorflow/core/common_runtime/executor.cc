@@ -155,9 +155,13 @@ class ExecutorImpl : public Executor {
   }
 
   ~ExecutorImpl() {
-    if (cost_model_) {
-      delete cost_model_;
+    {
+      mutex_lock l(build_cost_model_mu_);
+      while (build_cost_model_pending_) {
+        build_cost_model_cv_.wait(l);
+      }
     }
+    delete cost_model_.load();
   }
 
   Status Initialize() {
@@ -171,6 +175,10 @@ class ExecutorImpl : public Executor {
 
   ExecutorInternal::ExecuteCostModel* TryToBuildCostModel();
 
+  // Builds or rebuilds the cost model in the background, at most one
+  // build is pending.
+  void ScheduleBuildCostModel();
+
   ImmutableExecutorState& GetImmutableState() {
     return immutable_state_;
   }
@@ -187,8 +195,11 @@ class ExecutorImpl : public Executor {
   ExecutorInternal::KernelStats kernel_stats_;
 
   bool enable_cost_model_ = false;
-  std::atomic<int> build_cost_model_counter_{0};
-  ExecutorInternal::ExecuteCostModel* cost_model_ = nullptr;
+  mutex build_cost_model_mu_;
+  condition_variable build_cost_model_cv_;
+  bool build_cost_model_pending_ GUARDED_BY(build_cost_model_mu_) = false;
+  // Set once by the first build, then rebuilt in place.
+  std::atomic<ExecutorInternal::ExecuteCostModel*> cost_model_{nullptr};
 
   TF_DISALLOW_COPY_AND_ASSIGN(ExecutorImpl);
 };
@@ -468,19 +479,29 @@ class ExecutorStateFactory {
   }
 };
 
-// Sort node according cost from which ExecutorState
+// Sort node according cost from which ExecutorState. The costs are copied
+// before sorting, another run may rebuild the model while std::sort runs
+// and the comparison has to stay consistent. The copy is a scratch buffer
+// of the thread, which is reused by the next ready nodes it schedules.
 template <class PropagatorStateType>
-struct SortTaggedNode {
+void SortTaggedNodes(ExecutorInternal::ExecuteCostModel* cost_model,
+                     typename PropagatorStateType::TaggedNodeSeq* ready) {
   typedef typename PropagatorStateType::TaggedNode TaggedNode;
-
-  SortTaggedNode(const std::vector<int64>* immutable_accumulative_cost) :
-      immutable_accumulative_cost_(immutable_accumulative_cost) {}
-  bool operator()(const TaggedNode& n1, const TaggedNode& n2) {
-    return (*immutable_accumulative_cost_)[n1.get_node_item().node_id] >
-        (*immutable_accumulative_cost_)[n2.get_node_item().node_id];
+  static thread_local std::vector<std::pair<int64, TaggedNode>> nodes;
+  nodes.clear();
+  for (const TaggedNode& n : *ready) {
+    nodes.emplace_back(cost_model->GetOpAccumulativeCost(&n.get_node_item()),
+                       n);
   }
-  const std::vector<int64>* immutable_accumulative_cost_;
-};
+  std::sort(nodes.begin(), nodes.end(),
+            [](const std::pair<int64, TaggedNode>& n1,
+               const std::pair<int64, TaggedNode>& n2) {
+    return n1.first > n2.first;
+  });
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    (*ready)[i] = nodes[i].second;
+  }
+}
 
 template <class PropagatorStateType>
 ExecutorState<PropagatorStateType>::ExecutorState(
@@ -1552,9 +1573,7 @@ void CostExecutorState<PropagatorStateType>::CostScheduleReady(
   } else {
     // sort ready nodes
     // key path priority schedule
-    std::sort(ready->begin(), ready->end(),
-        SortTaggedNode<PropagatorStateType>(
-            this->kernel_stats_->GetAccumulativeCostArray()));
+    SortTaggedNodes<PropagatorStateType>(this->cost_model_, ready);
 
     // TODO: FIXME 50us or 100 ops
     // Use cost model here
@@ -1590,7 +1609,7 @@ void CostExecutorState<PropagatorStateType>::CostScheduleReady(
       } else {
         // TODO: expensive node also be considered batching.
         if (curr_expensive_node) {
-          auto item_acc_cost = this->kernel_stats_->GetOpAccumulativeCost(&item);
+          auto item_acc_cost = this->cost_model_->GetOpAccumulativeCost(&item);
           if (curr_accumulative_cost < item_acc_cost) {
             // Dispatch to another thread since there is plenty of work to
             // do for this thread.
@@ -1609,7 +1628,7 @@ void CostExecutorState<PropagatorStateType>::CostScheduleReady(
         } else {
           curr_expensive_node = &tagged_node;
           curr_accumulative_cost =
-              this->kernel_stats_->GetOpAccumulativeCost(&(tagged_node.get_node_item()));
+              this->cost_model_->GetOpAccumulativeCost(&(tagged_node.get_node_item()));
         }
       }
     }
@@ -1638,24 +1657,41 @@ void CostExecutorState<PropagatorStateType>::CostScheduleReady(
 }
 
 ExecutorInternal::ExecuteCostModel* ExecutorImpl::TryToBuildCostModel() {
-  if (cost_model_) return cost_model_;
-
+  ExecutorInternal::ExecuteCostModel* cm =
+      cost_model_.load(std::memory_order_acquire);
   if (!enable_cost_model_ ||
       !kernel_stats_.CollectStatsDone()) {
-    return nullptr;
+    return cm;
   }
+  // Build the model, or rebuild it online once new kernel stats were
+  // collected. The step runs with the current model meanwhile.
+  if (cm == nullptr || cm->NeedsRebuild()) {
+    ScheduleBuildCostModel();
+  }
+  return cm;
+}
 
-  // Build cost model
-  int counter = build_cost_model_counter_.fetch_add(1);
-  if (counter == 0) {
-    ExecutorInternal::ExecuteCostModel* cm =
-        new ExecutorInternal::ExecuteCostModel();
-    cm->BuildCostModel(&kernel_stats_);
-    cost_model_ = cm;
-    LOG(INFO) << "Build execute cost model successful.";
+void ExecutorImpl::ScheduleBuildCostModel() {
+  {
+    mutex_lock l(build_cost_model_mu_);
+    if (build_cost_model_pending_) return;
+    build_cost_model_pending_ = true;
   }
-  if (cost_model_) return cost_model_;
-  return nullptr;
+  Env::Default()->SchedClosure([this]() {
+    ExecutorInternal::ExecuteCostModel* cm =
+        cost_model_.load(std::memory_order_acquire);
+    if (cm == nullptr) {
+      cm = new ExecutorInternal::ExecuteCostModel();
+      cm->BuildCostModel(&kernel_stats_);
+      cost_model_.store(cm, std::memory_order_release);
+      LOG(INFO) << "Build execute cost model successful.";
+    } else {
+      cm->MaybeRebuildCostModel();
+    }
+    mutex_lock l(build_cost_model_mu_);
+    build_cost_model_pending_ = false;
+    build_cost_model_cv_.notify_all();
+  });
 }
 
 void ExecutorImpl::RunAsync(const Args& args, DoneCallback done) {
@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <algorithm>
 
+#include "tensorflow/core/common_runtime/costmodel.h"
 #include "tensorflow/core/common_runtime/device.h"
 #include "tensorflow/core/common_runtime/device_factory.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
@@ -27,6 +28,7 @@ limitations under the License.
 #include "tensorflow/core/framework/step_stats.pb.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/graph_constructor.h"
+#include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/lib/strings/strcat.h"
@@ -421,6 +423,89 @@ TEST_F(ExecutorTest, RecvInvalidRefDtype) {
   rendez->Unref();
 }
 
+// Records a sample of 'cost_ns' nanoseconds for 'item'.
+static void RecordCost(ExecutorInternal::KernelStats* stats,
+                       const NodeItem* item, int64 cost_ns) {
+  ExecutorInternal::KernelStatsInfo info;
+  stats->StartCollectOp(item, &info);
+  info.op_start_time_ = Env::Default()->NowNanos() - cost_ns;
+  stats->StopCollectOp(item, &info);
+}
+
+TEST(ExecuteCostModelTest, OrderAndRebuild) {
+  // a -> b -> c
+  // |
+  // --> d
+  auto g = absl::make_unique<Graph>(OpRegistry::Global());
+  Node* a = test::graph::Constant(g.get(), V(1.0));
+  Node* b = test::graph::Identity(g.get(), a);
+  Node* c = test::graph::Identity(g.get(), b);
+  Node* d = test::graph::Identity(g.get(), a);
+  GraphView gview;
+  TF_ASSERT_OK(gview.Initialize(g.get()));
+
+  // Collect in steps [1, 3), then again 2 steps after every collection.
+  setenv("START_NODE_STATS_STEP", "1", 1);
+  setenv("STOP_NODE_STATS_STEP", "3", 1);
+  setenv("REBUILD_NODE_STATS_INTERVAL", "2", 1);
+  ExecutorInternal::KernelStats stats;
+  unsetenv("START_NODE_STATS_STEP");
+  unsetenv("STOP_NODE_STATS_STEP");
+  unsetenv("REBUILD_NODE_STATS_INTERVAL");
+  stats.Initialize(gview, g.get());
+
+  // Step 0 is not collected, steps 1 and 2 are.
+  stats.MaybeCollectKernelStats();
+  stats.MaybeCollectKernelStats();
+  // The costs fall in the histogram buckets [512, 1024) and
+  // [65536, 131072), the percentile is the upper bound of the bucket.
+  for (Node* n : {a, b, c}) {
+    RecordCost(&stats, gview.node(n->id()), 600);
+  }
+  RecordCost(&stats, gview.node(d->id()), 80000);
+  stats.MaybeCollectKernelStats();
+  stats.MaybeCollectKernelStats();
+  ASSERT_TRUE(stats.CollectStatsDone());
+  EXPECT_EQ(stats.StatsVersion(), 1);
+
+  ExecutorInternal::ExecuteCostModel cm;
+  cm.BuildCostModel(&stats);
+  EXPECT_EQ(cm.BuildCount(), 1);
+  EXPECT_FALSE(cm.NeedsRebuild());
+  EXPECT_EQ(cm.GetNodeCost(gview.node(c->id())), 1024);
+  EXPECT_EQ(cm.GetNodeCost(gview.node(d->id())), 131072);
+  // The critical path a -> d is scheduled first.
+  EXPECT_EQ(cm.GetOpAccumulativeCost(gview.node(c->id())), 1024);
+  EXPECT_EQ(cm.GetOpAccumulativeCost(gview.node(b->id())), 2048);
+  EXPECT_EQ(cm.GetOpAccumulativeCost(gview.node(d->id())), 131072);
+  EXPECT_EQ(cm.GetOpAccumulativeCost(gview.node(a->id())), 132096);
+
+  // The second collection in steps [6, 8), d became cheap.
+  for (int step = 4; step <= 6; ++step) stats.MaybeCollectKernelStats();
+  RecordCost(&stats, gview.node(d->id()), 600);
+  stats.MaybeCollectKernelStats();
+  stats.MaybeCollectKernelStats();
+  EXPECT_EQ(stats.StatsVersion(), 2);
+  EXPECT_TRUE(cm.NeedsRebuild());
+
+  // The third collection doesn't reset the stats before the model read
+  // them.
+  for (int step = 9; step <= 12; ++step) stats.MaybeCollectKernelStats();
+  EXPECT_EQ(stats.GetNodeStatsCount(d->id()), 1);
+
+  EXPECT_TRUE(cm.MaybeRebuildCostModel());
+  EXPECT_FALSE(cm.MaybeRebuildCostModel());
+  EXPECT_EQ(cm.BuildCount(), 2);
+  // The new cost is smoothed, the nodes not run keep their cost.
+  EXPECT_EQ(cm.GetNodeCost(gview.node(d->id())), (3 * 131072 + 1024) / 4);
+  EXPECT_EQ(cm.GetNodeCost(gview.node(b->id())), 1024);
+  EXPECT_GT(cm.GetOpAccumulativeCost(gview.node(d->id())),
+            cm.GetOpAccumulativeCost(gview.node(b->id())));
+
+  stats.MaybeCollectKernelStats();
+  EXPECT_EQ(stats.GetNodeStatsCount(d->id()), 0);
+}
+
 // Create a graph that is 'depth' deep. At each level, fan-in and fan-out a
 // maximum of 'width' nodes. All nodes are no-ops and all dependencies are
 // control dependencies.
@@ -600,32 +600,28 @@ Status GraphExecutionState::PruneGraph(
 namespace {
 bool FindGradientOps(Graph* g, std::unordered_set<const Node*>& visited) {
   bool found = false;
+  int grad_input, indices_input;
   for (Node* n : g->nodes()) {
-    // Ftrl & Adagrad's input 3 is grad
-    if (n->IsApplyAdagradOps() ||
-        n->IsSparseApplyAdagradOps() ||
-        n->IsApplyFtrlOps() ||
-        n->IsSparseApplyFtrlOps()) {
-      Node* gradient = nullptr;
-      TF_CHECK_OK(n->input_node(3, &gradient));
-      visited.insert(gradient);
-      found = true;
-    }
-    // Adam's input 9 is grad
-    if (n->IsApplyAdamOps() ||
-        n->IsApplySparseAdamOps()) {
-      Node* gradient = nullptr;
-      TF_CHECK_OK(n->input_node(9, &gradient));
-      visited.insert(gradient);
-      found = true;
+    if (!GetApplyGradientInputs(n, &grad_input, &indices_input)) {
+      continue;
     }
+    Node* gradient = nullptr;
+    TF_CHECK_OK(n->input_node(grad_input, &gradient));
+    visited.insert(gradient);
+    // Sparse gradients, e.g. of EmbeddingVariables, are aggregated by id.
+    if (indices_input >= 0) {
+      Node* indices = nullptr;
+      TF_CHECK_OK(n->input_node(indices_input, &indices));
+      visited.insert(indices);
+    }
+    found = true;
   }
   return found;
 }
 }
 
 Status GraphExecutionState::PipelineGraph(std::unique_ptr<Graph>* g,
-    int32 micro_batch_num) {
+    int32 micro_batch_num, int32 micro_batch_concurrency) {
   Graph* graph = g->get();
   std::unique_ptr<Graph> g2duplicated(new Graph(OpRegistry::Global()));
   CopyGraph(*graph, g2duplicated.get());
@@ -636,7 +632,8 @@ Status GraphExecutionState::PipelineGraph(std::unique_ptr<Graph>* g,
   }
   auto excluded = FindExcludeDuplicationNodes(g2duplicated.get(), visited);
   // Duplicate Graph with micro_batch_num-1 duplications
-  ExtendGraph(g2duplicated.get(), excluded, micro_batch_num - 1);
+  ExtendGraph(g2duplicated.get(), excluded, micro_batch_num - 1,
+              micro_batch_concurrency);
 
   std::unique_ptr<Graph> copy(new Graph(graph->flib_def()));
   CopyGraph(*(g2duplicated.get()), copy.get());
@@ -647,7 +644,8 @@ Status GraphExecutionState::PipelineGraph(std::unique_ptr<Graph>* g,
 
 Status GraphExecutionState::SmartStageGraph(std::unique_ptr<Graph>* g,
                                             const std::vector<std::string>& target_nodes,
-                                            const bool do_smart_stage_gpu) {
+                                            const bool do_smart_stage_gpu,
+                                            const bool do_ev_prefetch) {
     VLOG(2) << "GraphExecutionState::SmartStageGraph";
     Graph* graph = g->get();
     std::unique_ptr<Graph> staged_graph(new Graph(OpRegistry::Global()));
@@ -678,7 +676,8 @@ Status GraphExecutionState::SmartStageGraph(std::unique_ptr<Graph>* g,
     for (it = stage_node_map.begin(); it != stage_node_map.end(); ++it) {
       if (unstage_node_map.find(it->first) != unstage_node_map.end()) {
         StageGraph(staged_graph.get(), it->second, unstage_node_map[it->first], 
-                   target_nodes, do_smart_stage_gpu, cpu_device_name);
+                   target_nodes, do_smart_stage_gpu, cpu_device_name,
+                   do_ev_prefetch);
       }
     }
     g->swap(staged_graph);
@@ -732,7 +731,8 @@ Status GraphExecutionState::InitBaseGraph(std::unique_ptr<Graph>&& new_graph) {
   int32 micro_batch_num = session_optimizer_options.micro_batch_num();
   if (micro_batch_num > 1) {
     VLOG(2) << "RUN Graph Optimization: Runtime Pipeline";
-    PipelineGraph(&new_graph, micro_batch_num);
+    PipelineGraph(&new_graph, micro_batch_num,
+                  session_optimizer_options.micro_batch_concurrency());
   }
 
   if (session_optimizer_options.do_smart_stage() ||
@@ -745,7 +745,8 @@ Status GraphExecutionState::InitBaseGraph(std::unique_ptr<Graph>&& new_graph) {
       target_nodes.push_back(s.substr(0, s.find_last_of(':')));
     }
     SmartStageGraph(&new_graph, target_nodes, 
-                    session_optimizer_options.do_smart_stage_gpu());
+                    session_optimizer_options.do_smart_stage_gpu(),
+                    session_optimizer_options.do_smart_stage_ev_prefetch());
   }
 
   SaveStatefulNodes(new_graph.get());
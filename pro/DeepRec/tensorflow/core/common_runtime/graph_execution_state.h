@@ -179,11 +179,13 @@ class GraphExecutionState {
   Status PruneGraph(const BuildGraphOptions& options, Graph* graph,
                     subgraph::RewriteGraphMetadata* out_rewrite_metadata);
 
-  Status PipelineGraph(std::unique_ptr<Graph>* graph, int32 micro_batch_num);
+  Status PipelineGraph(std::unique_ptr<Graph>* graph, int32 micro_batch_num,
+                       int32 micro_batch_concurrency);
   // SmartStage Graph for Runtime
   Status SmartStageGraph(std::unique_ptr<Graph>* graph,
                          const std::vector<std::string>& target_nodes,
-                         const bool do_smart_stage_gpu);
+                         const bool do_smart_stage_gpu,
+                         const bool do_ev_prefetch);
 
   Status OptimizeGraph(
       const BuildGraphOptions& options, std::unique_ptr<Graph>* optimized_graph,
@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_COMMON_RUNTIME_KERNEL_STAT_H_
 #define TENSORFLOW_CORE_COMMON_RUNTIME_KERNEL_STAT_H_
 
+#include <algorithm>
 #include <atomic>
 #include <memory>
 #include <queue>
@@ -26,6 +27,7 @@ limitations under the License.
 #include "absl/types/optional.h"
 #include "tensorflow/core/common_runtime/graph_view.h"
 #include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/lib/core/bits.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/env.h"
@@ -42,6 +44,8 @@ static const std::string start_node_stats_step_env_name =
     "START_NODE_STATS_STEP";
 static const std::string stop_node_stats_step_env_name =
     "STOP_NODE_STATS_STEP";
+static const std::string rebuild_node_stats_interval_env_name =
+    "REBUILD_NODE_STATS_INTERVAL";
 }
 
 // Hold stats info
@@ -74,6 +78,12 @@ class KernelStats {
       VLOG(1) << "User collect node stats, start_step is " << start_step_
               << ", stop_step is " << stop_step_;
     }    
+    s = ReadInt64FromEnvVar(
+        rebuild_node_stats_interval_env_name, 0, &rebuild_interval_);
+    if (!s.ok()) {
+      LOG(WARNING) << "Read REBUILD_NODE_STATS_INTERVAL envrionment error. "
+                   << s.error_message();
+    }
   }    
 
   void Initialize(const GraphView& gview,
@@ -89,15 +99,16 @@ class KernelStats {
         absl::make_unique<std::atomic<int64_t>[]>(gview.num_nodes());
     node_stats_count_ =
         absl::make_unique<std::atomic<int32_t>[]>(gview.num_nodes());
+    cost_histogram_ = absl::make_unique<std::atomic<int32_t>[]>(
+        gview.num_nodes() * kCostHistogramBuckets);
     for (int32_t i = 0; i < gview.num_nodes(); ++i) {
       if (gview.node(i)) {
         is_expensive_[i] =
             gview.node(i)->kernel && gview.node(i)->kernel->IsExpensive();
         cost_estimates_[i] = kInitialCostEstimateCycles;
-        immutable_avg_cost_[i] = 0;
-        node_stats_count_[i] = 0;
       }
     }
+    ResetNodeStats();
   }
 
   // Returns true iff the given node is considered "expensive". The
@@ -131,7 +142,10 @@ class KernelStats {
     cost_estimate.store(new_estimate, std::memory_order_relaxed);
   }
 
-  void CalculateAccumulativeCost() {
+  // Computes, for every node, the max total cost of the execute paths from
+  // the node to a sink node, given the cost of every single node.
+  void CalculateAccumulativeCost(const std::vector<int64>& node_cost,
+                                 std::vector<int64>* accumulative_cost) const {
     std::queue<Node*> q;
     std::unordered_map<Node*, int> pending_childs;
     for (auto n : g_->nodes()) {
@@ -141,18 +155,16 @@ class KernelStats {
       }
     }
 
-    immutable_accumulative_cost_.resize(nodes_count_);
+    accumulative_cost->assign(nodes_count_, 0);
     while (!q.empty()) {
       Node* curr = q.front();
       q.pop();
-      immutable_accumulative_cost_[curr->id()] =
-          immutable_avg_cost_[curr->id()];
+      (*accumulative_cost)[curr->id()] = node_cost[curr->id()];
       for (auto edge : curr->out_edges()) {
         int dest_id = edge->dst()->id();
-        int64 tmp = immutable_avg_cost_[curr->id()] +
-            immutable_accumulative_cost_[dest_id];
-        if (immutable_accumulative_cost_[curr->id()] < tmp) {
-          immutable_accumulative_cost_[curr->id()] = tmp;
+        int64 tmp = node_cost[curr->id()] + (*accumulative_cost)[dest_id];
+        if ((*accumulative_cost)[curr->id()] < tmp) {
+          (*accumulative_cost)[curr->id()] = tmp;
         }
       }
 
@@ -168,25 +180,42 @@ class KernelStats {
     collect_op_cost_ = false;
 
     // 1.calculate average cost
+    std::vector<int64> avg_cost(nodes_count_, 0);
     for (size_t i = 0; i < nodes_count_; ++i) {
       int32_t count = node_stats_count_[i];
       if (count > 0) {
         immutable_avg_cost_[i] = immutable_avg_cost_[i] / count;
       }
+      avg_cost[i] = immutable_avg_cost_[i];
     }
 
-    // 2.calculate accumulative op cost
-    CalculateAccumulativeCost();
+    // 2.calculate accumulative op cost, the first collection only, since
+    // the cost model owns the critical path cost once it was built.
+    if (!collect_stats_done_) {
+      CalculateAccumulativeCost(avg_cost, &immutable_accumulative_cost_);
+    }
 
     // 3. calculate other metrics here
 
+    // 4. schedule the next collection when rebuilding online
+    if (rebuild_interval_ > 0) {
+      int64 window = stop_step_ - start_step_;
+      start_step_ = counter_ + rebuild_interval_;
+      stop_step_ = start_step_ + window;
+      stop_counter_ = 0;
+      wait_to_collect_ = true;
+    }
+
     collect_stats_done_ = true;
+    stats_version_.fetch_add(1);
   }
 
   // Trace node info, for example execute time etc.
   void MaybeCollectKernelStats() {
     if (!collect_kernel_stats ||
-        collect_stats_done_) return;
+        (collect_stats_done_ && !wait_to_collect_ && !collect_op_cost_)) {
+      return;
+    }
 
     if (collect_op_cost_) {
       auto current = counter_.fetch_add(1);
@@ -201,15 +230,35 @@ class KernelStats {
 
     if (!wait_to_collect_) return;
     auto current = counter_.fetch_add(1);
-    if (current == start_step_) {
-      wait_to_collect_ = false;
-      collect_op_cost_ = true;
+    if (current < start_step_) return;
+    // The stats of the last collection are not reset before the cost
+    // model read them, the collection starts at a later step then.
+    if (collect_stats_done_ && has_reader_ &&
+        read_version_.load(std::memory_order_acquire) < StatsVersion()) {
+      return;
+    }
+    bool expected = true;
+    if (!wait_to_collect_.compare_exchange_strong(expected, false)) return;
+    if (collect_stats_done_) {
+      ResetNodeStats();
     }
+    collect_op_cost_ = true;
+  }
+
+  // Called before a cost model reads the stats for the first time, the
+  // next collections wait for it to read every collection.
+  void RegisterReader() {
+    has_reader_ = true;
+  }
+
+  // Called by the cost model once it doesn't read the stats of the
+  // collection 'version' anymore.
+  void MarkStatsRead(int64 version) {
+    read_version_.store(version, std::memory_order_release);
   }
 
   void StartCollectOp(const NodeItem* item, KernelStatsInfo* stat) {
     if (!collect_kernel_stats ||
-        collect_stats_done_ ||
         !collect_op_cost_) {
       return;
     }
@@ -219,8 +268,8 @@ class KernelStats {
 
   void StopCollectOp(const NodeItem* item, KernelStatsInfo* stat) {
     if (!collect_kernel_stats ||
-        collect_stats_done_ ||
-        !collect_op_cost_) {
+        !collect_op_cost_ ||
+        stat->op_start_time_ == 0) {
       return;
     }
 
@@ -230,14 +279,43 @@ class KernelStats {
                    << item->node_id << " VS " << nodes_count_;
     }
 
-    immutable_avg_cost_[item->node_id] +=
-        (stat->op_stop_time_ - stat->op_start_time_);
+    int64 cost = stat->op_stop_time_ - stat->op_start_time_;
+    immutable_avg_cost_[item->node_id] += cost;
 
     node_stats_count_[item->node_id]++;
+    cost_histogram_[item->node_id * kCostHistogramBuckets +
+                    CostHistogramBucket(cost)]++;
     // Collect Other info here
 
   }
 
+  // Returns the estimated 'percentile' of the execute time of the node
+  // in the last collection, or -1 if the node was never executed.
+  int64 GetNodeCostPercentile(int32_t node_id, int64 percentile) const {
+    int64 total = node_stats_count_[node_id];
+    if (total <= 0) return -1;
+    const std::atomic<int32_t>* hist =
+        &cost_histogram_[node_id * kCostHistogramBuckets];
+    int64 rank = std::max<int64>(1, (total * percentile + 99) / 100);
+    int64 seen = 0;
+    for (int b = 0; b < kCostHistogramBuckets; ++b) {
+      int64 count = hist[b];
+      if (count == 0) continue;
+      if (seen + count >= rank) {
+        // Interpolate linearly inside the bucket [2^b, 2^(b+1)).
+        int64 lower = (b == 0) ? 0 : (1LL << b);
+        int64 upper = 1LL << (b + 1);
+        return lower + (upper - lower) * (rank - seen) / count;
+      }
+      seen += count;
+    }
+    return immutable_avg_cost_[node_id];
+  }
+
+  int32_t GetNodeStatsCount(int32_t node_id) const {
+    return node_stats_count_[node_id];
+  }
+
   int64 GetNodeCost(const NodeItem* item) {
     if (item->node_id >= nodes_count_) {
       LOG(WARNING) << "Item node is exceed nodes_count_, "
@@ -266,7 +344,36 @@ class KernelStats {
     return collect_stats_done_;
   }
 
+  // Increased by one every time a collection finished.
+  int64 StatsVersion() const {
+    return stats_version_.load(std::memory_order_acquire);
+  }
+
+  const Graph* graph() const {
+    return g_;
+  }
+
  private:
+  // Buckets of the execute time histogram, bucket 'b' holds the
+  // costs in [2^b, 2^(b+1)) nanoseconds.
+  static constexpr int kCostHistogramBuckets = 40;
+
+  static int CostHistogramBucket(int64 cost) {
+    if (cost <= 1) return 0;
+    return std::min(Log2Floor64(static_cast<uint64>(cost)),
+                    kCostHistogramBuckets - 1);
+  }
+
+  void ResetNodeStats() {
+    for (int64_t i = 0; i < nodes_count_; ++i) {
+      immutable_avg_cost_[i] = 0;
+      node_stats_count_[i] = 0;
+      for (int b = 0; b < kCostHistogramBuckets; ++b) {
+        cost_histogram_[i * kCostHistogramBuckets + b] = 0;
+      }
+    }
+  }
+
   // Initial time (in CPU cycles) we expect an operation to take.  Used to
   // determine whether an operation should be place in a threadpool.
   // Operations start out "expensive".
@@ -283,6 +390,13 @@ class KernelStats {
   // to modify the value.
   int64 start_step_ = -1;
   int64 stop_step_ = -1;
+  // Steps between two collections, the stats are collected only
+  // once when it's not positive.
+  // User can set envrionment 'REBUILD_NODE_STATS_INTERVAL'.
+  int64 rebuild_interval_ = 0;
+  std::atomic<int64_t> stats_version_{0};
+  std::atomic<bool> has_reader_{false};
+  std::atomic<int64_t> read_version_{0};
   bool collect_kernel_stats = false;
   std::atomic<bool> wait_to_collect_;
   std::atomic<bool> collect_op_cost_;
@@ -293,6 +407,8 @@ class KernelStats {
   // Average execution time of nodes
   std::unique_ptr<std::atomic<int64_t>[]> immutable_avg_cost_;
   std::unique_ptr<std::atomic<int32_t>[]> node_stats_count_;
+  // Execute time histogram of nodes, kCostHistogramBuckets per node.
+  std::unique_ptr<std::atomic<int32_t>[]> cost_histogram_;
   // The max total execute time of the graph execute path,
   // which from current node to the sink node.
   // Example:
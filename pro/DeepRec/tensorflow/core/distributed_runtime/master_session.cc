@@ -1251,6 +1251,14 @@ Status MasterSession::ReffedClientGraphV2::RegisterPartitions(
                              env_->run_graph_mode_with_zero_copy,
                              true); // use fuse recv
     Status s;
+    bool fuse_ev_gather = false;
+    s = ReadBoolFromEnvVar("TF_STAR_FUSE_EV_GATHER", false, &fuse_ev_gather);
+    RETURN_IF_NOT_OK(s);
+    if (fuse_ev_gather) {
+      s = gp.FuseEvGather();
+      RETURN_IF_NOT_OK(s);
+    }
+
     // enable star_server (V2)
     if (env_->run_graph_mode) {
       s = gp.SplitGraphV2(&worker_sub_graph, &ps_sub_graphs);
@@ -238,7 +238,7 @@ class BloomFilter : public EmbeddingFilter<K, V, EV> {
       if (new_freq >= config_.filter_freq){
         TF_CHECK_OK(ev_->LookupOrCreateKey(key_buff[i], &value_ptr));
         if (config_.steps_to_live != 0 || config_.record_version) {
-          value_ptr->SetStep(version_buff[i]);
+          ev_->UpdateVersion(key_buff[i], value_ptr, version_buff[i]);
         }
         if (!is_filter){
           V* v = ev_->LookupOrCreateEmb(value_ptr, value_buff + i * ev_->ValueLen());
@@ -416,7 +416,7 @@ class CounterFilter : public EmbeddingFilter<K, V, EV> {
       }
         
       if (config_.steps_to_live != 0 || config_.record_version) {
-        value_ptr->SetStep(version_buff[i]);
+        ev_->UpdateVersion(key_buff[i], value_ptr, version_buff[i]);
       }
       if (value_ptr->GetFreq() >= config_.filter_freq){
         if(!is_filter){
@@ -498,7 +498,7 @@ class NullableFilter : public EmbeddingFilter<K, V, EV> {
         value_ptr->SetFreq(freq_buff[i]);
       }
       if (config_.steps_to_live != 0 || config_.record_version) {
-        value_ptr->SetStep(version_buff[i]);
+        ev_->UpdateVersion(key_buff[i], value_ptr, version_buff[i]);
       }
       if (!is_filter) {
         V* v = ev_->LookupOrCreateEmb(value_ptr, value_buff + i * ev_->ValueLen());
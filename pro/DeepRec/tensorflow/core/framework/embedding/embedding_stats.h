@@ -0,0 +1,265 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_EMBEDDING_STATS_H_
+#define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_EMBEDDING_STATS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace embedding {
+
+// Index of the counters in EmbeddingStats::GetStatistics().
+enum EmbeddingStatistic {
+  // Lookup batches, e.g. KvResourceGather runs.
+  kBatchCount = 0,
+  // Ids in the batches before deduplication.
+  kIdCount,
+  // Distinct ids in the batches.
+  kUniqueIdCount,
+  // Ids not found in any storage tier and created.
+  kNewIdCount,
+  // Distinct ids found in the first tier.
+  kTier0HitCount,
+  // Ids found in the second tier and moved back to the first one.
+  kTier1HitCount,
+  // Value bytes read from LevelDB or SSDHash.
+  kDiskReadBytes,
+  // Ids evicted from the first tier to the second one.
+  kCacheEvictionCount,
+  // Ids removed by shrink, i.e. global step or l2 weight eviction.
+  kShrinkEvictionCount,
+  // Value bytes of the ids removed by shrink.
+  kShrinkEvictionBytes,
+  // Reads of the LevelDB tier, and those of keys not found.
+  kDiskReadCount,
+  kDiskReadMissCount,
+  // Micros spent in the reads of the LevelDB tier.
+  kDiskReadMicros,
+  // Rows written to the LevelDB tier, and the micros spent in the writes.
+  kDiskWriteCount,
+  kDiskWriteMicros,
+  // Micros since the first batch.
+  kElapsedMicros,
+  kNumEmbeddingStatistics
+};
+
+// Always-on lookup statistics of an EmbeddingVariable, shared by the
+// variable and its slots through StorageManager. Counters are relaxed
+// atomics, heavy hitters are estimated by a count-min sketch.
+//
+// Every thread records one of 'sample_rate' ids in the sketch, weighted by
+// the rate, so the hottest ids rarely touch their shared counters. The
+// sketch and the counts of the heavy hitters are halved when a counter
+// gets large, which keeps the counters from wrapping and favors recent
+// ids. The top-k is only updated if its lock is free, a busy update is
+// retried by the next sample of the id.
+//
+// Set 'TF_EV_STATISTICS=0' to disable the statistics, 'TF_EV_HOT_ID_TOP_K'
+// for the number of heavy hitters, 0 disables the sketch, and
+// 'TF_EV_HOT_ID_SAMPLE_RATE' for the sample rate, 16 by default.
+template <class K>
+class EmbeddingStats {
+ public:
+  explicit EmbeddingStats(int64 top_k, int64 sample_rate = 1)
+      : top_k_(top_k),
+        sample_rate_(std::max<int64>(sample_rate, 1)),
+        start_micros_(0),
+        min_hot_count_(0) {
+    for (int i = 0; i < kNumEmbeddingStatistics; ++i) {
+      counters_[i] = 0;
+    }
+    if (top_k_ > 0) {
+      sketch_.reset(new std::atomic<uint32>[kSketchDepth * kSketchWidth]);
+      for (int64 i = 0; i < kSketchDepth * kSketchWidth; ++i) {
+        sketch_[i] = 0;
+      }
+    }
+  }
+
+  void Add(EmbeddingStatistic s, int64 value) {
+    counters_[s].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void RecordBatch(int64 num_ids, int64 num_unique) {
+    if (start_micros_.load(std::memory_order_relaxed) == 0) {
+      uint64 expected = 0;
+      start_micros_.compare_exchange_strong(expected,
+                                            Env::Default()->NowMicros());
+    }
+    Add(kBatchCount, 1);
+    Add(kIdCount, num_ids);
+    Add(kUniqueIdCount, num_unique);
+  }
+
+  // Counts 'count' occurrences of 'key' in the heavy hitter sketch.
+  void RecordId(K key, int64 count) {
+    if (top_k_ <= 0) return;
+    static thread_local uint64 num_calls = 0;
+    if (sample_rate_ > 1 && ++num_calls % sample_rate_ != 0) return;
+    const uint32 weight = static_cast<uint32>(
+        std::min<int64>(count * sample_rate_, kHalveThreshold));
+    const uint64 h = Hash64Combine(static_cast<uint64>(key), kSketchSeed);
+    uint32 estimate = std::numeric_limits<uint32>::max();
+    for (int64 d = 0; d < kSketchDepth; ++d) {
+      // Double hashing, 'h2' is odd so rows differ.
+      const uint64 h2 = (h >> 32) | 1;
+      const int64 col = static_cast<int64>((h + d * h2) % kSketchWidth);
+      uint32 v = sketch_[d * kSketchWidth + col].fetch_add(
+          weight, std::memory_order_relaxed) + weight;
+      estimate = std::min(estimate, v);
+    }
+    if (estimate > min_hot_count_.load(std::memory_order_relaxed)) {
+      UpdateHotIds(key, estimate);
+    }
+    if (estimate >= kHalveThreshold) {
+      Halve();
+    }
+  }
+
+  void GetStatistics(int64* out) const {
+    for (int i = 0; i < kNumEmbeddingStatistics; ++i) {
+      out[i] = counters_[i].load(std::memory_order_relaxed);
+    }
+    // A distinct id of a batch either hits the first tier, or is moved back
+    // from the second tier, or is created.
+    out[kTier0HitCount] = std::max<int64>(
+        0, out[kUniqueIdCount] - out[kTier1HitCount] - out[kNewIdCount]);
+    const uint64 start = start_micros_.load(std::memory_order_relaxed);
+    out[kElapsedMicros] = start == 0 ? 0 : Env::Default()->NowMicros() - start;
+  }
+
+  // Heavy hitters ordered by the estimated count, the largest first.
+  void GetHotIds(std::vector<std::pair<K, int64>>* hot_ids) const {
+    mutex_lock l(mu_);
+    hot_ids->assign(hot_ids_.begin(), hot_ids_.end());
+    std::sort(hot_ids->begin(), hot_ids->end(),
+              [](const std::pair<K, int64>& a, const std::pair<K, int64>& b) {
+                return a.second > b.second;
+              });
+  }
+
+  int64 TopK() const { return top_k_; }
+
+  std::string DebugString() const {
+    int64 stats[kNumEmbeddingStatistics];
+    GetStatistics(stats);
+    return strings::StrCat(
+        "batches: ", stats[kBatchCount], ", ids: ", stats[kIdCount],
+        ", unique ids: ", stats[kUniqueIdCount],
+        ", new ids: ", stats[kNewIdCount],
+        ", tier0 hits: ", stats[kTier0HitCount],
+        ", tier1 hits: ", stats[kTier1HitCount],
+        ", disk read bytes: ", stats[kDiskReadBytes],
+        ", cache evictions: ", stats[kCacheEvictionCount],
+        ", shrink evictions: ", stats[kShrinkEvictionCount],
+        ", shrink eviction bytes: ", stats[kShrinkEvictionBytes],
+        ", disk reads: ", stats[kDiskReadCount],
+        ", disk read misses: ", stats[kDiskReadMissCount],
+        ", disk read micros: ", stats[kDiskReadMicros],
+        ", disk writes: ", stats[kDiskWriteCount],
+        ", disk write micros: ", stats[kDiskWriteMicros],
+        ", elapsed micros: ", stats[kElapsedMicros]);
+  }
+
+ private:
+  static constexpr int64 kSketchDepth = 4;
+  static constexpr int64 kSketchWidth = 4096;
+  static constexpr uint64 kSketchSeed = 0x9e3779b97f4a7c15ULL;
+  // Far below the max of uint32, concurrent adds don't wrap before the
+  // halving.
+  static constexpr uint32 kHalveThreshold = 1u << 30;
+
+  void UpdateHotIds(K key, int64 estimate) {
+    mutex_lock l(mu_, std::try_to_lock);
+    if (l.mutex() == nullptr) return;
+    auto it = std::find_if(hot_ids_.begin(), hot_ids_.end(),
+                           [key](const std::pair<K, int64>& p) {
+                             return p.first == key;
+                           });
+    if (it != hot_ids_.end()) {
+      it->second = std::max(it->second, estimate);
+    } else if (static_cast<int64>(hot_ids_.size()) < top_k_) {
+      hot_ids_.emplace_back(key, estimate);
+    } else {
+      auto min_it = std::min_element(
+          hot_ids_.begin(), hot_ids_.end(),
+          [](const std::pair<K, int64>& a, const std::pair<K, int64>& b) {
+            return a.second < b.second;
+          });
+      if (estimate <= min_it->second) return;
+      *min_it = std::make_pair(key, estimate);
+    }
+    if (static_cast<int64>(hot_ids_.size()) == top_k_) {
+      int64 min_count = hot_ids_[0].second;
+      for (const auto& p : hot_ids_) {
+        min_count = std::min(min_count, p.second);
+      }
+      min_hot_count_.store(min_count, std::memory_order_relaxed);
+    }
+  }
+
+  // Halves the sketch and the counts of the heavy hitters, the adds that
+  // race with it are kept or halved.
+  void Halve() {
+    mutex_lock l(mu_);
+    // Another thread may have halved it already.
+    if (MaxSketchCount() >= kHalveThreshold) {
+      for (int64 i = 0; i < kSketchDepth * kSketchWidth; ++i) {
+        sketch_[i].store(sketch_[i].load(std::memory_order_relaxed) / 2,
+                         std::memory_order_relaxed);
+      }
+      for (auto& p : hot_ids_) {
+        p.second /= 2;
+      }
+      min_hot_count_.store(min_hot_count_.load(std::memory_order_relaxed) / 2,
+                           std::memory_order_relaxed);
+    }
+  }
+
+  uint32 MaxSketchCount() const {
+    uint32 max_count = 0;
+    for (int64 i = 0; i < kSketchDepth * kSketchWidth; ++i) {
+      max_count = std::max(max_count,
+                           sketch_[i].load(std::memory_order_relaxed));
+    }
+    return max_count;
+  }
+
+  const int64 top_k_;
+  const int64 sample_rate_;
+  std::atomic<int64> counters_[kNumEmbeddingStatistics];
+  std::atomic<uint64> start_micros_;
+  std::unique_ptr<std::atomic<uint32>[]> sketch_;
+  std::atomic<int64> min_hot_count_;
+  mutable mutex mu_;
+  std::vector<std::pair<K, int64>> hot_ids_ GUARDED_BY(mu_);
+};
+
+}  // namespace embedding
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_EMBEDDING_STATS_H_
@@ -61,11 +61,11 @@ class EmbeddingVar : public ResourceBase {
           add_freq_fn_ = [](ValuePtr<V>* value_ptr, int freq, int64 filter_freq) {};
         }
         if (emb_config_.steps_to_live != 0 || emb_config_.record_version){
-          update_version_fn_ = [](ValuePtr<V>* value_ptr, int64 gs) {
+          update_version_fn_ = [](K key, ValuePtr<V>* value_ptr, int64 gs) {
             value_ptr->SetStep(gs);
           };
         } else {
-          update_version_fn_ = [](ValuePtr<V>* value_ptr, int64 gs) {};
+          update_version_fn_ = [](K key, ValuePtr<V>* value_ptr, int64 gs) {};
         }
       }
 
@@ -87,6 +87,18 @@ class EmbeddingVar : public ResourceBase {
       if (LayoutType::NORMAL_CONTIGUOUS == storage_manager_->GetLayoutType()) {
         storage_manager_->SetAllocLen(value_len_, emb_config_.slot_num + 1);
       }
+      if (emb_config_.steps_to_live > 0) {
+        storage_manager_->EnableStepEviction(emb_config_.steps_to_live);
+        embedding::StepBucketIndex<K>* step_index =
+            storage_manager_->StepIndex();
+        if (step_index != nullptr) {
+          update_version_fn_ = [step_index](K key, ValuePtr<V>* value_ptr,
+                                            int64 gs) {
+            value_ptr->SetStep(gs);
+            step_index->UpdateGlobalStep(gs);
+          };
+        }
+      }
       return Status::OK();
     }
   }
@@ -109,8 +121,48 @@ class EmbeddingVar : public ResourceBase {
     return s;
   }
 
-  void UpdateVersion(ValuePtr<V>* value_ptr, int64 gs) {
-    update_version_fn_(value_ptr, gs);
+  // Brings 'key' into the first storage tier ahead of its lookup, new ids
+  // are created with the default value. Ids of a filtered variable are not
+  // admitted here, their frequencies are only counted by the lookup itself.
+  Status Prefetch(K key) {
+    if (emb_config_.filter_freq != 0) {
+      return storage_manager_->Promote(
+          key, emb_config_.total_num(storage_manager_->GetAllocLen()));
+    }
+    ValuePtr<V>* value_ptr = nullptr;
+    TF_RETURN_IF_ERROR(LookupOrCreateKey(key, &value_ptr));
+    LookupOrCreateEmb(value_ptr, GetDefaultValue(key));
+    return Status::OK();
+  }
+
+  // Prefetch of 'n' ids, the rows in the lower tiers of a multi-level
+  // variable are read in a batch first.
+  Status BatchPrefetch(const K* keys, int64 n) {
+    if (storage_manager_->IsMultiLevel()) {
+      TF_RETURN_IF_ERROR(BatchPromote(keys, n));
+    }
+    for (int64 i = 0; i < n; ++i) {
+      TF_RETURN_IF_ERROR(Prefetch(keys[i]));
+    }
+    return Status::OK();
+  }
+
+  // Moves the rows of 'keys' found in the lower tiers to the first one,
+  // each lower tier is read with one batched lookup.
+  Status BatchPromote(const K* keys, int64 n) {
+    return storage_manager_->BatchPromote(
+        keys, n, emb_config_.total_num(storage_manager_->GetAllocLen()));
+  }
+
+  // True if the row of 'key' is in the first storage tier, so that its
+  // lookup does not read the lower tiers.
+  bool IsInFirstTier(K key) {
+    ValuePtr<V>* value_ptr = nullptr;
+    return storage_manager_->LookupFirstTier(key, &value_ptr).ok();
+  }
+
+  void UpdateVersion(K key, ValuePtr<V>* value_ptr, int64 gs) {
+    update_version_fn_(key, value_ptr, gs);
   }
 
   void BatchCommit(std::vector<K> keys, std::vector<ValuePtr<V>*> value_ptrs) {
@@ -183,6 +235,10 @@ class EmbeddingVar : public ResourceBase {
     return storage_manager_->IsMultiLevel();
   }
 
+  embedding::NumaPlacement* GetNumaPlacement() const {
+    return storage_manager_->GetNumaPlacement();
+  }
+
   bool IsRecordFreq() {
     return emb_config_.record_freq;
   }
@@ -278,7 +334,7 @@ class EmbeddingVar : public ResourceBase {
   EmbeddingConfig emb_config_;
   EmbeddingFilter<K, V, EmbeddingVar<K, V>>* filter_;
   std::function<void(ValuePtr<V>*, int, int64)> add_freq_fn_;
-  std::function<void(ValuePtr<V>*, int64)> update_version_fn_;
+  std::function<void(K, ValuePtr<V>*, int64)> update_version_fn_;
 
   ~EmbeddingVar() override {
     // When dynamic dimension embedding is used, there will be more than one primary slot
@@ -24,6 +24,9 @@ template <class V>
 class ValuePtr;
 
 namespace embedding {
+template <class K>
+class EmbeddingStats;
+
 class Iterator {
  public:
   Iterator() {};
@@ -69,6 +72,13 @@ class KVInterface {
 
   virtual void SetTotalDims(int total_dims) {}
 
+  // Sizes the KV for 'num_keys' keys before they are inserted.
+  virtual void Reserve(int64 num_keys) {}
+
+  // Statistics of the EmbeddingVariable, to count the reads and writes of
+  // the storage. Not owned.
+  virtual void SetStats(EmbeddingStats<K>* stats) {}
+
   virtual void FreeValuePtr(ValuePtr<V>* value_ptr) {}
 
   virtual Status Commit(K key, const ValuePtr<V>* value_ptr) {return Status::OK();}
@@ -3,15 +3,22 @@
 
 #include "tensorflow/core/lib/io/path.h"
 
+#include "tensorflow/core/framework/embedding/embedding_stats.h"
 #include "tensorflow/core/framework/embedding/kv_interface.h"
 #include "tensorflow/core/framework/embedding/value_ptr.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/env_var.h"
 
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/comparator.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/write_batch.h"
 
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
 
 using leveldb::DB;
 using leveldb::Options;
@@ -85,14 +92,61 @@ class DBIterator : public Iterator {
   leveldb::Iterator* it_;
 };
 
+// The LevelDB storage tier. The DB is configured by environment variables:
+//
+//   TF_EV_LEVELDB_BLOCK_CACHE_MB   LRU cache of uncompressed blocks, 64 by
+//                                  default, 0 uses the 8MB cache of LevelDB.
+//   TF_EV_LEVELDB_BLOOM_BITS       bits per key of the bloom filter, 10 by
+//                                  default, 0 disables the filter.
+//   TF_EV_LEVELDB_COMPRESSION      "snappy", the default, or "none".
+//   TF_EV_LEVELDB_WRITE_BUFFER_MB  memtable size, 0 for the 4MB of LevelDB.
+//   TF_EV_LEVELDB_WRITE_BATCH      rows buffered by Commit before they are
+//                                  written with one WriteBatch, 1024 by
+//                                  default, 0 writes every row.
+//
+// Committed rows are readable from the write buffer until they are
+// written, the buffer is flushed before the DB is iterated or closed.
 template <class K, class V>
 class LevelDBKV : public KVInterface<K, V> {
  public:
   LevelDBKV(std::string path) {
     path_ = io::JoinPath(path, "level_db_" + std::to_string(Env::Default()->NowMicros()));;
     options_.create_if_missing = true;
+    int64 block_cache_mb = 64;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_LEVELDB_BLOCK_CACHE_MB",
+                                    block_cache_mb, &block_cache_mb));
+    if (block_cache_mb > 0) {
+      block_cache_.reset(leveldb::NewLRUCache(block_cache_mb << 20));
+      options_.block_cache = block_cache_.get();
+    }
+    int64 bloom_bits = 10;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_LEVELDB_BLOOM_BITS",
+                                    bloom_bits, &bloom_bits));
+    if (bloom_bits > 0) {
+      filter_policy_.reset(leveldb::NewBloomFilterPolicy(bloom_bits));
+      options_.filter_policy = filter_policy_.get();
+    }
+    std::string compression;
+    TF_CHECK_OK(ReadStringFromEnvVar("TF_EV_LEVELDB_COMPRESSION", "snappy",
+                                     &compression));
+    if (compression == "none") {
+      options_.compression = leveldb::kNoCompression;
+    } else {
+      LOG_IF(WARNING, compression != "snappy")
+          << "Unknown TF_EV_LEVELDB_COMPRESSION: " << compression
+          << ", use snappy.";
+      options_.compression = leveldb::kSnappyCompression;
+    }
+    int64 write_buffer_mb = 0;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_LEVELDB_WRITE_BUFFER_MB",
+                                    write_buffer_mb, &write_buffer_mb));
+    if (write_buffer_mb > 0) {
+      options_.write_buffer_size = write_buffer_mb << 20;
+    }
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_LEVELDB_WRITE_BATCH", 1024,
+                                    &write_batch_size_));
     leveldb::Status s = leveldb::DB::Open(options_, path_, &db_);
-    CHECK(s.ok());
+    CHECK(s.ok()) << s.ToString();
     counter_ =  new SizeCounter<K>(8);
     new_value_ptr_fn_ = [] (size_t size) { return new NormalContiguousValuePtr<V>(cpu_allocator(), size); };
     total_dims_ = 0;
@@ -102,24 +156,49 @@ class LevelDBKV : public KVInterface<K, V> {
     total_dims_ = total_dims;
   }
 
+  void SetStats(EmbeddingStats<K>* stats) {
+    stats_ = stats;
+  }
+
   ~LevelDBKV() {
+    Status s = Flush();
+    LOG_IF(ERROR, !s.ok()) << s.ToString();
     delete db_;
+    delete counter_;
   }
 
   Status Lookup(K key, ValuePtr<V>** value_ptr) {
     std::string val_str;
-    leveldb::Slice db_key((char*)(&key), sizeof(void*));
-    leveldb::ReadOptions options;
-    leveldb::Status s = db_->Get(options, db_key, &val_str);
-    if (s.IsNotFound()) {
+    if (!ReadRow(key, ReadOptions(), &val_str)) {
       return errors::NotFound(
           "Unable to find Key: ", key, " in LevelDB.");
-    } else {
-      ValuePtr<V>* val = new_value_ptr_fn_(total_dims_);
-      memcpy((int64 *)(val->GetPtr()), &val_str[0], val_str.length());
-      *value_ptr = val;
-      return Status::OK();
     }
+    *value_ptr = NewValuePtr(val_str);
+    return Status::OK();
+  }
+
+  // Reads the rows in the order of their DB keys with one snapshot, so
+  // that neighbouring rows are read from the same blocks. *value_ptrs[i] is
+  // nullptr if keys[i] is not found.
+  Status BatchLookup(std::vector<K> keys,
+                     std::vector<ValuePtr<V>**> value_ptrs) {
+    std::vector<int64> order(keys.size());
+    for (int64 i = 0; i < static_cast<int64>(order.size()); ++i) {
+      order[i] = i;
+    }
+    const leveldb::Comparator* cmp = options_.comparator;
+    std::sort(order.begin(), order.end(), [&keys, cmp](int64 a, int64 b) {
+      return cmp->Compare(DBKey(keys[a]), DBKey(keys[b])) < 0;
+    });
+    ReadOptions options;
+    options.snapshot = db_->GetSnapshot();
+    std::string val_str;
+    for (int64 i : order) {
+      *value_ptrs[i] = ReadRow(keys[i], options, &val_str) ?
+          NewValuePtr(val_str) : nullptr;
+    }
+    db_->ReleaseSnapshot(options.snapshot);
+    return Status::OK();
   }
 
   Status Insert(K key, const ValuePtr<V>* value_ptr) {
@@ -132,33 +211,69 @@ class LevelDBKV : public KVInterface<K, V> {
   } 
 
   Status BatchCommit(std::vector<K> keys, std::vector<ValuePtr<V>*> value_ptrs) {
+    mutex_lock fl(flush_mu_);
+    {
+      // The buffered rows are older.
+      mutex_lock l(write_mu_);
+      for (const K& key : keys) {
+        pending_.erase(key);
+      }
+    }
     WriteBatch batch;
     for (int i = 0; i < keys.size(); i++) {
-      std::string value_res((char*)value_ptrs[i]->GetPtr(), sizeof(FixedLengthHeader) + total_dims_ * sizeof(V));
-      leveldb::Slice db_key((char*)(&keys[i]), sizeof(void*));
-      batch.Put(db_key, value_res);
+      batch.Put(DBKey(keys[i]), Serialize(value_ptrs[i]));
       delete value_ptrs[i];
     }
-    db_->Write(WriteOptions(),&batch);
-    return Status::OK();
+    return Write(&batch, keys.size());
   }
 
+  // Buffers the row, the buffer is written with one WriteBatch once it has
+  // TF_EV_LEVELDB_WRITE_BATCH rows.
   Status Commit(K key, const ValuePtr<V>* value_ptr) {
-    std::string value_res((char*)value_ptr->GetPtr(), sizeof(FixedLengthHeader) + total_dims_ * sizeof(V));
-    leveldb::Slice db_key((char*)(&key), sizeof(void*));
-    leveldb::Status s = db_->Put(WriteOptions(), db_key, value_res);
-    if (!s.ok()){
-      return errors::AlreadyExists(
-          "already exists Key: ", key, " in RocksDB.");
-    } else {
-      return Status::OK();
+    if (write_batch_size_ <= 0) {
+      WriteBatch batch;
+      batch.Put(DBKey(key), Serialize(value_ptr));
+      return Write(&batch, 1);
+    }
+    bool full = false;
+    {
+      mutex_lock l(write_mu_);
+      pending_[key] = Serialize(value_ptr);
+      full = static_cast<int64>(pending_.size()) >= write_batch_size_;
     }
+    return full ? Flush() : Status::OK();
+  }
+
+  // Writes the buffered rows. They are moved to 'flushing_', still
+  // readable, while they are written.
+  Status Flush() {
+    mutex_lock fl(flush_mu_);
+    {
+      mutex_lock l(write_mu_);
+      if (pending_.empty()) {
+        return Status::OK();
+      }
+      flushing_.swap(pending_);
+    }
+    // 'flushing_' is only changed with flush_mu_ held.
+    WriteBatch batch;
+    for (const auto& row : flushing_) {
+      batch.Put(DBKey(row.first), row.second);
+    }
+    Status s = Write(&batch, flushing_.size());
+    mutex_lock l(write_mu_);
+    flushing_.clear();
+    return s;
   }
 
   Status Remove(K key) {
     counter_->sub(key, 1);
-    leveldb::Slice db_key((char*)(&key), sizeof(void*));
-    leveldb::Status s = db_->Delete(WriteOptions(), db_key);
+    mutex_lock fl(flush_mu_);
+    {
+      mutex_lock l(write_mu_);
+      pending_.erase(key);
+    }
+    leveldb::Status s = db_->Delete(WriteOptions(), DBKey(key));
     if (s.ok()) {
       return Status::OK();
     } else {
@@ -172,6 +287,8 @@ class LevelDBKV : public KVInterface<K, V> {
   }
 
   Iterator* GetIterator() {
+    Status s = Flush();
+    LOG_IF(ERROR, !s.ok()) << s.ToString();
     ReadOptions options;
     options.snapshot = db_->GetSnapshot();
     leveldb::Iterator* it = db_->NewIterator(options);
@@ -189,13 +306,81 @@ class LevelDBKV : public KVInterface<K, V> {
   std::string DebugString() const {
     return "";
   }
+
  private:
+  static leveldb::Slice DBKey(const K& key) {
+    return leveldb::Slice((char*)(&key), sizeof(void*));
+  }
+
+  std::string Serialize(const ValuePtr<V>* value_ptr) const {
+    return std::string((char*)value_ptr->GetPtr(),
+                       sizeof(FixedLengthHeader) + total_dims_ * sizeof(V));
+  }
+
+  ValuePtr<V>* NewValuePtr(const std::string& val_str) const {
+    ValuePtr<V>* val = new_value_ptr_fn_(total_dims_);
+    memcpy((int64 *)(val->GetPtr()), &val_str[0], val_str.length());
+    return val;
+  }
+
+  // Reads the row of 'key' from the write buffer or the DB, returns false
+  // if it is not found. Only the reads of the DB are disk reads.
+  bool ReadRow(K key, const ReadOptions& options, std::string* val_str) {
+    {
+      mutex_lock l(write_mu_);
+      auto it = pending_.find(key);
+      bool found = it != pending_.end();
+      if (!found) {
+        it = flushing_.find(key);
+        found = it != flushing_.end();
+      }
+      if (found) {
+        *val_str = it->second;
+        return true;
+      }
+    }
+    const uint64 start = stats_ ? Env::Default()->NowMicros() : 0;
+    leveldb::Status s = db_->Get(options, DBKey(key), val_str);
+    LOG_IF(ERROR, !s.ok() && !s.IsNotFound())
+        << "Failed to read Key: " << key << " from LevelDB: " << s.ToString();
+    if (stats_) {
+      stats_->Add(kDiskReadCount, 1);
+      if (!s.ok()) stats_->Add(kDiskReadMissCount, 1);
+      stats_->Add(kDiskReadMicros, Env::Default()->NowMicros() - start);
+    }
+    return s.ok();
+  }
+
+  Status Write(WriteBatch* batch, int64 rows) {
+    const uint64 start = stats_ ? Env::Default()->NowMicros() : 0;
+    leveldb::Status s = db_->Write(WriteOptions(), batch);
+    if (stats_) {
+      stats_->Add(kDiskWriteCount, rows);
+      stats_->Add(kDiskWriteMicros, Env::Default()->NowMicros() - start);
+    }
+    if (!s.ok()) {
+      return errors::Internal("Failed to write ", rows, " rows to LevelDB: ",
+                              s.ToString());
+    }
+    return Status::OK();
+  }
+
   DB* db_;
   SizeCounter<K>* counter_;
   Options options_;
+  std::unique_ptr<leveldb::Cache> block_cache_;
+  std::unique_ptr<const leveldb::FilterPolicy> filter_policy_;
   std::string path_;
   std::function<ValuePtr<V>*(size_t)> new_value_ptr_fn_;
   int total_dims_;
+  EmbeddingStats<K>* stats_ = nullptr;  // not owned
+
+  int64 write_batch_size_;
+  // Serializes the writes of the buffered rows with the other writes.
+  mutex flush_mu_;
+  mutex write_mu_;
+  std::unordered_map<K, std::string> pending_ GUARDED_BY(write_mu_);
+  std::unordered_map<K, std::string> flushing_;
 };
 
 } //namespace embedding
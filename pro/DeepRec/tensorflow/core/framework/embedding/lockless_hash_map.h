@@ -16,9 +16,17 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_LOCKLESS_HASH_MAP_H_
 #define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_LOCKLESS_HASH_MAP_H_
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "sparsehash/dense_hash_map_lockless"
 #include "tensorflow/core/framework/embedding/kv_interface.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 template <class V>
@@ -26,21 +34,36 @@ class ValuePtr;
 
 namespace embedding {
 
+// The keys are spread over segments, each one a dense_hash_map_lockless.
+// dense_hash_map_lockless grows by rehashing the whole table while its
+// writers wait, so with segments a growth rehashes 1/num_segments of the
+// keys, and the growths of the segments are spread over time instead of
+// stalling a step. Set by 'TF_EV_HASH_MAP_SEGMENTS', 16 by default.
 template <class K, class V>
 class LocklessHashMap : public KVInterface<K, V> {
  public:
-  LocklessHashMap() {
-    hash_map_.max_load_factor(0.8);
-    hash_map_.set_empty_key_and_value(LocklessHashMap<K, V>::EMPTY_KEY_, nullptr);
-    hash_map_.set_counternum(16);
-    hash_map_.set_deleted_key(LocklessHashMap<K, V>::DELETED_KEY_);
+  explicit LocklessHashMap(int num_segments = DefaultSegments())
+      : segments_(std::max(num_segments, 1)) {
+    for (auto& segment : segments_) {
+      segment.map = NewMap(0);
+    }
   }
 
   ~LocklessHashMap() {
+    for (auto& segment : segments_) {
+      delete segment.map.load();
+    }
   }
 
   Status Lookup(K key, ValuePtr<V>** value_ptr) {
-    auto iter = hash_map_.find_wait_free(key);
+    Segment& segment = SegmentOf(key);
+    auto iter = segment.map.load()->find_wait_free(key);
+    if (iter.first == LocklessHashMap<K, V>::EMPTY_KEY_) {
+      LockLessHashMap* draining = segment.draining.load();
+      if (draining != nullptr) {
+        iter = draining->find_wait_free(key);
+      }
+    }
     if (iter.first == LocklessHashMap<K, V>::EMPTY_KEY_) {
       return errors::NotFound(
           "Unable to find Key: ", key, " in LocklessHashMap.");
@@ -51,8 +74,16 @@ class LocklessHashMap : public KVInterface<K, V> {
   }
 
   Status Insert(K key, const ValuePtr<V>* value_ptr) {
-    auto iter = hash_map_.insert_lockless(
+    Segment& segment = SegmentOf(key);
+    LockLessHashMap* map = segment.map.load();
+    auto iter = map->insert_lockless(
         std::move(std::pair<K, ValuePtr<V>*>(key, const_cast<ValuePtr<V>*>(value_ptr))));
+    // The segment is replaced by Reserve() meanwhile, insert to the new map.
+    while (segment.map.load() != map) {
+      map = segment.map.load();
+      iter = map->insert_lockless(
+          std::move(std::pair<K, ValuePtr<V>*>(key, const_cast<ValuePtr<V>*>(value_ptr))));
+    }
     // insert fail, exist key
     if ((*(iter.first)).second != value_ptr){
       return errors::AlreadyExists(
@@ -64,12 +95,29 @@ class LocklessHashMap : public KVInterface<K, V> {
 
   // Other Method
   int64 Size() const {
-    return hash_map_.size_lockless();
+    int64 size = 0;
+    for (auto& segment : segments_) {
+      size += segment.map.load()->size_lockless();
+    }
+    return size;
   }
 
   // Remove KV
   Status Remove(K key) {
-    if (hash_map_.erase_lockless(key)) {
+    Segment& segment = SegmentOf(key);
+    bool erased = false;
+    LockLessHashMap* draining = segment.draining.load();
+    if (draining != nullptr && draining->erase_lockless(key)) {
+      erased = true;
+    }
+    LockLessHashMap* map = nullptr;
+    do {
+      map = segment.map.load();
+      if (map->erase_lockless(key)) {
+        erased = true;
+      }
+    } while (segment.map.load() != map);
+    if (erased) {
       return Status::OK();
     } else {
       return errors::NotFound(
@@ -77,10 +125,103 @@ class LocklessHashMap : public KVInterface<K, V> {
     }
   }
 
+  // Sizes the empty segments for 'num_keys' keys, e.g. before restoring,
+  // so that they don't grow while the keys are inserted. Segments which
+  // already have keys are left as they are.
+  void Reserve(int64 num_keys) {
+    // A quarter more for the keys which are not evenly spread.
+    const int64 keys_per_segment =
+        num_keys / segments_.size() + num_keys / segments_.size() / 4 + 1;
+    mutex_lock l(reserve_mu_);
+    for (auto& segment : segments_) {
+      LockLessHashMap* map = segment.map.load();
+      if (map->size_lockless() > 0 ||
+          map->bucket_count() >= 2 * keys_per_segment) {
+        continue;
+      }
+      LockLessHashMap* reserved = NewMap(keys_per_segment);
+      segment.draining = map;
+      segment.map = reserved;
+      // Copy the keys inserted before the new map was seen.
+      CopyKeys(map, reserved);
+      segment.draining = nullptr;
+      retired_.emplace_back(map);
+    }
+  }
+
   Status GetSnapshot(std::vector<K>* key_list, std::vector<ValuePtr<V>* >* value_ptr_list) {
+    for (auto& segment : segments_) {
+      GetSnapshot(segment.map.load(), key_list, value_ptr_list);
+    }
+    return Status::OK();
+  }
+
+  std::string DebugString() const {
+    int64 bucket_count = 0;
+    for (auto& segment : segments_) {
+      bucket_count += segment.map.load()->bucket_count();
+    }
+    LOG(INFO) << "map info size:" << Size();
+    LOG(INFO) << "map info segments:" << segments_.size();
+    LOG(INFO) << "map info bucket_count:" << bucket_count;
+    LOG(INFO) << "map info load_factor:" << (double)Size() / bucket_count;
+    LOG(INFO) << "map info max_load_factor:"
+              << segments_[0].map.load()->max_load_factor();
+    LOG(INFO) << "map info min_load_factor:"
+              << segments_[0].map.load()->min_load_factor();
+    return "";
+  }
+
+ private:
+  typedef google::dense_hash_map_lockless<K, ValuePtr<V>* > LockLessHashMap;
+
+  struct Segment {
+    std::atomic<LockLessHashMap*> map{nullptr};
+    // The map replaced by Reserve() while its keys are copied.
+    std::atomic<LockLessHashMap*> draining{nullptr};
+  };
+
+  static int DefaultSegments() {
+    static int segments = [] {
+      int64 n = 16;
+      Status s = ReadInt64FromEnvVar("TF_EV_HASH_MAP_SEGMENTS", 16, &n);
+      if (!s.ok()) {
+        LOG(WARNING) << "Read TF_EV_HASH_MAP_SEGMENTS envrionment error. "
+                     << s.error_message();
+      }
+      return static_cast<int>(std::max<int64>(n, 1));
+    }();
+    return segments;
+  }
+
+  static LockLessHashMap* NewMap(int64 num_keys) {
+    auto map = new LockLessHashMap();
+    map->max_load_factor(0.8);
+    map->set_empty_key_and_value(LocklessHashMap<K, V>::EMPTY_KEY_, nullptr);
+    map->set_counternum(16);
+    map->set_deleted_key(LocklessHashMap<K, V>::DELETED_KEY_);
+    if (num_keys > 0) {
+      // Lockless inserts double the table at half load.
+      map->resize(num_keys);
+      if (map->bucket_count() < 2 * num_keys) {
+        map->resize(2 * num_keys);
+      }
+    }
+    return map;
+  }
+
+  // The bucket of a key in a segment is taken from the low bits of the
+  // key, so the segment is taken from the high bits of a hash of it.
+  Segment& SegmentOf(K key) {
+    const uint64 h = static_cast<uint64>(key) * 0xC2B2AE3D27D4EB4FULL;
+    return segments_[(h >> 40) % segments_.size()];
+  }
+
+  static void GetSnapshot(LockLessHashMap* map, std::vector<K>* key_list,
+                          std::vector<ValuePtr<V>* >* value_ptr_list) {
     std::pair<const K, ValuePtr<V>*> *hash_map_dump;
     int64 bucket_count;
-    std::pair<std::pair<const K, ValuePtr<V>*>*, long unsigned int> it = hash_map_.GetSnapshot();
+    std::pair<std::pair<const K, ValuePtr<V>*>*, long unsigned int> it = map->GetSnapshot();
     hash_map_dump = it.first;
     bucket_count = it.second;
     for (int64 j = 0; j < bucket_count; j++) {
@@ -91,23 +232,25 @@ class LocklessHashMap : public KVInterface<K, V> {
       }
     }
     free(hash_map_dump);
-    return Status::OK();
   }
 
-  std::string DebugString() const {
-    LOG(INFO) << "map info size:" << Size();
-    LOG(INFO) << "map info bucket_count:" << hash_map_.bucket_count();
-    LOG(INFO) << "map info load_factor:" << hash_map_.load_factor();
-    LOG(INFO) << "map info max_load_factor:" << hash_map_.max_load_factor();
-    LOG(INFO) << "map info min_load_factor:" << hash_map_.min_load_factor();
-    return "";
+  static void CopyKeys(LockLessHashMap* from, LockLessHashMap* to) {
+    std::vector<K> key_list;
+    std::vector<ValuePtr<V>*> value_ptr_list;
+    GetSnapshot(from, &key_list, &value_ptr_list);
+    for (size_t i = 0; i < key_list.size(); ++i) {
+      to->insert_lockless(
+          std::move(std::pair<K, ValuePtr<V>*>(key_list[i], value_ptr_list[i])));
+    }
   }
 
- private:
-  typedef google::dense_hash_map_lockless<K, ValuePtr<V>* > LockLessHashMap;
   static const int EMPTY_KEY_;
   static const int DELETED_KEY_;
-  LockLessHashMap hash_map_;
+  std::vector<Segment> segments_;
+
+  // The maps replaced by Reserve(), lookups may still read them.
+  mutex reserve_mu_;
+  std::vector<std::unique_ptr<LockLessHashMap>> retired_ GUARDED_BY(reserve_mu_);
 };
 template <class K, class V>
 const int LocklessHashMap<K, V>::EMPTY_KEY_ = -1;
@@ -1,15 +1,27 @@
 #ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_MULTILEVEL_EMBEDDING_H_
 #define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_MULTILEVEL_EMBEDDING_H_
 
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+
 #include "tensorflow/core/framework/embedding/cache.h"
 #include "tensorflow/core/framework/embedding/config.pb.h"
 #include "tensorflow/core/framework/embedding/dense_hash_map.h"
+#include "tensorflow/core/framework/embedding/embedding_stats.h"
 #include "tensorflow/core/framework/embedding/leveldb_kv.h"
 #include "tensorflow/core/framework/embedding/ssd_hashkv.h"
 #include "tensorflow/core/framework/embedding/lockless_hash_map.h"
+#include "tensorflow/core/framework/embedding/numa_hash_map.h"
+#include "tensorflow/core/framework/embedding/numa_placement.h"
+#include "tensorflow/core/framework/embedding/persistent_hash_map.h"
+#include "tensorflow/core/framework/embedding/reduced_precision.h"
+#include "tensorflow/core/framework/embedding/step_bucket_index.h"
 #include "tensorflow/core/framework/embedding/kv_interface.h"
+#include "tensorflow/core/framework/tracking_allocator.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 template <class V>
@@ -58,11 +70,18 @@ class StorageManager {
   cache_(nullptr),
   cache_capacity_(cap),
   eviction_thread_(nullptr),
+  step_eviction_thread_(nullptr),
+  step_eviction_interval_ms_(1000),
+  step_eviction_batch_(4096),
   total_dims_(0),
   alloc_len_(0),
-  is_multi_level_(false) {}
+  is_multi_level_(false),
+  is_persistent_(false),
+  is_recovered_(false),
+  numa_placement_(nullptr) {}
 
   ~StorageManager() {
+    StopStepEviction();
     for (auto kv: kvs_) {
       delete kv.first;
     }
@@ -89,17 +108,49 @@ class StorageManager {
       Allocator* alloc_ssd;
       case StorageType::DRAM:
         VLOG(1) << "StorageManager::DRAM: " << name_;
-        kvs_.push_back(std::make_pair(new LocklessHashMap<K, V>(), ev_allocator()));
+        numa_placement_ = NumaPlacement::Get();
+        if (numa_placement_ != nullptr) {
+          kvs_.push_back(std::make_pair(
+              new NumaLocklessHashMap<K, V>(numa_placement_), ev_allocator()));
+        } else {
+          kvs_.push_back(std::make_pair(new LocklessHashMap<K, V>(), ev_allocator()));
+        }
         break;
       case StorageType::PMEM_MEMKIND:
         VLOG(1) << "StorageManager::PMEM_MEMKIND: " << name_;
         kvs_.push_back(std::make_pair(new LocklessHashMap<K, V>(), pmem_allocator()));
         break;
-      case StorageType::PMEM_LIBPMEM:
+      case StorageType::PMEM_LIBPMEM: {
         VLOG(1) << "StorageManager::PMEM_LIBPMEM: " << name_;
-        kvs_.push_back(std::make_pair(new LocklessHashMap<K, V>(),
-                                      experimental_pmem_allocator(sc_.path, sc_.size[0])));
+        Allocator* alloc_pmem = experimental_pmem_allocator(sc_.path, sc_.size[0]);
+#ifdef TENSORFLOW_USE_PMEM
+        // The allocator is wrapped when full allocation stats are collected.
+        Allocator* base_alloc = alloc_pmem;
+        auto tracking_alloc = dynamic_cast<TrackingAllocator*>(alloc_pmem);
+        if (tracking_alloc != nullptr) {
+          base_alloc = tracking_alloc->wrapped();
+        }
+        auto persistent_alloc = dynamic_cast<ExperimentalPMemAllocator*>(base_alloc);
+        if (persistent_alloc != nullptr && persistent_alloc->Persistent()) {
+          if (sc_.layout_type == LayoutType::NORMAL_CONTIGUOUS) {
+            auto kv = new PersistentHashMap<K, V>(name_, sc_.path, persistent_alloc);
+            Status s = kv->Init();
+            if (!s.ok()) {
+              delete kv;
+              return s;
+            }
+            is_persistent_ = true;
+            is_recovered_ = kv->Recovered();
+            kvs_.push_back(std::make_pair(kv, alloc_pmem));
+            break;
+          }
+          LOG(WARNING) << "Persistent PMEM_LIBPMEM needs layout normal_contiguous, "
+                       << name_ << " is not kept across restarts.";
+        }
+#endif  // TENSORFLOW_USE_PMEM
+        kvs_.push_back(std::make_pair(new LocklessHashMap<K, V>(), alloc_pmem));
         break;
+      }
       case StorageType::LEVELDB:
         VLOG(1) << "StorageManager::LEVELDB: " << name_;
         kvs_.push_back(std::make_pair(new LevelDBKV<K, V>(sc_.path), ev_allocator()));
@@ -139,6 +190,31 @@ class StorageManager {
     }
 
     hash_table_count_ = kvs_.size();
+    for (int i = 0; i < hash_table_count_; ++i) {
+      // Lookups of these levels read the value from disk.
+      level_on_disk_.push_back(
+          sc_.type == StorageType::LEVELDB ||
+          sc_.type == StorageType::SSDHASH ||
+          (i > 0 && (sc_.type == StorageType::DRAM_LEVELDB ||
+                     sc_.type == StorageType::DRAM_SSDHASH)));
+    }
+    bool enable_stats = true;
+    TF_CHECK_OK(ReadBoolFromEnvVar("TF_EV_STATISTICS", true, &enable_stats));
+    if (enable_stats) {
+      int64 top_k = 16;
+      TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_HOT_ID_TOP_K", 16, &top_k));
+      int64 sample_rate = 16;
+      TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_HOT_ID_SAMPLE_RATE", 16,
+                                      &sample_rate));
+      stats_.reset(new EmbeddingStats<K>(top_k, sample_rate));
+      for (auto kv : kvs_) {
+        kv.first->SetStats(stats_.get());
+      }
+    }
+    int64 expected_keys = 0;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_HASH_MAP_RESERVE", 0,
+                                    &expected_keys));
+    Reserve(expected_keys);
     if (hash_table_count_ > 1) {
       cache_ = new LRUCache<K>();
       eviction_thread_ = Env::Default()->StartThread(ThreadOptions(), "EV_Eviction",
@@ -160,7 +236,8 @@ class StorageManager {
     int64 temp = alloc_len_ * slot_num;
     if (temp > total_dims_) {
       total_dims_ = temp;
-      if (sc_.type == StorageType::LEVELDB || sc_.type == StorageType::SSDHASH) {
+      if (sc_.type == StorageType::LEVELDB || sc_.type == StorageType::SSDHASH ||
+          is_persistent_) {
         kvs_[0].first->SetTotalDims(total_dims_);
       } else if (sc_.type == StorageType::DRAM_LEVELDB || sc_.type == StorageType::DRAM_SSDHASH) {
         kvs_[1].first->SetTotalDims(total_dims_);
@@ -206,6 +283,26 @@ class StorageManager {
     return is_multi_level_;
   }
 
+  // Sizes the hash table for 'num_keys' keys, e.g. the keys to restore,
+  // which is only done for the single level storages.
+  void Reserve(int64 num_keys) {
+    if (!is_multi_level_ && num_keys > 0) {
+      kvs_[0].first->Reserve(num_keys);
+    }
+  }
+
+  // The NUMA placement of the keys, nullptr unless the storage is DRAM
+  // and TF_EV_NUMA_AWARE is set.
+  NumaPlacement* GetNumaPlacement() const {
+    return numa_placement_;
+  }
+
+  // True if the rows are reattached from a persistent PMem file of a
+  // previous process, restoring from checkpoint is not needed.
+  bool IsRecovered() {
+    return is_recovered_;
+  }
+
   std::string DebugString() const{
     return strings::StrCat("Level Number: ", hash_table_count_,
                           " alloc_len: ", alloc_len_,
@@ -223,6 +320,90 @@ class StorageManager {
     }
   }
 
+  // Reclaims the rows not updated in 'steps_to_live' steps continuously in
+  // a background thread instead of scanning every row in Shrink(gs), enabled
+  // by 'TF_EV_INCREMENTAL_SHRINK'. The thread wakes up every
+  // 'TF_EV_INCREMENTAL_SHRINK_INTERVAL_MS' and removes the expired rows in
+  // batches of 'TF_EV_INCREMENTAL_SHRINK_BATCH', holding mu_ per batch.
+  // Only a single tier in memory is supported.
+  void EnableStepEviction(int64 steps_to_live) {
+    bool incremental = false;
+    TF_CHECK_OK(ReadBoolFromEnvVar("TF_EV_INCREMENTAL_SHRINK", false,
+                                   &incremental));
+    if (!incremental || steps_to_live <= 0) {
+      return;
+    }
+    mutex_lock l(mu_);
+    if (step_index_) {
+      // Shared with the slots.
+      return;
+    }
+    if (hash_table_count_ > 1 || level_on_disk_[0] || is_persistent_) {
+      LOG(WARNING) << "TF_EV_INCREMENTAL_SHRINK only supports a single "
+                   << "storage tier in memory, " << name_
+                   << " is shrunk when saving checkpoints.";
+      return;
+    }
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_INCREMENTAL_SHRINK_INTERVAL_MS",
+                                    1000, &step_eviction_interval_ms_));
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_INCREMENTAL_SHRINK_BATCH", 4096,
+                                    &step_eviction_batch_));
+    step_index_.reset(new StepBucketIndex<K>(steps_to_live));
+    step_eviction_thread_ = Env::Default()->StartThread(
+        ThreadOptions(), "EV_StepEviction", [this]() { StepEviction(); });
+  }
+
+  // nullptr unless incremental shrink is enabled.
+  StepBucketIndex<K>* StepIndex() {
+    return step_index_.get();
+  }
+
+  // Removes the expired rows of at most 'max_keys' keys of the expired
+  // buckets, returns the number of keys checked. The removed rows are freed
+  // by StepEviction() once the kernels which may have looked them up
+  // before the removal have exited, see EnterEpoch().
+  int64 ShrinkExpired(int64 max_keys) {
+    const int64 gs = step_index_->GlobalStep();
+    const int64 steps_to_live = step_index_->StepsToLive();
+    std::vector<K> keys;
+    step_index_->PopExpired(gs, max_keys, &keys);
+    if (keys.empty()) {
+      return 0;
+    }
+    int64 reclaimed = 0;
+    {
+      mutex_lock l(mu_);
+      // Only advanced under mu_.
+      const int64 epoch = epoch_.load();
+      for (K key : keys) {
+        ValuePtr<V>* value_ptr = nullptr;
+        if (!kvs_[0].first->Lookup(key, &value_ptr).ok()) {
+          // Already removed by another path.
+          continue;
+        }
+        const int64 version = value_ptr->GetStep();
+        if (version == -1) {
+          // Restored without a version, starts to live from now on as in
+          // Shrink(gs).
+          value_ptr->SetStep(gs);
+          step_index_->Add(key, step_index_->Bucket(gs));
+        } else if (gs - version > steps_to_live) {
+          TF_CHECK_OK(kvs_[0].first->Remove(key));
+          retired_value_ptrs_.emplace_back(epoch, value_ptr);
+          ++reclaimed;
+        } else {
+          // Updated since the entry was added, the only entry of the key.
+          step_index_->Add(key, step_index_->Bucket(version));
+        }
+      }
+    }
+    if (stats_) {
+      stats_->Add(kShrinkEvictionCount, reclaimed);
+      stats_->Add(kShrinkEvictionBytes, reclaimed * total_dims_ * sizeof(V));
+    }
+    return keys.size();
+  }
+
   Status GetOrCreate(K key, ValuePtr<V>** value_ptr, size_t size) {
     bool found = false;
     int level = 0;
@@ -233,6 +414,14 @@ class StorageManager {
         break;
       }
     }
+    if (stats_) {
+      if (!found) {
+        stats_->Add(kNewIdCount, 1);
+      } else {
+        if (level > 0) stats_->Add(kTier1HitCount, 1);
+        if (level_on_disk_[level]) stats_->Add(kDiskReadBytes, size * sizeof(V));
+      }
+    }
     if (!found) {
       *value_ptr = new_value_ptr_fn_(kvs_[0].second, size);
     }
@@ -240,6 +429,9 @@ class StorageManager {
       Status s = kvs_[0].first->Insert(key, *value_ptr);
       if (s.ok()) {
         // Insert Success
+        if (!found && step_index_) {
+          step_index_->Add(key, step_index_->Bucket(step_index_->GlobalStep()));
+        }
         return s;
       } else {
         // Insert Failed, key already exist
@@ -252,6 +444,83 @@ class StorageManager {
     return Status::OK();
   }
 
+  // Looks up 'key' in the first tier only.
+  Status LookupFirstTier(K key, ValuePtr<V>** value_ptr) {
+    return kvs_[0].first->Lookup(key, value_ptr);
+  }
+
+  // Moves the row of 'key' from a lower tier to the first one, does nothing
+  // if 'key' is in the first tier or not found.
+  Status Promote(K key, size_t size) {
+    ValuePtr<V>* value_ptr = nullptr;
+    if (kvs_[0].first->Lookup(key, &value_ptr).ok()) {
+      return Status::OK();
+    }
+    for (int level = 1; level < hash_table_count_; ++level) {
+      if (kvs_[level].first->Lookup(key, &value_ptr).ok()) {
+        if (stats_) {
+          stats_->Add(kTier1HitCount, 1);
+          if (level_on_disk_[level]) stats_->Add(kDiskReadBytes, size * sizeof(V));
+        }
+        if (!kvs_[0].first->Insert(key, value_ptr).ok()) {
+          // Promoted concurrently by a lookup.
+          value_ptr->Destroy(kvs_[0].second);
+          delete value_ptr;
+        }
+        break;
+      }
+    }
+    return Status::OK();
+  }
+
+  // Promote of 'n' keys, the keys not in the first tier are read from
+  // each lower tier with one batched lookup.
+  Status BatchPromote(const K* keys, int64 n, size_t size) {
+    std::vector<K> missing;
+    ValuePtr<V>* value_ptr = nullptr;
+    for (int64 i = 0; i < n; ++i) {
+      if (!kvs_[0].first->Lookup(keys[i], &value_ptr).ok()) {
+        missing.push_back(keys[i]);
+      }
+    }
+    for (int level = 1; level < hash_table_count_ && !missing.empty();
+         ++level) {
+      std::vector<ValuePtr<V>*> found(missing.size(), nullptr);
+      std::vector<ValuePtr<V>**> outputs;
+      for (auto& output : found) {
+        outputs.push_back(&output);
+      }
+      Status s = kvs_[level].first->BatchLookup(missing, outputs);
+      if (errors::IsUnimplemented(s)) {
+        for (size_t i = 0; i < missing.size(); ++i) {
+          if (!kvs_[level].first->Lookup(missing[i], &found[i]).ok()) {
+            found[i] = nullptr;
+          }
+        }
+      } else {
+        TF_RETURN_IF_ERROR(s);
+      }
+      std::vector<K> rest;
+      for (size_t i = 0; i < missing.size(); ++i) {
+        if (found[i] == nullptr) {
+          rest.push_back(missing[i]);
+          continue;
+        }
+        if (stats_) {
+          stats_->Add(kTier1HitCount, 1);
+          if (level_on_disk_[level]) stats_->Add(kDiskReadBytes, size * sizeof(V));
+        }
+        if (!kvs_[0].first->Insert(missing[i], found[i]).ok()) {
+          // A duplicated key, or promoted concurrently by a lookup.
+          found[i]->Destroy(kvs_[0].second);
+          delete found[i];
+        }
+      }
+      missing.swap(rest);
+    }
+    return Status::OK();
+  }
+
   Status Remove(K key) {
     for (auto kv : kvs_) {
       kv.first->Remove(key);
@@ -271,6 +540,67 @@ class StorageManager {
     return cache_capacity_;
   }
 
+  // With incremental shrink, kernels and exports reading or updating rows
+  // run in an epoch, see ScopedEpoch. Rows removed in epoch e are freed
+  // when the epoch reaches e + 2. A reader of a later epoch entered after
+  // the removal and can't find the rows, and the epoch only advances from
+  // e + 1 to e + 2 after the readers of epoch e exited. Returns -1 if rows
+  // are not freed in the background.
+  int64 EnterEpoch() {
+    if (!step_index_) {
+      return -1;
+    }
+    while (true) {
+      const int64 epoch = epoch_.load();
+      active_kernels_[epoch & 1].fetch_add(1);
+      if (epoch_.load() == epoch) {
+        return epoch;
+      }
+      // Advanced meanwhile, the counter may be checked for an older epoch.
+      active_kernels_[epoch & 1].fetch_sub(1);
+    }
+  }
+
+  void ExitEpoch(int64 epoch) {
+    if (epoch >= 0) {
+      active_kernels_[epoch & 1].fetch_sub(1);
+    }
+  }
+
+  // Keeps the rows of 'keys' in the first tier until they are unpinned,
+  // the eviction skips pinned ids, so the kernels may hold the ValuePtrs
+  // of a batch larger than the cache. Pins are counted per key. Pin
+  // before looking the keys up, a row evicted before is read back from
+  // the lower tier.
+  //
+  // With incremental shrink the kernel also enters an epoch, the returned
+  // epoch is passed to UnpinIds().
+  int64 PinIds(const K* keys, int64 n) {
+    const int64 epoch = EnterEpoch();
+    if (cache_ == nullptr) {
+      return epoch;
+    }
+    mutex_lock l(pin_mu_);
+    for (int64 i = 0; i < n; ++i) {
+      ++pinned_ids_[keys[i]];
+    }
+    return epoch;
+  }
+
+  void UnpinIds(const K* keys, int64 n, int64 epoch) {
+    ExitEpoch(epoch);
+    if (cache_ == nullptr) {
+      return;
+    }
+    mutex_lock l(pin_mu_);
+    for (int64 i = 0; i < n; ++i) {
+      auto it = pinned_ids_.find(keys[i]);
+      if (it != pinned_ids_.end() && --it->second == 0) {
+        pinned_ids_.erase(it);
+      }
+    }
+  }
+
   Status GetSnapshot(std::vector<K>* key_list,
                      std::vector<ValuePtr<V>* >* value_ptr_list) {
     for (auto kv : kvs_) {
@@ -329,9 +659,11 @@ class StorageManager {
       for (int64 i = 0; i < key_list.size(); ++i) {
         V* val = value_ptr_list[i]->GetValue(emb_config.primary_emb_index, GetOffset(emb_config.primary_emb_index));;
         if (val != nullptr) {
-          V l2_weight = 0.0;
+          typedef typename ComputeType<V>::type TC;
+          TC l2_weight = 0.0;
           for (int64 j = 0; j < value_len; j++) {
-              l2_weight += val[j] * val[j];
+              const TC v = static_cast<TC>(val[j]);
+              l2_weight += v * v;
           }
           l2_weight *= 0.5;
           if (l2_weight < emb_config.l2_weight_threshold) {
@@ -341,15 +673,29 @@ class StorageManager {
       }
       for (const auto it : to_deleted) {
         // TODO memory recycle
+        // Remove before freeing, the KV may read the row to remove it,
+        // e.g. the row offset of the persistent index.
+        kv.first->Remove(it.first);
         (it.second)->Destroy(kv.second);
         delete it.second;
-        kv.first->Remove(it.first);
+      }
+      if (stats_) {
+        stats_->Add(kShrinkEvictionCount, to_deleted.size());
+        stats_->Add(kShrinkEvictionBytes,
+                    to_deleted.size() * total_dims_ * sizeof(V));
       }
     }
     return Status::OK();
   }
 
   Status Shrink(int64 gs, int64 steps_to_live) {
+    if (step_index_) {
+      // Most expired rows are already reclaimed in the background, drains
+      // the rest of the expired buckets instead of scanning every row.
+      step_index_->UpdateGlobalStep(gs);
+      while (ShrinkExpired(step_eviction_batch_) > 0) {}
+      return Status::OK();
+    }
     mutex_lock l(mu_);
     for (auto kv : kvs_) {
       std::vector<K> key_list;
@@ -368,26 +714,40 @@ class StorageManager {
       }
       for (const auto it : to_deleted) {
         // TODO memory recycle
+        // Remove before freeing, the KV may read the row to remove it,
+        // e.g. the row offset of the persistent index.
+        kv.first->Remove(it.first);
         (it.second)->Destroy(kv.second);
         delete it.second;
-        kv.first->Remove(it.first);
+      }
+      if (stats_) {
+        stats_->Add(kShrinkEvictionCount, to_deleted.size());
+        stats_->Add(kShrinkEvictionBytes,
+                    to_deleted.size() * total_dims_ * sizeof(V));
       }
     }
     return Status::OK();
   }
 
   Status Destroy() {
+    StopStepEviction();
     if (eviction_thread_) {
       mutex_lock l(mu_);
       shutdown_ = true;
     }
     delete eviction_thread_;
+    eviction_thread_ = nullptr;
     mutex_lock l(mu_);
+    // No kernel is running any more.
+    FreeRetiredValuePtrs(kint64max);
     std::vector<K> key_list;
     std::vector<ValuePtr<V>* > value_ptr_list;
     kvs_[0].first->GetSnapshot(&key_list, &value_ptr_list);
     for (auto value_ptr : value_ptr_list) {
-      value_ptr->Destroy(kvs_[0].second);
+      // Persistent rows are kept for the next process.
+      if (!is_persistent_) {
+        value_ptr->Destroy(kvs_[0].second);
+      }
       delete value_ptr;
     }
     return Status::OK();
@@ -404,6 +764,11 @@ class StorageManager {
     return cache_;
   }
 
+  // nullptr when 'TF_EV_STATISTICS' is disabled.
+  EmbeddingStats<K>* Stats() {
+    return stats_.get();
+  }
+
   Status Commit(K key, const ValuePtr<V>* value_ptr) {
     TF_CHECK_OK(kvs_[0].first->Commit(key, value_ptr));
     return Status::OK();
@@ -418,6 +783,64 @@ class StorageManager {
   mutex* get_mutex() { return &mu_; }
 
  private:
+  void StepEviction() {
+    while (true) {
+      {
+        mutex_lock l(step_eviction_mu_);
+        if (!step_eviction_shutdown_) {
+          WaitForMilliseconds(&l, &step_eviction_cv_,
+                              step_eviction_interval_ms_);
+        }
+        if (step_eviction_shutdown_) {
+          break;
+        }
+      }
+      {
+        mutex_lock l(mu_);
+        AdvanceEpoch();
+        FreeRetiredValuePtrs(epoch_.load() - 2);
+      }
+      while (ShrinkExpired(step_eviction_batch_) == step_eviction_batch_) {
+        mutex_lock l(step_eviction_mu_);
+        if (step_eviction_shutdown_) {
+          break;
+        }
+      }
+    }
+  }
+
+  void StopStepEviction() {
+    if (step_eviction_thread_ == nullptr) {
+      return;
+    }
+    {
+      mutex_lock l(step_eviction_mu_);
+      step_eviction_shutdown_ = true;
+      step_eviction_cv_.notify_all();
+    }
+    delete step_eviction_thread_;
+    step_eviction_thread_ = nullptr;
+  }
+
+  void AdvanceEpoch() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const int64 epoch = epoch_.load();
+    // Kernels of epoch - 1 share the counter with epoch + 1.
+    if (active_kernels_[(epoch + 1) & 1].load() == 0) {
+      epoch_.store(epoch + 1);
+    }
+  }
+
+  // Frees the rows removed in epochs up to 'max_epoch'.
+  void FreeRetiredValuePtrs(int64 max_epoch) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    while (!retired_value_ptrs_.empty() &&
+           retired_value_ptrs_.front().first <= max_epoch) {
+      ValuePtr<V>* value_ptr = retired_value_ptrs_.front().second;
+      value_ptr->Destroy(kvs_[0].second);
+      delete value_ptr;
+      retired_value_ptrs_.pop_front();
+    }
+  }
+
   void BatchEviction() {
     Env* env = Env::Default();
     const int EvictionSize = 10000;
@@ -449,15 +872,28 @@ class StorageManager {
         k_size = std::min(k_size, EvictionSize);
         size_t true_size = cache_->get_evic_ids(evic_ids, k_size);
         ValuePtr<V>* value_ptr;
+        // Held while the rows are moved, a kernel pins its ids before it
+        // looks them up, so it never gets a row which is evicted.
+        mutex_lock pl(pin_mu_);
+        std::vector<K> pinned;
         for (int64 i = 0; i < true_size; ++i) {
+          if (pinned_ids_.count(evic_ids[i]) > 0) {
+            pinned.push_back(evic_ids[i]);
+            continue;
+          }
           if (kvs_[0].first->Lookup(evic_ids[i], &value_ptr).ok()) {
             TF_CHECK_OK(kvs_[1].first->Commit(evic_ids[i], value_ptr));
             TF_CHECK_OK(kvs_[0].first->Remove(evic_ids[i]));
             value_ptr_out_of_date_.emplace_back(value_ptr);
+            if (stats_) stats_->Add(kCacheEvictionCount, 1);
           } else {
             // bypass
           }
         }
+        // Ranked as the most recent ids, the next candidates are others.
+        if (!pinned.empty()) {
+          cache_->add_to_rank(pinned.data(), pinned.size());
+        }
       }
     }
   }
@@ -470,6 +906,9 @@ class StorageManager {
   std::function<ValuePtr<V>*(Allocator*, size_t)> new_value_ptr_fn_;
   StorageConfig sc_;
   bool is_multi_level_;
+  bool is_persistent_;
+  bool is_recovered_;
+  NumaPlacement* numa_placement_;  // Not owned.
 
   int64 alloc_len_;
   int64 total_dims_;
@@ -478,14 +917,75 @@ class StorageManager {
   Thread* eviction_thread_;
   BatchCache<K>* cache_;
   int64 cache_capacity_;
+  std::unique_ptr<EmbeddingStats<K>> stats_;
+  std::vector<bool> level_on_disk_;
   mutex mu_;
   volatile bool shutdown_ GUARDED_BY(mu_) = false;
 
+  std::unique_ptr<StepBucketIndex<K>> step_index_;
+  Thread* step_eviction_thread_;
+  int64 step_eviction_interval_ms_;
+  int64 step_eviction_batch_;
+  // Removed rows with their epochs, in the order of removal.
+  std::deque<std::pair<int64, ValuePtr<V>*>> retired_value_ptrs_
+      GUARDED_BY(mu_);
+  std::atomic<int64> epoch_{0};
+  // Kernels running in the even and odd epochs.
+  std::atomic<int64> active_kernels_[2] = {{0}, {0}};
+  mutex step_eviction_mu_;
+  condition_variable step_eviction_cv_;
+  bool step_eviction_shutdown_ GUARDED_BY(step_eviction_mu_) = false;
+
   volatile bool done_ = false;
+  // Ids pinned by the kernels with their pin counts.
+  mutex pin_mu_;
+  std::unordered_map<K, int32> pinned_ids_ GUARDED_BY(pin_mu_);
   std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
 
 };
 
+// Pins 'keys' in the StorageManager for its lifetime.
+template <class K, class V>
+class ScopedPinIds {
+ public:
+  ScopedPinIds(StorageManager<K, V>* storage_manager, const K* keys, int64 n)
+      : storage_manager_(storage_manager), keys_(keys), n_(n) {
+    epoch_ = storage_manager_->PinIds(keys_, n_);
+  }
+
+  ~ScopedPinIds() {
+    storage_manager_->UnpinIds(keys_, n_, epoch_);
+  }
+
+ private:
+  StorageManager<K, V>* storage_manager_;
+  const K* keys_;
+  int64 n_;
+  int64 epoch_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ScopedPinIds);
+};
+
+// Keeps the rows read in its scope from being freed by the incremental
+// shrink, for readers which don't pin their ids, e.g. lookups and exports.
+template <class K, class V>
+class ScopedEpoch {
+ public:
+  explicit ScopedEpoch(StorageManager<K, V>* storage_manager)
+      : storage_manager_(storage_manager),
+        epoch_(storage_manager->EnterEpoch()) {}
+
+  ~ScopedEpoch() {
+    storage_manager_->ExitEpoch(epoch_);
+  }
+
+ private:
+  StorageManager<K, V>* storage_manager_;
+  int64 epoch_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ScopedEpoch);
+};
+
 } // embedding
 } // tensorflow
 
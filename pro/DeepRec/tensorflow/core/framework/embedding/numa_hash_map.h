@@ -0,0 +1,112 @@
+/* Copyright 2022 The DeepRec Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_NUMA_HASH_MAP_H_
+#define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_NUMA_HASH_MAP_H_
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/embedding/kv_interface.h"
+#include "tensorflow/core/framework/embedding/lockless_hash_map.h"
+#include "tensorflow/core/framework/embedding/numa_placement.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+
+namespace tensorflow {
+template <class V>
+class ValuePtr;
+
+namespace embedding {
+
+// One LocklessHashMap per NUMA node of the placement, a key lives in the
+// map of its node. The maps are created on their nodes, and grow in the
+// threads of their nodes when the kernels shard by node, so the buckets
+// probed by a node are on the node too.
+template <class K, class V>
+class NumaLocklessHashMap : public KVInterface<K, V> {
+ public:
+  explicit NumaLocklessHashMap(NumaPlacement* placement)
+      : placement_(placement), maps_(placement->NumNodes()) {
+    for (int node = 0; node < placement_->NumNodes(); ++node) {
+      placement_->RunOnNode(node, [this, node]() {
+        maps_[node].reset(new LocklessHashMap<K, V>());
+      });
+    }
+  }
+
+  ~NumaLocklessHashMap() {
+  }
+
+  Status Lookup(K key, ValuePtr<V>** value_ptr) {
+    return MapOf(key)->Lookup(key, value_ptr);
+  }
+
+  Status Insert(K key, const ValuePtr<V>* value_ptr) {
+    return MapOf(key)->Insert(key, value_ptr);
+  }
+
+  Status Remove(K key) {
+    return MapOf(key)->Remove(key);
+  }
+
+  // The keys are spread over the nodes, the tables of a node are
+  // allocated on the node.
+  void Reserve(int64 num_keys) {
+    const int64 keys_per_node = num_keys / placement_->NumNodes() + 1;
+    for (int node = 0; node < placement_->NumNodes(); ++node) {
+      placement_->RunOnNode(node, [this, node, keys_per_node]() {
+        maps_[node]->Reserve(keys_per_node);
+      });
+    }
+  }
+
+  int64 Size() const {
+    int64 size = 0;
+    for (auto& map : maps_) {
+      size += map->Size();
+    }
+    return size;
+  }
+
+  Status GetSnapshot(std::vector<K>* key_list,
+                     std::vector<ValuePtr<V>* >* value_ptr_list) {
+    for (auto& map : maps_) {
+      TF_RETURN_IF_ERROR(map->GetSnapshot(key_list, value_ptr_list));
+    }
+    return Status::OK();
+  }
+
+  std::string DebugString() const {
+    for (int node = 0; node < maps_.size(); ++node) {
+      LOG(INFO) << "map of NUMA node " << node << ":";
+      maps_[node]->DebugString();
+    }
+    return "";
+  }
+
+ private:
+  LocklessHashMap<K, V>* MapOf(K key) const {
+    return maps_[placement_->NodeOf(key)].get();
+  }
+
+  NumaPlacement* placement_;  // Not owned.
+  std::vector<std::unique_ptr<LocklessHashMap<K, V>>> maps_;
+};
+
+}  // namespace embedding
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_NUMA_HASH_MAP_H_
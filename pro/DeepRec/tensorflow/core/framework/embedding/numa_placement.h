@@ -0,0 +1,200 @@
+/* Copyright 2022 The DeepRec Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_NUMA_PLACEMENT_H_
+#define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_NUMA_PLACEMENT_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/numa.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace embedding {
+
+// Partitions the keys of the DRAM EmbeddingVariables by NUMA node. Every
+// node has a pool of threads bound to its cores, the keys of a node are
+// looked up, created and updated by the threads of the node only, so
+// their rows are allocated on the node by EVAllocator and stay local to
+// the threads which touch them.
+//
+// Enabled by 'TF_EV_NUMA_AWARE=1'. 'TF_EV_NUMA_NODES' overrides the
+// number of nodes, e.g. to simulate 2 nodes on a single node host, the
+// pools of the simulated nodes are not bound. Binding needs a build with
+// TENSORFLOW_USE_NUMA.
+class NumaPlacement {
+ public:
+  NumaPlacement(int num_nodes, int threads_per_node) {
+    const bool bind = port::NUMAEnabled();
+    for (int node = 0; node < num_nodes; ++node) {
+      ThreadOptions options;
+      if (bind && node < port::NUMANumNodes()) {
+        options.numa_node = node;
+      }
+      pools_.emplace_back(new thread::ThreadPool(
+          Env::Default(), options, strings::StrCat("EV_NUMA_Node_", node),
+          threads_per_node, /*low_latency_hint=*/false));
+    }
+  }
+
+  // The placement of the process, nullptr if it is disabled.
+  static NumaPlacement* Get() {
+    static NumaPlacement* placement = Create();
+    return placement;
+  }
+
+  int NumNodes() const {
+    return pools_.size();
+  }
+
+  template <class K>
+  int NodeOf(K key) const {
+    return static_cast<int>(
+        ((static_cast<uint64>(key) * 0x9E3779B97F4A7C15ULL) >> 32) %
+        pools_.size());
+  }
+
+  // Runs fn on a thread of 'node' and waits for it, e.g. to allocate the
+  // buckets of a hash table on the node.
+  void RunOnNode(int node, const std::function<void()>& fn) {
+    BlockingCounter counter(1);
+    pools_[node]->Schedule([&fn, &counter]() {
+      fn();
+      counter.DecrementCount();
+    });
+    counter.Wait();
+  }
+
+  // Runs work(start, limit) over the indices of 'keys' in [0, n), the
+  // indices of the keys of a node are split into blocks which run on the
+  // pool of the node. The ranges handed to 'work' hold keys of one node,
+  // so the kernels can pass the same function they pass to Shard(). Blocks
+  // the calling thread until done, a thread of a node pool never waits for
+  // work queued on its own pool, so concurrent kernels can't exhaust it.
+  template <class K>
+  void Shard(const K* keys, int64 n, int64 cost_per_unit,
+             const std::function<void(int64, int64)>& work) {
+    std::vector<std::vector<int64>> node_indices(NumNodes());
+    for (int64 i = 0; i < n; ++i) {
+      node_indices[NodeOf(keys[i])].push_back(i);
+    }
+    // Blocks of at least kMinCostPerBlock, at most 4 per thread.
+    const int64 min_block_size = std::max<int64>(
+        1, kMinCostPerBlock / std::max<int64>(1, cost_per_unit));
+    std::vector<int64> block_sizes(NumNodes(), 0);
+    int64 num_blocks = 0;
+    for (int node = 0; node < NumNodes(); ++node) {
+      const int64 size = node_indices[node].size();
+      if (size == 0) {
+        continue;
+      }
+      const int64 max_blocks = 4 * pools_[node]->NumThreads();
+      const int64 blocks = std::min(
+          max_blocks, (size + min_block_size - 1) / min_block_size);
+      block_sizes[node] = (size + blocks - 1) / blocks;
+      num_blocks += (size + block_sizes[node] - 1) / block_sizes[node];
+    }
+    BlockingCounter counter(num_blocks);
+    for (int node = 0; node < NumNodes(); ++node) {
+      const std::vector<int64>* indices = &node_indices[node];
+      const int64 size = indices->size();
+      for (int64 start = 0; start < size; start += block_sizes[node]) {
+        const int64 limit = std::min(size, start + block_sizes[node]);
+        pools_[node]->Schedule([indices, start, limit, &work, &counter]() {
+          RunRanges(*indices, start, limit, work);
+          counter.DecrementCount();
+        });
+      }
+    }
+    counter.Wait();
+  }
+
+ private:
+  static NumaPlacement* Create() {
+    bool numa_aware = false;
+    TF_CHECK_OK(ReadBoolFromEnvVar("TF_EV_NUMA_AWARE", false, &numa_aware));
+    if (!numa_aware) {
+      return nullptr;
+    }
+    int64 num_nodes = 1;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_NUMA_NODES",
+                                    port::NUMANumNodes(), &num_nodes));
+    if (num_nodes <= 1) {
+      LOG(INFO) << "EmbeddingVariable NUMA placement is disabled "
+                << "on a single NUMA node.";
+      return nullptr;
+    }
+    std::vector<unsigned> cpus;
+    if (port::NUMAEnabled()) {
+      port::NUMANodeCPUs(0, &cpus);
+    }
+    int64 threads_per_node = cpus.empty()
+        ? std::max<int64>(1, port::NumSchedulableCPUs() / num_nodes)
+        : cpus.size();
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EV_NUMA_THREADS_PER_NODE",
+                                    threads_per_node, &threads_per_node));
+    LOG(INFO) << "EmbeddingVariable NUMA placement, nodes: " << num_nodes
+              << ", threads per node: " << threads_per_node
+              << ", bound: " << port::NUMAEnabled();
+    return new NumaPlacement(num_nodes, threads_per_node);
+  }
+
+  // Calls work on the runs of consecutive indices in indices[start, limit).
+  static void RunRanges(const std::vector<int64>& indices, int64 start,
+                        int64 limit,
+                        const std::function<void(int64, int64)>& work) {
+    while (start < limit) {
+      int64 end = start + 1;
+      while (end < limit && indices[end] == indices[end - 1] + 1) {
+        ++end;
+      }
+      work(indices[start], indices[end - 1] + 1);
+      start = end;
+    }
+  }
+
+  // Same as the minimum cost of a shard of Shard().
+  static constexpr int64 kMinCostPerBlock = 10000;
+
+  std::vector<std::unique_ptr<thread::ThreadPool>> pools_;
+};
+
+// Shards the work on 'keys' by the NUMA nodes of the keys if 'placement'
+// is not nullptr, otherwise on the worker threads as Shard() does.
+template <class K>
+void ShardByNode(NumaPlacement* placement, int max_parallelism,
+                 thread::ThreadPool* workers, const K* keys, int64 n,
+                 int64 cost_per_unit,
+                 const std::function<void(int64, int64)>& work) {
+  if (placement != nullptr) {
+    placement->Shard(keys, n, cost_per_unit, work);
+  } else {
+    tensorflow::Shard(max_parallelism, workers, n, cost_per_unit, work);
+  }
+}
+
+}  // namespace embedding
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_NUMA_PLACEMENT_H_
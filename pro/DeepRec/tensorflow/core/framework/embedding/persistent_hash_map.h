@@ -0,0 +1,393 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_PERSISTENT_HASH_MAP_H_
+#define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_PERSISTENT_HASH_MAP_H_
+
+#ifdef TENSORFLOW_USE_PMEM
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "tensorflow/core/framework/embedding/kv_interface.h"
+#include "tensorflow/core/framework/embedding/lockless_hash_map.h"
+#include "tensorflow/core/framework/embedding/value_ptr.h"
+#include "tensorflow/core/framework/experimental_pmem_allocator.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace embedding {
+
+// KV of a PMEM_LIBPMEM EmbeddingVariable which survives process restarts.
+//
+// Rows use the NORMAL_CONTIGUOUS layout, so a row, i.e. its header with
+// version and frequency and the values of all slots, is one allocation in
+// the file of a persistent ExperimentalPMemAllocator. The key to row offset
+// index is an open addressing table in '<path>/<name>.evindex', lookups are
+// served by a volatile LocklessHashMap which is rebuilt from the index when
+// reattaching.
+//
+// Updates are ordered so that the file is always consistent:
+//   insert: row allocated (allocation bitmap) -> key -> offset published
+//   remove: offset tombstoned -> row freed
+// A crash between the steps leaks the row at most. Values are updated in
+// place like the DRAM EmbeddingVariable, they are not transactional.
+template <class K, class V>
+class PersistentHashMap : public KVInterface<K, V> {
+ public:
+  PersistentHashMap(const std::string& name, const std::string& path,
+                    ExperimentalPMemAllocator* alloc)
+      : alloc_(alloc) {
+    std::string file_name = name;
+    std::replace(file_name.begin(), file_name.end(), '/', '_');
+    index_path_ = io::JoinPath(path, strings::StrCat(file_name, ".evindex"));
+  }
+
+  ~PersistentHashMap() override {
+    if (header_ != nullptr) {
+      munmap(header_, MappedSize(header_->capacity));
+    }
+  }
+
+  // Map the index, reattach to the rows if it is left by another process.
+  Status Init() {
+    struct stat st;
+    if (stat(index_path_.c_str(), &st) == 0) {
+      TF_RETURN_IF_ERROR(MapIndex(index_path_, 0, &header_));
+      if (header_->magic != kIndexMagic) {
+        // Crashed before the first index was completed.
+        munmap(header_, st.st_size);
+        header_ = nullptr;
+      } else {
+        if (header_->key_size != sizeof(K) ||
+            header_->value_size != sizeof(V) ||
+            MappedSize(header_->capacity) !=
+                static_cast<size_t>(st.st_size)) {
+          return errors::FailedPrecondition(
+              "EV index ", index_path_, " doesn't match the EmbeddingVariable,"
+              " remove it and the PMem file to start from scratch.");
+        }
+        if (!alloc_->Recovered()) {
+          return errors::FailedPrecondition(
+              "EV index ", index_path_, " exists but the PMem file is new,"
+              " remove the index to start from scratch.");
+        }
+        Recover();
+        return Status::OK();
+      }
+    }
+    return CreateIndex(index_path_, kInitCapacity, &header_);
+  }
+
+  bool Recovered() const {
+    return recovered_;
+  }
+
+  Status Lookup(K key, ValuePtr<V>** value_ptr) override {
+    return map_.Lookup(key, value_ptr);
+  }
+
+  Status Insert(K key, const ValuePtr<V>* value_ptr) override {
+    TF_RETURN_IF_ERROR(map_.Insert(key, value_ptr));
+    void* row = value_ptr->GetPtr();
+    // The zeroed header means no slot initialized yet.
+    alloc_->Persist(row, kRowHeaderSize);
+    MaybeGrow();
+    tf_shared_lock l(mu_);
+    IndexInsert(header_, key, alloc_->ToOffset(row));
+    return Status::OK();
+  }
+
+  Status Remove(K key) override {
+    ValuePtr<V>* value_ptr = nullptr;
+    TF_RETURN_IF_ERROR(map_.Lookup(key, &value_ptr));
+    TF_RETURN_IF_ERROR(map_.Remove(key));
+    tf_shared_lock l(mu_);
+    IndexRemove(key, alloc_->ToOffset(value_ptr->GetPtr()));
+    return Status::OK();
+  }
+
+  int64 Size() const override {
+    return map_.Size();
+  }
+
+  void SetTotalDims(int total_dims) override {
+    mutex_lock l(mu_);
+    if (header_->total_dims == 0) {
+      header_->total_dims = total_dims;
+      Persist(&header_->total_dims, sizeof(header_->total_dims));
+    } else if (header_->total_dims != total_dims) {
+      LOG(FATAL) << "EV index " << index_path_ << " has rows of "
+                 << header_->total_dims << " values but the EmbeddingVariable"
+                 << " needs " << total_dims << ", remove it and the PMem file"
+                 << " to start from scratch.";
+    }
+  }
+
+  Status GetSnapshot(std::vector<K>* key_list,
+                     std::vector<ValuePtr<V>*>* value_ptr_list) override {
+    return map_.GetSnapshot(key_list, value_ptr_list);
+  }
+
+  std::string DebugString() const override {
+    return strings::StrCat("PersistentHashMap index: ", index_path_,
+                           ", size: ", Size(),
+                           ", capacity: ", header_->capacity,
+                           ", used slots: ", used_.load());
+  }
+
+ private:
+  static constexpr uint64 kIndexMagic = 0x5845444e49564545ULL;
+  static constexpr uint64 kInitCapacity = 1 << 16;
+  // Offsets of index slots, a row offset is never 0 since the allocator
+  // keeps its metadata at the beginning of the file.
+  static constexpr uint64 kEmptySlot = 0;
+  static constexpr uint64 kBusySlot = UINT64_MAX;
+  static constexpr uint64 kDeletedSlot = UINT64_MAX - 1;
+  // global_step and freq_counter of FixedLengthHeader.
+  static constexpr size_t kRowHeaderSize = 2 * sizeof(int64);
+
+  struct IndexHeader {
+    uint64 magic;
+    uint64 capacity;
+    uint64 key_size;
+    uint64 value_size;
+    uint64 total_dims;
+    uint64 reserved[3];
+  };
+
+  struct IndexSlot {
+    uint64 offset;
+    int64 key;
+  };
+
+  static size_t MappedSize(uint64 capacity) {
+    return sizeof(IndexHeader) + capacity * sizeof(IndexSlot);
+  }
+
+  static IndexSlot* Slots(IndexHeader* header) {
+    return reinterpret_cast<IndexSlot*>(header + 1);
+  }
+
+  static uint64 HashKey(K key) {
+    return Hash64(reinterpret_cast<const char*>(&key), sizeof(K));
+  }
+
+  void Persist(const void* addr, size_t len) const {
+    alloc_->Persist(addr, len);
+  }
+
+  // Map an existing index if capacity is 0, otherwise create a new one.
+  Status MapIndex(const std::string& path, uint64 capacity,
+                  IndexHeader** header) {
+    int fd = open(path.c_str(), capacity == 0 ? O_RDWR : O_RDWR | O_CREAT,
+                  0644);
+    if (fd < 0) {
+      return errors::Internal("Open EV index ", path, " failed: ",
+                              strerror(errno));
+    }
+    size_t size = 0;
+    if (capacity == 0) {
+      struct stat st;
+      fstat(fd, &st);
+      size = st.st_size;
+    } else {
+      size = MappedSize(capacity);
+      // Allocate the blocks now, page faults of a sparse file may fail
+      // with SIGBUS when the device is full.
+      if (ftruncate(fd, 0) != 0 || posix_fallocate(fd, 0, size) != 0) {
+        close(fd);
+        return errors::Internal("Resize EV index ", path, " failed: ",
+                                strerror(errno));
+      }
+    }
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED || size < sizeof(IndexHeader)) {
+      return errors::Internal("Map EV index ", path, " failed: ",
+                              strerror(errno));
+    }
+    *header = static_cast<IndexHeader*>(addr);
+    return Status::OK();
+  }
+
+  // Build a complete index in a temporary file and rename it, so a crash
+  // leaves either the old or the new index.
+  Status CreateIndex(const std::string& path, uint64 capacity,
+                     IndexHeader** header) {
+    std::string tmp_path = strings::StrCat(path, ".tmp");
+    IndexHeader* tmp = nullptr;
+    TF_RETURN_IF_ERROR(MapIndex(tmp_path, capacity, &tmp));
+    memset(tmp, 0, MappedSize(capacity));
+    tmp->capacity = capacity;
+    tmp->key_size = sizeof(K);
+    tmp->value_size = sizeof(V);
+    tmp->total_dims = header_ == nullptr ? 0 : header_->total_dims;
+    uint64 used = 0;
+    if (header_ != nullptr) {
+      IndexSlot* slots = Slots(header_);
+      for (uint64 i = 0; i < header_->capacity; ++i) {
+        uint64 offset = slots[i].offset;
+        if (offset != kEmptySlot && offset != kBusySlot &&
+            offset != kDeletedSlot) {
+          IndexInsert(tmp, slots[i].key, offset);
+          ++used;
+        }
+      }
+    }
+    tmp->magic = kIndexMagic;
+    if (msync(tmp, MappedSize(capacity), MS_SYNC) != 0 ||
+        rename(tmp_path.c_str(), path.c_str()) != 0) {
+      munmap(tmp, MappedSize(capacity));
+      return errors::Internal("Write EV index ", path, " failed: ",
+                              strerror(errno));
+    }
+    *header = tmp;
+    used_ = used;
+    return Status::OK();
+  }
+
+  void IndexInsert(IndexHeader* header, K key, uint64 offset) {
+    IndexSlot* slots = Slots(header);
+    const uint64 mask = header->capacity - 1;
+    for (uint64 i = HashKey(key) & mask;; i = (i + 1) & mask) {
+      if (slots[i].offset != kEmptySlot ||
+          !__sync_bool_compare_and_swap(&slots[i].offset, kEmptySlot,
+                                        kBusySlot)) {
+        continue;
+      }
+      slots[i].key = key;
+      Persist(&slots[i].key, sizeof(slots[i].key));
+      __atomic_store_n(&slots[i].offset, offset, __ATOMIC_RELEASE);
+      Persist(&slots[i].offset, sizeof(slots[i].offset));
+      used_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  // Match the offset too, the key may be inserted again before the old
+  // slot is removed.
+  void IndexRemove(K key, uint64 offset) {
+    IndexSlot* slots = Slots(header_);
+    const uint64 mask = header_->capacity - 1;
+    for (uint64 i = HashKey(key) & mask, n = 0; n <= mask;
+         i = (i + 1) & mask, ++n) {
+      uint64 o = __atomic_load_n(&slots[i].offset, __ATOMIC_ACQUIRE);
+      if (o == kEmptySlot) {
+        break;
+      }
+      if (o == offset && slots[i].key == key) {
+        __atomic_store_n(&slots[i].offset, kDeletedSlot, __ATOMIC_RELEASE);
+        Persist(&slots[i].offset, sizeof(slots[i].offset));
+        return;
+      }
+    }
+    LOG(WARNING) << "Key " << key << " is not found in EV index "
+                 << index_path_;
+  }
+
+  // Deleted slots are dropped when growing, so the table grows only if
+  // live keys need it.
+  void MaybeGrow() {
+    if (used_.load(std::memory_order_relaxed) * 10 <
+        header_->capacity * kMaxLoadFactor) {
+      return;
+    }
+    mutex_lock l(mu_);
+    uint64 capacity = header_->capacity;
+    if (used_.load(std::memory_order_relaxed) * 10 <
+        capacity * kMaxLoadFactor) {
+      return;
+    }
+    while (static_cast<uint64>(map_.Size()) * 10 * 2 >=
+           capacity * kMaxLoadFactor) {
+      capacity *= 2;
+    }
+    IndexHeader* old_header = header_;
+    IndexHeader* new_header = nullptr;
+    Status s = CreateIndex(index_path_, capacity, &new_header);
+    if (!s.ok()) {
+      LOG(FATAL) << "Grow EV index failed: " << s.error_message();
+    }
+    header_ = new_header;
+    munmap(old_header, MappedSize(old_header->capacity));
+  }
+
+  void Recover() {
+    IndexSlot* slots = Slots(header_);
+    uint64 used = 0;
+    int64 rows = 0;
+    for (uint64 i = 0; i < header_->capacity; ++i) {
+      uint64 offset = slots[i].offset;
+      if (offset == kEmptySlot) {
+        continue;
+      }
+      ++used;
+      if (offset == kBusySlot || offset == kDeletedSlot) {
+        continue;
+      }
+      void* row = alloc_->FromOffset(offset);
+      if (row == nullptr) {
+        LOG(WARNING) << "Invalid row offset " << offset << " of key "
+                     << slots[i].key << " in EV index " << index_path_;
+        slots[i].offset = kDeletedSlot;
+        Persist(&slots[i].offset, sizeof(slots[i].offset));
+        continue;
+      }
+      ValuePtr<V>* value_ptr = new NormalContiguousValuePtr<V>(row);
+      if (!map_.Insert(slots[i].key, value_ptr).ok()) {
+        // Left by a crash during an insert of a removed key.
+        delete value_ptr;
+        slots[i].offset = kDeletedSlot;
+        Persist(&slots[i].offset, sizeof(slots[i].offset));
+        continue;
+      }
+      ++rows;
+    }
+    used_ = used;
+    recovered_ = true;
+    LOG(INFO) << "Reattach EV index " << index_path_ << ", rows: " << rows;
+  }
+
+  // Grow when used slots reach kMaxLoadFactor / 10 of the capacity.
+  static constexpr uint64 kMaxLoadFactor = 7;
+
+  ExperimentalPMemAllocator* alloc_;  // not owned
+  std::string index_path_;
+  LocklessHashMap<K, V> map_;
+  // Shared by index inserts and removes, exclusive when growing.
+  mutex mu_;
+  IndexHeader* header_ = nullptr;
+  std::atomic<uint64> used_{0};
+  bool recovered_ = false;
+};
+
+}  // namespace embedding
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_USE_PMEM
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_PERSISTENT_HASH_MAP_H_
@@ -0,0 +1,200 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_REDUCED_PRECISION_H_
+#define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_REDUCED_PRECISION_H_
+
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#include "tensorflow/core/framework/numeric_types.h"
+#include "tensorflow/core/framework/tensor_types.h"
+#include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace embedding {
+
+// An EmbeddingVariable created with dtype bfloat16 or half stores the
+// embeddings and the slots of its optimizer, which share the same ValuePtr,
+// in 2 bytes per element. The optimizers load a row into float, update it in
+// float and round the result back when it is stored.
+template <typename V>
+struct ComputeType {
+  typedef V type;
+};
+
+template <>
+struct ComputeType<bfloat16> {
+  typedef float type;
+};
+
+template <>
+struct ComputeType<Eigen::half> {
+  typedef float type;
+};
+
+template <typename V>
+struct IsReducedPrecision {
+  static constexpr bool value =
+      !std::is_same<V, typename ComputeType<V>::type>::value;
+};
+
+// Rounds the updated values stochastically instead of to the nearest, so
+// that small updates are kept in expectation, enabled by
+// TF_EV_STOCHASTIC_ROUNDING.
+inline bool StochasticRounding() {
+  static const bool enabled = [] {
+    bool stochastic_rounding = false;
+    Status s = ReadBoolFromEnvVar("TF_EV_STOCHASTIC_ROUNDING", false,
+                                  &stochastic_rounding);
+    if (!s.ok()) {
+      LOG(ERROR) << "Read TF_EV_STOCHASTIC_ROUNDING failed: " << s;
+    }
+    return stochastic_rounding;
+  }();
+  return enabled;
+}
+
+// xorshift64*, one stream per thread.
+inline uint32 RoundingRandom() {
+  static thread_local uint64 state = random::New64() | 1;
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return static_cast<uint32>((state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+template <typename V>
+inline V RoundStochastically(float x);
+
+// Adds a random number to the 16 bits truncated by bfloat16.
+template <>
+inline bfloat16 RoundStochastically<bfloat16>(float x) {
+  if (std::isnan(x)) {
+    return bfloat16(x);
+  }
+  uint32 bits;
+  memcpy(&bits, &x, sizeof(bits));
+  bits += RoundingRandom() & 0xffff;
+  return bfloat16(Eigen::bfloat16_impl::raw_uint16_to_bfloat16(
+      static_cast<uint16>(bits >> 16)));
+}
+
+// Picks the representable neighbour of `x` other than the nearest one with
+// the probability of its relative distance.
+template <>
+inline Eigen::half RoundStochastically<Eigen::half>(float x) {
+  Eigen::half nearest(x);
+  const float nearest_f = static_cast<float>(nearest);
+  if (nearest_f == x || !std::isfinite(nearest_f)) {
+    return nearest;
+  }
+  const uint16 bits = nearest.x;
+  const bool up = x > nearest_f;
+  uint16 other;
+  if ((bits & 0x7fff) == 0) {
+    other = up ? 0x0001 : 0x8001;
+  } else if ((bits & 0x8000) == 0) {
+    other = up ? bits + 1 : bits - 1;
+  } else {
+    other = up ? bits - 1 : bits + 1;
+  }
+  Eigen::half neighbour(Eigen::half_impl::raw_uint16_to_half(other));
+  const float p = (x - nearest_f) / (static_cast<float>(neighbour) - nearest_f);
+  const float u = (RoundingRandom() >> 8) * (1.0f / (1 << 24));
+  return u < p ? neighbour : nearest;
+}
+
+// A row of the values, e.g. var->flat(value_ptr), viewed in the compute
+// type. Rows of float and double are updated in place and Store() does
+// nothing, rows in reduced precision are loaded into a float buffer and
+// written back by Store().
+template <typename V, bool kReduced = IsReducedPrecision<V>::value>
+class ValueRow {
+ public:
+  explicit ValueRow(typename TTypes<V>::Flat val) : flat_(val) {}
+
+  typename TTypes<V>::Flat flat() { return flat_; }
+
+  void Store() {}
+
+ private:
+  typename TTypes<V>::Flat flat_;
+};
+
+template <typename V>
+class ValueRow<V, true> {
+ public:
+  explicit ValueRow(typename TTypes<V>::Flat val)
+      : val_(val), buf_(val.size()) {
+    flat() = val_.template cast<float>();
+  }
+
+  typename TTypes<float>::Flat flat() {
+    return typename TTypes<float>::Flat(buf_.data(), buf_.size());
+  }
+
+  void Store() {
+    if (StochasticRounding()) {
+      for (int64 i = 0; i < val_.size(); ++i) {
+        val_(i) = RoundStochastically<V>(buf_[i]);
+      }
+    } else {
+      val_ = flat().template cast<V>();
+    }
+  }
+
+ private:
+  typename TTypes<V>::Flat val_;
+  gtl::InlinedVector<float, 64> buf_;
+};
+
+// Read only row, e.g. a row of the gradient.
+template <typename V, bool kReduced = IsReducedPrecision<V>::value>
+class ConstValueRow {
+ public:
+  ConstValueRow(const V* val, int64 len) : flat_(val, len) {}
+
+  typename TTypes<V>::ConstFlat flat() const { return flat_; }
+
+ private:
+  typename TTypes<V>::ConstFlat flat_;
+};
+
+template <typename V>
+class ConstValueRow<V, true> {
+ public:
+  ConstValueRow(const V* val, int64 len) : buf_(len) {
+    typename TTypes<float>::Flat buf(buf_.data(), len);
+    buf = typename TTypes<V>::ConstFlat(val, len).template cast<float>();
+  }
+
+  typename TTypes<float>::ConstFlat flat() const {
+    return typename TTypes<float>::ConstFlat(buf_.data(), buf_.size());
+  }
+
+ private:
+  gtl::InlinedVector<float, 64> buf_;
+};
+
+}  // namespace embedding
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_REDUCED_PRECISION_H_
@@ -0,0 +1,131 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_STEP_BUCKET_INDEX_H_
+#define TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_STEP_BUCKET_INDEX_H_
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace embedding {
+
+// Keys of an EmbeddingVariable bucketed by the global step of their last
+// update, each bucket spans 'bucket_steps' steps. Every live key has one
+// entry, in the bucket of its step or an earlier one: new rows are added to
+// the bucket of the current global step by StorageManager, and updates
+// don't move the entries, so an update only bumps the global step. When a
+// bucket expires, StorageManager removes its expired keys and adds the
+// other keys again to the bucket of their current step, so draining the
+// expired buckets finds every expired key and a key is moved at most once
+// per 'steps_to_live' steps.
+template <class K>
+class StepBucketIndex {
+ public:
+  static constexpr int64 kNumBuckets = 64;
+
+  explicit StepBucketIndex(int64 steps_to_live)
+      : steps_to_live_(steps_to_live),
+        bucket_steps_(std::max<int64>(1, steps_to_live / kNumBuckets)),
+        global_step_(0),
+        next_shard_(0) {}
+
+  int64 StepsToLive() const { return steps_to_live_; }
+
+  int64 Bucket(int64 step) const { return step / bucket_steps_; }
+
+  // Largest global step seen by UpdateGlobalStep().
+  int64 GlobalStep() const {
+    return global_step_.load(std::memory_order_relaxed);
+  }
+
+  void UpdateGlobalStep(int64 gs) {
+    int64 cur = global_step_.load(std::memory_order_relaxed);
+    // Most updates are of the current global step.
+    while (gs > cur && !global_step_.compare_exchange_weak(
+                           cur, gs, std::memory_order_relaxed)) {
+    }
+  }
+
+  void Add(K key, int64 bucket) {
+    Shard& shard =
+        shards_[Hash64Combine(static_cast<uint64>(key), 0) % kNumShards];
+    mutex_lock l(shard.mu);
+    shard.buckets[bucket].push_back(key);
+  }
+
+  // Moves at most 'max_keys' keys of the buckets in which every step is
+  // expired at global step 'gs' into 'keys'.
+  void PopExpired(int64 gs, int64 max_keys, std::vector<K>* keys) {
+    // Steps smaller than 'gs - steps_to_live' are expired.
+    const int64 end_bucket = Bucket(std::max<int64>(0, gs - steps_to_live_));
+    const int64 start = next_shard_.fetch_add(1, std::memory_order_relaxed);
+    for (int64 i = 0; i < kNumShards; ++i) {
+      Shard& shard = shards_[(start + i) % kNumShards];
+      mutex_lock l(shard.mu);
+      while (!shard.buckets.empty() &&
+             shard.buckets.begin()->first < end_bucket) {
+        std::vector<K>& bucket = shard.buckets.begin()->second;
+        const int64 n = std::min<int64>(
+            bucket.size(), max_keys - static_cast<int64>(keys->size()));
+        keys->insert(keys->end(), bucket.end() - n, bucket.end());
+        bucket.resize(bucket.size() - n);
+        if (bucket.empty()) {
+          shard.buckets.erase(shard.buckets.begin());
+        }
+        if (static_cast<int64>(keys->size()) >= max_keys) {
+          return;
+        }
+      }
+    }
+  }
+
+  // Entries in the index, one per live key.
+  int64 Size() const {
+    int64 size = 0;
+    for (int64 i = 0; i < kNumShards; ++i) {
+      mutex_lock l(shards_[i].mu);
+      for (const auto& bucket : shards_[i].buckets) {
+        size += bucket.second.size();
+      }
+    }
+    return size;
+  }
+
+ private:
+  static constexpr int64 kNumShards = 32;
+
+  struct Shard {
+    mutable mutex mu;
+    std::map<int64, std::vector<K>> buckets GUARDED_BY(mu);
+  };
+
+  const int64 steps_to_live_;
+  const int64 bucket_steps_;
+  std::atomic<int64> global_step_;
+  std::atomic<int64> next_shard_;
+  Shard shards_[kNumShards];
+};
+
+}  // namespace embedding
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_EMBEDDING_STEP_BUCKET_INDEX_H_
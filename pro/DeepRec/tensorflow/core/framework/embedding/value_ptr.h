@@ -354,6 +354,12 @@ class NormalContiguousValuePtr : public ValuePtr<V>{
     new ((char*)this->ptr_) FixedLengthHeader();
    }
   
+   // Wrap a row which is already allocated, e.g. reattached from a
+   // persistent PMem file.
+   explicit NormalContiguousValuePtr(void* ptr) {
+    this->ptr_ = ptr;
+   }
+
    ~NormalContiguousValuePtr(){
    }
 
@@ -13,8 +13,13 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <errno.h>
+#include <sys/mman.h>
 #include <atomic>
-#include <list>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/allocator_registry.h"
 #include "tensorflow/core/framework/tracking_allocator.h"
@@ -23,7 +28,9 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/mem.h"
 #include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
@@ -59,6 +66,7 @@ constexpr size_t kChunkSize = ( 1 << 22);  // 4MB chunk size
 constexpr size_t kPageSize = (1 << 12);    // 4KB page by default
 constexpr size_t kPageShift = 12;
 constexpr size_t kPageCount = kChunkSize / kPageSize;
+constexpr size_t kHugePageSize = (1 << 21);  // 2MB transparent huge page
 
 #if defined __x86_64__
 constexpr int kAddressBits =
@@ -67,12 +75,12 @@ constexpr int kAddressBits =
 constexpr int kAddressBits = 8 * sizeof(void*);
 #endif
 
-class Bin;
+class Chunk;
 class PageMap {
  public:
   PageMap() : root_{}, bytes_used_(0) {}
 
-  Bin* GetBin(const void* ptr) const {
+  Chunk* GetChunk(const void* ptr) const {
     const auto k =
       reinterpret_cast<std::uintptr_t>(ptr) >> kPageShift;
     const auto i1 = k >> kLeafBits;
@@ -80,10 +88,10 @@ class PageMap {
     if ((k >> kBits) > 0 || root_[i1] == nullptr) {
       return nullptr;
     }
-    return root_[i1]->bin[i2];
+    return root_[i1]->chunk[i2];
   }
 
-  void SetBin(const void* ptr, size_t npages, Bin* b) {
+  void SetChunk(const void* ptr, size_t npages, Chunk* c) {
     const auto start =
       reinterpret_cast<std::uintptr_t>(ptr) >> kPageShift;
     std::lock_guard<spin_lock> l(lock_);
@@ -99,7 +107,7 @@ class PageMap {
         bytes_used_ += sizeof(Leaf);
         root_[i1] = leaf;
       }
-      root_[i1]->bin[i2] = b;
+      root_[i1]->chunk[i2] = c;
     }
   }
  
@@ -116,7 +124,7 @@ class PageMap {
   static constexpr int kRootLength = 1 << kRootBits;
 
   struct Leaf {
-    Bin* bin[kLeafLength];
+    Chunk* chunk[kLeafLength];
   };
 
   mutable spin_lock lock_;
@@ -124,119 +132,200 @@ class PageMap {
   size_t bytes_used_;
 };
 
-class FreeList {
- public:
-  // Return current length of list
-  size_t length() const { return list_.size(); }
-
-  // Is list empty?
-  bool empty() const { return list_.empty(); }
-
-  void Push(void* ptr) {
-    list_.push_front(ptr);
-  }
-
-  bool TryPop(void** ret) {
-    if (list_.empty()) {
-      return false;
-    }
-
-    *ret = list_.back();
-    list_.pop_back();
-    return true;
-  }
-
-  // PushBatch and PopBatch do not guarantee an ordering.
-  void PushBatch(int N, void** ptrs) {
-    for (int i = 0; i < N; ++i) {
-      list_.push_front(ptrs[i]);
-    }
-  }
-
-  int PopBatch(int N, void** ret) {
-    if (list_.size() >= N) {
-      for (int i = 0; i < N; ++i) {
-        ret[i] = list_.back();
-        list_.pop_back();
-      }
-      return N;
-    } else {
-      auto loop = list_.size();
-      for (int i = 0; i < loop; ++i) {
-        ret[i] = list_.back();
-        list_.pop_back();
-      }
-      return loop;
-    }
+// Options and counters shared by all the chunks of an EVAllocatorImpl.
+struct ChunkContext {
+  PageMap* page_map = nullptr;
+  // Return the pages of empty chunks to the OS,
+  // user can set 'TF_EV_ALLOCATOR_RELEASE_MEMORY=0' to disable.
+  bool release_memory = true;
+  // Back chunks by transparent huge pages,
+  // user can set 'TF_EV_ALLOCATOR_HUGE_PAGE=1' to enable.
+  bool huge_page = false;
+  // Bind chunks to the NUMA node of the allocating thread, enabled
+  // with 'TF_EV_NUMA_AWARE=1' on the hosts with more than one node.
+  bool numa_aware = false;
+
+  // Bytes of chunks which are not returned to the OS.
+  std::atomic<int64> bytes_reserved{0};
+  std::atomic<int64> peak_bytes_reserved{0};
+
+  void AddReserved(int64 bytes) {
+    int64 reserved = bytes_reserved.fetch_add(bytes) + bytes;
+    int64 peak = peak_bytes_reserved.load(std::memory_order_relaxed);
+    while (reserved > peak &&
+           !peak_bytes_reserved.compare_exchange_weak(peak, reserved)) {}
   }
-
- private:
-  std::list<void*> list_;
 };
 
+class Bin;
+// A chunk is carved into slots of the same size. Slots are handed out
+// by bump allocation first, freed slots are reused by their index.
 class Chunk {
  public:
-  Chunk(size_t chunk_size, size_t slot_size, Bin* bin, PageMap* pm) :
-      chunk_size_(chunk_size), slot_size_(slot_size) {
+  // The pages are bound to 'numa_node' unless it is kNUMANoAffinity.
+  Chunk(size_t chunk_size, size_t slot_size, Bin* bin, ChunkContext* ctx,
+        int numa_node) :
+      chunk_size_(chunk_size), slot_size_(slot_size), bin_(bin), ctx_(ctx),
+      numa_node_(numa_node) {
     slot_count_ = chunk_size_ / slot_size_;
-    start_ = (char*)port::AlignedMalloc(chunk_size_, kPageSize);
+    const int alignment = ctx_->huge_page ? kHugePageSize : kPageSize;
+    if (numa_node_ != port::kNUMANoAffinity) {
+      start_ = (char*)port::NUMAMalloc(numa_node_, chunk_size_, alignment);
+    } else {
+      start_ = (char*)port::AlignedMalloc(chunk_size_, alignment);
+    }
     if (start_ == nullptr) {
       LOG(FATAL) << "OOM, can't create new Chunk for EVAllocator,"
                  << "please check free memory.";
     }
-    pm->SetBin(start_, kPageCount, bin);
+#ifdef MADV_HUGEPAGE
+    if (ctx_->huge_page && madvise(start_, chunk_size_, MADV_HUGEPAGE) != 0) {
+      LOG(WARNING) << "madvise(MADV_HUGEPAGE) failed for EVAllocator chunk, "
+                   << "errno: " << errno;
+    }
+#endif
+    ctx_->page_map->SetChunk(start_, kPageCount, this);
+    ctx_->AddReserved(chunk_size_);
     current_ = start_;
     end_ = start_ + chunk_size_;
   }
 
   ~Chunk() {
-    delete start_;
+    if (numa_node_ != port::kNUMANoAffinity) {
+      port::NUMAFree(start_, chunk_size_);
+    } else {
+      port::AlignedFree(start_);
+    }
   }
 
   void* Allocate() {
-    if (current_ + slot_size_ <= end_) {
-      auto ret = current_;
-      current_ += slot_size_;
-      return ret;
-    }
-    return nullptr;
+    void* ret = nullptr;
+    BatchAllocate(1, &ret);
+    return ret;
   }
 
   size_t BatchAllocate(size_t num, void** ret) {
-    for (int i = 0; i < num; ++i) {
-      if (current_ + slot_size_ > end_) {
-        return i;
-      }
+    size_t i = 0;
+    for (; i < num && !free_slots_.empty(); ++i) {
+      ret[i] = start_ + (size_t)free_slots_.back() * slot_size_;
+      free_slots_.pop_back();
+    }
+    for (; i < num && current_ + slot_size_ <= end_; ++i) {
       ret[i] = current_;
       current_ += slot_size_;
     }
-    return num;
+    in_use_ += i;
+    return i;
   }
 
-  size_t FullAllocate(void** ret) {
-    for (int i = 0; i < slot_count_; ++i) {
-      ret[i] = current_;
-      current_ += slot_size_;
+  void Deallocate(void* ptr) {
+    free_slots_.push_back(
+        static_cast<uint32>(((char*)ptr - start_) / slot_size_));
+    --in_use_;
+  }
+
+  // Return the pages of an empty chunk to the OS, the chunk is reused
+  // from the beginning.
+  bool Release() {
+    if (madvise(start_, chunk_size_, MADV_DONTNEED) != 0) {
+      LOG(WARNING) << "madvise(MADV_DONTNEED) failed for EVAllocator chunk, "
+                   << "errno: " << errno;
+      return false;
     }
-    return slot_count_;
+    std::vector<uint32>().swap(free_slots_);
+    current_ = start_;
+    ctx_->AddReserved(-(int64)chunk_size_);
+    return true;
+  }
+
+  // Pages of a released chunk are faulted in again when used.
+  void Reuse() {
+    ctx_->AddReserved(chunk_size_);
+  }
+
+  bool Empty() const {
+    return in_use_ == 0;
+  }
+
+  bool Full() const {
+    return free_slots_.empty() && current_ + slot_size_ > end_;
   }
 
-  size_t Count() {
+  size_t Count() const {
     return slot_count_;
   }
 
+  Bin* GetBin() const {
+    return bin_;
+  }
+
  private:
+  friend class ChunkList;
+
   char* start_ = nullptr;
   char* current_ = nullptr;
   char* end_ = nullptr;
   size_t chunk_size_;
   size_t slot_size_;
   size_t slot_count_;
+  size_t in_use_ = 0;
+  std::vector<uint32> free_slots_;
+  Bin* bin_ = nullptr;
+  ChunkContext* ctx_ = nullptr;
+  int numa_node_ = port::kNUMANoAffinity;
+
+  // Links of the ChunkList the chunk is in.
+  Chunk* prev_ = nullptr;
+  Chunk* next_ = nullptr;
 };
 
+// Intrusive doubly linked list of chunks.
+class ChunkList {
+ public:
+  bool empty() const { return head_ == nullptr; }
+
+  void Push(Chunk* c) {
+    c->prev_ = nullptr;
+    c->next_ = head_;
+    if (head_ != nullptr) {
+      head_->prev_ = c;
+    }
+    head_ = c;
+  }
+
+  Chunk* Pop() {
+    Chunk* c = head_;
+    if (c != nullptr) {
+      Remove(c);
+    }
+    return c;
+  }
+
+  void Remove(Chunk* c) {
+    if (c->prev_ != nullptr) {
+      c->prev_->next_ = c->next_;
+    } else {
+      head_ = c->next_;
+    }
+    if (c->next_ != nullptr) {
+      c->next_->prev_ = c->prev_;
+    }
+    c->prev_ = c->next_ = nullptr;
+  }
+
+ private:
+  Chunk* head_ = nullptr;
+};
+
+class ThreadLocalArena;
+// Slots of one size owned by one ThreadLocalArena. Only the owner thread
+// touches the chunks, other threads push their frees to the remote free
+// queue, which is drained by the owner on its next allocation. A non-current
+// chunk is either full, or partial, or the spare one, or released.
 class Bin {
  public:
-  Bin(size_t s, PageMap* pm) : bin_size_(s), page_map_(pm) {
+  Bin(size_t s, ThreadLocalArena* arena, ChunkContext* ctx)
+      : bin_size_(s), arena_(arena), ctx_(ctx) {
     current_chunk_ = CreateChunk();
   }
 
@@ -247,84 +336,185 @@ class Bin {
   }
 
   void* Allocate() {
-    void* ptr = nullptr;
-    if (free_list_.TryPop(&ptr)) {
-      return ptr;
-    }
-
-    ptr = current_chunk_->Allocate();
+    void* ptr = current_chunk_->Allocate();
     if (ptr == nullptr) {
-      current_chunk_ = CreateChunk();
+      NextChunk();
       ptr = current_chunk_->Allocate();
     }
+    slots_in_use_.fetch_add(1, std::memory_order_relaxed);
     return ptr;
   }
 
   size_t BatchAllocate(size_t num, void** ret) {
-    auto allocated = free_list_.PopBatch(num, ret);
-    auto remains = num - allocated;
-    if (remains == 0) {
-      return num;
+    size_t allocated = current_chunk_->BatchAllocate(num, ret);
+    while (allocated < num) {
+      NextChunk();
+      allocated += current_chunk_->BatchAllocate(
+          num - allocated, ret + allocated);
     }
+    slots_in_use_.fetch_add(num, std::memory_order_relaxed);
+    return num;
+  }
 
-    void** cur = ret + allocated;
-    allocated = current_chunk_->BatchAllocate(remains, cur);
-    remains -= allocated;
-    if (remains == 0) {
-      return num;
+  // Free by the owner thread.
+  void Deallocate(Chunk* chunk, void* ptr) {
+    const bool was_full = chunk->Full();
+    chunk->Deallocate(ptr);
+    slots_in_use_.fetch_sub(1, std::memory_order_relaxed);
+    if (chunk == current_chunk_) {
+      return;
     }
-
-    cur += allocated;
-    if (remains < current_chunk_->Count()) {
-      current_chunk_ = CreateChunk();
-
-      allocated = current_chunk_->BatchAllocate(remains, cur);
-      return num - (remains - allocated);
+    if (chunk->Empty()) {
+      if (!was_full) {
+        partial_.Remove(chunk);
+      }
+      RecycleChunk(chunk);
+    } else if (was_full) {
+      partial_.Push(chunk);
     }
+  }
 
-    // Allocate in multiple chunks.
-    auto chunk_num = remains / current_chunk_->Count();
-    for (int i = 0; i < chunk_num; ++i) {
-      current_chunk_ = CreateChunk();
-      allocated = current_chunk_->FullAllocate(cur);
-
-      cur += allocated;
-      remains -= allocated;
+  // Free by other threads, returns true if the owner should drain.
+  bool RemoteDeallocate(Chunk* chunk, void* ptr) {
+    remote_free_count_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<spin_lock> l(remote_lock_);
+    if (orphaned_) {
+      // The owner thread has exited, frees are serialized by the lock.
+      Deallocate(chunk, ptr);
+      return false;
     }
+    remote_frees_.push_back(ptr);
+    return remote_frees_.size() == 1;
+  }
 
-    current_chunk_ = CreateChunk();
-    allocated = current_chunk_->BatchAllocate(remains, cur);
-    return num - (remains - allocated);
+  void DrainRemoteFrees() {
+    std::vector<void*> frees;
+    {
+      std::lock_guard<spin_lock> l(remote_lock_);
+      frees.swap(remote_frees_);
+    }
+    for (auto ptr : frees) {
+      Deallocate(ctx_->page_map->GetChunk(ptr), ptr);
+    }
   }
 
-  void Deallocate(void* ptr) {
-    free_list_.Push(ptr);
+  // Called by the owner thread when it exits.
+  void Orphan() {
+    std::lock_guard<spin_lock> l(remote_lock_);
+    for (auto ptr : remote_frees_) {
+      Deallocate(ctx_->page_map->GetChunk(ptr), ptr);
+    }
+    std::vector<void*>().swap(remote_frees_);
+    orphaned_ = true;
   }
 
   size_t BinSize() const {
     return bin_size_;
   }
 
+  ThreadLocalArena* Arena() const {
+    return arena_;
+  }
+
+  int64 ChunkCount() const {
+    return chunk_count_.load(std::memory_order_relaxed);
+  }
+
+  int64 ReleasedChunkCount() const {
+    return released_chunk_count_.load(std::memory_order_relaxed);
+  }
+
+  int64 SlotsInUse() const {
+    return slots_in_use_.load(std::memory_order_relaxed);
+  }
+
+  int64 RemoteFreeCount() const {
+    return remote_free_count_.load(std::memory_order_relaxed);
+  }
+
+  int64 ReleaseCount() const {
+    return release_count_.load(std::memory_order_relaxed);
+  }
+
+  int NumaNode() const;
+
  private:
   Chunk* CreateChunk() {
-    auto c = new Chunk(kChunkSize, bin_size_, this, page_map_);
+    auto c = new Chunk(kChunkSize, bin_size_, this, ctx_, NumaNode());
     chunks_.emplace_back(c);
+    chunk_count_.fetch_add(1, std::memory_order_relaxed);
     return c;
   }
 
+  // Switch to a chunk with free slots, prefer resident chunks.
+  void NextChunk() {
+    Chunk* c = partial_.Pop();
+    if (c == nullptr && spare_chunk_ != nullptr) {
+      c = spare_chunk_;
+      spare_chunk_ = nullptr;
+    }
+    if (c == nullptr && !released_.empty()) {
+      c = released_.Pop();
+      c->Reuse();
+      released_chunk_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (c == nullptr) {
+      c = CreateChunk();
+    }
+    current_chunk_ = c;
+  }
+
+  // Keep one empty chunk resident to avoid page faults when the bin
+  // oscillates around a chunk boundary, release the others.
+  void RecycleChunk(Chunk* chunk) {
+    if (spare_chunk_ == nullptr) {
+      spare_chunk_ = chunk;
+      return;
+    }
+    if (!ctx_->release_memory || !chunk->Release()) {
+      partial_.Push(chunk);
+      return;
+    }
+    released_.Push(chunk);
+    released_chunk_count_.fetch_add(1, std::memory_order_relaxed);
+    release_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
  private:
   size_t bin_size_;
-  PageMap* page_map_ = nullptr;
+  ThreadLocalArena* arena_ = nullptr;
+  ChunkContext* ctx_ = nullptr;
   Chunk* current_chunk_ = nullptr;
+  Chunk* spare_chunk_ = nullptr;
 
-  FreeList free_list_;
+  ChunkList partial_;
+  ChunkList released_;
   std::vector<Chunk*> chunks_;
+
+  spin_lock remote_lock_;
+  std::vector<void*> remote_frees_;
+  bool orphaned_ = false;
+
+  // Stats, read by other threads.
+  std::atomic<int64> chunk_count_{0};
+  std::atomic<int64> released_chunk_count_{0};
+  std::atomic<int64> slots_in_use_{0};
+  std::atomic<int64> remote_free_count_{0};
+  std::atomic<int64> release_count_{0};
 };
 
 // Thread local arena
 class ThreadLocalArena {
  public:
-  ThreadLocalArena(PageMap* pm) : page_map_(pm) {}
+  // The arena of a thread bound to a NUMA node allocates its chunks on
+  // that node, e.g. the threads of the EV NUMA node pools.
+  ThreadLocalArena(ChunkContext* ctx,
+                   std::function<void(Bin*)> register_bin)
+      : ctx_(ctx), register_bin_(std::move(register_bin)) {
+    if (ctx_->numa_aware) {
+      numa_node_ = port::NUMAGetThreadNodeAffinity();
+    }
+  }
 
   ~ThreadLocalArena() {
     for (auto it = bins_.begin(); it != bins_.end(); ++it) {
@@ -334,45 +524,97 @@ class ThreadLocalArena {
   }
 
   void* Allocate(size_t num_bytes) {
-    auto it = bins_.find(num_bytes);
-    if (it != bins_.end()) {
-      return it->second->Allocate();
-    }
-    auto b = new Bin(num_bytes, page_map_);
-    bins_.emplace(num_bytes, b);
-    return b->Allocate();
+    MaybeDrainRemoteFrees();
+    return GetBin(num_bytes)->Allocate();
   }
 
   size_t BatchAllocate(size_t num, size_t num_bytes, void** ret) {
-    auto it = bins_.find(num_bytes);
-    if (it != bins_.end()) {
-      return it->second->BatchAllocate(num, ret);
+    MaybeDrainRemoteFrees();
+    return GetBin(num_bytes)->BatchAllocate(num, ret);
+  }
+
+  void Deallocate(Chunk* chunk, void* ptr) {
+    chunk->GetBin()->Deallocate(chunk, ptr);
+  }
+
+  void RemoteDeallocate(Chunk* chunk, void* ptr) {
+    if (chunk->GetBin()->RemoteDeallocate(chunk, ptr)) {
+      has_remote_frees_.store(true, std::memory_order_release);
     }
-    auto b = new Bin(num_bytes, page_map_);
-    bins_.emplace(num_bytes, b);
-    return b->BatchAllocate(num, ret);
   }
 
-  void Deallocate(size_t num_bytes, void* ptr) {
+  int NumaNode() const {
+    return numa_node_;
+  }
+
+  // pthread key destructor of the owner thread. The arena is kept since
+  // its slots may be still in use.
+  static void OnThreadExit(void* arena) {
+    auto a = static_cast<ThreadLocalArena*>(arena);
+    for (auto it = a->bins_.begin(); it != a->bins_.end(); ++it) {
+      it->second->Orphan();
+    }
+  }
+
+ private:
+  Bin* GetBin(size_t num_bytes) {
     auto it = bins_.find(num_bytes);
     if (it != bins_.end()) {
-      return it->second->Deallocate(ptr);
+      return it->second;
     }
-    auto b = new Bin(num_bytes, page_map_);
+    auto b = new Bin(num_bytes, this, ctx_);
     bins_.emplace(num_bytes, b);
-    return b->Deallocate(ptr);
+    register_bin_(b);
+    return b;
+  }
+
+  void MaybeDrainRemoteFrees() {
+    if (has_remote_frees_.load(std::memory_order_relaxed) &&
+        has_remote_frees_.exchange(false, std::memory_order_acquire)) {
+      for (auto it = bins_.begin(); it != bins_.end(); ++it) {
+        it->second->DrainRemoteFrees();
+      }
+    }
   }
 
  private:
   std::unordered_map<size_t, Bin*> bins_;
-  PageMap* page_map_ = nullptr;
+  ChunkContext* ctx_ = nullptr;
+  std::function<void(Bin*)> register_bin_;
+  std::atomic<bool> has_remote_frees_{false};
+  int numa_node_ = port::kNUMANoAffinity;
 };
 
+int Bin::NumaNode() const {
+  return arena_->NumaNode();
+}
+
 class EVAllocatorImpl {
  public:
   EVAllocatorImpl() {
-    pthread_key_create(&key_, nullptr);
-    page_map_ = new PageMap();
+    pthread_key_create(&key_, &ThreadLocalArena::OnThreadExit);
+    ctx_.page_map = new PageMap();
+    Status s = ReadBoolFromEnvVar("TF_EV_ALLOCATOR_RELEASE_MEMORY", true,
+                                  &ctx_.release_memory);
+    if (!s.ok()) {
+      LOG(WARNING) << "Read TF_EV_ALLOCATOR_RELEASE_MEMORY envrionment error. "
+                   << s.error_message();
+    }
+    bool numa_aware = false;
+    s = ReadBoolFromEnvVar("TF_EV_NUMA_AWARE", false, &numa_aware);
+    if (!s.ok()) {
+      LOG(WARNING) << "Read TF_EV_NUMA_AWARE envrionment error. "
+                   << s.error_message();
+    }
+    ctx_.numa_aware = numa_aware && port::NUMAEnabled();
+    // Rows of the NUMA aware EVs are spread over large node local
+    // chunks, so huge pages are the default to save TLB misses.
+    s = ReadBoolFromEnvVar("TF_EV_ALLOCATOR_HUGE_PAGE", numa_aware,
+                           &ctx_.huge_page);
+    if (!s.ok()) {
+      LOG(WARNING) << "Read TF_EV_ALLOCATOR_HUGE_PAGE envrionment error. "
+                   << s.error_message();
+    }
   }
 
   ~EVAllocatorImpl() {
@@ -387,24 +629,89 @@ class EVAllocatorImpl {
     return GetArena()->BatchAllocate(num, num_bytes, ret);
   }
 
+  // Free to the arena which owns the slot, rows of EV are usually
+  // allocated by the gather threads but freed by the eviction thread.
   void Deallocate(void* ptr) {
-    GetArena()->Deallocate(AllocatedSize(ptr), ptr);
+    Chunk* chunk = ctx_.page_map->GetChunk(ptr);
+    if (chunk == nullptr) {
+      LOG(FATAL) << "Deallocate " << ptr
+                 << " which is not allocated by EVAllocator.";
+    }
+    ThreadLocalArena* owner = chunk->GetBin()->Arena();
+    if (owner == pthread_getspecific(key_)) {
+      owner->Deallocate(chunk, ptr);
+    } else {
+      owner->RemoteDeallocate(chunk, ptr);
+    }
   }
 
   size_t AllocatedSize(const void* ptr) const {
-    auto bin = page_map_->GetBin(ptr);
-    if (bin != nullptr) {
-      return bin->BinSize();
+    auto chunk = ctx_.page_map->GetChunk(ptr);
+    if (chunk != nullptr) {
+      return chunk->GetBin()->BinSize();
     }
     return 0;
   }
 
+  int64 BytesReserved() const {
+    return ctx_.bytes_reserved.load(std::memory_order_relaxed);
+  }
+
+  int64 PeakBytesReserved() const {
+    return ctx_.peak_bytes_reserved.load(std::memory_order_relaxed);
+  }
+
+  // Per bin size stats summed over all the arenas.
+  string BinStatsDebugString() {
+    struct BinStats {
+      int64 arenas = 0;
+      int64 chunks = 0;
+      int64 released_chunks = 0;
+      int64 slots_in_use = 0;
+      int64 remote_frees = 0;
+      int64 releases = 0;
+    };
+    std::map<size_t, BinStats> stats;
+    {
+      mutex_lock l(bins_mu_);
+      for (auto b : bins_) {
+        auto& s = stats[b->BinSize()];
+        ++s.arenas;
+        s.chunks += b->ChunkCount();
+        s.released_chunks += b->ReleasedChunkCount();
+        s.slots_in_use += b->SlotsInUse();
+        s.remote_frees += b->RemoteFreeCount();
+        s.releases += b->ReleaseCount();
+      }
+    }
+    string ret = strings::StrCat(
+        "EVAllocator bytes_reserved: ", BytesReserved(),
+        ", peak_bytes_reserved: ", PeakBytesReserved(), "\n",
+        "bin_size\tarenas\tchunks\treleased_chunks\tslots_in_use"
+        "\toccupancy\tremote_frees\treleases\n");
+    for (auto& it : stats) {
+      const auto& s = it.second;
+      const int64 resident_slots =
+          (s.chunks - s.released_chunks) * (kChunkSize / it.first);
+      strings::StrAppend(
+          &ret, it.first, "\t", s.arenas, "\t", s.chunks, "\t",
+          s.released_chunks, "\t", s.slots_in_use, "\t",
+          strings::Printf("%.2f", resident_slots == 0 ? 0.0 :
+              (double)s.slots_in_use / resident_slots), "\t",
+          s.remote_frees, "\t", s.releases, "\n");
+    }
+    return ret;
+  }
+
  private:
   ThreadLocalArena* GetArena() {
     ThreadLocalArena* arena =
       static_cast<ThreadLocalArena*>(pthread_getspecific(key_));
     if (arena == nullptr) {
-      arena = new ThreadLocalArena(page_map_);
+      arena = new ThreadLocalArena(&ctx_, [this](Bin* b) {
+        mutex_lock l(bins_mu_);
+        bins_.push_back(b);
+      });
       pthread_setspecific(key_, arena);
     }
     return arena;
@@ -412,7 +719,11 @@ class EVAllocatorImpl {
 
  private:
   pthread_key_t key_;
-  PageMap* page_map_ = nullptr;
+  ChunkContext ctx_;
+
+  // All the bins for stats.
+  mutex bins_mu_;
+  std::vector<Bin*> bins_ GUARDED_BY(bins_mu_);
 };
 
 class EVAllocator : public Allocator {
@@ -520,9 +831,14 @@ class EVAllocator : public Allocator {
     impl_.Deallocate(ptr);
   }
 
+  // bytes_reserved is the resident chunk memory, which is always collected.
   absl::optional<AllocatorStats> GetStats() override {
+    VLOG(1) << impl_.BinStatsDebugString();
     mutex_lock l(mu_);
-    return stats_;
+    AllocatorStats stats = stats_;
+    stats.bytes_reserved = impl_.BytesReserved();
+    stats.peak_bytes_reserved = impl_.PeakBytesReserved();
+    return stats;
   }
 
   void ClearStats() override {
@@ -1,5 +1,9 @@
+#include <deque>
+
 #include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/core/threadpool_interface.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/test.h"
@@ -427,5 +431,121 @@ TEST(EVAllocator, TestMultiThreadAllocateDeallocateLongRun) {
   }
 }
 
+TEST(EVAllocator, TestCrossThreadDeallocateReleaseMemory) {
+  auto allocator = ev_allocator();
+  ASSERT_EQ(allocator->Name(), "ev_allocator");
+  constexpr size_t kChunkSize = 1 << 22;
+  // A size no other test uses, so the bin is created here.
+  constexpr int allocate_size = 1008;
+  constexpr int chunk_num = 8;
+  constexpr int size = chunk_num * (kChunkSize / allocate_size);
+
+  int64 reserved_before = allocator->GetStats()->bytes_reserved;
+  void** ptrs = new void*[size];
+  allocator->BatchAllocateRaw(size, 16, allocate_size, ptrs);
+  EXPECT_EQ(allocator->GetStats()->bytes_reserved,
+            reserved_before + chunk_num * kChunkSize);
+
+  // Free by another thread while the owner thread is still alive.
+  Thread* dealloc_th = Env::Default()->StartThread(
+      ThreadOptions(), "", [allocator, ptrs, size]() {
+        for (int i = 0; i < size; ++i) {
+          allocator->DeallocateRaw(ptrs[i]);
+        }
+      });
+  delete dealloc_th;
+
+  // The owner drains remote frees on its next allocation, all the empty
+  // chunks except the current and the spare one are released.
+  void* ptr = allocator->AllocateRaw(16, allocate_size);
+  EXPECT_LE(allocator->GetStats()->bytes_reserved,
+            reserved_before + 2 * kChunkSize);
+  allocator->DeallocateRaw(ptr);
+  delete[] ptrs;
+}
+
+// Workers allocate rows, an eviction thread frees the oldest ones, as
+// EV_Eviction does for DRAM_SSDHASH. Resident memory should be stable.
+TEST(EVAllocator, TestChurnResidentOverTime) {
+  auto allocator = ev_allocator();
+
+  constexpr int round_num = 10;
+  constexpr int batch_num = 20;
+  constexpr int batch_size = 10000;
+  constexpr int allocate_size = 144;
+  constexpr int max_live_rows = 1000000;
+  constexpr int THREAD_NUM = 8;
+  constexpr size_t kChunkSize = 1 << 22;
+  // Rows live at the end of a round, before the eviction thread runs.
+  constexpr int64 peak_live_bytes =
+      int64{max_live_rows + THREAD_NUM * batch_num * batch_size} *
+      allocate_size;
+  // Per thread: the current and the spare chunk, and the partly evicted
+  // chunks.
+  constexpr int64 slack_bytes = THREAD_NUM * 4 * kChunkSize;
+  const int64 reserved_before = allocator->GetStats()->bytes_reserved;
+
+  mutex mu;
+  std::deque<void*> live;
+  auto alloc_func = [allocator, &mu, &live]() {
+    void** ptrs = new void*[batch_size];
+    for (int i = 0; i < batch_num; ++i) {
+      auto alloc_num = allocator->BatchAllocateRaw(
+          batch_size, 16, allocate_size, ptrs);
+      for (int j = 0; j < alloc_num; ++j) {
+        memset(ptrs[j], 0, allocate_size);
+      }
+      mutex_lock l(mu);
+      live.insert(live.end(), ptrs, ptrs + alloc_num);
+    }
+    delete[] ptrs;
+  };
+  auto evict_func = [allocator, &mu, &live]() {
+    std::vector<void*> evicted;
+    {
+      mutex_lock l(mu);
+      while (live.size() > max_live_rows) {
+        evicted.push_back(live.front());
+        live.pop_front();
+      }
+    }
+    for (auto ptr : evicted) {
+      allocator->DeallocateRaw(ptr);
+    }
+  };
+
+  // Worker threads live across rounds like a thread pool.
+  std::unique_ptr<thread::ThreadPool> pool(new thread::ThreadPool(
+      Env::Default(), "churn", THREAD_NUM));
+  for (int r = 0; r < round_num; ++r) {
+    BlockingCounter counter(THREAD_NUM);
+    for (int i = 0; i < THREAD_NUM; ++i) {
+      pool->Schedule([&alloc_func, &counter]() {
+        alloc_func();
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+    Thread* evict_th =
+      Env::Default()->StartThread(ThreadOptions(), "EV_Eviction", evict_func);
+    delete evict_th;
+
+    double rss = getResident() * getpagesize() / 1024.0 / 1024.0;
+    const int64 reserved =
+        allocator->GetStats()->bytes_reserved - reserved_before;
+    LOG(INFO) << "round: " << r << ", rss: " << rss << "MB"
+              << ", reserved: " << reserved / 1024.0 / 1024.0
+              << "MB, live: "
+              << max_live_rows * allocate_size / 1024.0 / 1024.0 << "MB";
+    // The evicted chunks are reused or released, otherwise every round
+    // reserves another 'batch_num * batch_size' rows per thread.
+    EXPECT_LE(reserved, peak_live_bytes + slack_bytes);
+  }
+
+  for (auto ptr : live) {
+    allocator->DeallocateRaw(ptr);
+  }
+}
+
 }
 } // namespace tensorflow
@@ -1,6 +1,7 @@
 #include "tensorflow/core/framework/experimental_pmem_allocator.h"
 
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "libpmem.h"
@@ -28,6 +29,15 @@ ExperimentalPMemAllocator::NewExperimentalPMemAllocator(
   int is_pmem;
   uint64_t mapped_size;
   char* pmem;
+  struct stat st;
+  if (config.persistent && stat(pmem_file.c_str(), &st) == 0 &&
+      static_cast<uint64_t>(st.st_size) != pmem_size) {
+    // pmem_map_file would truncate or extend the file of a previous process
+    LOG(FATAL) << "Experimental PMem Allocator: Persistent file " << pmem_file
+               << " size " << st.st_size << " is not same as expected "
+               << pmem_size << ", remove it to start from scratch";
+    return nullptr;
+  }
   if ((pmem =
            (char*)pmem_map_file(pmem_file.c_str(), pmem_size, PMEM_FILE_CREATE,
                                 0666, &mapped_size, &is_pmem)) == nullptr) {
@@ -37,9 +47,15 @@ ExperimentalPMemAllocator::NewExperimentalPMemAllocator(
   }
 
   if (!is_pmem) {
-    LOG(FATAL) << "Experimental PMem Allocator: " << pmem_file
-               << " is not a valid pmem path";
-    return nullptr;
+    if (!config.persistent) {
+      LOG(FATAL) << "Experimental PMem Allocator: " << pmem_file
+                 << " is not a valid pmem path";
+      return nullptr;
+    }
+    // A regular file or tmpfs standing in for PMem
+    LOG(WARNING) << "Experimental PMem Allocator: " << pmem_file
+                 << " is not on PMem, persist it by "
+                 << (config.msync ? "msync" : "store ordering only");
   }
 
   if (mapped_size != pmem_size) {
@@ -51,7 +67,8 @@ ExperimentalPMemAllocator::NewExperimentalPMemAllocator(
 
   ExperimentalPMemAllocator* allocator = nullptr;
   allocator = new ExperimentalPMemAllocator(pmem, pmem_file, pmem_size,
-                                            max_access_threads, config);
+                                            max_access_threads, config,
+                                            is_pmem);
   return allocator;
 }
 
@@ -104,7 +121,8 @@ void ExperimentalPMemAllocator::BackgroundWork() {
 
 ExperimentalPMemAllocator::ExperimentalPMemAllocator(
     char* pmem, const std::string& pmem_file_name, uint64_t pmem_size,
-    uint32_t max_access_threads, const ExperimentalPMemAllocatorConfig& config)
+    uint32_t max_access_threads, const ExperimentalPMemAllocatorConfig& config,
+    bool is_pmem)
     : pmem_(pmem),
       pmem_file_(pmem_file_name),
       pmem_size_(pmem_size),
@@ -120,12 +138,18 @@ ExperimentalPMemAllocator::ExperimentalPMemAllocator(
       thread_cache_(max_access_threads, max_classified_record_block_size_),
       thread_manager_(std::make_shared<ThreadManager>(max_access_threads)),
       closing_(false),
+      is_pmem_(is_pmem),
+      persistent_(config.persistent),
+      msync_(config.msync),
       instance_id_(next_instance_.fetch_add(1, std::memory_order_relaxed)) {
   if (instance_id_ > next_instance_) {
     LOG(FATAL) << "Experimental PMem Allocator: Too many instance created (>"
                << kMaxInstance << "), abort";
   }
   init_data_size_2_block_size();
+  if (persistent_) {
+    InitPersistentSpace();
+  }
   if (bg_thread_interval_ > 0) {
     bg_threads_.emplace_back(Env::Default()->StartThread(
         tensorflow::ThreadOptions(), "execute_thread",
@@ -160,6 +184,10 @@ void ExperimentalPMemAllocator::DeallocateRaw(void* addr) {
   uint32_t b_size = segment_record_size_[segment];
   assert(b_size > 0);
 
+  if (persistent_) {
+    SetAllocated(addr, false);
+  }
+
   if (b_size > 0) {
     auto& thread_cache = thread_cache_[t_id];
     // Conflict with bg thread happens only if free entries more than
@@ -187,7 +215,123 @@ ExperimentalPMemAllocator::~ExperimentalPMemAllocator() {
     delete t;
   }
   pmem_unmap(pmem_, pmem_size_);
-  remove(pmem_file_.c_str());
+  if (!persistent_) {
+    remove(pmem_file_.c_str());
+  }
+}
+
+void ExperimentalPMemAllocator::Persist(const void* addr, size_t len) const {
+  if (is_pmem_) {
+    pmem_persist(addr, len);
+  } else if (msync_) {
+    pmem_msync(addr, len);
+  } else {
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+}
+
+void ExperimentalPMemAllocator::InitPersistentSpace() {
+  uint64_t segment_num = pmem_size_ / segment_size_;
+  uint64_t bitmap_words = (pmem_size_ / block_size_ + 63) / 64;
+  uint64_t table_offset = sizeof(PersistentHeader);
+  uint64_t bitmap_offset =
+      (table_offset + segment_num * sizeof(uint32_t) + 63) / 64 * 64;
+  uint64_t meta_size = bitmap_offset + bitmap_words * sizeof(uint64_t);
+  meta_segments_ = (meta_size + segment_size_ - 1) / segment_size_;
+  if (meta_segments_ >= segment_num) {
+    LOG(FATAL) << "Experimental PMem Allocator: PMem size " << pmem_size_
+               << " is too small for persistent metadata of " << meta_size
+               << " bytes";
+  }
+  persistent_record_size_ = (uint32_t*)(pmem_ + table_offset);
+  allocation_bitmap_ = (uint64_t*)(pmem_ + bitmap_offset);
+
+  PersistentHeader* header = (PersistentHeader*)pmem_;
+  if (header->magic == kPersistentMagic) {
+    if (header->version != kPersistentVersion ||
+        header->pmem_size != pmem_size_ ||
+        header->segment_size != segment_size_ ||
+        header->block_size != block_size_ ||
+        header->meta_segments != meta_segments_) {
+      LOG(FATAL) << "Experimental PMem Allocator: Persistent file "
+                 << pmem_file_ << " is created by another configuration, "
+                 << "remove it to start from scratch";
+    }
+    RecoverFreeSpace();
+    recovered_ = true;
+    return;
+  }
+
+  // The file may be left by a crash during formatting, clear the metadata
+  // and write the magic at last.
+  memset(pmem_, 0, meta_size);
+  Persist(pmem_, meta_size);
+  header->version = kPersistentVersion;
+  header->pmem_size = pmem_size_;
+  header->segment_size = segment_size_;
+  header->block_size = block_size_;
+  header->meta_segments = meta_segments_;
+  Persist(header, sizeof(PersistentHeader));
+  header->magic = kPersistentMagic;
+  Persist(&header->magic, sizeof(header->magic));
+  segment_head_ = meta_segments_;
+}
+
+void ExperimentalPMemAllocator::RecoverFreeSpace() {
+  uint64_t segment_num = pmem_size_ / segment_size_;
+  uint64_t head = meta_segments_;
+  uint64_t recovered_bytes = 0;
+  std::vector<FreeList> free_lists(max_classified_record_block_size_ + 1);
+  for (uint64_t segment = meta_segments_; segment < segment_num; ++segment) {
+    uint32_t b_size = persistent_record_size_[segment];
+    if (b_size == 0) {
+      continue;
+    }
+    if (b_size > max_classified_record_block_size_) {
+      LOG(FATAL) << "Experimental PMem Allocator: Invalid record size "
+                 << b_size << " of segment " << segment << " in "
+                 << pmem_file_;
+    }
+    head = segment + 1;
+    segment_record_size_[segment] = b_size;
+    uint64_t aligned_size = b_size * block_size_;
+    char* begin = (char*)Segment2Addr(segment);
+    for (uint64_t offset = 0; offset + aligned_size <= segment_size_;
+         offset += aligned_size) {
+      char* addr = begin + offset;
+      uint64_t block = (addr - pmem_) / block_size_;
+      if (allocation_bitmap_[block / 64] & (1ULL << (block % 64))) {
+        recovered_bytes += aligned_size;
+        continue;
+      }
+      free_lists[b_size].emplace_back(addr);
+      if (free_lists[b_size].size() >= kMinMovableListSize * 64) {
+        pool_.MoveEntryList(free_lists[b_size], b_size);
+      }
+    }
+  }
+  for (uint32_t b_size = 1; b_size < free_lists.size(); ++b_size) {
+    if (!free_lists[b_size].empty()) {
+      pool_.MoveEntryList(free_lists[b_size], b_size);
+    }
+  }
+  segment_head_ = head;
+  LOG(INFO) << "Experimental PMem Allocator: Recovered " << pmem_file_
+            << ", segments: " << head - meta_segments_
+            << ", allocated bytes: " << recovered_bytes;
+}
+
+void ExperimentalPMemAllocator::SetAllocated(const void* addr,
+                                             bool allocated) {
+  uint64_t block = ((char*)addr - pmem_) / block_size_;
+  uint64_t* word = allocation_bitmap_ + block / 64;
+  uint64_t mask = 1ULL << (block % 64);
+  if (allocated) {
+    __atomic_fetch_or(word, mask, __ATOMIC_RELEASE);
+  } else {
+    __atomic_fetch_and(word, ~mask, __ATOMIC_RELEASE);
+  }
+  Persist(word, sizeof(uint64_t));
 }
 
 bool ExperimentalPMemAllocator::AllocateSegmentSpace(Segment* segment,
@@ -198,6 +342,10 @@ bool ExperimentalPMemAllocator::AllocateSegmentSpace(Segment* segment,
       if (segment_head_.compare_exchange_strong(new_segment, new_segment + 1)) {
         *segment = Segment{Segment2Addr(new_segment), segment_size_};
         segment_record_size_[new_segment] = record_size;
+        if (persistent_) {
+          persistent_record_size_[new_segment] = record_size;
+          Persist(persistent_record_size_ + new_segment, sizeof(uint32_t));
+        }
         return true;
       }
       continue;
@@ -254,6 +402,10 @@ void* ExperimentalPMemAllocator::AllocateRaw(size_t alignment, size_t size) {
     break;
   }
 
+  if (persistent_ && ret != nullptr) {
+    SetAllocated(ret, true);
+  }
+
   if (pmem_allocator_collect_stats) {
     const std::size_t alloc_size = AllocatedSize(ret);
     mutex_lock l(mu_);
@@ -39,6 +39,10 @@ const float kBGThreadInterval = 1;
 // segment_size: It should be equal or larger than max(1MB,max_allocation_size),
 // recommand larger than 128 * max_allocation_size, it should be devidable by
 // allocation_unit
+// persistent: keep allocation metadata in the file and keep the file on exit,
+// so a restarted process can reattach to the allocated space
+// msync: use msync to persist updates of a file which is not on PMem,
+// otherwise the file is only consistent on process crash
 //
 // See doc/pmem_allocator.md for more details
 struct ExperimentalPMemAllocatorConfig {
@@ -47,16 +51,22 @@ struct ExperimentalPMemAllocatorConfig {
   ExperimentalPMemAllocatorConfig(uint64_t _segment_size,
                                   uint32_t _allocation_unit,
                                   uint32_t _bg_thread_interval,
-                                  uint64_t _max_allocation_size)
+                                  uint64_t _max_allocation_size,
+                                  bool _persistent = false,
+                                  bool _msync = false)
       : segment_size(_segment_size),
         allocation_unit(_allocation_unit),
         bg_thread_interval(_bg_thread_interval),
-        max_allocation_size(_max_allocation_size) {}
+        max_allocation_size(_max_allocation_size),
+        persistent(_persistent),
+        msync(_msync) {}
 
   uint64_t segment_size = kSegmentSize;
   uint32_t allocation_unit = kAllocationUnit;
   float bg_thread_interval = kBGThreadInterval;
   uint64_t max_allocation_size = DEFAULT_LIBPMEM_MAX_ALLOCATION_SIZE;
+  bool persistent = false;
+  bool msync = false;
 };
 
 // Manage allocation/de-allocation of PMem space at block unit
@@ -81,7 +91,8 @@ class ExperimentalPMemAllocator : public Allocator {
 
   ExperimentalPMemAllocator(char* pmem, const std::string& pmem_file_name,
                             uint64_t pmem_size, uint32_t max_access_threads,
-                            const ExperimentalPMemAllocatorConfig& config);
+                            const ExperimentalPMemAllocatorConfig& config,
+                            bool is_pmem = true);
 
   ExperimentalPMemAllocator(const ExperimentalPMemAllocator&) = delete;
 
@@ -117,6 +128,25 @@ class ExperimentalPMemAllocator : public Allocator {
   // pool
   void BackgroundWork();
 
+  // In persistent mode, the segment table and an allocation bitmap are kept
+  // in the first segments of the file and updated before an allocation is
+  // returned, so allocated space survives a crash or restart
+  bool Persistent() const { return persistent_; }
+
+  // True if the allocator reattached to a file of a previous process
+  bool Recovered() const { return recovered_; }
+
+  // Offset of an allocated address in the file, which is stable across
+  // processes, kPMemNull if addr is not in the file
+  uint64_t ToOffset(const void* addr) const { return Addr2Offset(addr); }
+
+  void* FromOffset(uint64_t offset) const { return Offset2Addr(offset); }
+
+  // Make stores to [addr, addr + len) durable: pmem_persist on PMem,
+  // pmem_msync if config.msync is set, otherwise only order the stores,
+  // which is enough when the process crashes but the OS survives
+  void Persist(const void* addr, size_t len) const;
+
   absl::optional<AllocatorStats> GetStats() override {
     mutex_lock l(mu_);
     return stats_;
@@ -289,6 +319,29 @@ class ExperimentalPMemAllocator : public Allocator {
 
   bool AllocateSegmentSpace(Segment* segment, uint32_t record_size);
 
+  // Header at the beginning of a persistent file, followed by the segment
+  // record size table and the allocation bitmap
+  struct PersistentHeader {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t pmem_size;
+    uint64_t segment_size;
+    uint64_t block_size;
+    uint64_t meta_segments;
+  };
+
+  static const uint64_t kPersistentMagic = 0x44525045564d454dULL;
+  static const uint64_t kPersistentVersion = 1;
+
+  // Format a new file, or recover segments and free space of an existing one
+  void InitPersistentSpace();
+
+  // Rebuild free lists from the allocation bitmap of recovered segments
+  void RecoverFreeSpace();
+
+  // Mark the block at addr allocated or freed in the allocation bitmap
+  void SetAllocated(const void* addr, bool allocated);
+
   void init_data_size_2_block_size() {
     data_size_2_block_size_.resize(max_allocation_size_);
     for (size_t i = 0; i < data_size_2_block_size_.size(); i++) {
@@ -331,6 +384,16 @@ class ExperimentalPMemAllocator : public Allocator {
 
   bool closing_;
 
+  const bool is_pmem_;
+  const bool persistent_;
+  const bool msync_;
+  bool recovered_ = false;
+  // Segments used by persistent metadata, allocation starts after them
+  uint64_t meta_segments_ = 0;
+  // Record size table and allocation bitmap in the file
+  uint32_t* persistent_record_size_ = nullptr;
+  uint64_t* allocation_bitmap_ = nullptr;
+
   uint64_t instance_id_;
   static std::atomic<uint64_t> next_instance_;
   static thread_local std::vector<AllocatorThread> access_threads_;
@@ -368,13 +431,31 @@ class ExperimentalPMEMAllocatorFactory : public AllocatorFactory {
       return nullptr;
     }
 
+    // ENV: TF_EV_PMEM_PERSISTENT, keep EV on the file across restarts
+    bool persistent = false;
+    s = ReadBoolFromEnvVar("TF_EV_PMEM_PERSISTENT", false, &persistent);
+    if (!s.ok()) {
+      LOG(FATAL) << "Experimental PMem Allocator: Read env variable "
+                    "TF_EV_PMEM_PERSISTENT error";
+      return nullptr;
+    }
+    // ENV: TF_EV_PMEM_MSYNC, msync a persistent file which is not on PMem
+    bool msync = false;
+    s = ReadBoolFromEnvVar("TF_EV_PMEM_MSYNC", false, &msync);
+    if (!s.ok()) {
+      LOG(FATAL) << "Experimental PMem Allocator: Read env variable "
+                    "TF_EV_PMEM_MSYNC error";
+      return nullptr;
+    }
+
     std::string allocator_file(pmem_path_ +
                                std::to_string(allocator_cnt_.fetch_add(1)));
     return ExperimentalPMemAllocator::NewExperimentalPMemAllocator(
         allocator_file, allocator_size_, kMaxAccessThreads,
         ExperimentalPMemAllocatorConfig(kSegmentSize, kAllocationUnit,
                                         kBGThreadInterval,
-                                        max_allocation_size));
+                                        max_allocation_size, persistent,
+                                        msync));
   }
 
   SubAllocator* CreateSubAllocator(int numa_node) override {
@@ -89,6 +89,8 @@ class TrackingAllocator : public Allocator {
   gtl::InlinedVector<AllocRecord, 4> GetRecordsAndUnRef();
   // Returns a copy of allocation records collected so far.
   gtl::InlinedVector<AllocRecord, 4> GetCurrentRecords();
+  // The allocator this wrapper forwards to.
+  Allocator* wrapped() const { return allocator_; }
 
  protected:
   ~TrackingAllocator() override {}
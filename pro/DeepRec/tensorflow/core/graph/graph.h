@@ -167,6 +167,15 @@ class Node {
            type_string() == "ResourceSparseApplyAdamAsync" ||
            type_string() == "KvResourceSparseApplyAdamAsync";
   }
+  bool IsKvSparseApplyOps() const {
+    return type_string() == "KvResourceSparseApplyAdagrad" ||
+           type_string() == "KvResourceSparseApplyAdagradDecay" ||
+           type_string() == "KvResourceSparseApplyAdam" ||
+           type_string() == "KvResourceSparseApplyAdamAsync" ||
+           type_string() == "KvResourceSparseApplyFtrl" ||
+           type_string() == "KvResourceSparseApplyFtrlV2" ||
+           type_string() == "KvResourceSparseApplyGradientDescent";
+  }
   bool IsApplyFtrlOps() const {
     return type_string() == "ApplyFtrl" ||
            type_string() == "ResourceApplyFtrl" ||
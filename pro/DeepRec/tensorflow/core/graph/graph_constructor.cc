@@ -49,6 +49,7 @@ limitations under the License.
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/public/version.h"
+#include "tensorflow/core/util/device_name_utils.h"
 
 namespace tensorflow {
 
@@ -1665,20 +1666,20 @@ void AggregateForApply(Graph* dest, Node* n,
   const Edge* e = nullptr;
   TF_CHECK_OK(n->input_edge(grad_input, &e));
   auto grad = e->src();
+  const int grad_output = e->src_output();
+  const DataType grad_type = grad->output_type(grad_output);
   auto duplicate_grads = duplicated_nodes[grad];
   std::vector<NodeDefBuilder::NodeOut> src_list;
-  src_list.emplace_back(grad->name(), e->src_output(),
-      grad->output_type(0));
+  src_list.emplace_back(grad->name(), grad_output, grad_type);
   for (auto it : duplicate_grads) {
-    src_list.emplace_back(it->name(), e->src_output(),
-        it->output_type(0));
+    src_list.emplace_back(it->name(), grad_output, grad_type);
   }
 
   NodeDef node_def;
   TF_CHECK_OK(NodeDefBuilder(n->name() + "/aggr_addn", "AddN")
       .Device(n->assigned_device_name())
       .Input(src_list)
-      .Attr("T", grad->output_type(0))
+      .Attr("T", grad_type)
       .Finalize(&node_def));
 
   Status s;
@@ -1688,9 +1689,9 @@ void AggregateForApply(Graph* dest, Node* n,
 
   dest->RemoveEdge(e);
   dest->AddEdge(aggregate_node, 0, n, grad_input);
-  dest->AddEdge(grad, 0, aggregate_node, 0);
+  dest->AddEdge(grad, grad_output, aggregate_node, 0);
   for (size_t i = 0; i < duplicate_grads.size(); ++i) {
-    dest->AddEdge(duplicate_grads[i], 0, aggregate_node, i+1);
+    dest->AddEdge(duplicate_grads[i], grad_output, aggregate_node, i+1);
   }
 }
 
@@ -1701,29 +1702,37 @@ void AggregateForSparseApply(Graph* dest, Node* n,
   const Edge* e = nullptr;
   TF_CHECK_OK(n->input_edge(grad_input, &e));
   auto grad = e->src();
+  const int grad_output = e->src_output();
+  const DataType grad_type = grad->output_type(grad_output);
   auto dup_grads = duplicated_nodes[grad];
 
   const Edge* e2 = nullptr;
   TF_CHECK_OK(n->input_edge(indices_input, &e2));
   auto indices = e2->src();
+  const int indices_output = e2->src_output();
+  const DataType indices_type = indices->output_type(indices_output);
   auto dup_indices = duplicated_nodes[indices];
 
+  // A gradient or indices which is not duplicated, e.g. a constant, is the
+  // same for every micro batch.
+  const size_t dup_num = std::max(dup_grads.size(), dup_indices.size());
+  dup_grads.resize(dup_num, grad);
+  dup_indices.resize(dup_num, indices);
+
   Node* axis = scalar_const_node(dest, 0, n->name() + "/axis_0",
       n->assigned_device_name());
 
   std::vector<NodeDefBuilder::NodeOut> src_list;
-  src_list.emplace_back(grad->name(), e->src_output(),
-      grad->output_type(0));
+  src_list.emplace_back(grad->name(), grad_output, grad_type);
   for (auto it : dup_grads) {
-    src_list.emplace_back(it->name(), e->src_output(),
-        it->output_type(0));
+    src_list.emplace_back(it->name(), grad_output, grad_type);
   }
   NodeDef node_def;
   TF_CHECK_OK(NodeDefBuilder(n->name() + "/aggr_concat", "ConcatV2")
       .Device(n->assigned_device_name())
       .Input(src_list)
       .Input(axis->name(), 0, axis->output_type(0))
-      .Attr("T", grad->output_type(0))
+      .Attr("T", grad_type)
       .Finalize(&node_def));
   Status s;
   Node* concat_grad = dest->AddNode(node_def, &s);
@@ -1731,18 +1740,16 @@ void AggregateForSparseApply(Graph* dest, Node* n,
   concat_grad->set_assigned_device_name(n->assigned_device_name());
 
   std::vector<NodeDefBuilder::NodeOut> src_list2;
-  src_list2.emplace_back(indices->name(), e2->src_output(),
-      indices->output_type(0));
+  src_list2.emplace_back(indices->name(), indices_output, indices_type);
   for (auto it : dup_indices) {
-    src_list2.emplace_back(it->name(), e2->src_output(),
-        it->output_type(0));
+    src_list2.emplace_back(it->name(), indices_output, indices_type);
   }
   NodeDef node_def2;
   TF_CHECK_OK(NodeDefBuilder(n->name() + "/aggr_concat2", "ConcatV2")
       .Device(n->assigned_device_name())
       .Input(src_list2)
       .Input(axis->name(), 0, axis->output_type(0))
-      .Attr("T", indices->output_type(0))
+      .Attr("T", indices_type)
       .Finalize(&node_def2));
   Node* concat_indices = dest->AddNode(node_def2, &s);
   TF_CHECK_OK(s);
@@ -1750,15 +1757,15 @@ void AggregateForSparseApply(Graph* dest, Node* n,
 
   dest->RemoveEdge(e);
   dest->RemoveEdge(e2);
-  dest->AddEdge(grad, 0, concat_grad, 0);
+  dest->AddEdge(grad, grad_output, concat_grad, 0);
   for (size_t i = 0; i < dup_grads.size(); ++i) {
-    dest->AddEdge(dup_grads[i], 0, concat_grad, i+1);
+    dest->AddEdge(dup_grads[i], grad_output, concat_grad, i+1);
   }
   dest->AddEdge(axis, 0, concat_grad, dup_grads.size()+1);
 
-  dest->AddEdge(indices, 0, concat_indices, 0);
+  dest->AddEdge(indices, indices_output, concat_indices, 0);
   for (size_t i = 0; i < dup_indices.size(); ++i) {
-    dest->AddEdge(dup_indices[i], 0, concat_indices, i+1);
+    dest->AddEdge(dup_indices[i], indices_output, concat_indices, i+1);
   }
   dest->AddEdge(axis, 0, concat_indices, dup_indices.size()+1);
 
@@ -1766,7 +1773,7 @@ void AggregateForSparseApply(Graph* dest, Node* n,
   TF_CHECK_OK(NodeDefBuilder(n->name() + "/aggr_unique", "Unique")
       .Device(n->assigned_device_name())
       .Input(concat_indices->name(), 0, concat_indices->output_type(0))
-      .Attr("T", indices->output_type(0))
+      .Attr("T", indices_type)
       .Finalize(&node_def_unique));
   Node* unique = dest->AddNode(node_def_unique, &s);
   TF_CHECK_OK(s);
@@ -1824,10 +1831,97 @@ void AggregateForSparseApply(Graph* dest, Node* n,
   dest->AddEdge(unsorted_segment_sum, 0, n, grad_input);
   dest->AddEdge(unique, 0, n, indices_input);
 }
+
+// Lets micro batch i start only after the gradients of micro batch
+// i - max_concurrency are computed, so that at most 'max_concurrency'
+// micro batches hold their activations at the same time.
+void LimitMicroBatchConcurrency(Graph* dest, const std::vector<Node*>& apply_nodes,
+    map_node_list& duplicated_nodes, int32 duplicate_num,
+    int32 max_concurrency) {
+  auto is_duplicated = [&duplicated_nodes](const Node* n) {
+    auto it = duplicated_nodes.find(n);
+    return it != duplicated_nodes.end() && !it->second.empty();
+  };
+
+  // Gradients of micro batch 0, duplicated ones belong to the others.
+  std::vector<Node*> grads;
+  for (Node* n : apply_nodes) {
+    int grad_input, indices_input;
+    GetApplyGradientInputs(n, &grad_input, &indices_input);
+    Node* grad = nullptr;
+    TF_CHECK_OK(n->input_node(grad_input, &grad));
+    if (is_duplicated(grad)) {
+      grads.push_back(grad);
+    }
+  }
+  // Nodes of micro batch 0 without inputs from the same micro batch.
+  std::vector<Node*> roots;
+  for (auto& it : duplicated_nodes) {
+    if (it.second.empty()) continue;
+    bool is_root = true;
+    for (const Edge* e : it.first->in_edges()) {
+      if (is_duplicated(e->src())) {
+        is_root = false;
+        break;
+      }
+    }
+    if (is_root) {
+      roots.push_back(const_cast<Node*>(it.first));
+    }
+  }
+  if (grads.empty() || roots.empty()) {
+    return;
+  }
+
+  auto micro_batch_node = [&duplicated_nodes](Node* n, int32 i) {
+    return i == 0 ? n : duplicated_nodes[n][i - 1];
+  };
+  for (int32 i = max_concurrency; i <= duplicate_num; ++i) {
+    const int32 done = i - max_concurrency;
+    Node* barrier = nullptr;
+    NodeBuilder builder(dest->NewName("micro_batch_" + std::to_string(done) +
+                                      "/gradients_done"), "NoOp");
+    for (Node* grad : grads) {
+      builder.ControlInput(micro_batch_node(grad, done));
+    }
+    TF_CHECK_OK(builder.Device(grads[0]->assigned_device_name())
+        .Finalize(dest, &barrier));
+    barrier->set_assigned_device_name(grads[0]->assigned_device_name());
+    for (Node* root : roots) {
+      dest->AddControlEdge(barrier, micro_batch_node(root, i));
+    }
+  }
+}
 } // namespace
 
+bool GetApplyGradientInputs(const Node* n, int* grad_input,
+    int* indices_input) {
+  if (!n->IsApplyAdagradOps() && !n->IsSparseApplyAdagradOps() &&
+      !n->IsApplyAdamOps() && !n->IsApplySparseAdamOps() &&
+      !n->IsApplyFtrlOps() && !n->IsSparseApplyFtrlOps() &&
+      !n->IsKvSparseApplyOps()) {
+    return false;
+  }
+  *grad_input = -1;
+  *indices_input = -1;
+  const OpDef& op_def = n->op_def();
+  for (int i = 0; i < op_def.input_arg_size(); ++i) {
+    const OpDef::ArgDef& arg = op_def.input_arg(i);
+    if (!arg.number_attr().empty() || !arg.type_list_attr().empty()) {
+      // Inputs after a list are not at the position of their arg.
+      return false;
+    }
+    if (arg.name() == "grad") {
+      *grad_input = i;
+    } else if (arg.name() == "indices") {
+      *indices_input = i;
+    }
+  }
+  return *grad_input >= 0;
+}
+
 void ExtendGraph(Graph* dest, std::unordered_set<const Node*> excluded,
-    int32 duplicate_num) {
+    int32 duplicate_num, int32 max_concurrency) {
   // Copy the nodes "Node in src" -> "Node in *dest"
   map_node_list duplicated_nodes;
   map_node margin_nodes;
@@ -1848,31 +1942,82 @@ void ExtendGraph(Graph* dest, std::unordered_set<const Node*> excluded,
     dest->AddEdge(it.src, it.src_output, it.dst, it.dst_input);
   }
 
-  // Add aggregate nodes for Apply***
+  std::vector<Node*> apply_nodes;
+  int grad_input, indices_input;
   for (Node* n : dest->op_nodes()) {
-    if (n->IsApplyAdagradOps() || n->IsApplyFtrlOps()) {
-      AggregateForApply(dest, n, duplicated_nodes, 3);
-    }
-    // concat ------------------------------->
-    // concat(indices) --> unique(indices) --> unsorted_segment_sum
-    if (n->IsSparseApplyAdagradOps() || n->IsSparseApplyFtrlOps()) {
-      AggregateForSparseApply(dest, n, duplicated_nodes, 3, 4);
+    if (GetApplyGradientInputs(n, &grad_input, &indices_input)) {
+      apply_nodes.push_back(n);
     }
+  }
+
+  if (max_concurrency > 0 && max_concurrency <= duplicate_num) {
+    LimitMicroBatchConcurrency(dest, apply_nodes, duplicated_nodes,
+                               duplicate_num, max_concurrency);
+  }
 
-    if (n->IsApplyAdamOps()) {
-      AggregateForApply(dest, n, duplicated_nodes, 9);
+  // Add aggregate nodes for Apply***
+  for (Node* n : apply_nodes) {
+    GetApplyGradientInputs(n, &grad_input, &indices_input);
+    if (indices_input < 0) {
+      AggregateForApply(dest, n, duplicated_nodes, grad_input);
+    } else {
+      // concat ------------------------------->
+      // concat(indices) --> unique(indices) --> unsorted_segment_sum
+      AggregateForSparseApply(dest, n, duplicated_nodes, grad_input,
+                              indices_input);
     }
+  }
+}
 
-    if (n->IsApplySparseAdamOps()) {
-      AggregateForSparseApply(dest, n, duplicated_nodes, 9, 10);
+namespace {
+// Inserts a KvResourcePrefetch before every CPU KvResourceGather whose ids
+// are staged, the prefetch is staged instead of the ids and runs for the
+// next batch while the current one trains. Only the rows are moved, the
+// gather still reads the values after the updates of the previous step.
+void AddEVPrefetchNodes(Graph* dest, std::vector<const Edge*>& edge_vec) {
+  for (size_t i = 0; i < edge_vec.size(); ++i) {
+    const Edge* e = edge_vec[i];
+    Node* gather = e->dst();
+    if (e->IsControlEdge() || e->dst_input() != 1 ||
+        (gather->type_string() != "KvResourceGather" &&
+         gather->type_string() != "KvResourceGatherV1")) {
+      continue;
+    }
+    // New ids would get the default value of the variable instead of the
+    // one fed to the gather.
+    if (gather->def().attr().at("is_use_default_value_tensor").b()) {
+      continue;
     }
+    DeviceNameUtils::ParsedName parsed;
+    if (!DeviceNameUtils::ParseFullName(gather->assigned_device_name(),
+                                        &parsed) ||
+        parsed.type != DEVICE_CPU) {
+      continue;
+    }
+    const Edge* handle_edge = nullptr;
+    TF_CHECK_OK(gather->input_edge(0, &handle_edge));
+    Node* prefetch = nullptr;
+    TF_CHECK_OK(NodeBuilder(dest->NewName(gather->name() + "/prefetch"),
+                            "KvResourcePrefetch")
+        .Input(handle_edge->src(), handle_edge->src_output())
+        .Input(e->src(), e->src_output())
+        .Attr("dtype", gather->def().attr().at("dtype"))
+        .Attr("Tkeys", gather->def().attr().at("Tkeys"))
+        .Device(gather->assigned_device_name())
+        .Finalize(dest, &prefetch));
+    prefetch->set_assigned_device_name(gather->assigned_device_name());
+    TF_CHECK_OK(dest->UpdateEdge(prefetch, 0, gather, 1));
+    TF_CHECK_OK(gather->input_edge(1, &edge_vec[i]));
+    VLOG(2) << "SmartStage prefetch ids of " << gather->name();
   }
 }
+}  // namespace
 
 void StageGraph(Graph* dest, Node* stage_node, Node* unstage_node,
                 const std::vector<std::string>& target_nodes, 
                 const bool do_smart_stage_gpu,
-                const std::string cpu_device_name) {
+                const std::string cpu_device_name,
+                const bool do_ev_prefetch) {
   std::string s1 = stage_node->def().attr().at("shared_name").s();
   std::string s2 = unstage_node->def().attr().at("shared_name").s();
   CHECK(s1 == s2);
@@ -1907,6 +2052,9 @@ void StageGraph(Graph* dest, Node* stage_node, Node* unstage_node,
 
   std::vector<const Edge*> edge_vec;
   GetStagingEdges(*dest, source_node_set, target_nodes, edge_vec);
+  if (do_ev_prefetch) {
+    AddEVPrefetchNodes(dest, edge_vec);
+  }
 
   std::vector<DataType> type_vec;
   int i = 0;
@@ -189,13 +189,24 @@ extern Status ImportGraphDef(const ImportGraphDefOptions& opts,
 // other than the implicit Source/Sink nodes.
 extern void CopyGraph(const Graph& src, Graph* dest);
 
+// Positions of the gradient and, for sparse updates, of the indices inputs
+// of an optimizer apply op. Returns false if 'n' is not an apply op known by
+// MicroBatch.
+extern bool GetApplyGradientInputs(const Node* n, int* grad_input,
+    int* indices_input);
+
+// Duplicates the nodes not in 'excluded' 'duplicated_num' times, one copy
+// per micro batch, and sums the gradients of all micro batches before the
+// apply ops. If 'max_concurrency' > 0, at most 'max_concurrency' micro
+// batches run at the same time.
 extern void ExtendGraph(Graph* dest, std::unordered_set<const Node*> excluded,
-    int32 duplicated_num);
+    int32 duplicated_num, int32 max_concurrency = 0);
 
 extern void StageGraph(Graph* dest, Node* stage_node, Node* unstage_node,
                        const std::vector<std::string>& target_nodes, 
                        const bool do_smart_stage_gpu,
-                       const std::string cpu_device_name);
+                       const std::string cpu_device_name,
+                       const bool do_ev_prefetch = false);
 extern void GetStagingEdges(const Graph& dest,
                             const std::unordered_set<Node *>& source_node_set,
                             const std::vector<std::string>& target_nodes,
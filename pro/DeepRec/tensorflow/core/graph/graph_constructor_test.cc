@@ -22,6 +22,7 @@ limitations under the License.
 #include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/framework/versions.pb.h"
+#include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/graph/node_builder.h"
 #include "tensorflow/core/kernels/ops_util.h"
@@ -3253,5 +3254,141 @@ TEST_F(GraphConstructorTest, ImportGraphDef_UnknownOps) {
        "when the module is first accessed."});
 }
 
+TEST_F(GraphConstructorTest, ExtendGraphKvSparseApply) {
+  ExpectOK(R"EOF(
+      node { name: 'var' op: 'Placeholder'
+             attr { key: 'dtype' value { type: DT_RESOURCE } } }
+      node { name: 'alpha' op: 'Const'
+             attr { key: 'dtype' value { type: DT_FLOAT } }
+             attr { key: 'value' value { tensor {
+               dtype: DT_FLOAT tensor_shape { } float_val: 0.1 } } } }
+      node { name: 'gstep' op: 'Const'
+             attr { key: 'dtype' value { type: DT_INT64 } }
+             attr { key: 'value' value { tensor {
+               dtype: DT_INT64 tensor_shape { } int64_val: 1 } } } }
+      node { name: 'x' op: 'Placeholder'
+             attr { key: 'dtype' value { type: DT_FLOAT } } }
+      node { name: 'ids' op: 'Placeholder'
+             attr { key: 'dtype' value { type: DT_INT64 } } }
+      node { name: 'grad' op: 'Identity' input: [ 'x' ]
+             attr { key: 'T' value { type: DT_FLOAT } } }
+      node { name: 'indices' op: 'Identity' input: [ 'ids' ]
+             attr { key: 'T' value { type: DT_INT64 } } }
+      node { name: 'apply' op: 'KvResourceSparseApplyGradientDescent'
+             input: [ 'var', 'alpha', 'grad', 'indices', 'gstep' ]
+             attr { key: 'T' value { type: DT_FLOAT } }
+             attr { key: 'Tindices' value { type: DT_INT64 } }
+             attr { key: 'Tstep' value { type: DT_INT64 } } }
+      )EOF");
+  int grad_input, indices_input;
+  ASSERT_TRUE(
+      GetApplyGradientInputs(FindNode("apply"), &grad_input, &indices_input));
+  EXPECT_EQ(2, grad_input);
+  EXPECT_EQ(3, indices_input);
+  EXPECT_FALSE(
+      GetApplyGradientInputs(FindNode("grad"), &grad_input, &indices_input));
+
+  std::unordered_set<const Node*> visited = {FindNode("grad"),
+                                             FindNode("indices")};
+  auto excluded = FindExcludeDuplicationNodes(&graph_, visited);
+  // Three micro batches, at most two of them at the same time.
+  ExtendGraph(&graph_, excluded, 2, 2);
+
+  EXPECT_TRUE(HasNode("grad/dup1"));
+  EXPECT_TRUE(HasNode("indices/dup1"));
+  EXPECT_FALSE(HasNode("x/dup0"));
+  EXPECT_FALSE(HasNode("apply/dup0"));
+  EXPECT_TRUE(HasEdge("grad/dup1", 0, "apply/aggr_concat", 2));
+  EXPECT_TRUE(HasEdge("indices/dup1", 0, "apply/aggr_concat2", 2));
+  EXPECT_TRUE(HasEdge("apply/aggr_unsorted_segment_sum", 0, "apply", 2));
+  EXPECT_TRUE(HasEdge("apply/aggr_unique", 0, "apply", 3));
+
+  // The third micro batch starts after the gradients of the first one.
+  Node* barrier = nullptr;
+  for (Node* n : graph_.op_nodes()) {
+    if (str_util::StartsWith(n->name(), "micro_batch_0/gradients_done")) {
+      barrier = n;
+    }
+  }
+  ASSERT_NE(barrier, nullptr);
+  EXPECT_TRUE(HasControlEdge("grad", barrier->name()));
+  EXPECT_TRUE(HasControlEdge(barrier->name(), "grad/dup1"));
+  EXPECT_TRUE(HasControlEdge(barrier->name(), "indices/dup1"));
+  EXPECT_FALSE(HasControlEdge(barrier->name(), "grad/dup0"));
+}
+
+TEST_F(GraphConstructorTest, StageGraphEVPrefetch) {
+  ExpectOK(R"EOF(
+      node { name: 'var' op: 'KvVarHandleOp'
+             attr { key: 'dtype' value { type: DT_FLOAT } }
+             attr { key: 'shape' value { shape { dim { size: 4 } } } }
+             attr { key: 'Tkeys' value { type: DT_INT64 } } }
+      node { name: 'default' op: 'Const'
+             attr { key: 'dtype' value { type: DT_FLOAT } }
+             attr { key: 'value' value { tensor {
+               dtype: DT_FLOAT tensor_shape { } float_val: 0.0 } } } }
+      node { name: 'ids' op: 'Const'
+             attr { key: 'dtype' value { type: DT_INT64 } }
+             attr { key: 'value' value { tensor {
+               dtype: DT_INT64 tensor_shape { dim { size: 1 } }
+               int64_val: 1 } } } }
+      node { name: 'stage' op: 'TensorBufferPut' input: [ 'ids' ]
+             attr { key: 'dtypes' value { list { type: DT_INT64 } } }
+             attr { key: 'shared_name' value { s: 'buffer' } } }
+      node { name: 'unstage' op: 'TensorBufferTake'
+             attr { key: 'dtypes' value { list { type: DT_INT64 } } }
+             attr { key: 'shared_name' value { s: 'buffer' } } }
+      node { name: 'staged_ids' op: 'Identity' input: [ 'unstage' ]
+             attr { key: 'T' value { type: DT_INT64 } } }
+      node { name: 'gather' op: 'KvResourceGather'
+             input: [ 'var', 'staged_ids', 'default' ]
+             attr { key: 'dtype' value { type: DT_FLOAT } }
+             attr { key: 'Tkeys' value { type: DT_INT64 } } }
+      node { name: 'gather_default' op: 'KvResourceGather'
+             input: [ 'var', 'staged_ids', 'default' ]
+             attr { key: 'is_use_default_value_tensor' value { b: true } }
+             attr { key: 'dtype' value { type: DT_FLOAT } }
+             attr { key: 'Tkeys' value { type: DT_INT64 } } }
+      node { name: 'gather_gpu' op: 'KvResourceGather'
+             input: [ 'var', 'staged_ids', 'default' ]
+             attr { key: 'dtype' value { type: DT_FLOAT } }
+             attr { key: 'Tkeys' value { type: DT_INT64 } } }
+      )EOF");
+  const string cpu_device = "/job:localhost/replica:0/task:0/device:CPU:0";
+  for (Node* n : graph_.op_nodes()) {
+    n->set_assigned_device_name(cpu_device);
+  }
+  FindNode("gather_gpu")->set_assigned_device_name(
+      "/job:localhost/replica:0/task:0/device:GPU:0");
+
+  StageGraph(&graph_, FindNode("stage"), FindNode("unstage"), {}, false,
+             cpu_device, true);
+
+  // The ids of the CPU gather are prefetched before they are staged.
+  Node* prefetch = FindNode("gather/prefetch");
+  ASSERT_NE(prefetch, nullptr);
+  EXPECT_EQ("KvResourcePrefetch", prefetch->type_string());
+  EXPECT_EQ(cpu_device, prefetch->assigned_device_name());
+  EXPECT_TRUE(HasEdge("var", 0, "gather/prefetch", 0));
+  EXPECT_TRUE(HasEdge("staged_ids", 0, "gather/prefetch", 1));
+  EXPECT_TRUE(HasEdge("ids", 0, "staged_ids", 0));
+  EXPECT_FALSE(HasNode("gather_default/prefetch"));
+  EXPECT_FALSE(HasNode("gather_gpu/prefetch"));
+
+  // Returns the node staged for input 1 of 'gather'.
+  auto staged_src = [this](const string& gather) -> string {
+    const Edge* e = nullptr;
+    TF_CHECK_OK(FindNode(gather)->input_edge(1, &e));
+    EXPECT_EQ("unstage", e->src()->name());
+    const Edge* staged = nullptr;
+    TF_CHECK_OK(FindNode("stage")->input_edge(e->src_output(), &staged));
+    return staged->src()->name();
+  };
+  EXPECT_EQ("gather/prefetch", staged_src("gather"));
+  EXPECT_EQ("staged_ids", staged_src("gather_default"));
+  EXPECT_EQ("staged_ids", staged_src("gather_gpu"));
+  EXPECT_EQ(2, FindNode("stage")->num_inputs());
+}
+
 }  // namespace
 }  // namespace tensorflow
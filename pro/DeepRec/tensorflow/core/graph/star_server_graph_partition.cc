@@ -1823,6 +1823,354 @@ Status GraphPartitionerBase::ResetSwitchOpDevice() {
   return Status::OK();
 }
 
+struct FusedGatherMember {
+  Node* gather;
+  const Edge* indices_edge;
+  std::vector<const Edge*> out_edges;
+  TensorShape value_shape;
+};
+
+// KvResourceGather on ps whose ids come from worker and whose outputs
+// are only consumed by worker, can be fused with the other ones on the
+// same ps.
+bool IsFusableEvGather(const PartitionOptions &opts,
+                       const std::function<bool (const std::string &)> &is_main_loc,
+                       const std::vector<ControlFlowInfo> &cf_info,
+                       Node* node, FusedGatherMember* member) {
+  if (node->type_string() != "KvResourceGather" ||
+      is_main_loc(opts.node_to_loc(node)) ||
+      !cf_info[node->id()].frame_name.empty()) {
+    return false;
+  }
+
+  const Edge* resource_edge = nullptr;
+  const Edge* indices_edge = nullptr;
+  for (const Edge* in_edge : node->in_edges()) {
+    if (in_edge->dst_input() == 0) {
+      resource_edge = in_edge;
+    } else if (in_edge->dst_input() == 1) {
+      indices_edge = in_edge;
+    }
+  }
+  if (resource_edge == nullptr || indices_edge == nullptr ||
+      !resource_edge->src()->IsKvVarHandle() ||
+      !is_main_loc(opts.node_to_loc(indices_edge->src())) ||
+      !cf_info[indices_edge->src()->id()].frame_name.empty()) {
+    return false;
+  }
+
+  PartialTensorShape value_shape;
+  if (!GetNodeAttr(resource_edge->src()->attrs(), "shape", &value_shape).ok() ||
+      !value_shape.AsTensorShape(&member->value_shape)) {
+    return false;
+  }
+
+  member->out_edges.clear();
+  for (const Edge* out_edge : node->out_edges()) {
+    if (out_edge->IsControlEdge() || !out_edge->dst()->IsOp() ||
+        !is_main_loc(opts.node_to_loc(out_edge->dst()))) {
+      return false;
+    }
+    member->out_edges.push_back(out_edge);
+  }
+  if (member->out_edges.empty()) {
+    return false;
+  }
+
+  member->gather = node;
+  member->indices_edge = indices_edge;
+  return true;
+}
+
+Status FinalizeFusedGatherNode(Graph* g, const std::string &device,
+                               NodeBuilder* builder, Node** node) {
+  builder->Device(device);
+  TF_RETURN_IF_ERROR(builder->Finalize(g, node));
+  (*node)->set_assigned_device_name(device);
+  return Status::OK();
+}
+
+Status AddFusedGatherConst(Graph* g, const std::string &name,
+                           const std::string &device, const Tensor &value,
+                           Node** node) {
+  NodeBuilder builder(g->NewName(name), "Const");
+  builder.Attr("dtype", value.dtype()).Attr("value", value);
+  return FinalizeFusedGatherNode(g, device, &builder, node);
+}
+
+// Fuse the KvResourceGather ops of `members` which are on the same ps:
+//
+// worker: ids_i -> Reshape(-1) -> ConcatV2 ------------------------------+
+//         ids_i -> Size -> Pack -------------------------------------+   |
+//                                                                    |   |
+// ps:     SplitV <---------------------------------------------------+---+
+//           |
+//           +-> KvResourceGather_i -> Reshape(-1) -> ConcatV2 ---+
+//                                                                |
+// worker: SplitV <-----------------------------------------------+
+//           |   ^
+//           |   +-- Pack <- Prod <- (Shape(ids_i) ++ value_shape_i)
+//           +-> Reshape(Shape(ids_i) ++ value_shape_i) -> consumers_i
+//
+// After partitioning, the ids of all these EVs are sent to the ps in one
+// tensor and the embeddings come back in one contiguous tensor, instead
+// of one pair of tensors per EV.
+Status FuseEvGatherGroup(Graph* g, const std::string &ps_device,
+                         const std::string &worker_device,
+                         const std::vector<FusedGatherMember> &members) {
+  const int n = members.size();
+  const std::string prefix =
+      strings::StrCat("FusedEvGather/", members[0].gather->name());
+
+  Tensor minus_one(DT_INT32, TensorShape({1}));
+  minus_one.flat<int32>()(0) = -1;
+  Tensor zero(DT_INT32, TensorShape({}));
+  zero.scalar<int32>()() = 0;
+
+  Node *worker_flat_shape, *worker_axis, *ps_flat_shape, *ps_axis;
+  TF_RETURN_IF_ERROR(AddFusedGatherConst(g, prefix + "/flat_shape",
+                                         worker_device, minus_one,
+                                         &worker_flat_shape));
+  TF_RETURN_IF_ERROR(AddFusedGatherConst(g, prefix + "/axis",
+                                         worker_device, zero, &worker_axis));
+  TF_RETURN_IF_ERROR(AddFusedGatherConst(g, prefix + "/flat_shape",
+                                         ps_device, minus_one,
+                                         &ps_flat_shape));
+  TF_RETURN_IF_ERROR(AddFusedGatherConst(g, prefix + "/axis",
+                                         ps_device, zero, &ps_axis));
+
+  // Worker: flatten the ids and compute the shapes of the embeddings.
+  std::vector<NodeBuilder::NodeOut> flat_ids, ids_sizes, emb_sizes;
+  std::vector<Node*> emb_shapes;
+  for (const FusedGatherMember &m : members) {
+    NodeBuilder::NodeOut ids(m.indices_edge->src(),
+                             m.indices_edge->src_output());
+    Node *flat, *size, *shape, *value_shape, *emb_shape, *emb_size;
+
+    NodeBuilder flat_builder(g->NewName(prefix + "/ids_flat"), "Reshape");
+    flat_builder.Input(ids).Input(worker_flat_shape);
+    TF_RETURN_IF_ERROR(
+        FinalizeFusedGatherNode(g, worker_device, &flat_builder, &flat));
+
+    NodeBuilder size_builder(g->NewName(prefix + "/ids_size"), "Size");
+    size_builder.Input(ids);
+    TF_RETURN_IF_ERROR(
+        FinalizeFusedGatherNode(g, worker_device, &size_builder, &size));
+
+    NodeBuilder shape_builder(g->NewName(prefix + "/ids_shape"), "Shape");
+    shape_builder.Input(ids);
+    TF_RETURN_IF_ERROR(
+        FinalizeFusedGatherNode(g, worker_device, &shape_builder, &shape));
+
+    Tensor value_shape_t(DT_INT32, TensorShape({m.value_shape.dims()}));
+    for (int i = 0; i < m.value_shape.dims(); ++i) {
+      value_shape_t.flat<int32>()(i) = m.value_shape.dim_size(i);
+    }
+    TF_RETURN_IF_ERROR(AddFusedGatherConst(g, prefix + "/value_shape",
+                                           worker_device, value_shape_t,
+                                           &value_shape));
+
+    NodeBuilder emb_shape_builder(g->NewName(prefix + "/emb_shape"),
+                                  "ConcatV2");
+    std::vector<NodeBuilder::NodeOut> emb_shape_parts = {
+        NodeBuilder::NodeOut(shape), NodeBuilder::NodeOut(value_shape)};
+    emb_shape_builder.Input(emb_shape_parts).Input(worker_axis);
+    TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, worker_device,
+                                               &emb_shape_builder,
+                                               &emb_shape));
+
+    NodeBuilder emb_size_builder(g->NewName(prefix + "/emb_size"), "Prod");
+    emb_size_builder.Input(emb_shape).Input(worker_axis);
+    TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, worker_device,
+                                               &emb_size_builder,
+                                               &emb_size));
+
+    flat_ids.emplace_back(flat);
+    ids_sizes.emplace_back(size);
+    emb_sizes.emplace_back(emb_size);
+    emb_shapes.push_back(emb_shape);
+  }
+
+  // Worker: all the ids and their sizes.
+  Node *fused_ids, *fused_ids_sizes;
+  NodeBuilder fused_ids_builder(g->NewName(prefix + "/ids"), "ConcatV2");
+  fused_ids_builder.Input(flat_ids).Input(worker_axis);
+  TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, worker_device,
+                                             &fused_ids_builder, &fused_ids));
+  NodeBuilder ids_sizes_builder(g->NewName(prefix + "/ids_sizes"), "Pack");
+  ids_sizes_builder.Input(ids_sizes);
+  TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, worker_device,
+                                             &ids_sizes_builder,
+                                             &fused_ids_sizes));
+
+  // Ps: split the ids, gather and concat the flattened embeddings.
+  Node* split_ids;
+  NodeBuilder split_ids_builder(g->NewName(prefix + "/split_ids"), "SplitV");
+  split_ids_builder.Input(fused_ids).Input(fused_ids_sizes).Input(ps_axis)
+                   .Attr("num_split", n);
+  TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, ps_device,
+                                             &split_ids_builder, &split_ids));
+
+  std::vector<NodeBuilder::NodeOut> flat_embs;
+  for (int i = 0; i < n; ++i) {
+    const FusedGatherMember &m = members[i];
+    TF_RETURN_IF_ERROR(g->UpdateEdge(split_ids, i, m.gather, 1));
+
+    Node* flat_emb;
+    NodeBuilder flat_emb_builder(g->NewName(prefix + "/emb_flat"), "Reshape");
+    flat_emb_builder.Input(m.gather, 0).Input(ps_flat_shape);
+    TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, ps_device,
+                                               &flat_emb_builder, &flat_emb));
+    flat_embs.emplace_back(flat_emb);
+  }
+
+  Node* fused_embs;
+  NodeBuilder fused_embs_builder(g->NewName(prefix + "/embs"), "ConcatV2");
+  fused_embs_builder.Input(flat_embs).Input(ps_axis);
+  TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, ps_device,
+                                             &fused_embs_builder,
+                                             &fused_embs));
+
+  // Worker: split the embeddings and restore their shapes.
+  Node *emb_sizes_node, *split_embs;
+  NodeBuilder emb_sizes_builder(g->NewName(prefix + "/emb_sizes"), "Pack");
+  emb_sizes_builder.Input(emb_sizes);
+  TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, worker_device,
+                                             &emb_sizes_builder,
+                                             &emb_sizes_node));
+  NodeBuilder split_embs_builder(g->NewName(prefix + "/split_embs"), "SplitV");
+  split_embs_builder.Input(fused_embs).Input(emb_sizes_node)
+                    .Input(worker_axis).Attr("num_split", n);
+  TF_RETURN_IF_ERROR(FinalizeFusedGatherNode(g, worker_device,
+                                             &split_embs_builder,
+                                             &split_embs));
+
+  for (int i = 0; i < n; ++i) {
+    const FusedGatherMember &m = members[i];
+    Node* emb;
+    NodeBuilder emb_builder(g->NewName(prefix + "/emb"), "Reshape");
+    emb_builder.Input(split_embs, i).Input(emb_shapes[i]);
+    TF_RETURN_IF_ERROR(
+        FinalizeFusedGatherNode(g, worker_device, &emb_builder, &emb));
+
+    for (const Edge* out_edge : m.out_edges) {
+      TF_RETURN_IF_ERROR(
+          g->UpdateEdge(emb, 0, out_edge->dst(), out_edge->dst_input()));
+    }
+  }
+
+  return Status::OK();
+}
+
+// Find a group of independent fusable KvResourceGather ops which are on
+// the same ps, returns false if there is none.
+bool FindFusableEvGatherGroup(
+    const PartitionOptions &opts, Graph* g,
+    const std::function<bool (const std::string &)> &is_main_loc,
+    const std::vector<ControlFlowInfo> &cf_info,
+    std::vector<FusedGatherMember>* group) {
+  std::vector<Node*> order;
+  GetReversePostOrder(*g, &order);
+
+  std::map<std::string, std::vector<FusedGatherMember>> candidates;
+  std::unordered_map<int, int> candidate_idx;
+  for (Node* node : order) {
+    FusedGatherMember m;
+    if (node->id() >= static_cast<int>(cf_info.size()) ||
+        !IsFusableEvGather(opts, is_main_loc, cf_info, node, &m)) {
+      continue;
+    }
+    std::string key = strings::StrCat(
+        node->assigned_device_name(), "|",
+        m.indices_edge->src()->assigned_device_name(), "|",
+        DataTypeString(node->output_type(0)), "|",
+        DataTypeString(m.indices_edge->src()->output_type(
+            m.indices_edge->src_output())));
+    const int idx = candidate_idx.size();
+    candidate_idx[node->id()] = idx;
+    candidates[key].push_back(m);
+  }
+  if (candidate_idx.size() < 2) {
+    return false;
+  }
+
+  // The candidates which are ancestors of each node, the gathers in one
+  // group must not depend on each other, otherwise fusing them makes a
+  // cycle.
+  const int words = (candidate_idx.size() + 63) / 64;
+  std::vector<std::vector<uint64>> ancestors(g->num_node_ids());
+  for (Node* node : order) {
+    std::vector<uint64> &anc = ancestors[node->id()];
+    for (const Edge* in_edge : node->in_edges()) {
+      const Node* src = in_edge->src();
+      if (src->IsNextIteration()) {
+        continue;
+      }
+      const std::vector<uint64> &src_anc = ancestors[src->id()];
+      auto it = candidate_idx.find(src->id());
+      if (src_anc.empty() && it == candidate_idx.end()) {
+        continue;
+      }
+      anc.resize(words, 0);
+      for (size_t w = 0; w < src_anc.size(); ++w) {
+        anc[w] |= src_anc[w];
+      }
+      if (it != candidate_idx.end()) {
+        anc[it->second / 64] |= 1ULL << (it->second % 64);
+      }
+    }
+  }
+
+  for (auto &it : candidates) {
+    std::vector<uint64> group_bits(words, 0);
+    group->clear();
+    // Candidates are in topological order, so a later one is never an
+    // ancestor of the ones already in the group.
+    for (const FusedGatherMember &m : it.second) {
+      const std::vector<uint64> &anc = ancestors[m.gather->id()];
+      bool depends = false;
+      for (size_t w = 0; w < anc.size(); ++w) {
+        if (anc[w] & group_bits[w]) {
+          depends = true;
+          break;
+        }
+      }
+      if (depends) {
+        continue;
+      }
+      const int idx = candidate_idx[m.gather->id()];
+      group_bits[idx / 64] |= 1ULL << (idx % 64);
+      group->push_back(m);
+    }
+    if (group->size() >= 2) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Status GraphPartitionerBase::FuseEvGather() {
+  while (true) {
+    std::vector<ControlFlowInfo> cf_info;
+    TF_RETURN_IF_ERROR(BuildControlFlowInfo(graph_, &cf_info));
+
+    std::vector<FusedGatherMember> group;
+    if (!FindFusableEvGatherGroup(opts_, graph_, is_main_loc_func_, cf_info,
+                                  &group)) {
+      break;
+    }
+
+    const std::string ps_device = group[0].gather->assigned_device_name();
+    const std::string worker_device =
+        group[0].indices_edge->src()->assigned_device_name();
+    LOG(INFO) << "Fuse " << group.size() << " KvResourceGather ops on "
+              << ps_device << " for " << worker_device;
+    TF_RETURN_IF_ERROR(
+        FuseEvGatherGroup(graph_, ps_device, worker_device, group));
+  }
+  return Status::OK();
+}
+
 std::unordered_set<const Node*> GraphPartitionerBase::GetClusteringNodes(
     std::unordered_set<const Node*> *ready,
     std::unordered_set<const Node*> *nodes) {
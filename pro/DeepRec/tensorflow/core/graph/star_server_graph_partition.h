@@ -168,6 +168,12 @@ class GraphPartitionerBase {
       const std::vector<SubGraph> &sub_graphs,
       SubGraph *worker_graph);
 
+  // Fuse the KvResourceGather ops of the EVs on the same ps, whose ids come
+  // from worker and whose embeddings are only used by worker, so that all
+  // the ids are sent in one tensor and all the embeddings come back in one
+  // contiguous tensor. Should be called before SplitGraph/SplitGraphV2.
+  Status FuseEvGather();
+
  protected:
   bool ShouldUseSendRecvMode(Node* src, Node* dst);
 
@@ -8,6 +8,7 @@
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/graph/graph_constructor.h"
 #include "tensorflow/core/graph/graph_def_builder.h"
+#include "tensorflow/core/graph/node_builder.h"
 #include "tensorflow/core/graph/star_server_graph_partition.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/util/device_name_utils.h"
@@ -530,5 +531,100 @@ TEST_F(DistGraphPartitionTest, testCompleteWorkerCrossPS) {
   ASSERT_TRUE(flag);
 }
 
+Node* AddTestNode(Graph* g, NodeBuilder* builder, const string& device) {
+  Node* node;
+  builder->Device(device);
+  TF_CHECK_OK(builder->Finalize(g, &node));
+  node->set_assigned_device_name(device);
+  return node;
+}
+
+Node* AddEvGather(Graph* g, const string& name, Node* ids,
+                  const string& worker_device, const string& ps_device) {
+  NodeBuilder ev_builder(name, "KvVarHandleOp");
+  ev_builder.Attr("dtype", DT_FLOAT)
+            .Attr("shape", TensorShape({8}))
+            .Attr("Tkeys", DT_INT64)
+            .Attr("shared_name", name);
+  Node* ev = AddTestNode(g, &ev_builder, ps_device);
+
+  Tensor default_value(DT_FLOAT, TensorShape({}));
+  default_value.scalar<float>()() = 0.0;
+  NodeBuilder default_builder(name + "/default", "Const");
+  default_builder.Attr("dtype", DT_FLOAT).Attr("value", default_value);
+  Node* default_node = AddTestNode(g, &default_builder, ps_device);
+
+  NodeBuilder gather_builder(name + "/gather", "KvResourceGather");
+  gather_builder.Input(ev).Input(ids).Input(default_node)
+                .Attr("dtype", DT_FLOAT);
+  Node* gather = AddTestNode(g, &gather_builder, ps_device);
+
+  NodeBuilder consumer_builder(name + "/consumer", "Identity");
+  consumer_builder.Input(gather);
+  return AddTestNode(g, &consumer_builder, worker_device);
+}
+
+Node* AddIds(Graph* g, const string& name, const string& device) {
+  Tensor ids(DT_INT64, TensorShape({4}));
+  ids.flat<int64>().setConstant(1);
+  NodeBuilder builder(name, "Const");
+  builder.Attr("dtype", DT_INT64).Attr("value", ids);
+  return AddTestNode(g, &builder, device);
+}
+
+TEST_F(DistGraphPartitionTest, testFuseEvGather) {
+  string worker_device = "/job:worker/replica:0/task:0/cpu:0";
+  string ps1_device = "/job:ps/replica:0/task:1/cpu:0";
+  setenv("TASK_INDEX","0",1);
+
+  g_.reset(new Graph(OpRegistry::Global()));
+  Graph* g = g_.get();
+  Node* c1 = AddEvGather(g, "ev1", AddIds(g, "ids1", worker_device),
+                         worker_device, ps1_device);
+  Node* c2 = AddEvGather(g, "ev2", AddIds(g, "ids2", worker_device),
+                         worker_device, ps1_device);
+  // ev3 depends on the embeddings of ev1, could not be fused with it.
+  NodeBuilder cast_builder("ids3", "Cast");
+  cast_builder.Input(c1).Attr("DstT", DT_INT64);
+  Node* ids3 = AddTestNode(g, &cast_builder, worker_device);
+  Node* c3 = AddEvGather(g, "ev3", ids3, worker_device, ps1_device);
+
+  TrainGraphPartitioner gp(popts_, g, true, true);
+  TF_ASSERT_OK(gp.FuseEvGather());
+
+  int fused_embs = 0;
+  for (const Node* node : g->nodes()) {
+    if (node->type_string() == "ConcatV2" &&
+        node->assigned_device_name() == ps1_device) {
+      ++fused_embs;
+      ASSERT_EQ(2, node->num_inputs() - 1);
+    }
+    if (node->type_string() == "KvResourceGather") {
+      const Edge* indices_edge;
+      TF_ASSERT_OK(node->input_edge(1, &indices_edge));
+      if (node->name() == "ev3/gather") {
+        ASSERT_EQ("ids3", indices_edge->src()->name());
+      } else {
+        ASSERT_EQ("SplitV", indices_edge->src()->type_string());
+      }
+    }
+  }
+  ASSERT_EQ(1, fused_embs);
+
+  for (Node* consumer : {c1, c2}) {
+    const Edge* in_edge;
+    TF_ASSERT_OK(consumer->input_edge(0, &in_edge));
+    ASSERT_EQ("Reshape", in_edge->src()->type_string());
+    ASSERT_EQ(worker_device, in_edge->src()->assigned_device_name());
+  }
+  const Edge* in_edge;
+  TF_ASSERT_OK(c3->input_edge(0, &in_edge));
+  ASSERT_EQ("ev3/gather", in_edge->src()->name());
+
+  SubGraph worker_sub_graph;
+  vector<SubGraph> ps_sub_graphs;
+  TF_ASSERT_OK(gp.SplitGraph(&worker_sub_graph, &ps_sub_graphs));
+}
+
 }  // namespace tensorflow
 
@@ -15,6 +15,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/arrow_util.h"
 
 #include <unistd.h>
+#include <algorithm>
 #include <cstdlib>
 #include <memory>
 #include <numeric>
@@ -23,6 +24,7 @@ limitations under the License.
 #include <vector>
 
 #include "arrow/array.h"
+#include "arrow/buffer.h"
 #include "arrow/util/thread_pool.h"
 #include "tensorflow/core/kernels/data/eigen.h"
 #include "tensorflow/core/framework/allocation_description.pb.h"
@@ -168,20 +170,25 @@ class ArrowPrimitiveTensorBuffer : public TensorBuffer {
   return ::arrow::Status::OK();
 }
 
-// Primitive Arrow arrays have validity and value buffers.
-#define RAGGED_TENSOR_BUILDER_PRIMITIVE_VISIT(ARRAY_CLASS)                    \
-  ::arrow::Status Visit(const ARRAY_CLASS& array) override {                  \
-    if (TF_PREDICT_FALSE(ragged_rank_ != 0)) {                                \
-      return ::arrow::Status::Invalid("Inconsistent ragged rank");            \
-    }                                                                         \
-    Tensor tensor;                                                            \
-    auto st =                                                                 \
-        MakeTensorFromArrowBuffer(dtype_, array.data()->buffers[1], &tensor); \
-    if (!st.ok()) {                                                           \
-      return st;                                                              \
-    }                                                                         \
-    ragged_tensor_.push_front(std::move(tensor));                             \
-    return ::arrow::Status::OK();                                             \
+// Primitive Arrow arrays have validity and value buffers, the values of
+// a sliced array are sliced from the value buffer without copy.
+#define RAGGED_TENSOR_BUILDER_PRIMITIVE_VISIT(ARRAY_CLASS)                     \
+  ::arrow::Status Visit(const ARRAY_CLASS& array) override {                   \
+    if (TF_PREDICT_FALSE(ragged_rank_ != 0)) {                                 \
+      return ::arrow::Status::Invalid("Inconsistent ragged rank");             \
+    }                                                                          \
+    const int64 width = DataTypeSize(dtype_);                                  \
+    Tensor tensor;                                                             \
+    auto st = MakeTensorFromArrowBuffer(                                       \
+        dtype_,                                                                \
+        ::arrow::SliceBuffer(array.data()->buffers[1], array.offset() * width, \
+                             array.length() * width),                          \
+        &tensor);                                                              \
+    if (!st.ok()) {                                                            \
+      return st;                                                               \
+    }                                                                          \
+    ragged_tensor_.push_front(std::move(tensor));                              \
+    return ::arrow::Status::OK();                                              \
   }
 
 #define RAGGED_TENSOR_BUILDER_STRING_VISIT(ARRAY_CLASS)            \
@@ -216,14 +223,34 @@ class RaggedTensorBuilder : public ::arrow::ArrayVisitor {
 
   ::arrow::Status Visit(const ::arrow::ListArray& array) override {
     --ragged_rank_;
+    const int64 num_splits = array.length() + 1;
+    const int32 first_offset = array.value_offset(0);
     Tensor tensor;
-    auto st =
-        MakeTensorFromArrowBuffer(DT_INT32, array.value_offsets(), &tensor);
-    if (!st.ok()) {
-      return st;
+    if (first_offset == 0) {
+      // Row splits are the offsets buffer itself.
+      auto st = MakeTensorFromArrowBuffer(
+          DT_INT32,
+          ::arrow::SliceBuffer(array.value_offsets(),
+                               array.offset() * sizeof(int32),
+                               num_splits * sizeof(int32)),
+          &tensor);
+      if (!st.ok()) {
+        return st;
+      }
+    } else {
+      // Offsets of a sliced list must be rebased to start from zero.
+      tensor = Tensor(DT_INT32, TensorShape({num_splits}));
+      auto splits = tensor.vec<int32>();
+      for (int64 i = 0; i < num_splits; ++i) {
+        splits(i) = array.value_offset(i) - first_offset;
+      }
     }
     ragged_tensor_.push_front(std::move(tensor));
-    return array.values()->Accept(this);
+    const int32 num_values = array.value_offset(array.length()) - first_offset;
+    if (first_offset == 0 && num_values == array.values()->length()) {
+      return array.values()->Accept(this);
+    }
+    return array.values()->Slice(first_offset, num_values)->Accept(this);
   }
 
   RAGGED_TENSOR_BUILDER_PRIMITIVE_VISIT(::arrow::Int8Array);
@@ -287,10 +314,6 @@ Status MakeTensorsFromArrowArray(
     return errors::Internal("Arrow array with null values not supported");
   }
 
-  if (TF_PREDICT_FALSE(arrow_array->data()->offset != 0)) {
-    return errors::Internal("Arrow array has zero non-offset not supported");
-  }
-
   RaggedTensorBuilder builder(dtype, ragged_rank);
   TF_RETURN_IF_ARROW_ERROR(builder.Build(arrow_array, output_tensors));
   return Status::OK();
@@ -341,15 +364,31 @@ int GetArrowFileBufferSizeFromEnv() {
   return ::arrow::Status::OK();
 }
 
+int GetParquetReadParallelismFromEnv() {
+  return std::max(EnvGetInt("PARQUET_READ_PARALLELISM", 1), 1);
+}
+
+int GetParquetReadAheadRowGroupsFromEnv() {
+  return EnvGetInt("PARQUET_READ_AHEAD_ROW_GROUPS",
+                   2 * GetParquetReadParallelismFromEnv());
+}
+
 ::arrow::Status OpenParquetReader(
     std::unique_ptr<::parquet::arrow::FileReader>* reader,
     const std::shared_ptr<::arrow::io::RandomAccessFile>& file) {
+  return OpenParquetReader(reader, file, nullptr);
+}
+
+::arrow::Status OpenParquetReader(
+    std::unique_ptr<::parquet::arrow::FileReader>* reader,
+    const std::shared_ptr<::arrow::io::RandomAccessFile>& file,
+    const std::shared_ptr<::parquet::FileMetaData>& metadata) {
   auto config = ::parquet::ReaderProperties();
   config.enable_buffered_stream();
   config.set_buffer_size(GetArrowFileBufferSizeFromEnv());
   ARROW_RETURN_NOT_OK(::parquet::arrow::FileReader::Make(
       ::arrow::default_memory_pool(),
-      ::parquet::ParquetFileReader::Open(file, config), reader));
+      ::parquet::ParquetFileReader::Open(file, config, metadata), reader));
   // If ARROW_NUM_THREADS > 0, specified number of threads will be used.
   // If ARROW_NUM_THREADS = 0, no threads will be used.
   // If ARROW_NUM_THREADS < 0, all threads will be used.
@@ -56,6 +56,12 @@ int UpdateArrowCpuThreadPoolCapacityFromEnv();
 
 int GetArrowFileBufferSizeFromEnv();
 
+// Number of row groups decoded in parallel by ParquetBatchReader.
+int GetParquetReadParallelismFromEnv();
+
+// Number of row groups ParquetBatchReader decodes ahead of the consumer.
+int GetParquetReadAheadRowGroupsFromEnv();
+
 ::arrow::Status OpenArrowFile(
     std::shared_ptr<::arrow::io::RandomAccessFile>* file,
     const std::string& filename);
@@ -64,6 +70,13 @@ int GetArrowFileBufferSizeFromEnv();
     std::unique_ptr<::parquet::arrow::FileReader>* reader,
     const std::shared_ptr<::arrow::io::RandomAccessFile>& file);
 
+// Opens a reader reusing the metadata of an opened file, which skips
+// parsing the footer again.
+::arrow::Status OpenParquetReader(
+    std::unique_ptr<::parquet::arrow::FileReader>* reader,
+    const std::shared_ptr<::arrow::io::RandomAccessFile>& file,
+    const std::shared_ptr<::parquet::FileMetaData>& metadata);
+
 ::arrow::Status GetParquetDataFrameFields(
     std::vector<std::string>* field_names,
     std::vector<std::string>* field_dtypes,
@@ -14,13 +14,20 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parquet_batch_reader.h"
 
+#include <algorithm>
+#include <deque>
 #include <memory>
 #include <numeric>
 #include <string>
 #include <vector>
 
 #include "absl/strings/match.h"
+#include "arrow/array/concatenate.h"
 #include "tensorflow/core/kernels/data/arrow_util.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
 
 namespace tensorflow {
 namespace data {
@@ -97,6 +104,25 @@ class ParquetBatchReader::Impl {
             actual_ragged_rank, ", which should be ", expected_ragged_rank);
       }
     }
+
+    int parallelism = ArrowUtil::GetParquetReadParallelismFromEnv();
+    if (parallelism > 1 && !row_group_indices_.empty() &&
+        !column_indices_.empty()) {
+      // Decode row groups on a thread pool, each with its own reader.
+      file_ = file;
+      metadata_ = reader_->parquet_reader()->metadata();
+      read_ahead_ = std::max(ArrowUtil::GetParquetReadAheadRowGroupsFromEnv(),
+                             parallelism);
+      threads_.reset(new thread::ThreadPool(
+          Env::Default(), ThreadOptions(), "parquet_batch_reader",
+          parallelism, false /* low_latency_hint */));
+      convert_threads_.reset(new thread::ThreadPool(
+          Env::Default(), ThreadOptions(), "parquet_batch_convert",
+          parallelism, false /* low_latency_hint */));
+      ScheduleRowGroups();
+      return Status::OK();
+    }
+
     reader_->set_batch_size(batch_size_);
 
     TF_RETURN_IF_ARROW_ERROR(reader_->GetRecordBatchReader(
@@ -105,6 +131,10 @@ class ParquetBatchReader::Impl {
   }
 
   Status Read(std::vector<Tensor>* output_tensors) {
+    if (threads_) {
+      return ReadFromRowGroups(output_tensors);
+    }
+
     // Read next batch from parquet file.
     std::shared_ptr<::arrow::RecordBatch> batch;
     TF_RETURN_IF_ARROW_ERROR(batch_reader_->ReadNext(&batch));
@@ -127,6 +157,140 @@ class ParquetBatchReader::Impl {
   }
 
  private:
+  // A row group decoded in background.
+  struct RowGroup {
+    mutex mu;
+    condition_variable cv;
+    bool ready GUARDED_BY(mu) = false;
+    Status status GUARDED_BY(mu);
+    std::shared_ptr<::arrow::Table> table GUARDED_BY(mu);
+  };
+
+  static Status ReadRowGroup(
+      const std::shared_ptr<::arrow::io::RandomAccessFile>& file,
+      const std::shared_ptr<::parquet::FileMetaData>& metadata,
+      int row_group_index, const std::vector<int>& column_indices,
+      std::shared_ptr<::arrow::Table>* table) {
+    std::unique_ptr<::parquet::arrow::FileReader> reader;
+    TF_RETURN_IF_ARROW_ERROR(
+        ArrowUtil::OpenParquetReader(&reader, file, metadata));
+    TF_RETURN_IF_ARROW_ERROR(
+        reader->ReadRowGroup(row_group_index, column_indices, table));
+    return Status::OK();
+  }
+
+  // Keeps read_ahead_ row groups decoding or decoded ahead of the consumer.
+  void ScheduleRowGroups() {
+    while (next_row_group_ < row_group_indices_.size() &&
+           row_groups_.size() < static_cast<size_t>(read_ahead_)) {
+      auto row_group = std::make_shared<RowGroup>();
+      row_groups_.push_back(row_group);
+      int row_group_index = row_group_indices_[next_row_group_++];
+      auto file = file_;
+      auto metadata = metadata_;
+      auto column_indices = column_indices_;
+      threads_->Schedule([row_group, file, metadata, row_group_index,
+                          column_indices]() {
+        std::shared_ptr<::arrow::Table> table;
+        Status s = ReadRowGroup(file, metadata, row_group_index,
+                                column_indices, &table);
+        mutex_lock l(row_group->mu);
+        row_group->status = s;
+        row_group->table = std::move(table);
+        row_group->ready = true;
+        row_group->cv.notify_all();
+      });
+    }
+  }
+
+  Status NextTable() {
+    ScheduleRowGroups();
+    if (row_groups_.empty()) {
+      return errors::OutOfRange("Reached end of parquet file ", filename_);
+    }
+    auto row_group = row_groups_.front();
+    row_groups_.pop_front();
+    ScheduleRowGroups();
+    mutex_lock l(row_group->mu);
+    while (!row_group->ready) {
+      row_group->cv.wait(l);
+    }
+    TF_RETURN_IF_ERROR(row_group->status);
+    table_ = std::move(row_group->table);
+    table_row_ = 0;
+    return Status::OK();
+  }
+
+  // Batches may span row groups like the record batch reader does, only
+  // the batches spanning row groups are concatenated, other batches are
+  // zero-copy slices of the decoded row groups.
+  Status ReadFromRowGroups(std::vector<Tensor>* output_tensors) {
+    const size_t num_columns = column_indices_.size();
+    std::vector<::arrow::ArrayVector> pieces(num_columns);
+    int64 num_rows = 0;
+    while (num_rows < batch_size_) {
+      if (!table_ || table_row_ >= table_->num_rows()) {
+        Status s = NextTable();
+        if (errors::IsOutOfRange(s)) {
+          break;
+        }
+        TF_RETURN_IF_ERROR(s);
+        continue;
+      }
+      int64 n = std::min(batch_size_ - num_rows,
+                         table_->num_rows() - table_row_);
+      for (size_t i = 0; i < num_columns; ++i) {
+        auto column = table_->column(i)->Slice(table_row_, n);
+        for (const auto& chunk : column->chunks()) {
+          pieces[i].push_back(chunk);
+        }
+      }
+      table_row_ += n;
+      num_rows += n;
+    }
+    if (TF_PREDICT_FALSE(num_rows == 0)) {
+      return errors::OutOfRange("Reached end of parquet file ", filename_);
+    }
+    if (TF_PREDICT_FALSE(drop_remainder_ && num_rows < batch_size_)) {
+      return errors::OutOfRange("Reached end of parquet file ", filename_,
+                                " after dropping reminder batch");
+    }
+
+    // Populate tensors of columns in parallel, on threads other than the
+    // decoding ones so that read-ahead never delays the current batch.
+    std::vector<std::vector<Tensor>> column_tensors(num_columns);
+    std::vector<Status> statuses(num_columns);
+    BlockingCounter counter(num_columns - 1);
+    for (size_t i = 1; i < num_columns; ++i) {
+      convert_threads_->Schedule([this, i, &pieces, &column_tensors,
+                                  &statuses, &counter]() {
+        statuses[i] = MakeColumnTensors(i, pieces[i], &column_tensors[i]);
+        counter.DecrementCount();
+      });
+    }
+    statuses[0] = MakeColumnTensors(0, pieces[0], &column_tensors[0]);
+    counter.Wait();
+    for (size_t i = 0; i < num_columns; ++i) {
+      TF_RETURN_IF_ERROR(statuses[i]);
+      output_tensors->insert(output_tensors->end(), column_tensors[i].begin(),
+                             column_tensors[i].end());
+    }
+    return Status::OK();
+  }
+
+  Status MakeColumnTensors(size_t i, const ::arrow::ArrayVector& pieces,
+                           std::vector<Tensor>* output_tensors) {
+    std::shared_ptr<::arrow::Array> array;
+    if (pieces.size() == 1) {
+      array = pieces[0];
+    } else {
+      TF_CHECKED_ARROW_ASSIGN(
+          array, ::arrow::Concatenate(pieces, ::arrow::default_memory_pool()));
+    }
+    return ArrowUtil::MakeTensorsFromArrowArray(
+        field_dtypes_[i], field_ragged_ranks_[i], array, output_tensors);
+  }
+
   const string filename_;
   const int64 batch_size_;
   std::vector<string> field_names_;
@@ -139,6 +303,17 @@ class ParquetBatchReader::Impl {
   std::unique_ptr<::arrow::RecordBatchReader> batch_reader_;
   std::vector<int> row_group_indices_;
   std::vector<int> column_indices_;
+  std::shared_ptr<::arrow::io::RandomAccessFile> file_;
+  std::shared_ptr<::parquet::FileMetaData> metadata_;
+  int read_ahead_ = 0;
+  size_t next_row_group_ = 0;
+  std::deque<std::shared_ptr<RowGroup>> row_groups_;
+  std::shared_ptr<::arrow::Table> table_;
+  int64 table_row_ = 0;
+  // Declared last to finish pending row groups before other members
+  // are destroyed.
+  std::unique_ptr<thread::ThreadPool> convert_threads_;
+  std::unique_ptr<thread::ThreadPool> threads_;
 };
 
 ParquetBatchReader::ParquetBatchReader(
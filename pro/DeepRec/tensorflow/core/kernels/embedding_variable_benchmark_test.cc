@@ -0,0 +1,734 @@
+/* Copyright 2022 The DeepRec Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Micro-benchmarks of EmbeddingVariable on every storage type, run with
+//
+//   bazel run -c opt \
+//     //tensorflow/core/kernels:embedding_variable_benchmark_test -- \
+//     --benchmarks=all
+//
+// The benchmarks are named BM_EV<Case>[_<Distribution>]/<storage_type>
+// [/<threads>], with the storage types of embedding/config.proto, and
+// BM_LocklessHashMapInsertLatency/<segments>/<reserve> reports the
+// latency percentiles of the inserts into the hash table. With
+// TEST_REPORT_FILE_PREFIX set, every benchmark writes a BenchmarkEntries
+// proto, see util/reporter.h, so that the results can be tracked per
+// commit. The workload is configured by environment variables:
+//
+//   EV_BENCHMARK_DIM          embedding dimension, 64 by default
+//   EV_BENCHMARK_BATCH_SIZE   ids of a step, 4096 by default
+//   EV_BENCHMARK_NUM_KEYS     ids drawn from, 262144 by default
+//   EV_BENCHMARK_CACHE_BYTES  DRAM level of the multi-level storage
+//                             types, 16MB by default
+//   EV_BENCHMARK_ZIPF_THETA   skew of the Zipfian ids, in (0, 1), 0.99
+//                             by default
+//
+// The DRAM benchmarks run with the keys partitioned by NUMA node with
+// TF_EV_NUMA_AWARE=1, TF_EV_NUMA_NODES=2 simulates 2 nodes on a single
+// node host, so the cost of the partitioning can be compared with the
+// plain sharding before running on a 2-socket host.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/kv_variable_ops.h"
+#include "tensorflow/core/lib/random/philox_random.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/public/session_options.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
+
+namespace tensorflow {
+namespace embedding {
+namespace {
+
+struct BenchmarkConfig {
+  int64 dim = 64;
+  int64 batch_size = 4096;
+  int64 num_keys = 1 << 18;
+  int64 cache_bytes = 16 << 20;
+  double zipf_theta = 0.99;
+};
+
+const BenchmarkConfig& Config() {
+  static const BenchmarkConfig* config = [] {
+    BenchmarkConfig* c = new BenchmarkConfig;
+    TF_CHECK_OK(ReadInt64FromEnvVar("EV_BENCHMARK_DIM", c->dim, &c->dim));
+    TF_CHECK_OK(ReadInt64FromEnvVar("EV_BENCHMARK_BATCH_SIZE",
+                                    c->batch_size, &c->batch_size));
+    TF_CHECK_OK(ReadInt64FromEnvVar("EV_BENCHMARK_NUM_KEYS",
+                                    c->num_keys, &c->num_keys));
+    TF_CHECK_OK(ReadInt64FromEnvVar("EV_BENCHMARK_CACHE_BYTES",
+                                    c->cache_bytes, &c->cache_bytes));
+    string theta;
+    TF_CHECK_OK(ReadStringFromEnvVar("EV_BENCHMARK_ZIPF_THETA", "", &theta));
+    if (!theta.empty()) {
+      CHECK(strings::safe_strtod(theta.c_str(), &c->zipf_theta))
+          << "Invalid EV_BENCHMARK_ZIPF_THETA: " << theta;
+    }
+    CHECK_GT(c->dim, 0);
+    CHECK_GT(c->batch_size, 0);
+    CHECK_GE(c->num_keys, c->batch_size)
+        << "EV_BENCHMARK_NUM_KEYS should not be less than the batch size.";
+    CHECK(c->zipf_theta > 0.0 && c->zipf_theta < 1.0)
+        << "EV_BENCHMARK_ZIPF_THETA should be in (0, 1).";
+    LOG(INFO) << "EV benchmark dim: " << c->dim
+              << ", batch_size: " << c->batch_size
+              << ", num_keys: " << c->num_keys
+              << ", cache_bytes: " << c->cache_bytes
+              << ", zipf_theta: " << c->zipf_theta;
+    return c;
+  }();
+  return *config;
+}
+
+// Draws ranks in [0, n) with a probability proportional to
+// 1 / (rank + 1)^theta, as the Zipfian generator of YCSB, see "Quickly
+// Generating Billion-Record Synthetic Databases", Gray et al.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(int64 n, double theta) : n_(n), theta_(theta) {
+    zetan_ = Zeta(n, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) /
+           (1.0 - Zeta(2, theta) / zetan_);
+  }
+
+  int64 Next(random::SimplePhilox* rnd) const {
+    const double u = rnd->RandDouble();
+    const double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_)) return 1;
+    return std::min(n_ - 1, static_cast<int64>(
+        n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_)));
+  }
+
+ private:
+  static double Zeta(int64 n, double theta) {
+    double sum = 0.0;
+    for (int64 i = 1; i <= n; ++i) {
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  const int64 n_;
+  const double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+// Scrambles the ranks so that the frequent ids are not neighbours, the
+// multiplier is odd so no two ranks below 2^63 share an id.
+int64 RankToId(int64 rank) {
+  return static_cast<int64>(
+      (static_cast<uint64>(rank) * 0x9E3779B97F4A7C15ULL) >> 1);
+}
+
+// 'count' ids drawn from Config().num_keys ids, the same ids for every run.
+Tensor GenerateIds(int64 count, bool zipf) {
+  const BenchmarkConfig& config = Config();
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  std::unique_ptr<ZipfianGenerator> zipfian;
+  if (zipf) {
+    zipfian.reset(new ZipfianGenerator(config.num_keys, config.zipf_theta));
+  }
+  Tensor ids(DT_INT64, TensorShape({count}));
+  auto flat = ids.flat<int64>();
+  for (int64 i = 0; i < count; ++i) {
+    const int64 rank = zipf ? zipfian->Next(&rnd)
+                            : static_cast<int64>(rnd.Uniform64(config.num_keys));
+    flat(i) = RankToId(rank);
+  }
+  return ids;
+}
+
+// The layout the python EmbeddingVariable picks for the storage type.
+string Layout(int storage_type, int64 steps_to_live) {
+  if (storage_type == DRAM && steps_to_live == 0) {
+    return "light";
+  }
+  return "normal_contiguous";
+}
+
+int64 ResidentBytes() {
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (fp == nullptr) {
+    LOG(ERROR) << "Fail to open /proc/self/statm.";
+    return 0;
+  }
+  long size = 0, resident = 0;
+  if (fscanf(fp, "%ld %ld", &size, &resident) != 2) {
+    LOG(ERROR) << "Fail to fscanf /proc/self/statm.";
+    resident = 0;
+  }
+  fclose(fp);
+  return static_cast<int64>(resident) * getpagesize();
+}
+
+// Runs fn(begin, end) on 'threads' threads over [0, n).
+void ParallelFor(int threads, int64 n,
+                 const std::function<void(int64, int64)>& fn) {
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back(fn, n * i / threads, n * (i + 1) / threads);
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+}
+
+/// Graph benchmarks, of the kernels.
+
+enum EVOp {
+  kGather,
+  kMixed,
+  kGradientDescent,
+  kAdagrad,
+  kAdagradDecay,
+  kAdam,
+  kAdamAsync,
+  kFtrl,
+};
+
+int SlotNum(EVOp op) {
+  switch (op) {
+    case kGather:
+    case kGradientDescent:
+      return 0;
+    case kMixed:
+    case kAdagrad:
+      return 1;
+    default:
+      return 2;
+  }
+}
+
+Node* FloatScalar(Graph* g, float value) {
+  Tensor t(DT_FLOAT, TensorShape({}));
+  t.scalar<float>()() = value;
+  return test::graph::Constant(g, t);
+}
+
+Node* Int64Scalar(Graph* g, int64 value) {
+  Tensor t(DT_INT64, TensorShape({}));
+  t.scalar<int64>()() = value;
+  return test::graph::Constant(g, t);
+}
+
+Node* Int32Vector(Graph* g, int32 value) {
+  Tensor t(DT_INT32, TensorShape({1}));
+  t.vec<int32>()(0) = value;
+  return test::graph::Constant(g, t);
+}
+
+Node* KvVarHandle(Graph* g, const string& name) {
+  Node* ret;
+  TF_CHECK_OK(NodeBuilder(g->NewName("kv_var_handle"), "KvVarHandleOp")
+                  .Attr("shared_name", name)
+                  .Attr("dtype", DT_FLOAT)
+                  .Attr("shape", TensorShape({Config().dim}))
+                  .Attr("Tkeys", DT_INT64)
+                  .Finalize(g, &ret));
+  return ret;
+}
+
+Node* VarHandle(Graph* g, const string& name) {
+  Node* ret;
+  TF_CHECK_OK(NodeBuilder(g->NewName("var_handle"), "VarHandleOp")
+                  .Attr("shared_name", name)
+                  .Attr("dtype", DT_FLOAT)
+                  .Attr("shape", TensorShape({}))
+                  .Finalize(g, &ret));
+  return ret;
+}
+
+Node* AssignVariable(Graph* g, Node* var, Node* value) {
+  Node* ret;
+  TF_CHECK_OK(NodeBuilder(g->NewName("assign"), "AssignVariableOp")
+                  .Input(var)
+                  .Input(value)
+                  .Attr("dtype", DT_FLOAT)
+                  .Finalize(g, &ret));
+  return ret;
+}
+
+Node* InitializeKvVariable(Graph* g, Node* var, Node* primary,
+                           int storage_type, int slot_num, int slot_index) {
+  const BenchmarkConfig& config = Config();
+  const int64 default_value_dim = 4096;
+  Tensor default_value(DT_FLOAT,
+                       TensorShape({default_value_dim, config.dim}));
+  default_value.flat<float>().setConstant(0.01f);
+  Node* ret;
+  TF_CHECK_OK(
+      NodeBuilder(g->NewName("initialize_kv_variable"),
+                  "InitializeKvVariableOp")
+          .Input(var)
+          .Input(primary)
+          .Input(test::graph::Constant(g, default_value))
+          .Input(Int64Scalar(g, -1))
+          .Attr("slot_num", slot_num)
+          .Attr("slot_index", slot_index)
+          .Attr("Tkeys", DT_INT64)
+          .Attr("dtype", DT_FLOAT)
+          .Attr("shape", TensorShape({config.dim}))
+          .Attr("counter_type", DT_INT64)
+          .Attr("layout", Layout(storage_type, 0))
+          .Attr("storage_type", storage_type)
+          .Attr("storage_path", testing::TmpDir())
+          .Attr("storage_size", std::vector<int64>({config.cache_bytes}))
+          .Attr("default_value_dim", default_value_dim)
+          .Finalize(g, &ret));
+  return ret;
+}
+
+Node* Slice(Graph* g, Node* ids, Node* begin, int32 size) {
+  Node* ret;
+  TF_CHECK_OK(NodeBuilder(g->NewName("slice"), "Slice")
+                  .Input(ids)
+                  .Input(begin)
+                  .Input(Int32Vector(g, size))
+                  .Attr("T", DT_INT64)
+                  .Attr("Index", DT_INT32)
+                  .Finalize(g, &ret));
+  return ret;
+}
+
+// A batch of the ids of 'pool' from a random offset, every step.
+Node* RandomBatch(Graph* g, Node* pool, int64 pool_size) {
+  const int32 batch_size = Config().batch_size;
+  Tensor minval(DT_INT32, TensorShape({}));
+  minval.scalar<int32>()() = 0;
+  Tensor maxval(DT_INT32, TensorShape({}));
+  maxval.scalar<int32>()() = pool_size - batch_size + 1;
+  Node* begin;
+  TF_CHECK_OK(NodeBuilder(g->NewName("random_begin"), "RandomUniformInt")
+                  .Input(Int32Vector(g, 1))
+                  .Input(test::graph::Constant(g, minval))
+                  .Input(test::graph::Constant(g, maxval))
+                  .Attr("Tout", DT_INT32)
+                  .Attr("T", DT_INT32)
+                  .Finalize(g, &begin));
+  return Slice(g, pool, begin, batch_size);
+}
+
+Node* Gather(Graph* g, Node* var, Node* ids) {
+  Node* ret;
+  TF_CHECK_OK(NodeBuilder(g->NewName("gather"), "KvResourceGather")
+                  .Input(var)
+                  .Input(ids)
+                  .Input(FloatScalar(g, 0.0f))
+                  .Attr("dtype", DT_FLOAT)
+                  .Attr("Tkeys", DT_INT64)
+                  .Finalize(g, &ret));
+  return ret;
+}
+
+// 'vars' are the variable and its slots, then the beta powers of AdamAsync.
+Node* Apply(Graph* g, EVOp op, const std::vector<Node*>& vars, Node* ids) {
+  const BenchmarkConfig& config = Config();
+  Tensor grad(DT_FLOAT, TensorShape({config.batch_size, config.dim}));
+  grad.flat<float>().setConstant(0.01f);
+  Node* grad_node = test::graph::Constant(g, grad);
+  Node* lr = FloatScalar(g, 0.01f);
+  Node* global_step = Int64Scalar(g, 100);
+
+  const char* op_name = nullptr;
+  std::vector<Node*> inputs;
+  switch (op) {
+    case kGradientDescent:
+      op_name = "KvResourceSparseApplyGradientDescent";
+      inputs = {vars[0], lr, grad_node, ids, global_step};
+      break;
+    case kMixed:
+    case kAdagrad:
+      op_name = "KvResourceSparseApplyAdagrad";
+      inputs = {vars[0], vars[1], lr, grad_node, ids, global_step};
+      break;
+    case kAdagradDecay:
+      op_name = "KvResourceSparseApplyAdagradDecay";
+      inputs = {vars[0], vars[1], vars[2], lr,
+                Int64Scalar(g, 100000), FloatScalar(g, 0.9f),
+                FloatScalar(g, 0.1f), global_step, grad_node, ids};
+      break;
+    case kAdam:
+      op_name = "KvResourceSparseApplyAdam";
+      inputs = {vars[0], vars[1], vars[2],
+                FloatScalar(g, 0.9f), FloatScalar(g, 0.999f), lr,
+                FloatScalar(g, 0.9f), FloatScalar(g, 0.999f),
+                FloatScalar(g, 1e-8f), grad_node, ids, global_step};
+      break;
+    case kAdamAsync:
+      op_name = "KvResourceSparseApplyAdamAsync";
+      inputs = {vars[0], vars[1], vars[2], vars[3], vars[4], lr,
+                FloatScalar(g, 0.9f), FloatScalar(g, 0.999f),
+                FloatScalar(g, 1e-8f), grad_node, ids, global_step};
+      break;
+    case kFtrl:
+      op_name = "KvResourceSparseApplyFtrl";
+      inputs = {vars[0], vars[1], vars[2], grad_node, ids, lr,
+                FloatScalar(g, 0.001f), FloatScalar(g, 0.001f),
+                FloatScalar(g, -0.5f)};
+      break;
+    default:
+      LOG(FATAL) << "Not an optimizer: " << op;
+  }
+  NodeBuilder builder(g->NewName("apply"), op_name);
+  for (Node* input : inputs) {
+    builder.Input(input);
+  }
+  builder.Attr("T", DT_FLOAT).Attr("Tindices", DT_INT64);
+  if (op != kFtrl) {
+    builder.Attr("Tstep", DT_INT64);
+  }
+  Node* ret;
+  TF_CHECK_OK(builder.Finalize(g, &ret));
+  return ret;
+}
+
+// 'init' creates the variable of 'op', its slots and the rows of the ids
+// of 'pool', 'g' runs 'op' on a random batch of 'pool' every step.
+// Returns the ids of a step.
+int64 BuildGraphs(int storage_type, EVOp op, const Tensor& pool,
+                  Graph* g, Graph* init) {
+  const int64 batch_size = Config().batch_size;
+  const int64 pool_size = pool.NumElements();
+  const int slot_num = SlotNum(op);
+  std::vector<string> names = {"var"};
+  for (int i = 1; i <= slot_num; ++i) {
+    names.push_back(strings::StrCat("var/slot_", i));
+  }
+  std::vector<string> beta_power_names;
+  if (op == kAdamAsync) {
+    beta_power_names = {"beta1_power", "beta2_power"};
+  }
+
+  // The handles are shared by the two graphs through their names.
+  std::vector<Node*> init_ops;
+  Node* primary = KvVarHandle(init, names[0]);
+  for (int i = 0; i < static_cast<int>(names.size()); ++i) {
+    Node* var = i == 0 ? primary : KvVarHandle(init, names[i]);
+    init_ops.push_back(InitializeKvVariable(
+        init, var, primary, storage_type, slot_num, i));
+  }
+  for (const string& name : beta_power_names) {
+    init_ops.push_back(AssignVariable(
+        init, VarHandle(init, name), FloatScalar(init, 0.9f)));
+  }
+  // Batch by batch, as the batch should fit in the cache of the
+  // multi-level storage types.
+  Node* init_pool = test::graph::Constant(init, pool);
+  Node* prev = nullptr;
+  for (int64 begin = 0; begin < pool_size; begin += batch_size) {
+    Node* gather = Gather(
+        init, primary,
+        Slice(init, init_pool, Int32Vector(init, begin),
+              std::min(batch_size, pool_size - begin)));
+    if (prev == nullptr) {
+      for (Node* n : init_ops) {
+        init->AddControlEdge(n, gather);
+      }
+    } else {
+      init->AddControlEdge(prev, gather);
+    }
+    prev = gather;
+  }
+
+  std::vector<Node*> vars;
+  for (const string& name : names) {
+    vars.push_back(KvVarHandle(g, name));
+  }
+  for (const string& name : beta_power_names) {
+    vars.push_back(VarHandle(g, name));
+  }
+  Node* step_pool = test::graph::Constant(g, pool);
+  Node* ids = RandomBatch(g, step_pool, pool_size);
+  switch (op) {
+    case kGather:
+      Gather(g, vars[0], ids);
+      return batch_size;
+    case kMixed:
+      // Reads and writes other ids of the same variable at once.
+      Gather(g, vars[0], ids);
+      Apply(g, op, vars, RandomBatch(g, step_pool, pool_size));
+      return 2 * batch_size;
+    default:
+      Apply(g, op, vars, ids);
+      return batch_size;
+  }
+}
+
+void BM_EVGraph(int iters, int storage_type, int threads, EVOp op,
+                bool zipf) {
+  testing::StopTiming();
+  testing::UseRealTime();
+  Graph* g = new Graph(OpRegistry::Global());
+  Graph* init = new Graph(OpRegistry::Global());
+  const int64 ids_per_step = BuildGraphs(
+      storage_type, op, GenerateIds(Config().num_keys, zipf), g, init);
+  testing::ItemsProcessed(static_cast<int64>(iters) * ids_per_step);
+
+  // The kernels shard the ids on the intra op threads.
+  SessionOptions options;
+  options.config.set_intra_op_parallelism_threads(threads);
+  test::Benchmark("cpu", g, &options, init).Run(iters);
+}
+
+#define EV_BENCHMARK_STORAGE_TYPES_AND_THREADS        \
+  ArgPair(DRAM, 1)->ArgPair(DRAM, 8)                  \
+      ->ArgPair(LEVELDB, 1)->ArgPair(LEVELDB, 8)      \
+      ->ArgPair(SSDHASH, 1)->ArgPair(SSDHASH, 8)      \
+      ->ArgPair(DRAM_SSDHASH, 1)->ArgPair(DRAM_SSDHASH, 8) \
+      ->ArgPair(DRAM_LEVELDB, 1)->ArgPair(DRAM_LEVELDB, 8)
+
+#define BM_EV_GRAPH(CASE)                                               \
+  void BM_EV##CASE##_Uniform(int iters, int storage_type, int threads) { \
+    BM_EVGraph(iters, storage_type, threads, k##CASE, false);           \
+  }                                                                     \
+  void BM_EV##CASE##_Zipf(int iters, int storage_type, int threads) {    \
+    BM_EVGraph(iters, storage_type, threads, k##CASE, true);            \
+  }                                                                     \
+  BENCHMARK(BM_EV##CASE##_Uniform)->EV_BENCHMARK_STORAGE_TYPES_AND_THREADS; \
+  BENCHMARK(BM_EV##CASE##_Zipf)->EV_BENCHMARK_STORAGE_TYPES_AND_THREADS
+
+BM_EV_GRAPH(Gather);
+BM_EV_GRAPH(Mixed);
+BM_EV_GRAPH(GradientDescent);
+BM_EV_GRAPH(Adagrad);
+BM_EV_GRAPH(AdagradDecay);
+BM_EV_GRAPH(Adam);
+BM_EV_GRAPH(AdamAsync);
+BM_EV_GRAPH(Ftrl);
+
+/// EmbeddingVar benchmarks, of the storage.
+
+EmbeddingVar<int64, float>* CreateEV(int storage_type, int64 steps_to_live) {
+  const BenchmarkConfig& config = Config();
+  const string layout = Layout(storage_type, steps_to_live);
+  auto storage_manager = new embedding::StorageManager<int64, float>(
+      "EmbeddingVar", embedding::StorageConfig(
+          static_cast<StorageType>(storage_type), testing::TmpDir(),
+          {config.cache_bytes}, layout));
+  TF_CHECK_OK(storage_manager->Init());
+  auto ev = new EmbeddingVar<int64, float>("EmbeddingVar", storage_manager,
+      EmbeddingConfig(/*emb_index = */0, /*primary_emb_index = */0,
+                      /*block_num = */1, /*slot_num = */0,
+                      /*name = */"", steps_to_live,
+                      /*filter_freq = */0, /*max_freq = */999999,
+                      /*l2_weight_threshold = */-1.0, layout,
+                      /*max_element_size = */0,
+                      /*false_positive_probability = */-1.0,
+                      /*counter_type = */DT_INT64));
+  Tensor default_value(DT_FLOAT, TensorShape({config.dim}));
+  default_value.flat<float>().setConstant(0.01f);
+  TF_CHECK_OK(ev->Init(default_value, 1));
+  return ev;
+}
+
+// Creates or updates the row of 'id' at 'global_step', as the kernels of
+// the optimizers do.
+void UpdateRow(EmbeddingVar<int64, float>* ev, int64 id, int64 global_step) {
+  ValuePtr<float>* value_ptr = nullptr;
+  TF_CHECK_OK(ev->LookupOrCreateKey(id, &value_ptr));
+  ev->UpdateVersion(id, value_ptr, global_step);
+  ev->flat(value_ptr).setConstant(0.02f);
+  ev->Commit(id, value_ptr);
+}
+
+void InsertRows(EmbeddingVar<int64, float>* ev, int threads) {
+  ParallelFor(threads, Config().num_keys, [ev](int64 begin, int64 end) {
+    for (int64 i = begin; i < end; ++i) {
+      UpdateRow(ev, RankToId(i), 0);
+    }
+  });
+}
+
+// Insertion of new rows, and the resident memory of a row.
+void BM_EVInsert(int iters, int storage_type, int threads) {
+  testing::StopTiming();
+  testing::UseRealTime();
+  const int64 num_keys = Config().num_keys;
+  int64 bytes_per_row = 0;
+  for (int i = 0; i < iters; ++i) {
+    EmbeddingVar<int64, float>* ev = CreateEV(storage_type, 0);
+    const int64 resident = ResidentBytes();
+    testing::StartTiming();
+    InsertRows(ev, threads);
+    testing::StopTiming();
+    // Memory freed by the previous iterations may be reused.
+    bytes_per_row = std::max(bytes_per_row,
+                             (ResidentBytes() - resident) / num_keys);
+    ev->Unref();
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_keys);
+  testing::SetLabel(strings::StrCat("bytes_per_row=", bytes_per_row));
+}
+
+BENCHMARK(BM_EVInsert)->EV_BENCHMARK_STORAGE_TYPES_AND_THREADS;
+
+// Eviction of the rows out of steps_to_live by Shrink, half of the rows
+// are evicted every iteration.
+void BM_EVEviction(int iters, int storage_type) {
+  testing::StopTiming();
+  testing::UseRealTime();
+  const int64 num_keys = Config().num_keys;
+  EmbeddingVar<int64, float>* ev = CreateEV(storage_type, 1);
+  for (int i = 0; i < iters; ++i) {
+    const int64 global_step = 2 * (i + 1);
+    for (int64 rank = 0; rank < num_keys; ++rank) {
+      UpdateRow(ev, RankToId(rank), global_step - (rank % 2 == 0 ? 2 : 0));
+    }
+    testing::StartTiming();
+    TF_CHECK_OK(ev->Shrink(global_step));
+    testing::StopTiming();
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * (num_keys / 2));
+  ev->Unref();
+}
+
+BENCHMARK(BM_EVEviction)
+    ->Arg(DRAM)->Arg(LEVELDB)->Arg(SSDHASH)->Arg(DRAM_SSDHASH)
+    ->Arg(DRAM_LEVELDB);
+
+string CheckpointPrefix(int storage_type) {
+  return strings::StrCat(testing::TmpDir(), "/ev_benchmark_", storage_type);
+}
+
+void Save(EmbeddingVar<int64, float>* ev, const string& prefix) {
+  Tensor part_offset(DT_INT32, TensorShape({kSavedPartitionNum + 1}));
+  BundleWriter writer(Env::Default(), prefix);
+  TF_CHECK_OK(DumpEmbeddingValues(ev, "var", &writer, &part_offset));
+  TF_CHECK_OK(writer.Finish());
+}
+
+void BM_EVSave(int iters, int storage_type) {
+  testing::StopTiming();
+  testing::UseRealTime();
+  const BenchmarkConfig& config = Config();
+  EmbeddingVar<int64, float>* ev = CreateEV(storage_type, 0);
+  InsertRows(ev, 1);
+  const int64 rows = ev->Size();
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    Save(ev, CheckpointPrefix(storage_type));
+  }
+  testing::StopTiming();
+  testing::ItemsProcessed(static_cast<int64>(iters) * rows);
+  testing::BytesProcessed(
+      static_cast<int64>(iters) * rows * config.dim * sizeof(float));
+  ev->Unref();
+}
+
+BENCHMARK(BM_EVSave)
+    ->Arg(DRAM)->Arg(LEVELDB)->Arg(SSDHASH)->Arg(DRAM_SSDHASH)
+    ->Arg(DRAM_LEVELDB);
+
+void BM_EVRestore(int iters, int storage_type) {
+  testing::StopTiming();
+  testing::UseRealTime();
+  const BenchmarkConfig& config = Config();
+  const string prefix = CheckpointPrefix(storage_type);
+  int64 rows = 0;
+  {
+    EmbeddingVar<int64, float>* ev = CreateEV(storage_type, 0);
+    InsertRows(ev, 1);
+    rows = ev->Size();
+    Save(ev, prefix);
+    ev->Unref();
+  }
+  for (int i = 0; i < iters; ++i) {
+    EmbeddingVar<int64, float>* ev = CreateEV(storage_type, 0);
+    testing::StartTiming();
+    BundleReader reader(Env::Default(), prefix);
+    TF_CHECK_OK(reader.status());
+    TF_CHECK_OK(EVRestoreNoPartition(ev, &reader, "var-keys", "var-values",
+                                     "var-versions", "var-freqs"));
+    testing::StopTiming();
+    ev->Unref();
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * rows);
+  testing::BytesProcessed(
+      static_cast<int64>(iters) * rows * config.dim * sizeof(float));
+}
+
+BENCHMARK(BM_EVRestore)
+    ->Arg(DRAM)->Arg(LEVELDB)->Arg(SSDHASH)->Arg(DRAM_SSDHASH)
+    ->Arg(DRAM_LEVELDB);
+
+/// LocklessHashMap benchmarks.
+
+// Latency of the inserts while the table grows from empty to num_keys
+// keys, on 8 threads. A segment rehashes all its keys when it grows, the
+// inserts waiting for it make the tail of the latency.
+void BM_LocklessHashMapInsertLatency(int iters, int num_segments,
+                                     int reserve) {
+  testing::StopTiming();
+  testing::UseRealTime();
+  const int threads = 8;
+  const int64 num_keys = Config().num_keys;
+  std::vector<int64> latencies(num_keys);
+  for (int i = 0; i < iters; ++i) {
+    LocklessHashMap<int64, float> hashmap(num_segments);
+    if (reserve) {
+      hashmap.Reserve(num_keys);
+    }
+    // The map only holds the pointers.
+    auto value_ptr = reinterpret_cast<ValuePtr<float>*>(&hashmap);
+    testing::StartTiming();
+    ParallelFor(threads, num_keys,
+                [&hashmap, &latencies, value_ptr](int64 begin, int64 end) {
+      Env* env = Env::Default();
+      for (int64 i = begin; i < end; ++i) {
+        const uint64 start = env->NowNanos();
+        TF_CHECK_OK(hashmap.Insert(RankToId(i), value_ptr));
+        latencies[i] = env->NowNanos() - start;
+      }
+    });
+    testing::StopTiming();
+  }
+  std::sort(latencies.begin(), latencies.end());
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_keys);
+  testing::SetLabel(strings::StrCat(
+      "p50_ns=", latencies[num_keys / 2],
+      " p99_ns=", latencies[num_keys * 99 / 100],
+      " max_ns=", latencies.back()));
+}
+
+BENCHMARK(BM_LocklessHashMapInsertLatency)
+    ->ArgPair(1, 0)->ArgPair(16, 0)->ArgPair(64, 0)
+    ->ArgPair(1, 1)->ArgPair(16, 1);
+
+}  // namespace
+}  // namespace embedding
+}  // namespace tensorflow
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <thread>
 
 #include "tensorflow/core/framework/op.h"
@@ -31,7 +32,12 @@
 #include <sys/resource.h>
 #include "tensorflow/core/framework/embedding/kv_interface.h"
 #include "tensorflow/core/framework/embedding/cache.h"
+#include "tensorflow/core/framework/embedding/numa_hash_map.h"
 #include "tensorflow/core/kernels/kv_variable_ops.h"
+#ifdef TENSORFLOW_USE_PMEM
+#include "tensorflow/core/framework/embedding/persistent_hash_map.h"
+#include "tensorflow/core/framework/experimental_pmem_allocator.h"
+#endif
 #ifdef TENSORFLOW_USE_JEMALLOC
 #include "jemalloc/jemalloc.h"
 #endif
@@ -154,7 +160,7 @@ TEST(TensorBundleTest, TestEVShrinkLockless) {
     ValuePtr<float>* value_ptr = nullptr;
     Status s = emb_var->LookupOrCreateKey(i, &value_ptr);
     typename TTypes<float>::Flat vflat = emb_var->flat(value_ptr);
-    emb_var->UpdateVersion(value_ptr, i);
+    emb_var->UpdateVersion(i, value_ptr, i);
   }
 
   int size = emb_var->Size();
@@ -168,6 +174,63 @@ TEST(TensorBundleTest, TestEVShrinkLockless) {
 
 }
 
+TEST(TensorBundleTest, TestEVIncrementalShrinkLockless) {
+  setenv("TF_EV_INCREMENTAL_SHRINK", "1", 1);
+  setenv("TF_EV_INCREMENTAL_SHRINK_INTERVAL_MS", "10", 1);
+  int64 value_size = 64;
+  int64 insert_num = 30;
+  Tensor value(DT_FLOAT, TensorShape({value_size}));
+  test::FillValues<float>(&value, std::vector<float>(value_size, 9.0));
+
+  int steps_to_live = 5;
+  auto storage_manager = new embedding::StorageManager<int64, float>(
+                 "name", embedding::StorageConfig());
+  TF_CHECK_OK(storage_manager->Init());
+  EmbeddingVar<int64, float>* emb_var
+    = new EmbeddingVar<int64, float>("name",
+        storage_manager, EmbeddingConfig(0, 0, 1, 1, "", steps_to_live));
+  emb_var->Init(value, 1);
+  ASSERT_NE(storage_manager->StepIndex(), nullptr);
+
+  for (int64 i = 0; i < insert_num; ++i) {
+    ValuePtr<float>* value_ptr = nullptr;
+    TF_CHECK_OK(emb_var->LookupOrCreateKey(i, &value_ptr));
+    emb_var->flat(value_ptr);
+    emb_var->UpdateVersion(i, value_ptr, i);
+  }
+
+  // Reclaimed by the background thread without Shrink(gs). At global step
+  // insert_num - 1 the rows of the last steps_to_live + 1 steps live, a
+  // row expires when gs - version > steps_to_live.
+  for (int i = 0; i < 1000 && emb_var->Size() > steps_to_live + 1; ++i) {
+    Env::Default()->SleepForMicroseconds(10 * 1000);
+  }
+  ASSERT_EQ(emb_var->Size(), steps_to_live + 1);
+
+  // Updates don't add entries, a key has one entry in the index.
+  ValuePtr<float>* value_ptr = nullptr;
+  TF_CHECK_OK(emb_var->LookupOrCreateKey(insert_num - 1, &value_ptr));
+  for (int64 gs = insert_num; gs < insert_num + steps_to_live; ++gs) {
+    emb_var->UpdateVersion(insert_num - 1, value_ptr, gs);
+  }
+  ASSERT_LE(storage_manager->StepIndex()->Size(), emb_var->Size());
+
+  // Keys updated again are kept.
+  emb_var->UpdateVersion(insert_num - 1, value_ptr, insert_num * 2);
+  emb_var->Shrink(insert_num * 2);
+  ASSERT_EQ(emb_var->Size(), 1);
+  ASSERT_EQ(storage_manager->StepIndex()->Size(), 1);
+
+  int64 stats[embedding::kNumEmbeddingStatistics];
+  storage_manager->Stats()->GetStatistics(stats);
+  ASSERT_EQ(stats[embedding::kShrinkEvictionCount], insert_num - 1);
+  ASSERT_GT(stats[embedding::kShrinkEvictionBytes], 0);
+
+  emb_var->Unref();
+  unsetenv("TF_EV_INCREMENTAL_SHRINK");
+  unsetenv("TF_EV_INCREMENTAL_SHRINK_INTERVAL_MS");
+}
+
 
 TEST(EmbeddingVariableTest, TestEmptyEV) {
   int64 value_size = 8;
@@ -1019,6 +1082,129 @@ TEST(EmbeddingVariableTest, TestRemoveLockless) {
   LOG(INFO) << "2 size:" << hashmap->Size();
 }
 
+TEST(EmbeddingVariableTest, TestLocklessHashMapReserve) {
+  const int64 n = 20000;
+  const int num_threads = 4;
+  std::vector<ValuePtr<float>*> value_ptrs(n);
+  for (int64 i = 0; i < n; ++i) {
+    value_ptrs[i] = new NormalValuePtr<float>(ev_allocator(), 16);
+  }
+  // Inserts race with the replacement of the empty segments.
+  LocklessHashMap<int64, float> hashmap(/*num_segments=*/8);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&hashmap, &value_ptrs, t, n, num_threads]() {
+      for (int64 i = t; i < n; i += num_threads) {
+        TF_CHECK_OK(hashmap.Insert(i, value_ptrs[i]));
+      }
+    });
+  }
+  hashmap.Reserve(n);
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(hashmap.Size(), n);
+  for (int64 i = 0; i < n; ++i) {
+    ValuePtr<float>* value_ptr = nullptr;
+    TF_CHECK_OK(hashmap.Lookup(i, &value_ptr));
+    ASSERT_EQ(value_ptr, value_ptrs[i]);
+  }
+  ASSERT_FALSE(hashmap.Insert(0, value_ptrs[1]).ok());
+  TF_CHECK_OK(hashmap.Remove(0));
+  ASSERT_EQ(hashmap.Size(), n - 1);
+  std::vector<int64> key_list;
+  std::vector<ValuePtr<float>*> value_ptr_list;
+  TF_CHECK_OK(hashmap.GetSnapshot(&key_list, &value_ptr_list));
+  ASSERT_EQ(key_list.size(), n - 1);
+
+  // Keys inserted after Reserve().
+  LocklessHashMap<int64, float> reserved(/*num_segments=*/4);
+  reserved.Reserve(n);
+  for (int64 i = 0; i < n; ++i) {
+    TF_CHECK_OK(reserved.Insert(i, value_ptrs[i]));
+  }
+  ASSERT_EQ(reserved.Size(), n);
+  for (auto ptr : value_ptrs) {
+    ptr->Destroy(ev_allocator());
+    delete ptr;
+  }
+}
+
+TEST(EmbeddingVariableTest, TestNumaPlacementShard) {
+  // 2 simulated nodes.
+  embedding::NumaPlacement placement(2, 2);
+  const int64 n = 1000;
+  std::vector<int64> keys(n);
+  for (int64 i = 0; i < n; ++i) {
+    keys[i] = i * 7;
+  }
+  std::vector<int> visits(n, 0);
+  std::atomic<bool> mixed_nodes(false);
+  placement.Shard(keys.data(), n, 1000,
+                  [&](int64 start, int64 limit) {
+    for (int64 i = start; i < limit; ++i) {
+      ++visits[i];
+      if (placement.NodeOf(keys[i]) != placement.NodeOf(keys[start])) {
+        mixed_nodes = true;
+      }
+    }
+  });
+  ASSERT_FALSE(mixed_nodes);
+  for (int64 i = 0; i < n; ++i) {
+    ASSERT_EQ(visits[i], 1);
+  }
+
+  // More concurrent kernels than threads of a node.
+  embedding::NumaPlacement small_placement(2, 1);
+  const int num_kernels = 8;
+  std::vector<std::atomic<int64>> kernel_visits(num_kernels);
+  std::vector<std::unique_ptr<Thread>> kernels;
+  for (int t = 0; t < num_kernels; ++t) {
+    kernel_visits[t] = 0;
+    kernels.emplace_back(Env::Default()->StartThread(
+        ThreadOptions(), "kernel", [&small_placement, &keys, &kernel_visits,
+                                    t, n]() {
+      for (int r = 0; r < 20; ++r) {
+        small_placement.Shard(keys.data(), n, 1000,
+                              [&kernel_visits, t](int64 start, int64 limit) {
+          kernel_visits[t] += limit - start;
+        });
+      }
+    }));
+  }
+  kernels.clear();
+  for (int t = 0; t < num_kernels; ++t) {
+    ASSERT_EQ(kernel_visits[t], 20 * n);
+  }
+
+  embedding::NumaLocklessHashMap<int64, float> hashmap(&placement);
+  std::vector<ValuePtr<float>*> value_ptrs(n);
+  placement.Shard(keys.data(), n, 1000, [&](int64 start, int64 limit) {
+    for (int64 i = start; i < limit; ++i) {
+      value_ptrs[i] = new NormalValuePtr<float>(ev_allocator(), 16);
+      TF_CHECK_OK(hashmap.Insert(keys[i], value_ptrs[i]));
+    }
+  });
+  ASSERT_EQ(hashmap.Size(), n);
+  for (int64 i = 0; i < n; ++i) {
+    ValuePtr<float>* value_ptr = nullptr;
+    TF_CHECK_OK(hashmap.Lookup(keys[i], &value_ptr));
+    ASSERT_EQ(value_ptr, value_ptrs[i]);
+  }
+  std::vector<int64> key_list;
+  std::vector<ValuePtr<float>*> value_ptr_list;
+  TF_CHECK_OK(hashmap.GetSnapshot(&key_list, &value_ptr_list));
+  ASSERT_EQ(key_list.size(), n);
+  TF_CHECK_OK(hashmap.Remove(keys[0]));
+  ASSERT_EQ(hashmap.Size(), n - 1);
+  ValuePtr<float>* value_ptr = nullptr;
+  ASSERT_FALSE(hashmap.Lookup(keys[0], &value_ptr).ok());
+  for (auto ptr : value_ptrs) {
+    ptr->Destroy(ev_allocator());
+    delete ptr;
+  }
+}
+
 TEST(EmbeddingVariableTest, TestBatchCommitofDBKV) {
   int64 value_size = 4;
   Tensor value(DT_FLOAT, TensorShape({value_size}));
@@ -1080,6 +1266,88 @@ TEST(EmbeddingVariableTest, TestSizeDBKV) {
   LOG(INFO) << "2 size:" << hashmap->Size();
 }
 
+#ifdef TENSORFLOW_USE_PMEM
+TEST(EmbeddingVariableTest, TestPersistentHashMapRecover) {
+  // A regular file stands in for PMem, rows are synced by msync.
+  std::string pmem_file = io::JoinPath(testing::TmpDir(), "ev_recover.pmem");
+  std::string index_file = io::JoinPath(testing::TmpDir(), "ev_recover.evindex");
+  remove(pmem_file.c_str());
+  remove(index_file.c_str());
+  const uint64 pmem_size = 64 << 20;
+  const int total_dims = 16;
+  ExperimentalPMemAllocatorConfig config;
+  config.persistent = true;
+  config.msync = true;
+
+  ExperimentalPMemAllocator* alloc =
+      ExperimentalPMemAllocator::NewExperimentalPMemAllocator(
+          pmem_file, pmem_size, 64, config);
+  ASSERT_NE(alloc, nullptr);
+  auto hashmap = new PersistentHashMap<int64, float>("ev_recover",
+      testing::TmpDir(), alloc);
+  TF_CHECK_OK(hashmap->Init());
+  ASSERT_FALSE(hashmap->Recovered());
+  hashmap->SetTotalDims(total_dims);
+  for (int64 i = 0; i < 100; ++i) {
+    ValuePtr<float>* value_ptr =
+        new NormalContiguousValuePtr<float>(alloc, total_dims);
+    value_ptr->SetValue((float)i, total_dims);
+    TF_CHECK_OK(hashmap->Insert(i, value_ptr));
+  }
+  for (int64 i = 0; i < 100; i += 2) {
+    ValuePtr<float>* value_ptr = nullptr;
+    TF_CHECK_OK(hashmap->Lookup(i, &value_ptr));
+    TF_CHECK_OK(hashmap->Remove(i));
+    value_ptr->Destroy(alloc);
+    delete value_ptr;
+  }
+  ASSERT_EQ(hashmap->Size(), 50);
+  std::vector<int64> key_list;
+  std::vector<ValuePtr<float>*> value_ptr_list;
+  TF_CHECK_OK(hashmap->GetSnapshot(&key_list, &value_ptr_list));
+  for (auto value_ptr : value_ptr_list) {
+    delete value_ptr;
+  }
+  delete hashmap;
+  delete alloc;
+
+  alloc = ExperimentalPMemAllocator::NewExperimentalPMemAllocator(
+      pmem_file, pmem_size, 64, config);
+  ASSERT_NE(alloc, nullptr);
+  ASSERT_TRUE(alloc->Recovered());
+  hashmap = new PersistentHashMap<int64, float>("ev_recover",
+      testing::TmpDir(), alloc);
+  TF_CHECK_OK(hashmap->Init());
+  ASSERT_TRUE(hashmap->Recovered());
+  hashmap->SetTotalDims(total_dims);
+  ASSERT_EQ(hashmap->Size(), 50);
+  for (int64 i = 0; i < 100; ++i) {
+    ValuePtr<float>* value_ptr = nullptr;
+    Status s = hashmap->Lookup(i, &value_ptr);
+    if (i % 2 == 0) {
+      ASSERT_FALSE(s.ok());
+      continue;
+    }
+    TF_CHECK_OK(s);
+    float* val = (float*)((char*)value_ptr->GetPtr() +
+        sizeof(FixedLengthHeader));
+    for (int j = 0; j < total_dims; ++j) {
+      ASSERT_EQ(val[j], (float)i);
+    }
+  }
+  key_list.clear();
+  value_ptr_list.clear();
+  TF_CHECK_OK(hashmap->GetSnapshot(&key_list, &value_ptr_list));
+  for (auto value_ptr : value_ptr_list) {
+    delete value_ptr;
+  }
+  delete hashmap;
+  delete alloc;
+  remove(pmem_file.c_str());
+  remove(index_file.c_str());
+}
+#endif  // TENSORFLOW_USE_PMEM
+
 TEST(EmbeddingVariableTest, TestSSDIterator) {
   std::string temp_dir = testing::TmpDir();
   Allocator* alloc = ev_allocator();
@@ -1136,6 +1404,74 @@ TEST(EmbeddingVariableTest, TestLevelDBIterator) {
   }
 }
 
+TEST(EmbeddingVariableTest, TestEmbeddingStatsHotIds) {
+  EmbeddingStats<int64> stats(2, /*sample_rate=*/4);
+  // One of 4 calls of the thread is recorded with 4 times its count, 3
+  // calls per round so that every call is sampled in some round.
+  for (int64 i = 0; i < 400; ++i) {
+    stats.RecordId(7, 1);
+    stats.RecordId(7, 1);
+    stats.RecordId(i + 100, 1);
+  }
+  std::vector<std::pair<int64, int64>> hot_ids;
+  stats.GetHotIds(&hot_ids);
+  ASSERT_GE(hot_ids.size(), 1);
+  EXPECT_EQ(hot_ids[0].first, 7);
+  EXPECT_GE(hot_ids[0].second, 400);
+
+  // Large counts are halved instead of wrapping around.
+  for (int64 i = 0; i < 64; ++i) {
+    stats.RecordId(7, 1 << 28);
+  }
+  stats.GetHotIds(&hot_ids);
+  EXPECT_EQ(hot_ids[0].first, 7);
+  EXPECT_GT(hot_ids[0].second, 0);
+  EXPECT_LT(hot_ids[0].second, 1LL << 31);
+}
+
+TEST(EmbeddingVariableTest, TestLevelDBWriteBehind) {
+  setenv("TF_EV_LEVELDB_WRITE_BATCH", "4", 1);
+  KVInterface<int64, float>* hashmap = new LevelDBKV<int64, float>(testing::TmpDir());
+  unsetenv("TF_EV_LEVELDB_WRITE_BATCH");
+  EmbeddingStats<int64> stats(0);
+  hashmap->SetStats(&stats);
+  hashmap->SetTotalDims(8);
+  for (int64 i = 0; i < 10; i++) {
+    ValuePtr<float>* tmp = new NormalContiguousValuePtr<float>(ev_allocator(), 8);
+    tmp->SetValue((float)i, 8);
+    TF_CHECK_OK(hashmap->Commit(i, tmp));
+    delete tmp;
+  }
+  int64 counters[kNumEmbeddingStatistics];
+  stats.GetStatistics(counters);
+  // Two batches of 4 rows are written, 2 rows are buffered.
+  ASSERT_EQ(counters[kDiskWriteCount], 8);
+
+  std::vector<int64> keys = {9, 100, 0, 5};
+  std::vector<ValuePtr<float>*> values(keys.size(), nullptr);
+  std::vector<ValuePtr<float>**> outputs;
+  for (auto& value : values) {
+    outputs.push_back(&value);
+  }
+  TF_CHECK_OK(hashmap->BatchLookup(keys, outputs));
+  ASSERT_EQ(values[1], nullptr);
+  for (int i : {0, 2, 3}) {
+    ASSERT_NE(values[i], nullptr);
+    float* row = (float*)values[i]->GetPtr() + sizeof(FixedLengthHeader) / sizeof(float);
+    ASSERT_EQ(row[7], (float)keys[i]);
+    delete values[i];
+  }
+  stats.GetStatistics(counters);
+  // 9 is read from the write buffer.
+  ASSERT_EQ(counters[kDiskReadCount], 3);
+  ASSERT_EQ(counters[kDiskReadMissCount], 1);
+
+  TF_CHECK_OK(hashmap->Remove(9));
+  ValuePtr<float>* value_ptr = nullptr;
+  ASSERT_FALSE(hashmap->Lookup(9, &value_ptr).ok());
+  delete hashmap;
+}
+
 TEST(EmbeddingVariableTest, TestLRUCache) {
   BatchCache<int64>* cache = new LRUCache<int64>();
   int num_ids = 30;
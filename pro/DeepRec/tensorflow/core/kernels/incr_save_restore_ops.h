@@ -454,6 +454,9 @@ class IndicesIncrRecorder: public ResourceBase {
       return st;
     }
 
+    // The dump iterators look the rows up one by one, they are not freed
+    // by the incremental shrink until they are dumped.
+    embedding::ScopedEpoch<K, V> epoch(emb_var->storage_manager());
     IncrEVValueDumpIterator<K, V> ev_value_dump_iter(
         partitioned_incr_keys, emb_var);
     st = SaveTensorWithFixedBuffer(tensor_name + "-sparse_incr_values",
@@ -0,0 +1,477 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/framework/embedding/cache.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/kv_variable_ops.h"
+#include "tensorflow/core/kernels/string_to_hash_bucket_ali_op.h"
+#include "tensorflow/core/kernels/unique_ali_op_util.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+namespace {
+// Same knobs as UniqueAliOp, the fused lookup dedups ids the same way.
+const char* kUniqueOpSerialEnv = "DEEPREC_UNIQUE_OP_SERIAL";
+const char* kUniqueOpHashMapEnv = "DEEPREC_UNIQUE_OP_HASH_MAP";
+const char* kUniqueOpUniqRatioHint = "DEEPREC_UNIQUE_OP_UNIQ_RATIO_HINT";
+const char* kUniqueOpPartitionSizeEnv = "DEEPREC_UNIQUE_OP_PARTITION_SIZE";
+const int64 kDefaultUniqueRatioHint = 4;
+
+enum class Combiner { kSum, kMean, kSqrtN };
+
+Status ParseCombiner(const string& combiner_str, Combiner* combiner) {
+  if (combiner_str == "sum") {
+    *combiner = Combiner::kSum;
+  } else if (combiner_str == "mean") {
+    *combiner = Combiner::kMean;
+  } else if (combiner_str == "sqrtn") {
+    *combiner = Combiner::kSqrtN;
+  } else {
+    return errors::InvalidArgument("Unsupported combiner ", combiner_str);
+  }
+  return Status::OK();
+}
+
+template <typename T>
+inline T CombinerScale(Combiner combiner, int64 num) {
+  if (num == 0 || combiner == Combiner::kSum) {
+    return static_cast<T>(1);
+  } else if (combiner == Combiner::kMean) {
+    return static_cast<T>(1) / static_cast<T>(num);
+  }
+  return static_cast<T>(1) / std::sqrt(static_cast<T>(num));
+}
+
+// Groups the positions [0, N) by `segment(i)` in CSR layout: positions of
+// segment s are (*positions)[(*offsets)[s], (*offsets)[s + 1]), in their
+// original order.
+template <typename SegmentFn>
+void BuildSegments(int64 N, int64 num_segments, SegmentFn segment,
+                   std::vector<int64>* offsets, std::vector<int32>* positions) {
+  offsets->assign(num_segments + 1, 0);
+  for (int64 i = 0; i < N; ++i) {
+    ++(*offsets)[segment(i) + 1];
+  }
+  for (int64 s = 0; s < num_segments; ++s) {
+    (*offsets)[s + 1] += (*offsets)[s];
+  }
+  positions->resize(N);
+  std::vector<int64> cursor(offsets->begin(), offsets->end() - 1);
+  for (int64 i = 0; i < N; ++i) {
+    (*positions)[cursor[segment(i)]++] = static_cast<int32>(i);
+  }
+}
+
+Status ValidateSparseInput(const Tensor& sp_values, const Tensor& sp_indices,
+                           const Tensor& sp_dense_shape, int64* num_rows) {
+  if (!TensorShapeUtils::IsVector(sp_values.shape())) {
+    return errors::InvalidArgument("sp_values must be a vector, got ",
+                                   sp_values.shape().DebugString());
+  }
+  if (!TensorShapeUtils::IsMatrix(sp_indices.shape()) ||
+      sp_indices.dim_size(0) != sp_values.dim_size(0)) {
+    return errors::InvalidArgument(
+        "sp_indices must be a matrix with as many rows as sp_values, got ",
+        sp_indices.shape().DebugString(), " and ",
+        sp_values.shape().DebugString());
+  }
+  if (!TensorShapeUtils::IsVector(sp_dense_shape.shape()) ||
+      sp_dense_shape.NumElements() != 2) {
+    return errors::InvalidArgument(
+        "Only 2-D SparseTensor is supported, got dense_shape ",
+        sp_dense_shape.shape().DebugString());
+  }
+  if (sp_values.NumElements() > std::numeric_limits<int32>::max()) {
+    return errors::InvalidArgument(
+        "sp_values larger than ", std::numeric_limits<int32>::max(),
+        " elements is not supported");
+  }
+  *num_rows = sp_dense_shape.vec<int64>()(0);
+  if (*num_rows < 0) {
+    return errors::InvalidArgument("dense_shape[0] = ", *num_rows,
+                                   " is negative");
+  }
+  auto indices = sp_indices.matrix<int64>();
+  for (int64 i = 0; i < sp_indices.dim_size(0); ++i) {
+    if (indices(i, 0) < 0 || indices(i, 0) >= *num_rows) {
+      return errors::InvalidArgument("sp_indices[", i, ", 0] = ",
+                                     indices(i, 0), " is not in [0, ",
+                                     *num_rows, ")");
+    }
+  }
+  return Status::OK();
+}
+}  // namespace
+
+// Fused Unique + KvResourceGather + SparseSegmentReduction for a 2-D
+// SparseTensor of ids. The ids are deduplicated with the hash maps of
+// UniqueAliOp, every distinct id is looked up in the EmbeddingVariable once
+// and rows are reduced from the unique embeddings straight into the output.
+template <typename TKey, typename TValue>
+class KvResourceEmbeddingLookupSparseOp : public OpKernel {
+ public:
+  explicit KvResourceEmbeddingLookupSparseOp(OpKernelConstruction* c)
+      : OpKernel(c) {
+    string combiner_str;
+    OP_REQUIRES_OK(c, c->GetAttr("combiner", &combiner_str));
+    OP_REQUIRES_OK(c, ParseCombiner(combiner_str, &combiner_));
+
+    OP_REQUIRES_OK(c, ReadInt64FromEnvVar(kUniqueOpPartitionSizeEnv,
+                                          kPartitionSize, &partition_size_));
+    OP_REQUIRES(c, partition_size_ > 0,
+                errors::InvalidArgument("Invaild PARTITION_SIZE=",
+                                        partition_size_));
+    OP_REQUIRES_OK(c, ReadBoolFromEnvVar(kUniqueOpSerialEnv, false, &serial_));
+    OP_REQUIRES_OK(c, ReadInt64FromEnvVar(kUniqueOpUniqRatioHint,
+                                          kDefaultUniqueRatioHint,
+                                          &unique_ratio_hint_));
+    OP_REQUIRES(c, unique_ratio_hint_ > 0,
+                errors::InvalidArgument("Invaild ", kUniqueOpUniqRatioHint,
+                                        "=", unique_ratio_hint_));
+    string hash_map_str;
+    OP_REQUIRES_OK(c, ReadStringFromEnvVar(kUniqueOpHashMapEnv, "GOOGLE",
+                                           &hash_map_str));
+    std::transform(hash_map_str.begin(), hash_map_str.end(),
+                   hash_map_str.begin(), ::toupper);
+    if (hash_map_str == "MULTIMAP" && std::is_same<TKey, int64>::value) {
+      // MultiMapCompute only handles int64 ids.
+      map_flag_ = MULTIMAP;
+    } else if (hash_map_str == "STL") {
+      map_flag_ = STL;
+    } else if (hash_map_str == "ABSL") {
+      map_flag_ = ABSL;
+    } else if (hash_map_str == "SORT") {
+      map_flag_ = SORT;
+    } else if (hash_map_str == "AUTO") {
+      map_flag_ = AUTO;
+      selector_.reset(new UniqueAlgorithmSelector(unique_ratio_hint_));
+    } else {
+      map_flag_ = GOOGLE;
+    }
+  }
+
+  void Compute(OpKernelContext* c) override {
+    EmbeddingVar<TKey, TValue>* ev = nullptr;
+    OP_REQUIRES_OK(c, LookupResource(c, HandleFromInput(c, 0), &ev));
+    core::ScopedUnref unref_me(ev);
+
+    const Tensor& sp_values = c->input(1);
+    const Tensor& sp_indices = c->input(2);
+    const Tensor& sp_dense_shape = c->input(3);
+    int64 num_rows = 0;
+    OP_REQUIRES_OK(c, ValidateSparseInput(sp_values, sp_indices,
+                                          sp_dense_shape, &num_rows));
+    const int64 N = sp_values.NumElements();
+    const int64 value_len = ev->ValueLen();
+
+    Tensor ids;
+    OP_REQUIRES_OK(c, ToIds(c, sp_values, &ids));
+
+    Tensor unique_keys;
+    Tensor unique_idx;
+    Tensor unique_counts;
+    if (N > 0) {
+      UniqueWithoutAxis<TKey, int32>(c, ids, &unique_idx, &unique_keys,
+                                     &unique_counts, 3, partition_size_,
+                                     serial_, unique_ratio_hint_, map_flag_,
+                                     selector_.get());
+      if (!c->status().ok()) return;
+    } else {
+      OP_REQUIRES_OK(c, c->allocate_temp(DataTypeToEnum<TKey>::v(),
+                                         TensorShape({0}), &unique_keys));
+      OP_REQUIRES_OK(c, c->allocate_temp(DT_INT32, TensorShape({0}),
+                                         &unique_idx));
+    }
+    const int64 num_unique = unique_keys.NumElements();
+    OP_REQUIRES(c, !ev->IsMultiLevel() || ev->CacheSize() >= num_unique,
+        errors::InvalidArgument(
+            "MultiLevel EV's Cache size ", ev->CacheSize(),
+            " should large than IDs in batch ", num_unique));
+
+    Tensor* out = nullptr;
+    OP_REQUIRES_OK(c, c->allocate_output(
+        0, TensorShape({num_rows, value_len}), &out));
+    c->set_output(1, unique_keys);
+    c->set_output(2, unique_idx);
+    auto out_flat = out->flat<TValue>();
+    if (num_rows == 0) return;
+    if (N == 0) {
+      out_flat.setZero();
+      return;
+    }
+
+    auto worker_threads = c->device()->tensorflow_cpu_worker_threads();
+
+    // Look up every distinct id once, its count is the frequency of the id
+    // in this batch as KvResourceGatherV1 records it.
+    Tensor unique_emb;
+    OP_REQUIRES_OK(c, c->allocate_temp(DataTypeToEnum<TValue>::v(),
+                                       TensorShape({num_unique, value_len}),
+                                       &unique_emb));
+    TValue* emb_base = unique_emb.flat<TValue>().data();
+    auto keys_flat = unique_keys.flat<TKey>();
+    auto counts_flat = unique_counts.flat<int32>();
+    TValue* default_v = ev->GetDefaultValuePtr();
+    embedding::EmbeddingStats<TKey>* stats = ev->storage_manager()->Stats();
+    // The rows are not freed by the incremental shrink while they are
+    // copied.
+    embedding::ScopedEpoch<TKey, TValue> epoch(ev->storage_manager());
+    auto lookup = [ev, keys_flat, counts_flat, emb_base, default_v,
+                   value_len, stats](int64 start, int64 limit) {
+      for (int64 i = start; i < limit; ++i) {
+        TValue* default_v_ptr = default_v +
+            value_len * (keys_flat(i) % ev->GetDefaultValueDim());
+        ev->LookupOrCreate(keys_flat(i), emb_base + i * value_len,
+                           default_v_ptr, counts_flat(i));
+        if (stats) stats->RecordId(keys_flat(i), counts_flat(i));
+      }
+    };
+    Shard(worker_threads->num_threads, worker_threads->workers, num_unique,
+          value_len * sizeof(TValue), lookup);
+    if (stats) stats->RecordBatch(N, num_unique);
+
+    ev->storage_manager()->Schedule([ev, unique_keys]() {
+      embedding::BatchCache<TKey>* cache = ev->Cache();
+      if (cache) {
+        cache->add_to_rank(unique_keys);
+      }
+    });
+
+    // Reduce rows from the unique embeddings directly into the output.
+    auto indices = sp_indices.matrix<int64>();
+    std::vector<int64> row_offsets;
+    std::vector<int32> positions;
+    BuildSegments(N, num_rows, [&indices](int64 i) { return indices(i, 0); },
+                  &row_offsets, &positions);
+    auto idx_flat = unique_idx.flat<int32>();
+    TValue* out_base = out_flat.data();
+    const Combiner combiner = combiner_;
+    auto reduce = [&row_offsets, &positions, idx_flat, emb_base, out_base,
+                   value_len, combiner](int64 start, int64 limit) {
+      for (int64 row = start; row < limit; ++row) {
+        TValue* dst = out_base + row * value_len;
+        const int64 begin = row_offsets[row];
+        const int64 end = row_offsets[row + 1];
+        std::fill(dst, dst + value_len, static_cast<TValue>(0));
+        for (int64 k = begin; k < end; ++k) {
+          const TValue* src = emb_base + idx_flat(positions[k]) * value_len;
+          for (int64 j = 0; j < value_len; ++j) {
+            dst[j] += src[j];
+          }
+        }
+        const TValue scale = CombinerScale<TValue>(combiner, end - begin);
+        if (scale != static_cast<TValue>(1)) {
+          for (int64 j = 0; j < value_len; ++j) {
+            dst[j] *= scale;
+          }
+        }
+      }
+    };
+    const int64 cost_per_row =
+        std::max<int64>(1, N / num_rows) * value_len * sizeof(TValue);
+    Shard(worker_threads->num_threads, worker_threads->workers, num_rows,
+          cost_per_row, reduce);
+  }
+
+ protected:
+  // Ids of the EmbeddingVariable for `sp_values`.
+  virtual Status ToIds(OpKernelContext* c, const Tensor& sp_values,
+                       Tensor* ids) {
+    *ids = sp_values;
+    return Status::OK();
+  }
+
+ private:
+  Combiner combiner_;
+  bool serial_ = false;
+  int64 partition_size_ = 0;
+  int64 unique_ratio_hint_ = kDefaultUniqueRatioHint;
+  UniqueMaps map_flag_ = GOOGLE;
+  std::unique_ptr<UniqueAlgorithmSelector> selector_;
+};
+
+#define REGISTER_KERNELS(ktype, vtype)                                \
+  REGISTER_KERNEL_BUILDER(Name("KvResourceEmbeddingLookupSparse")     \
+                              .Device(DEVICE_CPU)                     \
+                              .TypeConstraint<vtype>("dtype")         \
+                              .TypeConstraint<ktype>("Tkeys"),        \
+                          KvResourceEmbeddingLookupSparseOp<ktype, vtype>)
+#define REGISTER_KERNELS_ALL_INDEX(type) \
+  REGISTER_KERNELS(int32, type);         \
+  REGISTER_KERNELS(int64, type)
+TF_CALL_float(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_double(REGISTER_KERNELS_ALL_INDEX);
+#undef REGISTER_KERNELS_ALL_INDEX
+#undef REGISTER_KERNELS
+
+// KvResourceEmbeddingLookupSparse of string features, the strings are hashed
+// into int64 ids the same way as StringToHash64, without the modulo of
+// StringToHashBucketFast, so the ids keep the whole key space of the
+// EmbeddingVariable and no intermediate id tensor is passed between ops.
+template <typename TValue>
+class KvResourceStringEmbeddingLookupSparseOp
+    : public KvResourceEmbeddingLookupSparseOp<int64, TValue> {
+ public:
+  explicit KvResourceStringEmbeddingLookupSparseOp(OpKernelConstruction* c)
+      : KvResourceEmbeddingLookupSparseOp<int64, TValue>(c) {}
+
+ protected:
+  Status ToIds(OpKernelContext* c, const Tensor& sp_values,
+               Tensor* ids) override {
+    TF_RETURN_IF_ERROR(c->allocate_temp(DT_INT64, sp_values.shape(), ids));
+    const string* input = sp_values.flat<string>().data();
+    int64* output = ids->flat<int64>().data();
+    auto hash = [input, output](int64 start, int64 limit) {
+      StringToHash64Range<Fingerprint64>(input, output, start, limit);
+    };
+    auto worker_threads = c->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers,
+          sp_values.NumElements(), kStringToHash64ElementCost, hash);
+    return Status::OK();
+  }
+};
+
+#define REGISTER_KERNELS(vtype)                                          \
+  REGISTER_KERNEL_BUILDER(Name("KvResourceStringEmbeddingLookupSparse")  \
+                              .Device(DEVICE_CPU)                        \
+                              .TypeConstraint<vtype>("dtype"),           \
+                          KvResourceStringEmbeddingLookupSparseOp<vtype>)
+TF_CALL_float(REGISTER_KERNELS);
+TF_CALL_double(REGISTER_KERNELS);
+#undef REGISTER_KERNELS
+
+// Accumulates the gradient of every output row into the rows of the distinct
+// ids it was reduced from, the result can be applied to the EmbeddingVariable
+// by KvResourceSparseApply* with `unique_keys` as indices.
+template <typename TKey, typename TValue>
+class KvResourceEmbeddingLookupSparseGradOp : public OpKernel {
+ public:
+  explicit KvResourceEmbeddingLookupSparseGradOp(OpKernelConstruction* c)
+      : OpKernel(c) {
+    string combiner_str;
+    OP_REQUIRES_OK(c, c->GetAttr("combiner", &combiner_str));
+    OP_REQUIRES_OK(c, ParseCombiner(combiner_str, &combiner_));
+  }
+
+  void Compute(OpKernelContext* c) override {
+    const Tensor& grad = c->input(0);
+    const Tensor& sp_indices = c->input(1);
+    const Tensor& unique_keys = c->input(2);
+    const Tensor& unique_idx = c->input(3);
+    OP_REQUIRES(c, TensorShapeUtils::IsMatrix(grad.shape()),
+                errors::InvalidArgument("gradients must be a matrix, got ",
+                                        grad.shape().DebugString()));
+    OP_REQUIRES(c, TensorShapeUtils::IsMatrix(sp_indices.shape()) &&
+                   sp_indices.dim_size(0) == unique_idx.NumElements(),
+                errors::InvalidArgument(
+                    "sp_indices and unique_idx must have the same number of "
+                    "rows, got ", sp_indices.shape().DebugString(), " and ",
+                    unique_idx.shape().DebugString()));
+    const int64 N = unique_idx.NumElements();
+    const int64 num_rows = grad.dim_size(0);
+    const int64 value_len = grad.dim_size(1);
+    const int64 num_unique = unique_keys.NumElements();
+
+    Tensor* out = nullptr;
+    OP_REQUIRES_OK(c, c->allocate_output(
+        0, TensorShape({num_unique, value_len}), &out));
+    if (num_unique == 0) return;
+
+    auto indices = sp_indices.matrix<int64>();
+    auto idx_flat = unique_idx.flat<int32>();
+    std::vector<int64> row_counts(num_rows, 0);
+    for (int64 i = 0; i < N; ++i) {
+      OP_REQUIRES(c, FastBoundsCheck(indices(i, 0), num_rows),
+                  errors::InvalidArgument("sp_indices[", i, ", 0] = ",
+                                          indices(i, 0), " is not in [0, ",
+                                          num_rows, ")"));
+      OP_REQUIRES(c, FastBoundsCheck(idx_flat(i), num_unique),
+                  errors::InvalidArgument("unique_idx[", i, "] = ",
+                                          idx_flat(i), " is not in [0, ",
+                                          num_unique, ")"));
+      ++row_counts[indices(i, 0)];
+    }
+    std::vector<TValue> row_scale(num_rows);
+    for (int64 row = 0; row < num_rows; ++row) {
+      row_scale[row] = CombinerScale<TValue>(combiner_, row_counts[row]);
+    }
+
+    // Group the values by their distinct id, so that every output row is
+    // written by one shard only.
+    std::vector<int64> unique_offsets;
+    std::vector<int32> positions;
+    BuildSegments(N, num_unique, [idx_flat](int64 i) { return idx_flat(i); },
+                  &unique_offsets, &positions);
+
+    const TValue* grad_base = grad.flat<TValue>().data();
+    TValue* out_base = out->flat<TValue>().data();
+    auto accumulate = [&unique_offsets, &positions, &row_scale, indices,
+                       grad_base, out_base, value_len](int64 start,
+                                                       int64 limit) {
+      for (int64 u = start; u < limit; ++u) {
+        TValue* dst = out_base + u * value_len;
+        std::fill(dst, dst + value_len, static_cast<TValue>(0));
+        for (int64 k = unique_offsets[u]; k < unique_offsets[u + 1]; ++k) {
+          const int64 row = indices(positions[k], 0);
+          const TValue* src = grad_base + row * value_len;
+          const TValue scale = row_scale[row];
+          for (int64 j = 0; j < value_len; ++j) {
+            dst[j] += src[j] * scale;
+          }
+        }
+      }
+    };
+    auto worker_threads = c->device()->tensorflow_cpu_worker_threads();
+    const int64 cost_per_unique =
+        std::max<int64>(1, N / num_unique) * value_len * sizeof(TValue);
+    Shard(worker_threads->num_threads, worker_threads->workers, num_unique,
+          cost_per_unique, accumulate);
+  }
+
+ private:
+  Combiner combiner_;
+};
+
+#define REGISTER_KERNELS(ktype, vtype)                                  \
+  REGISTER_KERNEL_BUILDER(Name("KvResourceEmbeddingLookupSparseGrad")   \
+                              .Device(DEVICE_CPU)                       \
+                              .TypeConstraint<vtype>("dtype")           \
+                              .TypeConstraint<ktype>("Tkeys"),          \
+                          KvResourceEmbeddingLookupSparseGradOp<ktype, vtype>)
+#define REGISTER_KERNELS_ALL_INDEX(type) \
+  REGISTER_KERNELS(int32, type);         \
+  REGISTER_KERNELS(int64, type)
+TF_CALL_float(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_double(REGISTER_KERNELS_ALL_INDEX);
+#undef REGISTER_KERNELS_ALL_INDEX
+#undef REGISTER_KERNELS
+
+}  // namespace tensorflow
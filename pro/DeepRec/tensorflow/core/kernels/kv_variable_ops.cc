@@ -19,9 +19,13 @@ limitations under the License.
 #define EIGEN_USE_GPU
 #endif
 
+#include <atomic>
+#include <memory>
+
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/embedding/cache.h"
 #include "tensorflow/core/framework/embedding/config.pb.h"
+#include "tensorflow/core/framework/embedding/numa_placement.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/resource_mgr.h"
@@ -62,6 +66,10 @@ const int64 kInitializableEmbeddingVarUseDB = -215;
                           ResourceHandleOp<EmbeddingVar<ktype, vtype>>);
 REGISTER_KV_VAR_HANDLE(int32, float)
 REGISTER_KV_VAR_HANDLE(int64, float)
+REGISTER_KV_VAR_HANDLE(int32, bfloat16)
+REGISTER_KV_VAR_HANDLE(int64, bfloat16)
+REGISTER_KV_VAR_HANDLE(int32, Eigen::half)
+REGISTER_KV_VAR_HANDLE(int64, Eigen::half)
 #undef REGISTER_KV_VAR_HANDLE
 
 template <typename T, typename TKey, typename TValue>
@@ -87,14 +95,73 @@ class KvVariableShapeOp : public OpKernel {
   REGISTER_KERNEL_BUILDER(                                            \
       Name("KvVariableShape").Device(DEVICE_CPU)                      \
                              .TypeConstraint<type>("out_type")        \
-                             .TypeConstraint<ktype>("Tkeys"),         \
+                             .TypeConstraint<ktype>("Tkeys")          \
+                             .TypeConstraint<vtype>("dtype"),         \
                              KvVariableShapeOp<type, ktype, vtype>);
-REGISTER_KV_VARIABLE_SHAPE(int32, int32, float)
-REGISTER_KV_VARIABLE_SHAPE(int32, int64, float)
-REGISTER_KV_VARIABLE_SHAPE(int64, int32, float)
-REGISTER_KV_VARIABLE_SHAPE(int64, int64, float)
+#define REGISTER_KV_VARIABLE_SHAPE_ALL(vtype)                         \
+  REGISTER_KV_VARIABLE_SHAPE(int32, int32, vtype)                     \
+  REGISTER_KV_VARIABLE_SHAPE(int32, int64, vtype)                     \
+  REGISTER_KV_VARIABLE_SHAPE(int64, int32, vtype)                     \
+  REGISTER_KV_VARIABLE_SHAPE(int64, int64, vtype)
+TF_CALL_half(REGISTER_KV_VARIABLE_SHAPE_ALL);
+TF_CALL_bfloat16(REGISTER_KV_VARIABLE_SHAPE_ALL);
+TF_CALL_float(REGISTER_KV_VARIABLE_SHAPE_ALL);
+#undef REGISTER_KV_VARIABLE_SHAPE_ALL
 #undef REGISTER_KV_VARIABLE_SHAPE
 
+template <typename TKey, typename TValue>
+class KvResourceStatisticsOp : public OpKernel {
+ public:
+  explicit KvResourceStatisticsOp(OpKernelConstruction* c) : OpKernel(c) {}
+
+  void Compute(OpKernelContext* ctx) override {
+    EmbeddingVar<TKey, TValue>* ev = nullptr;
+    OP_REQUIRES_OK(ctx, LookupResource(ctx, HandleFromInput(ctx, 0), &ev));
+    core::ScopedUnref unref_me(ev);
+    embedding::EmbeddingStats<TKey>* stats = ev->storage_manager()->Stats();
+
+    Tensor* statistics = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(
+        0, TensorShape({embedding::kNumEmbeddingStatistics}), &statistics));
+    auto statistics_flat = statistics->flat<int64>();
+    std::vector<std::pair<TKey, int64>> hot_ids;
+    if (stats) {
+      stats->GetStatistics(statistics_flat.data());
+      stats->GetHotIds(&hot_ids);
+    } else {
+      statistics_flat.setZero();
+    }
+
+    const int64 num_hot_ids = hot_ids.size();
+    Tensor* hot_keys = nullptr;
+    Tensor* hot_counts = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(
+        1, TensorShape({num_hot_ids}), &hot_keys));
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(
+        2, TensorShape({num_hot_ids}), &hot_counts));
+    auto hot_keys_flat = hot_keys->flat<TKey>();
+    auto hot_counts_flat = hot_counts->flat<int64>();
+    for (int64 i = 0; i < num_hot_ids; ++i) {
+      hot_keys_flat(i) = hot_ids[i].first;
+      hot_counts_flat(i) = hot_ids[i].second;
+    }
+  }
+};
+
+#define REGISTER_KV_RESOURCE_STATISTICS(ktype, vtype)                 \
+  REGISTER_KERNEL_BUILDER(                                            \
+      Name("KvResourceStatistics").Device(DEVICE_CPU)                 \
+                                  .TypeConstraint<ktype>("Tkeys")     \
+                                  .TypeConstraint<vtype>("dtype"),    \
+                                  KvResourceStatisticsOp<ktype, vtype>);
+REGISTER_KV_RESOURCE_STATISTICS(int32, float)
+REGISTER_KV_RESOURCE_STATISTICS(int64, float)
+REGISTER_KV_RESOURCE_STATISTICS(int32, bfloat16)
+REGISTER_KV_RESOURCE_STATISTICS(int64, bfloat16)
+REGISTER_KV_RESOURCE_STATISTICS(int32, Eigen::half)
+REGISTER_KV_RESOURCE_STATISTICS(int64, Eigen::half)
+#undef REGISTER_KV_RESOURCE_STATISTICS
+
 class DestroyKvResourceOp : public OpKernel {
  public:
   explicit DestroyKvResourceOp(OpKernelConstruction* ctx) : OpKernel(ctx) {
@@ -319,6 +386,8 @@ class InitializeKvVariableOp : public OpKernel {
   REGISTER_KERNELS(int32, T);     \
   REGISTER_KERNELS(int64, T);
 
+TF_CALL_half(REGISTER_CPU_KERNELS);
+TF_CALL_bfloat16(REGISTER_CPU_KERNELS);
 TF_CALL_float(REGISTER_CPU_KERNELS);
 TF_CALL_double(REGISTER_CPU_KERNELS);
 #undef REGISTER_CPU_KERNELS
@@ -348,16 +417,25 @@ class KvResourceIsInitializedOp : public OpKernel {
 #define REGISTER_KERNELS(ktype, vtype)                             \
   REGISTER_KERNEL_BUILDER(Name("KvVarIsInitializedOp")             \
                           .TypeConstraint<ktype>("Tkeys")          \
+                          .TypeConstraint<vtype>("dtype")          \
                           .Device(DEVICE_CPU),                     \
                           KvResourceIsInitializedOp<ktype, vtype>);
 REGISTER_KERNELS(int32, float)
 REGISTER_KERNELS(int64, float)
+REGISTER_KERNELS(int32, bfloat16)
+REGISTER_KERNELS(int64, bfloat16)
+REGISTER_KERNELS(int32, Eigen::half)
+REGISTER_KERNELS(int64, Eigen::half)
 #undef REGISTER_KERNELS
 
+// For a multi-level EV the ids in the first tier are gathered in parallel
+// while the rows of the other ids are read from the lower tier with one
+// batched lookup. Those ids are gathered once the read is done, new ids
+// with their default values. Enabled by 'TF_ENABLE_EV_ASYNC_GATHER'.
 template <typename TKey, typename TValue>
-class KvResourceGatherOp : public OpKernel {
+class KvResourceGatherOp : public AsyncOpKernel {
  public:
-  explicit KvResourceGatherOp(OpKernelConstruction* c) : OpKernel(c) {
+  explicit KvResourceGatherOp(OpKernelConstruction* c) : AsyncOpKernel(c) {
     OP_REQUIRES_OK(c,
         c->GetAttr("is_use_default_value_tensor",
           &is_use_default_value_tensor_));
@@ -381,11 +459,14 @@ class KvResourceGatherOp : public OpKernel {
         return 1;
       };
     }
+    TF_CHECK_OK(ReadBoolFromEnvVar("TF_ENABLE_EV_ASYNC_GATHER", true,
+                                   &async_gather_));
   }
 
-  void Compute(OpKernelContext* c) override {
+  void ComputeAsync(OpKernelContext* c, DoneCallback done) override {
     EmbeddingVar<TKey, TValue>* ev = nullptr;
-    OP_REQUIRES_OK(c, LookupResource(c, HandleFromInput(c, 0), &ev));
+    OP_REQUIRES_OK_ASYNC(c, LookupResource(c, HandleFromInput(c, 0), &ev),
+                         done);
     core::ScopedUnref unref_me(ev);
     const Tensor& indices = c->input(1);
     const int64 N = indices.NumElements();
@@ -395,62 +476,178 @@ class KvResourceGatherOp : public OpKernel {
     result_shape.AppendShape(value_shape);
 
     Tensor* out = nullptr;
-    OP_REQUIRES_OK(c, c->allocate_output(0, result_shape, &out));
+    OP_REQUIRES_OK_ASYNC(c, c->allocate_output(0, result_shape, &out), done);
+    if (N == 0) {
+      done();
+      return;
+    }
 
     int32* counts = nullptr;
     if (c->num_inputs() == 4)
       counts = (int32*)c->input(3).data();
 
-    if (N > 0) {
-      auto out_flat = out->shaped<TValue, 2>({N, out->NumElements() / N});
-      TValue* out_base = &out_flat(0, 0);
+    auto out_flat = out->shaped<TValue, 2>({N, out->NumElements() / N});
+    TValue* out_base = &out_flat(0, 0);
 
-      auto indices_flat = indices.flat<TKey>();
-      const int64 indices_size = static_cast<int64>(indices_flat.dimension(0));
-      const int64 slice_elems = out_flat.dimension(1);
-      TValue* default_v = nullptr;
-      if (is_use_default_value_tensor_) {
-        default_v = (TValue*)c->input(2).data();
-      } else {
-        default_v = ev->GetDefaultValuePtr();
+    auto indices_flat = indices.flat<TKey>();
+    const int64 slice_elems = out_flat.dimension(1);
+    TValue* default_v = nullptr;
+    if (is_use_default_value_tensor_) {
+      default_v = (TValue*)c->input(2).data();
+    } else {
+      default_v = ev->GetDefaultValuePtr();
+    }
+    OP_REQUIRES_ASYNC(c, ev->ValueLen() == slice_elems,
+        errors::InvalidArgument(
+            "ev's value_len should same with output's dimension(1)",
+            std::to_string(slice_elems), std::to_string(ev->ValueLen())),
+        done);
+    if (ev->IsMultiLevel() && ev->CacheSize() < N &&
+        !warned_cache_size_.exchange(true)) {
+      LOG(WARNING) << "MultiLevel EV's Cache size " << ev->CacheSize()
+                   << " is less than IDs in batch " << N
+                   << ", the cache exceeds its size while the batch is"
+                   << " gathered.";
+    }
+    // The rows of the batch are not evicted while they are gathered, even
+    // if the batch is larger than the cache, nor freed by the incremental
+    // shrink.
+    embedding::StorageManager<TKey, TValue>* storage_manager =
+        ev->storage_manager();
+    const int64 epoch = storage_manager->PinIds(indices_flat.data(), N);
+    const size_t slice_bytes = slice_elems * sizeof(TValue);
+    embedding::EmbeddingStats<TKey>* stats = ev->storage_manager()->Stats();
+    auto lookup = [this, indices_flat, out_base, slice_elems, default_v, ev,
+                   counts, stats](int64 i) {
+      TValue* default_v_ptr = get_default_v_fn_(
+          default_v, indices_flat(i), i, ev->GetDefaultValueDim(),
+          ev->ValueLen());
+      int32 count = get_count_fn_(counts, i);
+      ev->LookupOrCreate(indices_flat(i),
+          out_base + i * slice_elems, default_v_ptr, count);
+      if (stats) stats->RecordId(indices_flat(i), count);
+    };
+    if (stats) {
+      // Ids of KvResourceGatherV1 are deduplicated and counted by
+      // UniqueWithCounts, otherwise duplicates are not known here.
+      int64 num_ids = N;
+      if (counts) {
+        num_ids = 0;
+        for (int64 i = 0; i < N; ++i) num_ids += counts[i];
       }
-      OP_REQUIRES(c, ev->ValueLen() == slice_elems,
-          errors::InvalidArgument(
-              "ev's value_len should same with output's dimension(1)",
-              std::to_string(slice_elems), std::to_string(ev->ValueLen())));
-      OP_REQUIRES(c, !ev->IsMultiLevel() || (ev->IsMultiLevel() && ev->CacheSize() >= N),
-          errors::InvalidArgument(
-              "MultiLevel EV's Cache size ", ev->CacheSize(),
-              " should large than IDs in batch ", N));
-      const size_t slice_bytes = slice_elems * sizeof(TValue);
-      auto do_work = [this, indices_flat,
-           out_base, slice_elems, c, default_v, ev, counts] (
-               int64 start, int64 limit) {
+      stats->RecordBatch(num_ids, N);
+    }
+
+    auto worker_threads = c->device()->tensorflow_cpu_worker_threads();
+    std::vector<int64> hits;
+    std::shared_ptr<std::vector<int64>> misses(new std::vector<int64>());
+    if (ev->IsMultiLevel() && async_gather_) {
+      std::vector<char> in_first_tier(N);
+      Shard(worker_threads->num_threads, worker_threads->workers, N,
+            100 /* cost */,
+            [ev, indices_flat, &in_first_tier](int64 start, int64 limit) {
         for (int64 i = start; i < limit; ++i) {
-          TValue* default_v_ptr = get_default_v_fn_(
-              default_v, indices_flat(i), i, ev->GetDefaultValueDim(),
-              ev->ValueLen());
-          int32 count = get_count_fn_(counts, i);
-          ev->LookupOrCreate(indices_flat(i),
-              out_base + i * slice_elems, default_v_ptr, count);
+          in_first_tier[i] = ev->IsInFirstTier(indices_flat(i));
         }
-      };
+      });
+      for (int64 i = 0; i < N; ++i) {
+        if (in_first_tier[i]) {
+          hits.push_back(i);
+        } else {
+          misses->push_back(i);
+        }
+      }
+    }
+
+    if (misses->empty()) {
+      embedding::ShardByNode(ev->GetNumaPlacement(),
+          worker_threads->num_threads, worker_threads->workers,
+          indices_flat.data(), N, slice_bytes,
+          [&lookup](int64 start, int64 limit) {
+        for (int64 i = start; i < limit; ++i) {
+          lookup(i);
+        }
+      });
+      ScheduleRank(ev, indices);
+      storage_manager->UnpinIds(indices_flat.data(), N, epoch);
+      done();
+      return;
+    }
+
+    // The read of the misses and the gather of the hits run concurrently,
+    // the last one to finish unpins the batch and calls done. The ev is
+    // referenced by both until they finish.
+    std::shared_ptr<std::atomic<int>> pending(new std::atomic<int>(2));
+    auto finish = [done, pending, storage_manager, indices, N, epoch]() {
+      if (pending->fetch_sub(1) == 1) {
+        storage_manager->UnpinIds(indices.flat<TKey>().data(), N, epoch);
+        done();
+      }
+    };
+    Tensor miss_keys = GetKeys(indices_flat, *misses);
+    ev->Ref();
+    worker_threads->workers->Schedule(
+        [c, ev, lookup, misses, miss_keys, slice_bytes, finish]() {
+      core::ScopedUnref unref_me(ev);
+      const int64 num_misses = misses->size();
+      Status s = ev->BatchPromote(miss_keys.flat<TKey>().data(), num_misses);
+      if (!s.ok()) {
+        c->SetStatus(s);
+        finish();
+        return;
+      }
       auto worker_threads = c->device()->tensorflow_cpu_worker_threads();
-      Shard(worker_threads->num_threads,
-          worker_threads->workers, indices_size,
-          slice_bytes, do_work);
-          
-      ev->storage_manager()->Schedule([ev, indices]() {
-        embedding::BatchCache<TKey>* cache = ev->Cache();
-        if (cache) {
-          cache->add_to_rank(indices);
+      Shard(worker_threads->num_threads, worker_threads->workers,
+            num_misses, slice_bytes,
+            [&lookup, &misses](int64 start, int64 limit) {
+        for (int64 i = start; i < limit; ++i) {
+          lookup((*misses)[i]);
+        }
+      });
+      ScheduleRank(ev, miss_keys);
+      finish();
+    });
+
+    if (!hits.empty()) {
+      Shard(worker_threads->num_threads, worker_threads->workers,
+            hits.size(), slice_bytes, [&lookup, &hits](int64 start,
+                                                       int64 limit) {
+        for (int64 i = start; i < limit; ++i) {
+          lookup(hits[i]);
         }
       });
+      // The misses are ranked once they are in the first tier, otherwise
+      // the eviction could skip them.
+      ScheduleRank(ev, GetKeys(indices_flat, hits));
     }
+    finish();
   }
 
   private:
+    static Tensor GetKeys(typename TTypes<TKey>::ConstFlat indices_flat,
+                          const std::vector<int64>& index) {
+      Tensor keys(DataTypeToEnum<TKey>::v(),
+                  TensorShape({static_cast<int64>(index.size())}));
+      auto keys_flat = keys.flat<TKey>();
+      for (int64 i = 0; i < keys_flat.size(); ++i) {
+        keys_flat(i) = indices_flat(index[i]);
+      }
+      return keys;
+    }
+
+    static void ScheduleRank(EmbeddingVar<TKey, TValue>* ev,
+                             const Tensor& keys) {
+      ev->storage_manager()->Schedule([ev, keys]() {
+        embedding::BatchCache<TKey>* cache = ev->Cache();
+        if (cache) {
+          cache->add_to_rank(keys);
+        }
+      });
+    }
+
     bool is_use_default_value_tensor_;
+    bool async_gather_;
+    std::atomic<bool> warned_cache_size_{false};
     std::function<
       TValue*(TValue*, TKey, int64, int64, int64)> get_default_v_fn_;
     std::function<int32(int32*, int64)> get_count_fn_;
@@ -474,6 +671,8 @@ class KvResourceGatherOp : public OpKernel {
 #define REGISTER_GATHER_CPU(type) REGISTER_GATHER_ALL_INDICES(CPU, type)
 
 // Registration of the CPU implementations.
+TF_CALL_half(REGISTER_GATHER_CPU);
+TF_CALL_bfloat16(REGISTER_GATHER_CPU);
 TF_CALL_float(REGISTER_GATHER_CPU);
 TF_CALL_double(REGISTER_GATHER_CPU);
 //TF_CALL_QUANTIZED_TYPES(REGISTER_GATHER_CPU);
@@ -501,6 +700,8 @@ TF_CALL_double(REGISTER_GATHER_CPU);
 #define REGISTER_GATHER_CPU(type) REGISTER_GATHER_ALL_INDICES(CPU, type)
 
 // Registration of the CPU implementations.
+TF_CALL_half(REGISTER_GATHER_CPU);
+TF_CALL_bfloat16(REGISTER_GATHER_CPU);
 TF_CALL_float(REGISTER_GATHER_CPU);
 TF_CALL_double(REGISTER_GATHER_CPU);
 //TF_CALL_QUANTIZED_TYPES(REGISTER_GATHER_CPU);
@@ -508,6 +709,59 @@ TF_CALL_double(REGISTER_GATHER_CPU);
 #undef REGISTER_GATHER_CPU
 #undef REGISTER_GATHER_ALL_INDICES
 #undef REGISTER_GATHER_FULL
+
+template <typename TKey, typename TValue>
+class KvResourcePrefetchOp : public OpKernel {
+ public:
+  explicit KvResourcePrefetchOp(OpKernelConstruction* c) : OpKernel(c) {}
+
+  void Compute(OpKernelContext* c) override {
+    EmbeddingVar<TKey, TValue>* ev = nullptr;
+    OP_REQUIRES_OK(c, LookupResource(c, HandleFromInput(c, 0), &ev));
+    core::ScopedUnref unref_me(ev);
+    const Tensor& indices = c->input(1);
+    const int64 N = indices.NumElements();
+    if (N > 0) {
+      auto indices_flat = indices.flat<TKey>();
+      // The promoted rows are not freed by the incremental shrink while
+      // they are moved.
+      embedding::ScopedEpoch<TKey, TValue> epoch(ev->storage_manager());
+      auto do_work = [c, ev, indices_flat] (int64 start, int64 limit) {
+        OP_REQUIRES_OK(c, ev->BatchPrefetch(&indices_flat(start),
+                                            limit - start));
+      };
+      auto worker_threads = c->device()->tensorflow_cpu_worker_threads();
+      Shard(worker_threads->num_threads,
+          worker_threads->workers, N,
+          ev->ValueLen() * sizeof(TValue), do_work);
+      // Rank the ids as recently used, so that they are not evicted from
+      // the first tier before the lookup.
+      ev->storage_manager()->Schedule([ev, indices]() {
+        embedding::BatchCache<TKey>* cache = ev->Cache();
+        if (cache) {
+          cache->add_to_rank(indices);
+        }
+      });
+    }
+    c->set_output(0, indices);
+  }
+};
+
+#define REGISTER_KERNELS(ktype, vtype)                         \
+  REGISTER_KERNEL_BUILDER(Name("KvResourcePrefetch")           \
+                              .Device(DEVICE_CPU)              \
+                              .TypeConstraint<vtype>("dtype")  \
+                              .TypeConstraint<ktype>("Tkeys"), \
+                          KvResourcePrefetchOp<ktype, vtype>)
+#define REGISTER_KERNELS_ALL_INDEX(type)                       \
+  REGISTER_KERNELS(int32, type)                                \
+  REGISTER_KERNELS(int64, type)
+TF_CALL_half(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_bfloat16(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_float(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_double(REGISTER_KERNELS_ALL_INDEX);
+#undef REGISTER_KERNELS_ALL_INDEX
+#undef REGISTER_KERNELS
 /*
 // Op that outputs tensors of all keys and all values.
 template <typename TKey, typename TValue>
@@ -755,6 +1009,17 @@ class KvResourceImportV2Op: public AsyncOpKernel {
 
     auto do_compute = [this, context, file_name_string, ev,
          name_string, done] () {
+      if (ev->storage_manager()->IsRecovered()) {
+        // The checkpoint may be newer than the rows left in PMem, e.g. if
+        // it comes from another job, remove the PMem files to restore it.
+        LOG(WARNING) << "EV " << name_string << " is reattached to "
+                     << "persistent PMem, the checkpoint "
+                     << file_name_string << " is NOT restored. Remove the "
+                     << "PMem file and its EV index to restore it.";
+        ev->SetInitialized();
+        done();
+        return;
+      }
       BundleReader reader(Env::Default(), file_name_string);
       auto s = reader.status();
       if (!s.ok()) {
@@ -815,6 +1080,8 @@ class KvResourceImportV2Op: public AsyncOpKernel {
 #define REGISTER_KERNELS_ALL_INDEX(type)                       \
   REGISTER_KERNELS(int32, type)                                \
   REGISTER_KERNELS(int64, type)
+TF_CALL_half(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_bfloat16(REGISTER_KERNELS_ALL_INDEX);
 TF_CALL_float(REGISTER_KERNELS_ALL_INDEX);
 TF_CALL_double(REGISTER_KERNELS_ALL_INDEX);
 //TF_CALL_QUANTIZED_TYPES(REGISTER_KERNELS_ALL_INDEX);
@@ -888,6 +1155,8 @@ class KvResourceIncrImportOp: public AsyncOpKernel {
 #define REGISTER_KERNELS_ALL_INDEX(type)                       \
   REGISTER_KERNELS(int32, type)                                \
   REGISTER_KERNELS(int64, type)
+TF_CALL_half(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_bfloat16(REGISTER_KERNELS_ALL_INDEX);
 TF_CALL_float(REGISTER_KERNELS_ALL_INDEX);
 TF_CALL_double(REGISTER_KERNELS_ALL_INDEX);
 //TF_CALL_QUANTIZED_TYPES(REGISTER_KERNELS_ALL_INDEX);
@@ -909,6 +1178,9 @@ class KvResourceExportOp : public OpKernel {
     std::vector<int64> tot_version_list;
     std::vector<int64> tot_freq_list;
     embedding::Iterator* it = nullptr;
+    // The values are read through raw pointers until they are copied to
+    // the outputs, the rows are not freed by the incremental shrink.
+    embedding::ScopedEpoch<TKey, TValue> epoch(ev->storage_manager());
     int64 total_size = ev->GetSnapshot(
         &tot_key_list, &tot_valueptr_list, &tot_version_list,
         &tot_freq_list, &it);
@@ -962,7 +1234,9 @@ class KvResourceExportOp : public OpKernel {
   REGISTER_KERNELS(int32, type)                                \
   REGISTER_KERNELS(int64, type)
 
-REGISTER_KERNELS_ALL_INDEX(float);
+TF_CALL_half(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_bfloat16(REGISTER_KERNELS_ALL_INDEX);
+TF_CALL_float(REGISTER_KERNELS_ALL_INDEX);
 
 #undef REGISTER_KERNELS_ALL_INDEX
 #undef REGISTER_KERNELS
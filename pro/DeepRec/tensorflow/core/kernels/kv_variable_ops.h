@@ -183,6 +183,9 @@ Status DumpEmbeddingValues(EmbeddingVar<K, V>* ev,
   std::vector<int64> tot_version_filter_list;
   embedding::Iterator* it = nullptr;
   mutex_lock l(*ev->storage_manager()->get_mutex());
+  // The values are written through raw pointers, the rows are not freed by
+  // the incremental shrink until they are dumped.
+  embedding::ScopedEpoch<K, V> epoch(ev->storage_manager());
   int64 total_size = ev->GetSnapshot(&tot_key_list,
       &tot_valueptr_list, &tot_version_list, &tot_freq_list, &it);
   VLOG(1) << "EV:" << tensor_key << ", save size:" << total_size;
@@ -636,6 +639,9 @@ Status EVRestoreNoPartition(EmbeddingVar<K, V>* ev, BundleReader* reader,
   int64 tot_key_num = key_shape.dim_size(0);
   size_t value_unit_bytes = sizeof(V) *  value_shape.dim_size(1);
   std::string key_str = "|";
+  // Size the hash table for the restored keys at once.
+  ev->storage_manager()->Reserve(tot_key_num +
+      (restore_filter_flag ? key_filter_shape.dim_size(0) : 0));
   while(tot_key_num > 0) {
     size_t read_key_num = std::min(
         std::min(buffer_size / sizeof(K),
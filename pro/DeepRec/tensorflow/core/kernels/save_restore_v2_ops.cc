@@ -118,6 +118,19 @@ class SaveV2 : public OpKernel {
     }
   }
 
+  template <typename TValue>
+  void DumpEvWithKeyType(OpKernelContext* context, int variable_index,
+      const string& tensor_name, BundleWriter& writer,
+      DataType key_type, DataType global_step_type) {
+    if (key_type == DT_INT32) {
+      DumpEvWithGlobalStep<int32, TValue>(context, variable_index,
+          tensor_name, writer, global_step_type);
+    } else if (key_type == DT_INT64) {
+      DumpEvWithGlobalStep<int64, TValue>(context, variable_index,
+          tensor_name, writer, global_step_type);
+    }
+  }
+
   template <typename TKey, typename TValue, typename TGlobalStep>
   void DumpEv(OpKernelContext* context, int variable_index,
       const string& tensor_name, BundleWriter& writer) {
@@ -169,13 +182,15 @@ class SaveV2 : public OpKernel {
       if (tensor_types_[i] == DT_RESOURCE) {
         auto& handle = HandleFromInput(context, i + kFixedInputs);
         if (IsHandle<EmbeddingVar<int64, float>>(handle)) {
-          if (ev_key_types_[start_ev_key_index] == DT_INT32) {
-            DumpEvWithGlobalStep<int32, float>(context,
-                i + kFixedInputs, tensor_name, writer, tensor_types_[0]);
-          } else if (ev_key_types_[start_ev_key_index] == DT_INT64) {
-            DumpEvWithGlobalStep<int64, float>(context,
-                i + kFixedInputs, tensor_name, writer, tensor_types_[0]);
-          }
+          DumpEvWithKeyType<float>(context, i + kFixedInputs, tensor_name,
+              writer, ev_key_types_[start_ev_key_index], tensor_types_[0]);
+        } else if (IsHandle<EmbeddingVar<int64, bfloat16>>(handle)) {
+          DumpEvWithKeyType<bfloat16>(context, i + kFixedInputs, tensor_name,
+              writer, ev_key_types_[start_ev_key_index], tensor_types_[0]);
+        } else if (IsHandle<EmbeddingVar<int64, Eigen::half>>(handle)) {
+          DumpEvWithKeyType<Eigen::half>(context, i + kFixedInputs,
+              tensor_name, writer, ev_key_types_[start_ev_key_index],
+              tensor_types_[0]);
         } else if (IsHandle<HashTableResource>(handle)) {
           auto handles = context->input(i + kFixedInputs).flat<ResourceHandle>();
           int tensible_size = handles.size() - 1;
@@ -165,6 +165,8 @@ TF_CALL_REAL_NUMBER_TYPES(REGISTER_CPU_SPARSE_KERNELS);
           .TypeConstraint<type>("T")                                         \
           .TypeConstraint<int32>("Tidx"),                                    \
       SparseSegmentReductionMeanWithNumSegmentsAliOp<CPUDevice, type>);
+REGISTER_CPU_SPARSE_KERNELS(Eigen::half);
+REGISTER_CPU_SPARSE_KERNELS(bfloat16);
 REGISTER_CPU_SPARSE_KERNELS(float);
 REGISTER_CPU_SPARSE_KERNELS(double);
 #undef REGISTER_CPU_SPARSE_KERNELS
@@ -181,6 +183,8 @@ REGISTER_CPU_SPARSE_KERNELS(double);
           .TypeConstraint<type>("T")                                          \
           .TypeConstraint<int32>("Tidx"),                                     \
       SparseSegmentReductionSqrtNWithNumSegmentsAliOp<CPUDevice, type>);
+REGISTER_CPU_SPARSE_KERNELS(Eigen::half);
+REGISTER_CPU_SPARSE_KERNELS(bfloat16);
 REGISTER_CPU_SPARSE_KERNELS(float);
 REGISTER_CPU_SPARSE_KERNELS(double);
 #undef REGISTER_CPU_SPARSE_KERNELS
@@ -235,6 +239,8 @@ class SparseSegmentSqrtNGradAliOp : public SparseSegmentGradAliOpBase<T> {
                               .TypeConstraint<type>("T")      \
                               .TypeConstraint<int32>("Tidx"), \
                           SparseSegmentMeanGradAliOp<type>);
+REGISTER_CPU_SPARSE_KERNELS(Eigen::half);
+REGISTER_CPU_SPARSE_KERNELS(bfloat16);
 REGISTER_CPU_SPARSE_KERNELS(float);
 REGISTER_CPU_SPARSE_KERNELS(double);
 #undef REGISTER_CPU_SPARSE_KERNELS
@@ -245,6 +251,8 @@ REGISTER_CPU_SPARSE_KERNELS(double);
                               .TypeConstraint<type>("T")      \
                               .TypeConstraint<int32>("Tidx"), \
                           SparseSegmentSqrtNGradAliOp<type>);
+REGISTER_CPU_SPARSE_KERNELS(Eigen::half);
+REGISTER_CPU_SPARSE_KERNELS(bfloat16);
 REGISTER_CPU_SPARSE_KERNELS(float);
 REGISTER_CPU_SPARSE_KERNELS(double);
 #undef REGISTER_CPU_SPARSE_KERNELS
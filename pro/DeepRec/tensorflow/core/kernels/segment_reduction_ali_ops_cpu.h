@@ -0,0 +1,180 @@
+#ifndef TENSORFLOW_CORE_KERNELS_SEGMENT_REDUCTION_ALI_OPS_CPU_H_
+#define TENSORFLOW_CORE_KERNELS_SEGMENT_REDUCTION_ALI_OPS_CPU_H_
+
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__GNUC__) && (__GNUC__ > 6) && defined(__AVX512F__)
+#include <immintrin.h>
+#define SEGMENT_REDUCTION_USE_AVX512
+#endif
+
+#include "third_party/eigen3/Eigen/Core"
+#include "tensorflow/core/framework/numeric_types.h"
+#include "tensorflow/core/platform/prefetch.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace segment_reduction {
+
+// Row kernels of the sparse segment reductions on CPU. The rows of a
+// segment are summed in float registers and stored once per segment, so
+// half and bfloat16 rows are accumulated in float too. The common
+// embedding dims have kernels specialized at compile time.
+template <typename T>
+struct IsVectorized {
+  static constexpr bool value = std::is_same<T, float>::value ||
+                                std::is_same<T, Eigen::half>::value ||
+                                std::is_same<T, bfloat16>::value;
+};
+
+// Sums the rows input[indices[i] * dim] for i in [0, num) into 'acc'.
+template <typename T>
+using SumRowsFn = void (*)(const T* input, int64 dim, const int32* indices,
+                           int64 num, float* acc);
+
+// Rows are gathered by index, so they are prefetched a few rows ahead.
+constexpr int kPrefetchDistance = 4;
+
+template <typename T>
+inline void PrefetchRow(const T* input, int64 dim, const int32* indices,
+                        int64 i, int64 num) {
+  if (i + kPrefetchDistance < num) {
+    port::prefetch<port::PREFETCH_HINT_T0>(
+        input + static_cast<int64>(indices[i + kPrefetchDistance]) * dim);
+  }
+}
+
+template <typename T>
+void SumRowsGeneric(const T* input, int64 dim, const int32* indices,
+                    int64 num, float* acc) {
+  std::fill(acc, acc + dim, 0.0f);
+  for (int64 i = 0; i < num; ++i) {
+    PrefetchRow(input, dim, indices, i, num);
+    const T* row = input + static_cast<int64>(indices[i]) * dim;
+    for (int64 j = 0; j < dim; ++j) {
+      acc[j] += static_cast<float>(row[j]);
+    }
+  }
+}
+
+#ifdef SEGMENT_REDUCTION_USE_AVX512
+constexpr int kBlockSize = 16;
+
+inline __m512 Load16(const float* p) { return _mm512_loadu_ps(p); }
+
+inline __m512 Load16(const Eigen::half* p) {
+  return _mm512_cvtph_ps(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+}
+
+// bfloat16 is the upper half of a float.
+inline __m512 Load16(const bfloat16* p) {
+  const __m512i v = _mm512_cvtepu16_epi32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+  return _mm512_castsi512_ps(_mm512_slli_epi32(v, 16));
+}
+#endif
+
+// 'dim' is kDim. With AVX-512 the sum of a row of up to 256 columns stays
+// in registers for the whole segment.
+template <typename T, int kDim>
+void SumRowsFixed(const T* input, int64 dim, const int32* indices,
+                  int64 num, float* acc) {
+#ifdef SEGMENT_REDUCTION_USE_AVX512
+  if (kDim % kBlockSize == 0) {
+    constexpr int kBlocks = kDim / kBlockSize > 0 ? kDim / kBlockSize : 1;
+    __m512 sum[kBlocks];
+    for (int b = 0; b < kBlocks; ++b) {
+      sum[b] = _mm512_setzero_ps();
+    }
+    for (int64 i = 0; i < num; ++i) {
+      PrefetchRow(input, kDim, indices, i, num);
+      const T* row = input + static_cast<int64>(indices[i]) * kDim;
+      for (int b = 0; b < kBlocks; ++b) {
+        sum[b] = _mm512_add_ps(sum[b], Load16(row + b * kBlockSize));
+      }
+    }
+    for (int b = 0; b < kBlocks; ++b) {
+      _mm512_storeu_ps(acc + b * kBlockSize, sum[b]);
+    }
+    return;
+  }
+#endif
+  float sum[kDim] = {0.0f};
+  for (int64 i = 0; i < num; ++i) {
+    PrefetchRow(input, kDim, indices, i, num);
+    const T* row = input + static_cast<int64>(indices[i]) * kDim;
+    for (int j = 0; j < kDim; ++j) {
+      sum[j] += static_cast<float>(row[j]);
+    }
+  }
+  std::copy(sum, sum + kDim, acc);
+}
+
+template <typename T, bool kVectorized = IsVectorized<T>::value>
+struct RowOps {
+  static SumRowsFn<T> GetSumRowsFn(int64 dim) { return &SumRowsGeneric<T>; }
+
+  // acc[j] += scale * row[j].
+  static void ScaleAdd(const T* row, int64 dim, float scale, float* acc) {
+    for (int64 j = 0; j < dim; ++j) {
+      acc[j] += scale * static_cast<float>(row[j]);
+    }
+  }
+};
+
+template <typename T>
+struct RowOps<T, true> {
+  static SumRowsFn<T> GetSumRowsFn(int64 dim) {
+    switch (dim) {
+      case 8:
+        return &SumRowsFixed<T, 8>;
+      case 16:
+        return &SumRowsFixed<T, 16>;
+      case 32:
+        return &SumRowsFixed<T, 32>;
+      case 64:
+        return &SumRowsFixed<T, 64>;
+      case 128:
+        return &SumRowsFixed<T, 128>;
+      case 256:
+        return &SumRowsFixed<T, 256>;
+      default:
+        return &SumRowsGeneric<T>;
+    }
+  }
+
+  static void ScaleAdd(const T* row, int64 dim, float scale, float* acc) {
+    int64 j = 0;
+#ifdef SEGMENT_REDUCTION_USE_AVX512
+    const __m512 s = _mm512_set1_ps(scale);
+    for (; j + kBlockSize <= dim; j += kBlockSize) {
+      _mm512_storeu_ps(acc + j, _mm512_fmadd_ps(Load16(row + j), s,
+                                                _mm512_loadu_ps(acc + j)));
+    }
+#endif
+    for (; j < dim; ++j) {
+      acc[j] += scale * static_cast<float>(row[j]);
+    }
+  }
+};
+
+// out[j] = acc[j] / divisor, 'divisor' is 1 for sums.
+template <typename T>
+inline void StoreRow(const float* acc, int64 dim, float divisor, T* out) {
+  if (divisor == 1.0f) {
+    for (int64 j = 0; j < dim; ++j) {
+      out[j] = static_cast<T>(acc[j]);
+    }
+  } else {
+    for (int64 j = 0; j < dim; ++j) {
+      out[j] = static_cast<T>(acc[j] / divisor);
+    }
+  }
+}
+
+}  // namespace segment_reduction
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_SEGMENT_REDUCTION_ALI_OPS_CPU_H_
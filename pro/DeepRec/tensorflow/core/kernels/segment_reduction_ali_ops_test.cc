@@ -270,6 +270,87 @@ TEST_F(SparseSegmentMeanTest, Normal_double64) {
   test::ExpectTensorEqual<double>(expected, *GetOutput(0));
 }
 
+TEST_F(SparseSegmentSumTest, Normal_bfloat16) {
+  CreateOp(DT_BFLOAT16);
+  TF_ASSERT_OK(InitOp());
+  // 300 rows of ones, a sum in bfloat16 would stop at 256.
+  const int kRows = 300;
+  const int kDim = 16;
+  std::vector<bfloat16> input(kRows * kDim, bfloat16(1.0f));
+  std::vector<int32> indices(kRows);
+  std::vector<int32> segment_ids(kRows, 0);
+  for (int i = 0; i < kRows; ++i) {
+    indices[i] = i;
+  }
+
+  AddInputFromArray<bfloat16>(TensorShape({kRows, kDim}), input);
+  AddInputFromArray<int32>(TensorShape({kRows}), indices);
+  AddInputFromArray<int32>(TensorShape({kRows}), segment_ids);
+
+  TF_ASSERT_OK(RunOpKernel());
+
+  auto out = GetOutput(0)->flat<bfloat16>();
+  ASSERT_EQ(out.size(), kDim);
+  for (int j = 0; j < kDim; ++j) {
+    EXPECT_EQ(static_cast<float>(out(j)), 300.0f);
+  }
+}
+
+class SparseSegmentMeanDimTest : public SparseSegmentMeanTest {
+ protected:
+  // Segments of 1 to 12 rows, checked against a sum in double.
+  void RunDim(int dim) {
+    CreateOp(DT_FLOAT);
+    TF_ASSERT_OK(InitOp());
+    const int kRows = 97;
+    std::vector<float> input(kRows * dim);
+    for (int i = 0; i < kRows * dim; ++i) {
+      input[i] = static_cast<float>((i * 7919) % 1000) / 100.0f - 5.0f;
+    }
+    std::vector<int32> indices;
+    std::vector<int32> segment_ids;
+    const int kSegments = 40;
+    for (int s = 0; s < kSegments; ++s) {
+      // Segment 3 is empty.
+      const int len = s == 3 ? 0 : s % 12 + 1;
+      for (int k = 0; k < len; ++k) {
+        indices.push_back((s * 31 + k * 17) % kRows);
+        segment_ids.push_back(s);
+      }
+    }
+    std::vector<float> expected(kSegments * dim, 0.0f);
+    for (int s = 0; s < kSegments; ++s) {
+      int len = 0;
+      std::vector<double> sum(dim, 0.0);
+      for (size_t k = 0; k < indices.size(); ++k) {
+        if (segment_ids[k] != s) continue;
+        ++len;
+        for (int j = 0; j < dim; ++j) {
+          sum[j] += input[indices[k] * dim + j];
+        }
+      }
+      for (int j = 0; j < dim; ++j) {
+        expected[s * dim + j] = len == 0 ? 0.0f : sum[j] / len;
+      }
+    }
+
+    const int num = indices.size();
+    AddInputFromArray<float>(TensorShape({kRows, dim}), input);
+    AddInputFromArray<int32>(TensorShape({num}), indices);
+    AddInputFromArray<int32>(TensorShape({num}), segment_ids);
+
+    TF_ASSERT_OK(RunOpKernel());
+
+    Tensor expected_tensor(DT_FLOAT, TensorShape({kSegments, dim}));
+    test::FillValues<float>(&expected_tensor, expected);
+    test::ExpectTensorNear<float>(expected_tensor, *GetOutput(0), 1e-5);
+  }
+};
+
+TEST_F(SparseSegmentMeanDimTest, Dim64_float32) { RunDim(64); }
+
+TEST_F(SparseSegmentMeanDimTest, Dim20_float32) { RunDim(20); }
+
 
 class SparseSegmentMeanGradTest : public OpsTestBase {
  protected:
@@ -536,6 +617,32 @@ TEST_F(SparseSegmentMeanGradTest, Normal_float32) {
   test::ExpectTensorEqual<float>(expected, *GetOutput(0));
 }
 
+TEST_F(SparseSegmentSqrtNGradTest, Normal_bfloat16) {
+  CreateOp(DT_BFLOAT16);
+  TF_ASSERT_OK(InitOp());
+  // Rows 0 and 2 are gathered by segment 0 of 4 rows, row 1 by segment 1.
+  std::vector<bfloat16> grad = {bfloat16(2.0f), bfloat16(4.0f),
+                                bfloat16(3.0f), bfloat16(5.0f)};
+  std::vector<int32> indices = {0, 2, 0, 2, 1};
+  std::vector<int32> segment_ids = {0, 0, 0, 0, 1};
+  std::vector<int32> dim0(1, 3);
+
+  AddInputFromArray<bfloat16>(TensorShape({2, 2}), grad);
+  AddInputFromArray<int32>(TensorShape({5}), indices);
+  AddInputFromArray<int32>(TensorShape({5}), segment_ids);
+  AddInputFromArray<int32>(TensorShape({}), dim0);
+
+  TF_ASSERT_OK(RunOpKernel());
+
+  auto out = GetOutput(0)->matrix<bfloat16>();
+  // Each of rows 0 and 2 gets 2 / sqrt(4) of the segment 0 gradient.
+  EXPECT_EQ(static_cast<float>(out(0, 0)), 2.0f);
+  EXPECT_EQ(static_cast<float>(out(0, 1)), 4.0f);
+  EXPECT_EQ(static_cast<float>(out(2, 0)), 2.0f);
+  EXPECT_EQ(static_cast<float>(out(1, 0)), 3.0f);
+  EXPECT_EQ(static_cast<float>(out(1, 1)), 5.0f);
+}
+
 
 template <typename Index>
 static void BM_SegmentReduction(int iters, const string& reduction,
@@ -611,6 +718,70 @@ BM_Reduce_Arg(64, 32, 2);
 BM_Reduce_Arg(4096, 32, 2);
 BM_Reduce_Arg(4096, 128, 2);
 
+// Sparse segment reductions of embedding rows, 'dim' columns and segments
+// of 'segment_size' rows gathered from 'num_rows' rows.
+static void SparseSegmentReductionHelper(int iters, const string& op,
+                                         DataType dtype, int dim,
+                                         int segment_size) {
+  testing::StopTiming();
+  Graph* g = new Graph(OpRegistry::Global());
+  const int kNumRows = 100000;
+  const int kNumIndices = 32768;
+
+  Tensor indices(DT_INT32, TensorShape({kNumIndices}));
+  auto indices_flat = indices.flat<int32>();
+  Tensor segments(DT_INT32, TensorShape({kNumIndices}));
+  auto segments_flat = segments.flat<int32>();
+  for (int i = 0; i < kNumIndices; ++i) {
+    indices_flat(i) = (i * 7919) % kNumRows;
+    segments_flat(i) = i / segment_size;
+  }
+  Tensor input(DT_FLOAT, TensorShape({kNumRows, dim}));
+  input.flat<float>().setRandom();
+  Node* data = test::graph::Constant(g, input);
+  if (dtype != DT_FLOAT) {
+    data = test::graph::Cast(g, data, dtype);
+  }
+
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), op)
+                  .Input(data)
+                  .Input(test::graph::Constant(g, indices))
+                  .Input(test::graph::Constant(g, segments))
+                  .Attr("T", dtype)
+                  .Finalize(g, &node));
+
+  testing::UseRealTime();
+  testing::BytesProcessed(static_cast<int64>(iters) * kNumIndices * dim *
+                          DataTypeSize(dtype));
+  SessionOptions opts;
+  opts.config.set_intra_op_parallelism_threads(1);
+  testing::StartTiming();
+  test::Benchmark("cpu", g, &opts).Run(iters);
+}
+
+#define BM_SparseSegmentReduction(OP, TYPE, DTYPE)                          \
+  static void BM_##OP##_##TYPE(int iters, int dim, int segment_size) {      \
+    SparseSegmentReductionHelper(iters, #OP, DTYPE, dim, segment_size);     \
+  }                                                                         \
+  BENCHMARK(BM_##OP##_##TYPE)                                               \
+      ->ArgPair(8, 8)                                                       \
+      ->ArgPair(16, 8)                                                      \
+      ->ArgPair(32, 8)                                                      \
+      ->ArgPair(64, 8)                                                      \
+      ->ArgPair(128, 8)                                                     \
+      ->ArgPair(256, 8)                                                     \
+      ->ArgPair(24, 8)                                                      \
+      ->ArgPair(64, 1)                                                      \
+      ->ArgPair(64, 64);
+
+BM_SparseSegmentReduction(SparseSegmentSum, float, DT_FLOAT);
+BM_SparseSegmentReduction(SparseSegmentMean, float, DT_FLOAT);
+BM_SparseSegmentReduction(SparseSegmentSqrtN, float, DT_FLOAT);
+BM_SparseSegmentReduction(SparseSegmentSum, bfloat16, DT_BFLOAT16);
+BM_SparseSegmentReduction(SparseSegmentMean, bfloat16, DT_BFLOAT16);
+BM_SparseSegmentReduction(SparseSegmentSum, half, DT_HALF);
+
 static void SparseSegmentMeanGradHelper(int iters, float uniqueness,
                                         int size, int nth) {
   testing::StopTiming();
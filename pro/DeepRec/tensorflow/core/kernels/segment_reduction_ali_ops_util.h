@@ -1,6 +1,8 @@
 #ifndef TENSORFLOW_CORE_KERNELS_SEGMENT_REDUCTION_ALI_OPS_UTIL_H_
 #define TENSORFLOW_CORE_KERNELS_SEGMENT_REDUCTION_ALI_OPS_UTIL_H_
 
+#include <vector>
+
 #include "third_party/eigen3/Eigen/Core"
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 
@@ -11,6 +13,7 @@
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_types.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/segment_reduction_ali_ops_cpu.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/util/util.h"
@@ -89,9 +92,15 @@ class SparseSegmentReduction {
     auto output_flat = output->flat_outer_dims<T>();
 
     const auto indices_vec = indices.vec<Index>();
+    // float, half and bfloat16 are summed in float by the row kernels.
+    const bool vectorized = segment_reduction::IsVectorized<T>::value;
+    const segment_reduction::SumRowsFn<T> sum_rows =
+        segment_reduction::RowOps<T>::GetSumRowsFn(num_col);
     auto work = [this, &context,
                  &output_flat, &input_flat, &indices_vec, &segment_vec,
-                 num_col, num_indices, output_rows](int64 start, int64 end) {
+                 num_col, num_indices, output_rows, vectorized,
+                 sum_rows](int64 start, int64 end) {
+      std::vector<float> acc(vectorized ? num_col : 0);
       OutputRow uninitialized_index = start;
       // We mannually set start_pos of first thread and end_pos of last thread,
       // which could make sure that unsorted ids would be checked out.
@@ -145,9 +154,14 @@ class SparseSegmentReduction {
           gap_slice.setConstant(default_value_);
         }
 
-        auto out = output_flat.template chip<0>(out_index);
-        const int bad_offset = Reduce(input_flat, indices_vec,
-                                      start_pos, cur_pos - start_pos, out);
+        const int64 bad_offset =
+            vectorized
+                ? ReduceRows(input_flat, indices_vec, start_pos,
+                             cur_pos - start_pos, sum_rows, acc.data(),
+                             &output_flat(out_index, 0))
+                : Reduce(input_flat, indices_vec, start_pos,
+                         cur_pos - start_pos,
+                         output_flat.template chip<0>(out_index));
         OP_REQUIRES(context, bad_offset < 0,
                     errors::InvalidArgument(
                         "Bad: indices[", start_pos + bad_offset,
@@ -190,6 +204,30 @@ class SparseSegmentReduction {
     return FirstGreatEqual(segment_vec, idx, lb, mid);
   }
 
+  // Same as Reduce below, the rows are summed into 'acc' by 'sum_rows'.
+  int64 ReduceRows(const typename TTypes<T>::ConstMatrix& input_flat,
+                   const typename TTypes<Index>::ConstVec& indices_vec,
+                   int64 start, int64 num,
+                   segment_reduction::SumRowsFn<T> sum_rows, float* acc,
+                   T* out) {
+    const Index* indices = indices_vec.data() + start;
+    const int64 num_rows = input_flat.dimension(0);
+    for (int64 i = 0; i < num; ++i) {
+      if (!FastBoundsCheck(indices[i], num_rows)) return i;
+    }
+    const int64 num_col = input_flat.dimension(1);
+    sum_rows(input_flat.data(), num_col, indices, num, acc);
+    float divisor = 1.0f;
+    if (is_mean_) {
+      divisor = static_cast<float>(num);
+    }
+    if (is_sqrtn_) {
+      divisor = static_cast<float>(sqrt(num));
+    }
+    segment_reduction::StoreRow(acc, num_col, divisor, out);
+    return -1;
+  }
+
   int64 Reduce(const typename TTypes<T>::ConstMatrix& input_flat,
                const typename TTypes<Index>::ConstVec& indices_vec, int64 start,
                int64 num,
@@ -405,6 +443,47 @@ class SparseSegmentReductionGrad {
           1 /* cost */, do_scan);
     if (!context->status().ok()) return;
 
+    if (segment_reduction::IsVectorized<T>::value) {
+      auto do_write_rows = [this, &context, &output_flat, &input_flat,
+                            &indices_vec, &segment_vec, &counting, M, N,
+                            num_col, cnt_layout_by_n](int64 start, int64 end) {
+        // The rows are accumulated in float, in place for float outputs.
+        const bool in_place = std::is_same<T, float>::value;
+        const int64 size = (end - start) * num_col;
+        std::vector<float> buffer(in_place ? 0 : size);
+        float* acc = in_place
+            ? reinterpret_cast<float*>(&output_flat(start, 0))
+            : buffer.data();
+        std::fill(acc, acc + size, 0.0f);
+        for (int64 i = 0; i < N; ++i) {
+          const Index output_idx = internal::SubtleMustCopy(indices_vec(i));
+          OP_REQUIRES(context, FastBoundsCheck(output_idx, M),
+                      errors::InvalidArgument("Index ", output_idx,
+                                              " out of range [0, ", M, ")."));
+          if (output_idx < start || output_idx >= end) continue;
+
+          const SegmentId in_idx = internal::SubtleMustCopy(segment_vec(i));
+          const int iscale = cnt_layout_by_n ? counting[i] : counting[in_idx];
+          float scale = 1.0f;
+          if (iscale != 1) {
+            scale = is_sqrtn_
+                ? static_cast<float>(1.0 / sqrt(static_cast<double>(iscale)))
+                : static_cast<float>(1.0 / static_cast<double>(iscale));
+          }
+          segment_reduction::RowOps<T>::ScaleAdd(
+              &input_flat(in_idx, 0), num_col, scale,
+              acc + (output_idx - start) * num_col);
+        }
+        if (!in_place) {
+          segment_reduction::StoreRow(acc, size, 1.0f,
+                                      &output_flat(start, 0));
+        }
+      };
+      Shard(worker_threads->num_threads - 1, worker_threads->workers, M,
+            num_col /* cost */, do_write_rows);
+      return;
+    }
+
     auto do_write = [this, &context, &output_flat, &input_flat,
                      &indices_vec, &segment_vec, &counting, M, N, num_col,
                      cnt_layout_by_n](int64 start, int64 end) {
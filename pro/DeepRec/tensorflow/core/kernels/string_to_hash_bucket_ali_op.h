@@ -213,6 +213,62 @@ class StringToKeyedHashBucketAliOp : public OpKernel {
   TF_DISALLOW_COPY_AND_ASSIGN(StringToKeyedHashBucketAliOp);
 };
 
+#if defined(__AVX512F__)
+const int64 kStringToHash64ElementCost = 25;  // for AVX512 batch-vectorized impl.
+#else
+const int64 kStringToHash64ElementCost = 100;  // Estimated for 32 byte strings.
+#endif
+
+// Hashes input[start, end) into non-negative int64 ids in output, strings of
+// the same length are hashed 8 at a time by Hash64Farm_Batch512 on AVX512.
+// Shared by StringToHash64 and the EmbeddingVariable lookups of strings.
+template <uint64 hash(StringPiece)>
+void StringToHash64Range(const string* input, int64* output, int64 start,
+                         int64 end) {
+  int64 i = start;
+#if defined(__AVX512F__)
+  const int64 batch_end = end - (end - start) % 8;
+  const char* batch_ptr[8];
+  uint64_t input_hash[8];
+  bool enable_batch_hash = true;
+  if (batch_end - start >= 8) {
+    for (; i < batch_end; i += 8) {
+      // first unrolling by 8 (for Hash64V3_Batch512)
+      // double check whether all the 8 strings within
+      // a batch having the same string length.
+      enable_batch_hash = true;
+      const size_t size_0 = input[i].size();
+      batch_ptr[0] = input[i].data();
+      for (int j = 1; j < 8; j++) {
+        if (input[i + j].size() == size_0) {
+          batch_ptr[j] = input[i + j].data();
+        } else {
+          enable_batch_hash = false;
+          break;
+        }
+      }
+      if (enable_batch_hash) {
+        Hash64Farm_Batch512(batch_ptr, &input_hash[0], size_0);
+      } else {
+        // roll back to normal Hash64 function
+        for (int j = 0; j < 8; j++) {
+          input_hash[j] = (uint64_t)hash(input[i + j]);
+        }
+      }
+      // feed ids to output tensor
+      for (int j = 0; j < 8; j++) {
+        output[i + j] = input_hash[j] & kint64max;
+      }
+    }
+  }
+#endif
+  // for remained iterations
+  for (; i < end; ++i) {
+    // Clearing the sign bit keeps the id in the positive range of int64.
+    output[i] = hash(input[i]) & kint64max;
+  }
+}
+
 template <uint64 hash(StringPiece)>
 class StringToHash64Op : public OpKernel {
  public:
@@ -222,74 +278,23 @@ class StringToHash64Op : public OpKernel {
   void Compute(OpKernelContext* context) override {
     const Tensor* input_tensor;
     OP_REQUIRES_OK(context, context->input("input", &input_tensor));
-    const auto& input_flat = input_tensor->flat<string>();
+    const string* input = input_tensor->flat<string>().data();
 
     Tensor* output_tensor = nullptr;
     OP_REQUIRES_OK(context,
                    context->allocate_output("output", input_tensor->shape(),
                                             &output_tensor));
-    auto output_flat = output_tensor->flat<int64>();
+    int64* output = output_tensor->flat<int64>().data();
 
-    auto RunTask = [this, &input_flat, &output_flat](int64 start, int64 end) {
-      typedef decltype(input_flat.size()) Index;
-      auto batch_end = end - (end - start)%8;
-      auto i = start;
-#if defined(__AVX512F__)
-      const char* batch_ptr[8];
-      uint64_t input_hash[8];
-      bool enable_batch_hash = true;
-      if (batch_end - start >= 8) {
-        for(; i < batch_end; i+=8) {
-          // first unrolling by 8 (for Hash64V3_Batch512)
-          // double check whether all the 8 strings within
-          // a batch having the same string length.
-          enable_batch_hash = true;
-          Index size_0 = input_flat(i).size();
-          batch_ptr[0] = input_flat(i).data();
-          for(int j=1; j<8; j++) {
-            if (input_flat(i+j).size() == size_0) {
-              batch_ptr[j] = input_flat(i+j).data();
-            } else {
-              enable_batch_hash = false;
-              break;
-            }
-          }
-          if (enable_batch_hash) {
-            Hash64Farm_Batch512(batch_ptr, &input_hash[0], size_0);
-          } else {
-            // roll back to normal Hash64 function
-            for(int j=0; j<8; j++) {
-                input_hash[j] = (uint64_t)hash(input_flat(i+j));
-            }
-          }
-          // feed ids to output tensor
-          for(int j=0; j<8; j++) {
-            output_flat(i+j) = input_hash[j] & kint64max;
-          }
-        }
-      }
-#endif
-      // for remained iterations
-      for(; i < end; ++i) {
-        const uint64 input_hash = hash(input_flat(i));
-        // The number of buckets is always in the positive range of int64 so is
-        // the resulting bucket_id. Casting the bucket_id from uint64 to int64
-        // is safe.
-        output_flat(i) = input_hash & kint64max;
-      }
+    auto RunTask = [input, output](int64 start, int64 end) {
+      StringToHash64Range<hash>(input, output, start, end);
     };
 
     auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
-#if defined (__AVX512F__)
-    const int64 element_cost = 25;  // for AVX512 batch-vectorized impl.
-#else
-    const int64 element_cost = 100;  // Estimated for 32 byte strings.
-#endif
-
     // NOTE(zycao): Here we have to use 'num_threads - 1' to make sure no more
     // task fractions should be created. The cost is also a coarse estimation.
     Shard(worker_threads->num_threads - 1, worker_threads->workers,
-          input_flat.size(), element_cost, RunTask);
+          input_tensor->NumElements(), kStringToHash64ElementCost, RunTask);
   }
 
   TF_DISALLOW_COPY_AND_ASSIGN(StringToHash64Op);
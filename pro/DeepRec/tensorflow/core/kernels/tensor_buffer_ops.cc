@@ -230,4 +230,32 @@ REGISTER_KERNEL_BUILDER(
     TensorBufferSizeOp);
 #endif  // TENSORFLOW_USE_SYCL
 
+class TensorBufferStatisticsOp : public TensorBufferOp {
+ public:
+  explicit TensorBufferStatisticsOp(OpKernelConstruction* ctx)
+      : TensorBufferOp(ctx) {}
+
+  void ComputeWithTensorBuf(OpKernelContext* ctx, TensorBuf* buf) override {
+    Tensor* statistics = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(
+                            0, TensorShape({tensor_buffer::kNumStatistics}),
+                            &statistics));
+    OP_REQUIRES_OK(ctx, buf->GetStatistics(statistics));
+  }
+};
+
+REGISTER_KERNEL_BUILDER(Name("TensorBufferStatistics").Device(DEVICE_CPU),
+                        TensorBufferStatisticsOp);
+#if GOOGLE_CUDA
+REGISTER_KERNEL_BUILDER(
+    Name("TensorBufferStatistics").HostMemory("statistics").Device(DEVICE_GPU),
+    TensorBufferStatisticsOp);
+#endif  // GOOGLE_CUDA
+#ifdef TENSORFLOW_USE_SYCL
+REGISTER_KERNEL_BUILDER(
+    Name("TensorBufferStatistics").HostMemory("statistics")
+        .Device(DEVICE_SYCL),
+    TensorBufferStatisticsOp);
+#endif  // TENSORFLOW_USE_SYCL
+
 }  // namespace tensorflow
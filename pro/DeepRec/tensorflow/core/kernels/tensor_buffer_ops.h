@@ -30,106 +30,248 @@ limitations under the License.
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/tensor_buffer_statistics.h"
 
 #include "third_party/eigen3/Eigen/Core"
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // __linux__
+
+#include <atomic>
 #include <chrono>
+#include <climits>
 #include <cstddef>
-#include <deque>
+#include <memory>
+#include <thread>
 #include <vector>
 
 namespace tensorflow {
 
 #define TF_RESOURCE_DEBUG_STRING_CONST const
 
-class TensorBuf : public ResourceBase {
- public:
-  explicit TensorBuf(int64 capacity)
-      : capacity_(capacity), is_cancelled_(false), is_closed_(false) {}
-
-  ~TensorBuf() { Cancel(); }
+namespace tensor_buffer {
+
+// Blocks the calling thread while *addr == expected, at most timeout_millis.
+inline void FutexWait(std::atomic<int32>* addr, int32 expected,
+                      int64 timeout_millis) {
+#if defined(__linux__)
+  struct timespec ts;
+  ts.tv_sec = timeout_millis / 1000;
+  ts.tv_nsec = (timeout_millis % 1000) * 1000000;
+  syscall(SYS_futex, reinterpret_cast<int32*>(addr), FUTEX_WAIT_PRIVATE,
+          expected, &ts, nullptr, 0);
+#else
+  if (addr->load() == expected) {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+#endif  // __linux__
+}
 
-  Status Put(const std::vector<Tensor>& record, int64 timeout_millis) {
-    std::unique_lock<std::mutex> lock(mu_);
+// Wakes up all threads blocked on addr.
+inline void FutexWakeAll(std::atomic<int32>* addr) {
+#if defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<int32*>(addr), FUTEX_WAKE_PRIVATE,
+          INT_MAX, nullptr, nullptr, 0);
+#endif  // __linux__
+}
 
-    bool should_retry = !put_cv_.wait_for(
-        lock, std::chrono::milliseconds(timeout_millis),
-        [this]() { return buffer_.size() < capacity_ || is_cancelled_; });
-    if (should_retry) {
-      lock.unlock();
-      LOG(WARNING) << "Prefetching was ignored since timeout.";
-      return Status::OK();
+// Bounded lock-free MPMC ring of records, each slot carries a sequence
+// number telling whether it is ready to be written or read at a position.
+class RecordRing {
+ public:
+  explicit RecordRing(size_t capacity)
+      : capacity_(capacity), slots_(new Slot[capacity]),
+        enqueue_pos_(0), dequeue_pos_(0) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
     }
+  }
 
-    if (TF_PREDICT_FALSE(is_cancelled_)) {
-      lock.unlock();
-      return Status(errors::Cancelled("Session was closed."));
+  bool TryPush(std::vector<Tensor>* record) {
+    Slot* slot;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      slot = &slots_[pos % capacity_];
+      size_t seq = slot->seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
     }
+    slot->record = std::move(*record);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
 
-    buffer_.push_back(std::move(record));
-
-    lock.unlock();
-    take_cv_.notify_all();
+  bool TryPop(std::vector<Tensor>* record) {
+    Slot* slot;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      slot = &slots_[pos % capacity_];
+      size_t seq = slot->seq.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    *record = std::move(slot->record);
+    slot->record.clear();
+    slot->seq.store(pos + capacity_, std::memory_order_release);
+    return true;
+  }
 
-    return Status::OK();
+  // Approximate number of records, exact when there is no concurrent
+  // push or pop.
+  size_t Size() const {
+    size_t enqueue_pos = enqueue_pos_.load(std::memory_order_acquire);
+    size_t dequeue_pos = dequeue_pos_.load(std::memory_order_acquire);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
   }
 
-  Status Take(std::vector<Tensor>* record) {
-    std::unique_lock<std::mutex> lock(mu_);
+  size_t Capacity() const { return capacity_; }
 
-    take_cv_.wait(lock, [this]() { return !buffer_.empty() || is_cancelled_; });
+ private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    std::vector<Tensor> record;
+  };
+
+  const size_t capacity_;
+  std::unique_ptr<Slot[]> slots_;
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+};
 
-    if (TF_PREDICT_FALSE(is_closed_ && buffer_.empty())) {
-      lock.unlock();
-      return Status(errors::OutOfRange("EOF reached."));
-    }
+}  // namespace tensor_buffer
 
-    if (TF_PREDICT_FALSE(is_cancelled_ && buffer_.empty())) {
-      lock.unlock();
-      return Status(errors::Cancelled("Session was closed."));
-    }
+class TensorBuf : public ResourceBase {
+ public:
+  explicit TensorBuf(int64 capacity)
+      : ring_(capacity), is_cancelled_(false), is_closed_(false) {}
 
-    *record = std::move(buffer_.front());
-    buffer_.pop_front();
+  ~TensorBuf() { Cancel(); }
 
-    lock.unlock();
-    put_cv_.notify_all();
+  // Puts the record into the buffer, blocks while the buffer is full,
+  // so that no prefetched record is ever dropped. A warning is logged
+  // every timeout_millis the put is stalled.
+  Status Put(const std::vector<Tensor>& record, int64 timeout_millis) {
+    std::vector<Tensor> pending(record);
+    int64 stall_start = 0;
+    for (;;) {
+      if (TF_PREDICT_FALSE(is_cancelled_.load(std::memory_order_acquire))) {
+        FinishStall(stall_start, &put_stall_micros_);
+        return Status(errors::Cancelled("Session was closed."));
+      }
+      if (ring_.TryPush(&pending)) {
+        put_count_.fetch_add(1, std::memory_order_relaxed);
+        FinishStall(stall_start, &put_stall_micros_);
+        Notify(&take_epoch_, &take_waiters_);
+        return Status::OK();
+      }
+      if (stall_start == 0) {
+        stall_start = Env::Default()->NowMicros();
+        put_stall_count_.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (!Wait(&put_epoch_, &put_waiters_, timeout_millis,
+                [this]() { return ring_.Size() < ring_.Capacity(); })) {
+        LOG(WARNING) << "Prefetching was stalled for "
+                     << (Env::Default()->NowMicros() - stall_start) / 1000
+                     << " ms since buffer is full.";
+      }
+    }
+  }
 
-    return Status::OK();
+  Status Take(std::vector<Tensor>* record) {
+    int64 stall_start = 0;
+    for (;;) {
+      if (ring_.TryPop(record)) {
+        take_count_.fetch_add(1, std::memory_order_relaxed);
+        FinishStall(stall_start, &take_stall_micros_);
+        Notify(&put_epoch_, &put_waiters_);
+        return Status::OK();
+      }
+      if (TF_PREDICT_FALSE(is_closed_.load(std::memory_order_acquire))) {
+        FinishStall(stall_start, &take_stall_micros_);
+        return Status(errors::OutOfRange("EOF reached."));
+      }
+      if (TF_PREDICT_FALSE(is_cancelled_.load(std::memory_order_acquire))) {
+        FinishStall(stall_start, &take_stall_micros_);
+        return Status(errors::Cancelled("Session was closed."));
+      }
+      if (stall_start == 0) {
+        stall_start = Env::Default()->NowMicros();
+        take_stall_count_.fetch_add(1, std::memory_order_relaxed);
+      }
+      Wait(&take_epoch_, &take_waiters_, kTakeWaitMillis,
+           [this]() { return ring_.Size() > 0; });
+    }
   }
 
   Status Cancel(bool is_cancelled = true) {
-    std::unique_lock<std::mutex> lock(mu_);
-
-    is_cancelled_ = is_cancelled;
-
-    lock.unlock();
-    put_cv_.notify_all();
-    take_cv_.notify_all();
+    is_cancelled_.store(is_cancelled, std::memory_order_release);
+    WakeAll();
     return Status::OK();
   }
 
   Status Close() {
-    std::unique_lock<std::mutex> lock(mu_);
-
-    is_cancelled_ = true;
-    is_closed_ = true;
-
-    lock.unlock();
-    put_cv_.notify_all();
-    take_cv_.notify_all();
+    is_cancelled_.store(true, std::memory_order_release);
+    is_closed_.store(true, std::memory_order_release);
+    WakeAll();
     return Status::OK();
   }
 
   Status GetSize(Tensor* size) {
-    std::unique_lock<std::mutex> lock(mu_);
-    size->scalar<int32>().setConstant(static_cast<int64>(buffer_.size()));
+    size->scalar<int32>().setConstant(static_cast<int32>(ring_.Size()));
+    return Status::OK();
+  }
+
+  // Occupancy and stall counters, a put stall means the model is the
+  // bottleneck while a take stall means the input pipeline is.
+  Status GetStatistics(Tensor* statistics) {
+    auto stats = statistics->vec<int64>();
+    stats(tensor_buffer::kCapacity) = ring_.Capacity();
+    stats(tensor_buffer::kSize) = ring_.Size();
+    stats(tensor_buffer::kPutCount) =
+        put_count_.load(std::memory_order_relaxed);
+    stats(tensor_buffer::kPutStallCount) =
+        put_stall_count_.load(std::memory_order_relaxed);
+    stats(tensor_buffer::kPutStallMicros) =
+        put_stall_micros_.load(std::memory_order_relaxed);
+    stats(tensor_buffer::kTakeCount) =
+        take_count_.load(std::memory_order_relaxed);
+    stats(tensor_buffer::kTakeStallCount) =
+        take_stall_count_.load(std::memory_order_relaxed);
+    stats(tensor_buffer::kTakeStallMicros) =
+        take_stall_micros_.load(std::memory_order_relaxed);
     return Status::OK();
   }
 
   string DebugString() TF_RESOURCE_DEBUG_STRING_CONST override {
-    return strings::StrCat("TensorBuf(capacity=", capacity_, ")");
+    return strings::StrCat(
+        "TensorBuf(capacity=", ring_.Capacity(), ", size=", ring_.Size(),
+        ", put_stall_count=", put_stall_count_.load(),
+        ", put_stall_micros=", put_stall_micros_.load(),
+        ", take_stall_count=", take_stall_count_.load(),
+        ", take_stall_micros=", take_stall_micros_.load(), ")");
   }
 
   void Schedule(const string& name, int64 num_threads,
@@ -151,13 +293,65 @@ class TensorBuf : public ResourceBase {
   }
 
  private:
-  std::deque<std::vector<Tensor> > buffer_;
-  std::size_t capacity_;
-  bool is_cancelled_;
-  bool is_closed_;
+  // Take waits in slices so that cancellation is never missed.
+  static constexpr int64 kTakeWaitMillis = 1000;
+
+  // Waits until ready() or a notification, returns false on timeout.
+  template <typename Predicate>
+  bool Wait(std::atomic<int32>* epoch, std::atomic<int32>* waiters,
+            int64 timeout_millis, Predicate ready) {
+    int32 expected = epoch->load(std::memory_order_acquire);
+    waiters->fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool notified = true;
+    if (!ready() && !is_cancelled_.load(std::memory_order_acquire)) {
+      tensor_buffer::FutexWait(epoch, expected, timeout_millis);
+      notified = epoch->load(std::memory_order_acquire) != expected;
+    }
+    waiters->fetch_sub(1, std::memory_order_relaxed);
+    return notified;
+  }
+
+  // Only pays for a wake up syscall when someone is waiting.
+  void Notify(std::atomic<int32>* epoch, std::atomic<int32>* waiters) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters->load(std::memory_order_seq_cst) > 0) {
+      epoch->fetch_add(1, std::memory_order_release);
+      tensor_buffer::FutexWakeAll(epoch);
+    }
+  }
+
+  void WakeAll() {
+    put_epoch_.fetch_add(1, std::memory_order_release);
+    take_epoch_.fetch_add(1, std::memory_order_release);
+    tensor_buffer::FutexWakeAll(&put_epoch_);
+    tensor_buffer::FutexWakeAll(&take_epoch_);
+  }
+
+  void FinishStall(int64 stall_start, std::atomic<int64>* stall_micros) {
+    if (stall_start != 0) {
+      stall_micros->fetch_add(Env::Default()->NowMicros() - stall_start,
+                              std::memory_order_relaxed);
+    }
+  }
+
+  tensor_buffer::RecordRing ring_;
+  std::atomic<bool> is_cancelled_;
+  std::atomic<bool> is_closed_;
+
+  std::atomic<int32> put_epoch_{0};
+  std::atomic<int32> put_waiters_{0};
+  std::atomic<int32> take_epoch_{0};
+  std::atomic<int32> take_waiters_{0};
+
+  std::atomic<int64> put_count_{0};
+  std::atomic<int64> put_stall_count_{0};
+  std::atomic<int64> put_stall_micros_{0};
+  std::atomic<int64> take_count_{0};
+  std::atomic<int64> take_stall_count_{0};
+  std::atomic<int64> take_stall_micros_{0};
+
   std::mutex mu_;
-  std::condition_variable take_cv_;
-  std::condition_variable put_cv_;
   std::shared_ptr<thread::ThreadPool> threads_;
 };
 }
@@ -22,6 +22,8 @@ limitations under the License.
 #include <algorithm>
 
 #include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/framework/embedding/numa_placement.h"
+#include "tensorflow/core/framework/embedding/reduced_precision.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/kernels/kv_variable_ops.h"
@@ -120,34 +122,45 @@ class KvSparseApplyAdagradOp : public OpKernel {
                     "Inner dimension should be greater than zero."));
 
     if (N > 0) {
+      // The rows of the batch are not evicted while they are updated.
+      embedding::ScopedPinIds<TKey, T> pin_ids(var->storage_manager(),
+          indices.vec<TKey>().data(), N);
       if (inner_dim > 0) {
+        typedef typename embedding::ComputeType<T>::type TC;
         auto indices_vec = indices.vec<TKey>();
         auto grad_flat = grad.flat_outer_dims<T>();
-        T lr_scalar = lr.scalar<T>()();
+        // lr is in TC, not rounded to T.
+        TC lr_scalar = lr.scalar<TC>()();
         Tstep gs = global_step.scalar<Tstep>()();
 
         auto do_work = [this, ctx, &indices_vec, var, accum, &grad_flat,
-            &gs, &lr_scalar] (int64 start_i, int64 limit_i) {
+            &gs, &lr_scalar, inner_dim] (int64 start_i, int64 limit_i) {
           for (int64 i = start_i; i < limit_i; i++) {
             const TKey index = indices_vec(i);
             ValuePtr<T>* value_ptr = nullptr;
             bool is_filter = false;
             OP_REQUIRES_OK(ctx, var->LookupOrCreateKey(index, &value_ptr, &is_filter));
-            var->UpdateVersion(value_ptr, gs);
+            var->UpdateVersion(index, value_ptr, gs);
             if (is_filter) {
-              auto a = accum->flat(value_ptr);
-              auto g = grad_flat.template chip<0>(i);
-              auto v = var->flat(value_ptr);
+              embedding::ValueRow<T> a_row(accum->flat(value_ptr));
+              embedding::ConstValueRow<T> g_row(&grad_flat(i, 0), inner_dim);
+              embedding::ValueRow<T> v_row(var->flat(value_ptr));
+              auto a = a_row.flat();
+              auto g = g_row.flat();
+              auto v = v_row.flat();
 
               a += g.square();
               v -= g.constant(lr_scalar) * g * a.rsqrt();
+              a_row.Store();
+              v_row.Store();
               var->Commit(index, value_ptr);
             }
           }
         };
         const int64 cost = 1000; //very unreliable estimate for cost per step.
         auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-        Shard(worker_threads.num_threads, worker_threads.workers, N, cost, do_work);
+        embedding::ShardByNode(var->GetNumaPlacement(), worker_threads.num_threads,
+            worker_threads.workers, indices_vec.data(), N, cost, do_work);
       }
     }
   }
@@ -156,19 +169,23 @@ class KvSparseApplyAdagradOp : public OpKernel {
   bool use_exclusive_lock_;
 };
 
-#define REGISTER_KERNELS(Tindices, T, Tstep)                         \
-  REGISTER_KERNEL_BUILDER(Name("KvResourceSparseApplyAdagrad")       \
-                              .Device(DEVICE_CPU)                    \
-                              .TypeConstraint<T>("T")                \
-                              .TypeConstraint<Tindices>("Tindices")  \
-                              .TypeConstraint<Tstep>("Tstep"),       \
-                          KvSparseApplyAdagradOp<Tindices, T, Tstep>);
+#define REGISTER_KERNELS(Tindices, T, Tstep)                          \
+  REGISTER_KERNEL_BUILDER(                                            \
+      Name("KvResourceSparseApplyAdagrad")                            \
+          .Device(DEVICE_CPU)                                         \
+          .TypeConstraint<T>("T")                                     \
+          .TypeConstraint<embedding::ComputeType<T>::type>("Tscalar") \
+          .TypeConstraint<Tindices>("Tindices")                       \
+          .TypeConstraint<Tstep>("Tstep"),                            \
+      KvSparseApplyAdagradOp<Tindices, T, Tstep>);
 #define REGISTER_CPU_KERNELS(T)        \
   REGISTER_KERNELS(int32, T, int32);   \
   REGISTER_KERNELS(int64, T, int32);   \
   REGISTER_KERNELS(int32, T, int64);   \
   REGISTER_KERNELS(int64, T, int64);
 
+TF_CALL_half(REGISTER_CPU_KERNELS);
+TF_CALL_bfloat16(REGISTER_CPU_KERNELS);
 TF_CALL_float(REGISTER_CPU_KERNELS);
 
 #undef REGISTER_CPU_KERNELS
@@ -279,6 +296,7 @@ DECLARE_GPU_SPEC(int64, double);
   REGISTER_KERNEL_BUILDER(Name("KvResourceSparseApplyAdagrad")       \
                               .Device(DEVICE_GPU)                    \
                               .TypeConstraint<T>("T")                \
+                              .TypeConstraint<T>("Tscalar")          \
                               .HostMemory("lr")                      \
                               .HostMemory("global_step")             \
                               .TypeConstraint<Tindices>("Tindices")  \
@@ -384,6 +402,9 @@ class KvSparseApplyFtrlOp : public OpKernel {
     }
 
     if (N > 0) {
+      // The rows of the batch are not evicted while they are updated.
+      embedding::ScopedPinIds<TKey, T> pin_ids(var_->storage_manager(),
+          indices.vec<TKey>().data(), N);
       if (inner_dim > 0) {
         auto indices_vec = indices.vec<TKey>();
         auto grad_flat = grad.flat_outer_dims<T>();
@@ -458,7 +479,8 @@ class KvSparseApplyFtrlOp : public OpKernel {
 
         const int64 cost = 4500; //very unreliable estimate for cost per step.
         auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-        Shard(worker_threads.num_threads, worker_threads.workers, N, cost, do_work);
+        embedding::ShardByNode(var_->GetNumaPlacement(), worker_threads.num_threads,
+            worker_threads.workers, indices_vec.data(), N, cost, do_work);
       }
     }
 
@@ -1095,6 +1117,9 @@ class KvSparseApplyAdagradDecayOp : public OpKernel {
         "grad must be the same size as indices in the first dimension."));
 
     if (N > 0) {
+      // The rows of the batch are not evicted while they are updated.
+      embedding::ScopedPinIds<Tindex, T> pin_ids(var->storage_manager(),
+          indices.vec<Tindex>().data(), N);
       auto indices_vec = indices.vec<Tindex>();
       T lr_scalar = lr.scalar<T>()();
       Tstep gs = global_step.scalar<Tstep>()();
@@ -1134,7 +1159,8 @@ class KvSparseApplyAdagradDecayOp : public OpKernel {
         };
         const int64 cost = 1000;
         auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-        Shard(worker_threads.num_threads, worker_threads.workers, N, cost, do_work);
+        embedding::ShardByNode(var->GetNumaPlacement(), worker_threads.num_threads,
+            worker_threads.workers, indices_vec.data(), N, cost, do_work);
       }
     }
 
@@ -1252,15 +1278,20 @@ class KvSparseApplyAdamOp : public OpKernel {
             "grad must be the same size as indices in the first dimension."));
 
     if (N > 0) {
-      T beta1_power_scalar = beta1_power.scalar<T>()();
-      T beta2_power_scalar = beta2_power.scalar<T>()();
-      T lr_scalar = lr.scalar<T>()();
-      T beta1_scalar = beta1.scalar<T>()();
-      T beta2_scalar = beta2.scalar<T>()();
-      T epsilon_scalar = epsilon.scalar<T>()();
-      const T alpha = lr_scalar *
-          Eigen::numext::sqrt(static_cast<T>(1) - beta2_power_scalar) /
-          (static_cast<T>(1) - beta1_power_scalar);
+      // The rows of the batch are not evicted while they are updated.
+      embedding::ScopedPinIds<Tindex, T> pin_ids(var->storage_manager(),
+          indices.vec<Tindex>().data(), N);
+      typedef typename embedding::ComputeType<T>::type TC;
+      // The hyperparameters are in TC, not rounded to T.
+      TC beta1_power_scalar = beta1_power.scalar<TC>()();
+      TC beta2_power_scalar = beta2_power.scalar<TC>()();
+      TC lr_scalar = lr.scalar<TC>()();
+      TC beta1_scalar = beta1.scalar<TC>()();
+      TC beta2_scalar = beta2.scalar<TC>()();
+      TC epsilon_scalar = epsilon.scalar<TC>()();
+      const TC alpha = lr_scalar *
+          Eigen::numext::sqrt(static_cast<TC>(1) - beta2_power_scalar) /
+          (static_cast<TC>(1) - beta1_power_scalar);
 
       auto DoWork = [this, ctx, inner_dim, &var, &m, &v, &grad, &indices,
            &beta1_power_scalar, &beta2_power_scalar, &lr_scalar, &beta1_scalar,
@@ -1276,16 +1307,23 @@ class KvSparseApplyAdamOp : public OpKernel {
             ValuePtr<T>* value_ptr = nullptr;
             bool is_filter =false;
             OP_REQUIRES_OK(ctx, var->LookupOrCreateKey(index, &value_ptr, &is_filter));
-            var->UpdateVersion(value_ptr, gs);
+            var->UpdateVersion(index, value_ptr, gs);
             if (is_filter) {
-              auto var_i = var->flat(value_ptr);
-              auto m_a = m->flat(value_ptr);
-              auto v_a = v->flat(value_ptr);
-
-              auto g = grad_flat.template chip<0>(i);
-              m_a += (g - m_a) * (static_cast<T>(1) - beta1_scalar);
-              v_a += (g.square() - v_a) * (static_cast<T>(1) - beta2_scalar);
+              embedding::ValueRow<T> var_row(var->flat(value_ptr));
+              embedding::ValueRow<T> m_row(m->flat(value_ptr));
+              embedding::ValueRow<T> v_row(v->flat(value_ptr));
+              embedding::ConstValueRow<T> g_row(&grad_flat(i, 0), inner_dim);
+              auto var_i = var_row.flat();
+              auto m_a = m_row.flat();
+              auto v_a = v_row.flat();
+
+              auto g = g_row.flat();
+              m_a += (g - m_a) * (static_cast<TC>(1) - beta1_scalar);
+              v_a += (g.square() - v_a) * (static_cast<TC>(1) - beta2_scalar);
               var_i -= (m_a * alpha) / (v_a.sqrt() + epsilon_scalar);
+              var_row.Store();
+              m_row.Store();
+              v_row.Store();
               var->Commit(index, value_ptr);
             }
           }
@@ -1294,7 +1332,8 @@ class KvSparseApplyAdamOp : public OpKernel {
 
       const int64 cost = 1000;
       auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-      Shard(worker_threads.num_threads, worker_threads.workers, N, cost, DoWork);
+      embedding::ShardByNode(var->GetNumaPlacement(), worker_threads.num_threads,
+          worker_threads.workers, indices.flat<Tindex>().data(), N, cost, DoWork);
     }
   }
 
@@ -1303,15 +1342,19 @@ class KvSparseApplyAdamOp : public OpKernel {
 };
 
 #define REGISTER_KERNELS(T, Tindices)                                 \
-  REGISTER_KERNEL_BUILDER(Name("KvResourceSparseApplyAdam")             \
-                              .Device(DEVICE_CPU)                     \
-                              .TypeConstraint<T>("T")                 \
-                              .TypeConstraint<Tindices>("Tindices"),  \
-                          KvSparseApplyAdamOp<CPUDevice, T, Tindices>);
+  REGISTER_KERNEL_BUILDER(                                            \
+      Name("KvResourceSparseApplyAdam")                               \
+          .Device(DEVICE_CPU)                                         \
+          .TypeConstraint<T>("T")                                     \
+          .TypeConstraint<embedding::ComputeType<T>::type>("Tscalar") \
+          .TypeConstraint<Tindices>("Tindices"),                      \
+      KvSparseApplyAdamOp<CPUDevice, T, Tindices>);
 #define REGISTER_CPU_KERNELS(T) \
   REGISTER_KERNELS(T, int32);   \
   REGISTER_KERNELS(T, int64);
 
+TF_CALL_half(REGISTER_CPU_KERNELS);
+TF_CALL_bfloat16(REGISTER_CPU_KERNELS);
 TF_CALL_float(REGISTER_CPU_KERNELS);
 
 #undef REGISTER_CPU_KERNELS
@@ -1885,6 +1928,9 @@ class KvSparseApplyAdamAsyncOp : public OpKernel {
             "grad must be the same size as indices in the first dimension."));
 
     if (N > 0) {
+      // The rows of the batch are not evicted while they are updated.
+      embedding::ScopedPinIds<Tindex, T> pin_ids(var->storage_manager(),
+          indices.vec<Tindex>().data(), N);
       if (apply_sparse_rmsprop_) {
         auto indices_vec = indices.vec<Tindex>();
 
@@ -1903,7 +1949,7 @@ class KvSparseApplyAdamAsyncOp : public OpKernel {
             ValuePtr<T>* value_ptr = nullptr;
             bool is_filter = false;
             OP_REQUIRES_OK(ctx, var->LookupOrCreateKey(index, &value_ptr, &is_filter));
-            var->UpdateVersion(value_ptr, gs);
+            var->UpdateVersion(index, value_ptr, gs);
             if (is_filter) {
               auto v_ = v->flat(value_ptr);
               auto m_ = m->flat(value_ptr);
@@ -1923,7 +1969,8 @@ class KvSparseApplyAdamAsyncOp : public OpKernel {
         };
         const int64 cost = 1000;
         auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-        Shard(worker_threads.num_threads, worker_threads.workers, N, cost, do_work);
+        embedding::ShardByNode(var->GetNumaPlacement(), worker_threads.num_threads,
+            worker_threads.workers, indices_vec.data(), N, cost, do_work);
       } else {
         auto beta1_power_scalar = beta1_power.scalar<T>();
         auto beta2_power_scalar = beta2_power.scalar<T>();
@@ -1952,7 +1999,7 @@ class KvSparseApplyAdamAsyncOp : public OpKernel {
               ValuePtr<T>* value_ptr = nullptr;
               bool is_filter = false;
               OP_REQUIRES_OK(ctx, var->LookupOrCreateKey(index, &value_ptr, &is_filter));
-              var->UpdateVersion(value_ptr, gs);
+              var->UpdateVersion(index, value_ptr, gs);
               if (is_filter) {
                 auto m_a = m->flat(value_ptr);
                 auto v_a = v->flat(value_ptr);
@@ -1970,7 +2017,8 @@ class KvSparseApplyAdamAsyncOp : public OpKernel {
 
         const int64 cost = 1000;
         auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-        Shard(worker_threads.num_threads, worker_threads.workers, N, cost, do_work);
+        embedding::ShardByNode(var->GetNumaPlacement(), worker_threads.num_threads,
+            worker_threads.workers, indices_vec.data(), N, cost, do_work);
 
         beta1_power_scalar() *= beta1_scalar;
         beta2_power_scalar() *= beta2_scalar;
@@ -2228,31 +2276,40 @@ class KvResourceSparseApplyGradientDescentOp : public OpKernel {
         "grad must be the same size as indices in the first dimension."));
 
     if (N > 0) {
+      // The rows of the batch are not evicted while they are updated.
+      embedding::ScopedPinIds<Tindex, T> pin_ids(var->storage_manager(),
+          indices.vec<Tindex>().data(), N);
+      typedef typename embedding::ComputeType<T>::type TC;
       auto indices_vec = indices.vec<Tindex>();
-      T lr_scalar = lr.scalar<T>()();
+      // lr is in TC, not rounded to T.
+      TC lr_scalar = lr.scalar<TC>()();
       Tstep gs = global_step.scalar<Tstep>()();
 
       if (inner_dim > 0) {
         auto grad_flat = grad.flat_outer_dims<T>();
         auto do_work = [this, ctx, &indices_vec, var, &grad_flat, &gs,
-            &lr_scalar] (int64 start_i, int64 limit_i) {
+            &lr_scalar, inner_dim] (int64 start_i, int64 limit_i) {
           for (int64 i = start_i; i < limit_i; i++) {
             const Tindex index = indices_vec(i);
             ValuePtr<T>* value_ptr = nullptr;
             bool is_filter = false;
             OP_REQUIRES_OK(ctx, var->LookupOrCreateKey(index, &value_ptr, &is_filter));
-            var->UpdateVersion(value_ptr, gs);
+            var->UpdateVersion(index, value_ptr, gs);
             if (is_filter) {
-              auto g = grad_flat.template chip<0>(i);
-              auto v = var->flat(value_ptr);
+              embedding::ConstValueRow<T> g_row(&grad_flat(i, 0), inner_dim);
+              embedding::ValueRow<T> v_row(var->flat(value_ptr));
+              auto g = g_row.flat();
+              auto v = v_row.flat();
               v -= g.constant(lr_scalar) * g;
+              v_row.Store();
               var->Commit(index, value_ptr);
             }
           }
         };
         const int64 cost = 1000;
         auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-        Shard(worker_threads.num_threads, worker_threads.workers, N, cost, do_work);
+        embedding::ShardByNode(var->GetNumaPlacement(), worker_threads.num_threads,
+            worker_threads.workers, indices_vec.data(), N, cost, do_work);
       }
     }
 
@@ -2263,14 +2320,16 @@ class KvResourceSparseApplyGradientDescentOp : public OpKernel {
   bool use_exclusive_lock_;
 };
 
-#define REGISTER_KERNELS(T, Tindices, Tstep)                               \
-  REGISTER_KERNEL_BUILDER(Name("KvResourceSparseApplyGradientDescent")     \
-                              .Device(DEVICE_CPU)                          \
-                              .HostMemory("var")                           \
-                              .TypeConstraint<T>("T")                      \
-                              .TypeConstraint<Tindices>("Tindices")        \
-                              .TypeConstraint<Tstep>("Tstep"),             \
-                          KvResourceSparseApplyGradientDescentOp<T, Tindices, Tstep>);
+#define REGISTER_KERNELS(T, Tindices, Tstep)                          \
+  REGISTER_KERNEL_BUILDER(                                            \
+      Name("KvResourceSparseApplyGradientDescent")                    \
+          .Device(DEVICE_CPU)                                         \
+          .HostMemory("var")                                          \
+          .TypeConstraint<T>("T")                                     \
+          .TypeConstraint<embedding::ComputeType<T>::type>("Tscalar") \
+          .TypeConstraint<Tindices>("Tindices")                       \
+          .TypeConstraint<Tstep>("Tstep"),                            \
+      KvResourceSparseApplyGradientDescentOp<T, Tindices, Tstep>);
 
 #define REGISTER_CPU_KERNELS(T)        \
   REGISTER_KERNELS(T, int64, int32);   \
@@ -2278,6 +2337,8 @@ class KvResourceSparseApplyGradientDescentOp : public OpKernel {
   REGISTER_KERNELS(T, int32, int32);   \
   REGISTER_KERNELS(T, int32, int64);   \
 
+TF_CALL_half(REGISTER_CPU_KERNELS);
+TF_CALL_bfloat16(REGISTER_CPU_KERNELS);
 TF_CALL_float(REGISTER_CPU_KERNELS);
 
 #undef REGISTER_CPU_KERNELS
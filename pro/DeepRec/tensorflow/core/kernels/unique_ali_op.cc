@@ -15,6 +15,7 @@ limitations under the License.
 
 #include <algorithm>
 #include <functional>
+#include <memory>
 #include <unordered_map>
 
 #include "absl/container/flat_hash_map.h"
@@ -40,6 +41,8 @@ const char* kMultiMapString = "MULTIMAP";
 const char* kStlHashMapString = "STL";
 const char* kAbslHashMapString = "ABSL";
 const char* kGoogleHashMapString = "GOOGLE";
+const char* kSortString = "SORT";
+const char* kAutoString = "AUTO";
 const int64 kDefaultUniqueRatioHint = 4;
 }
 
@@ -65,7 +68,10 @@ class UniqueAliOp : public OpKernel {
     //     "MULTIMAP" for multimap parrallel process,
     //     "STL" for std::unordred_map,
     //     "ABSL" for absl::flat_hash_map,
-    //     "GOOGLE" for google::dense_hash_map.
+    //     "GOOGLE" for google::dense_hash_map,
+    //     "SORT" for radix sort of int32 and int64 keys,
+    //     "AUTO" for choosing among the serial hash map, the partitioned
+    //            hash map and the radix sort by the measured batches.
     std::string hash_map_str;
     OP_REQUIRES_OK(context, ReadStringFromEnvVar(kUniqueOpHashMapEnv,
                                                  kGoogleHashMapString,
@@ -92,6 +98,11 @@ class UniqueAliOp : public OpKernel {
       map_flag_ = ABSL;
     } else if (!hash_map_str.compare(kGoogleHashMapString)) {
       map_flag_ = GOOGLE;
+    } else if (!hash_map_str.compare(kSortString)) {
+      map_flag_ = SORT;
+    } else if (!hash_map_str.compare(kAutoString)) {
+      map_flag_ = AUTO;
+      selector_.reset(new UniqueAlgorithmSelector(unique_ratio_hint_));
     } else {
       map_flag_ = GOOGLE;
     }
@@ -113,13 +124,13 @@ class UniqueAliOp : public OpKernel {
       UniqueWithoutAxis<T, TIndex>(context, input,
           &idx, &output, &output_counter, num_outputs(),
           partition_size_, serial_, unique_ratio_hint_,
-          map_flag_);
+          map_flag_, selector_.get());
     } else {
       const Tensor& axis_tensor = context->input(1);
       UniqueWithAxis<T, TIndex>(context, input,
           axis_tensor, &idx, &output, &output_counter,
           num_outputs(), partition_size_, serial_,
-          unique_ratio_hint_, map_flag_);
+          unique_ratio_hint_, map_flag_, selector_.get());
     }
     context->set_output(0, output);
     context->set_output(1, idx);
@@ -132,6 +143,7 @@ class UniqueAliOp : public OpKernel {
   int64 partition_size_ = 0;
   int64 unique_ratio_hint_;
   UniqueMaps map_flag_ = GOOGLE;  // "GOOGLE" dense hash map is default
+  std::unique_ptr<UniqueAlgorithmSelector> selector_;
 };
 
 #define REGISTER_UNIQUE(type)                                    \
@@ -19,6 +19,7 @@ limitations under the License.
 #include <algorithm>
 #include <limits>
 #include <functional>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 
@@ -36,6 +37,8 @@ limitations under the License.
 #include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/work_sharder.h"
 
@@ -53,7 +56,11 @@ typedef enum {
   MULTIMAP = 0,
   STL = 1,
   ABSL = 2,
-  GOOGLE = 3
+  GOOGLE = 3,
+  // Radix sort of int32 and int64 ids, others fall back to GOOGLE.
+  SORT = 4,
+  // Chosen at runtime by UniqueAlgorithmSelector.
+  AUTO = 5
 } UniqueMaps;
 
 }  // namespace
@@ -561,6 +568,333 @@ void MultiMapCompute(OpKernelContext* context, const Tensor& input,
   t2_runner.Run();
 }
 
+// LSD radix sort based unique of int32 and int64 ids. The (id, position)
+// pairs are sorted by 8-bit digits in parallel, the digits shared by all ids
+// are skipped, e.g. the high bytes of small ids. Sorting is stable, so the
+// first element of each run of equal ids is its first occurrence, and the
+// unique ids are numbered in the order of first occurrence as in
+// SerialComputeV1. The counts are produced along with the runs.
+template<typename T, typename TIndex>
+void RadixSortCompute(OpKernelContext* context, const Tensor& input,
+    Tensor* idx, int64 axis, int64* uniq_size_out, bool serial,
+    int num_outputs, Tensor* output_counter, Tensor* output) {
+  typedef typename std::make_unsigned<T>::type UT;
+  const int kRadixBits = 8;
+  const int kRadixSize = 1 << kRadixBits;
+
+  auto Tin = input.flat<T>();
+  const int64 N = input.NumElements();
+  auto idx_vec = idx->template vec<TIndex>();
+  AllocatorAttributes attr;
+  attr.set_on_host(true);
+  if (N == 0) {
+    *uniq_size_out = 0;
+    OP_REQUIRES_OK(context, context->allocate_temp(
+        DataTypeToEnum<T>::v(), input.shape(), output, attr));
+    if (num_outputs > 2) {
+      OP_REQUIRES_OK(context, context->allocate_temp(
+          DataTypeToEnum<TIndex>::v(), TensorShape({0}), output_counter,
+          attr));
+    }
+    return;
+  }
+
+  int32 max_threads =
+    context->device()->tensorflow_cpu_worker_threads()->num_threads;
+  auto thread_pool =
+    context->device()->tensorflow_cpu_worker_threads()->workers;
+  int32 num_tasks = static_cast<int32>(std::max<int64>(1, std::min<int64>(
+      max_threads, (N + kPartitionSize - 1) / kPartitionSize)));
+  if (serial) num_tasks = 1;
+  Partitioner parter(N, num_tasks);
+
+  std::unique_ptr<UT[]> keys(new UT[N]);
+  std::unique_ptr<UT[]> keys_tmp(new UT[N]);
+  std::unique_ptr<uint32[]> pos(new uint32[N]);
+  std::unique_ptr<uint32[]> pos_tmp(new uint32[N]);
+
+  // Step 1: Load the ids, find out the bits which differ between them.
+  std::vector<UT> or_bits(num_tasks, 0);
+  std::vector<UT> and_bits(num_tasks, static_cast<UT>(~UT(0)));
+  auto LoadTask = [&Tin, &keys, &pos, &or_bits, &and_bits, &parter]
+    (int32 task_id, int32 num_tasks) {
+      const Range* range = parter.GetRange(task_id);
+      UT o = 0, a = static_cast<UT>(~UT(0));
+      for (int64 i = range->Start(); i < range->End(); ++i) {
+        const UT k = static_cast<UT>(Tin(i));
+        keys[i] = k;
+        pos[i] = static_cast<uint32>(i);
+        o |= k;
+        a &= k;
+      }
+      or_bits[task_id] = o;
+      and_bits[task_id] = a;
+    };
+  TaskRunner load_runner(LoadTask, thread_pool, num_tasks);
+  load_runner.Run();
+  UT varying = 0;
+  {
+    UT o = 0, a = static_cast<UT>(~UT(0));
+    for (int32 i = 0; i < num_tasks; ++i) {
+      o |= or_bits[i];
+      a &= and_bits[i];
+    }
+    varying = o ^ a;
+  }
+
+  // Step 2: One counting pass and one scatter pass per varying digit.
+  std::vector<int64> offsets(num_tasks * kRadixSize);
+  for (int shift = 0; shift < static_cast<int>(sizeof(UT) * 8);
+       shift += kRadixBits) {
+    if (((varying >> shift) & (kRadixSize - 1)) == 0) continue;
+    auto CountTask = [&keys, &offsets, &parter, shift, kRadixSize]
+      (int32 task_id, int32 num_tasks) {
+        const Range* range = parter.GetRange(task_id);
+        int64* hist = offsets.data() + task_id * kRadixSize;
+        std::fill(hist, hist + kRadixSize, 0);
+        for (int64 i = range->Start(); i < range->End(); ++i) {
+          ++hist[(keys[i] >> shift) & (kRadixSize - 1)];
+        }
+      };
+    TaskRunner count_runner(CountTask, thread_pool, num_tasks);
+    count_runner.Run();
+
+    // Digit major, then task, to keep the sort stable.
+    int64 start = 0;
+    for (int b = 0; b < kRadixSize; ++b) {
+      for (int32 t = 0; t < num_tasks; ++t) {
+        const int64 count = offsets[t * kRadixSize + b];
+        offsets[t * kRadixSize + b] = start;
+        start += count;
+      }
+    }
+
+    auto ScatterTask = [&keys, &keys_tmp, &pos, &pos_tmp, &offsets, &parter,
+        shift, kRadixSize] (int32 task_id, int32 num_tasks) {
+      const Range* range = parter.GetRange(task_id);
+      int64* offset = offsets.data() + task_id * kRadixSize;
+      for (int64 i = range->Start(); i < range->End(); ++i) {
+        const int64 dst = offset[(keys[i] >> shift) & (kRadixSize - 1)]++;
+        keys_tmp[dst] = keys[i];
+        pos_tmp[dst] = pos[i];
+      }
+    };
+    TaskRunner scatter_runner(ScatterTask, thread_pool, num_tasks);
+    scatter_runner.Run();
+    keys.swap(keys_tmp);
+    pos.swap(pos_tmp);
+  }
+  keys_tmp.reset();
+  pos_tmp.reset();
+
+  // Step 3: Mark the first occurrences, number them in the order of their
+  //         positions. The number of the run is kept in the index of its
+  //         first position.
+  std::unique_ptr<bool[]> is_first(new bool[N]);
+  auto MarkTask = [&keys, &pos, &is_first, &parter]
+    (int32 task_id, int32 num_tasks) {
+      const Range* range = parter.GetRange(task_id);
+      for (int64 i = range->Start(); i < range->End(); ++i) {
+        is_first[pos[i]] = (i == 0 || keys[i] != keys[i - 1]);
+      }
+    };
+  TaskRunner mark_runner(MarkTask, thread_pool, num_tasks);
+  mark_runner.Run();
+
+  std::vector<int64> first_counts(num_tasks, 0);
+  auto CountFirstTask = [&is_first, &first_counts, &parter]
+    (int32 task_id, int32 num_tasks) {
+      const Range* range = parter.GetRange(task_id);
+      int64 count = 0;
+      for (int64 i = range->Start(); i < range->End(); ++i) {
+        count += is_first[i];
+      }
+      first_counts[task_id] = count;
+    };
+  TaskRunner count_first_runner(CountFirstTask, thread_pool, num_tasks);
+  count_first_runner.Run();
+  int64 uniq_size = 0;
+  for (int32 i = 0; i < num_tasks; ++i) {
+    const int64 count = first_counts[i];
+    first_counts[i] = uniq_size;
+    uniq_size += count;
+  }
+
+  auto NumberTask = [&is_first, &first_counts, &idx_vec, &parter]
+    (int32 task_id, int32 num_tasks) {
+      const Range* range = parter.GetRange(task_id);
+      int64 id = first_counts[task_id];
+      for (int64 i = range->Start(); i < range->End(); ++i) {
+        if (is_first[i]) {
+          idx_vec(i) = id++;
+        }
+      }
+    };
+  TaskRunner number_runner(NumberTask, thread_pool, num_tasks);
+  number_runner.Run();
+  is_first.reset();
+
+  *uniq_size_out = uniq_size;
+  TensorShape output_shape(input.shape());
+  output_shape.set_dim(axis, uniq_size);
+  OP_REQUIRES_OK(context, context->allocate_temp(
+      DataTypeToEnum<T>::v(), output_shape, output, attr));
+  auto key_output_vec = output->template vec<T>();
+  if (num_outputs > 2) {
+    OP_REQUIRES_OK(context, context->allocate_temp(
+        DataTypeToEnum<TIndex>::v(), TensorShape({uniq_size}),
+        output_counter, attr));
+  }
+  TIndex* counts = num_outputs > 2 ?
+      output_counter->template vec<TIndex>().data() : nullptr;
+
+  // Step 4: Every task writes the runs starting in its range of the sorted
+  //         ids, the last run may extend beyond the range.
+  auto OutputTask = [&keys, &pos, &idx_vec, &key_output_vec, counts,
+      &parter, N] (int32 task_id, int32 num_tasks) {
+      const Range* range = parter.GetRange(task_id);
+      int64 i = range->Start();
+      while (i < range->End() && i > 0 && keys[i] == keys[i - 1]) {
+        ++i;
+      }
+      while (i < range->End()) {
+        const TIndex id = idx_vec(pos[i]);
+        const UT key = keys[i];
+        key_output_vec(id) = static_cast<T>(key);
+        int64 j = i + 1;
+        for (; j < N && keys[j] == key; ++j) {
+          idx_vec(pos[j]) = id;
+        }
+        if (counts != nullptr) {
+          counts[id] = static_cast<TIndex>(j - i);
+        }
+        i = j;
+      }
+    };
+  TaskRunner output_runner(OutputTask, thread_pool, num_tasks);
+  output_runner.Run();
+}
+
+template <typename T>
+struct RadixSortable {
+  static constexpr bool value =
+      std::is_same<T, int32>::value || std::is_same<T, int64>::value;
+};
+
+// Returns false for the types not supported by RadixSortCompute.
+template <typename T, typename TIndex,
+          bool kSortable = RadixSortable<T>::value>
+struct RadixSortUnique {
+  static bool Compute(OpKernelContext* context, const Tensor& input,
+      Tensor* idx, int64 axis, int64* uniq_size, bool serial,
+      int num_outputs, Tensor* output_counter, Tensor* output) {
+    return false;
+  }
+};
+
+template <typename T, typename TIndex>
+struct RadixSortUnique<T, TIndex, true> {
+  static bool Compute(OpKernelContext* context, const Tensor& input,
+      Tensor* idx, int64 axis, int64* uniq_size, bool serial,
+      int num_outputs, Tensor* output_counter, Tensor* output) {
+    OP_REQUIRES(context,
+                input.NumElements() <= std::numeric_limits<int32>::max(),
+                errors::InvalidArgument(
+                    "unique does not support input tensors larger than ",
+                    std::numeric_limits<int32>::max(), " elements"));
+    RadixSortCompute<T, TIndex>(context, input, idx, axis, uniq_size,
+                                serial, num_outputs, output_counter, output);
+    return true;
+  }
+};
+
+// Picks the implementation of Unique at runtime for
+// 'DEEPREC_UNIQUE_OP_HASH_MAP=AUTO', one selector per kernel. Batches smaller
+// than kPartitionLimit use the serial hash map. For larger batches the radix
+// sort and the partitioned hash map are timed on the live batches: each one
+// runs kWarmupRuns times first, then the one with the lower moving average of
+// nanoseconds per id is used and the other one is retried every
+// kProbeInterval runs, so that the choice follows the batch size and the
+// unique ratio. Both are measured again when the batch size changes by more
+// than 2x. The moving average of the unique ratio sizes the hash maps instead
+// of 'DEEPREC_UNIQUE_OP_UNIQ_RATIO_HINT'.
+class UniqueAlgorithmSelector {
+ public:
+  enum Algorithm {
+    kSerialHash = 0,
+    kPartitionedHash = 1,
+    kRadixSort = 2,
+    kNumAlgorithms
+  };
+
+  explicit UniqueAlgorithmSelector(int64 unique_ratio_hint)
+      : default_ratio_hint_(unique_ratio_hint) {}
+
+  Algorithm Select(int64 n) {
+    if (n < kPartitionLimit) {
+      return kSerialHash;
+    }
+    mutex_lock l(mu_);
+    if (n > 2 * batch_size_ || 2 * n < batch_size_) {
+      batch_size_ = n;
+      runs_[kPartitionedHash] = 0;
+      runs_[kRadixSort] = 0;
+    }
+    for (int a = kPartitionedHash; a < kNumAlgorithms; ++a) {
+      if (runs_[a] < kWarmupRuns) {
+        return static_cast<Algorithm>(a);
+      }
+    }
+    const Algorithm best = cost_[kRadixSort] <= cost_[kPartitionedHash] ?
+        kRadixSort : kPartitionedHash;
+    if (++selections_ % kProbeInterval == 0) {
+      return best == kRadixSort ? kPartitionedHash : kRadixSort;
+    }
+    return best;
+  }
+
+  void Update(Algorithm algo, int64 n, int64 uniq_size, int64 micros) {
+    if (n <= 0) return;
+    mutex_lock l(mu_);
+    const double ratio = static_cast<double>(uniq_size) / n;
+    unique_ratio_ = unique_ratio_ < 0 ? ratio :
+        (1 - kDecay) * unique_ratio_ + kDecay * ratio;
+    if (algo == kSerialHash) return;
+    const double ns_per_id = micros * 1000.0 / n;
+    cost_[algo] = runs_[algo] == 0 ? ns_per_id :
+        (1 - kDecay) * cost_[algo] + kDecay * ns_per_id;
+    if (++runs_[algo] == kWarmupRuns && runs_[kPartitionedHash] >= kWarmupRuns
+        && runs_[kRadixSort] >= kWarmupRuns) {
+      VLOG(1) << "[UniqueAuto] batch size: " << n
+              << ", unique ratio: " << unique_ratio_
+              << ", partitioned hash ns/id: " << cost_[kPartitionedHash]
+              << ", radix sort ns/id: " << cost_[kRadixSort];
+    }
+  }
+
+  // Ids per unique id of the recent batches.
+  int64 UniqueRatioHint() {
+    mutex_lock l(mu_);
+    if (unique_ratio_ <= 0) {
+      return default_ratio_hint_;
+    }
+    return std::max<int64>(1, static_cast<int64>(1.0 / unique_ratio_));
+  }
+
+ private:
+  static constexpr int64 kWarmupRuns = 3;
+  static constexpr int64 kProbeInterval = 100;
+  static constexpr double kDecay = 0.2;
+
+  mutex mu_;
+  const int64 default_ratio_hint_;
+  int64 batch_size_ GUARDED_BY(mu_) = 0;
+  int64 selections_ GUARDED_BY(mu_) = 0;
+  int64 runs_[kNumAlgorithms] GUARDED_BY(mu_) = {0, 0, 0};
+  double cost_[kNumAlgorithms] GUARDED_BY(mu_) = {0, 0, 0};
+  double unique_ratio_ GUARDED_BY(mu_) = -1;
+};
+
 template<typename T, typename TIndex>
 void MultipleElements(OpKernelContext* context, const Tensor& input,
                       Tensor* idx, Tensor* output, int64* uniq_size,
@@ -658,11 +992,50 @@ void ComputeInternalWithHashMap(OpKernelContext* context, const Tensor& input,
   }
 }
 
+// Runs the implementation picked by 'selector' over the 1-D int32 or int64
+// 'input', returns true if the counts are produced.
+template<typename T, typename TIndex>
+bool AutoCompute(OpKernelContext* context, const Tensor& input, Tensor* idx,
+    int64 axis, int64* uniq_size, int32 num_buckets, int num_outputs,
+    Tensor* output_counter, UniqueAlgorithmSelector* selector,
+    Tensor* output) {
+  typedef google::dense_hash_map<T, TIndex> DefaultHashMap;
+  const int64 N = input.NumElements();
+  const uint64 start = Env::Default()->NowMicros();
+  const UniqueAlgorithmSelector::Algorithm algo = selector->Select(N);
+  bool counted = false;
+  switch (algo) {
+    case UniqueAlgorithmSelector::kRadixSort:
+      counted = RadixSortUnique<T, TIndex>::Compute(context, input, idx,
+          axis, uniq_size, false, num_outputs, output_counter, output);
+      break;
+    case UniqueAlgorithmSelector::kPartitionedHash:
+      if (std::is_same<T, int64>::value && num_buckets > 1) {
+        MultiMapCompute<TIndex, google::dense_hash_map<int64, TIndex, IdHash>>
+            (context, input, idx, axis, uniq_size, num_buckets,
+             selector->UniqueRatioHint(), output);
+      } else {
+        ParallelComputeV1<T, TIndex, DefaultHashMap>
+            (context, input, idx, axis, uniq_size, output);
+      }
+      break;
+    default:
+      SerialComputeV1<T, TIndex, DefaultHashMap>
+          (context, input, idx, axis, uniq_size, output);
+  }
+  if (context->status().ok()) {
+    selector->Update(algo, N, *uniq_size,
+                     Env::Default()->NowMicros() - start);
+  }
+  return counted;
+}
+
 template<typename T, typename TIndex>
 void UniqueInternal(OpKernelContext* context, const Tensor& input,
     Tensor* idx, Tensor* output, Tensor* output_counter, int num_outputs,
     int64 partition_size, bool serial, int64 axis, int64 unique_ratio_hint,
-    std::vector<int64>& new_sizes, UniqueMaps map_flag) {
+    std::vector<int64>& new_sizes, UniqueMaps map_flag,
+    UniqueAlgorithmSelector* selector) {
   typedef google::dense_hash_map<T, TIndex> DefaultHashMap;
 
   AllocatorAttributes attr;
@@ -672,6 +1045,8 @@ void UniqueInternal(OpKernelContext* context, const Tensor& input,
       TensorShape({new_sizes[1]}), idx, attr));
 
   int64 uniq_size_out;
+  // The radix sort produces the counts along with the unique ids.
+  bool counted = false;
 
   if (new_sizes[0] == 1 && new_sizes[2] == 1) {
     // Specialized and faster implementation when unique is run over single
@@ -705,6 +1080,25 @@ void UniqueInternal(OpKernelContext* context, const Tensor& input,
         ComputeInternalWithHashMap<T, TIndex, DefaultHashMap>
             (context, input, idx, axis, &uniq_size_out, N, serial, output);
         break;
+      case SORT:
+        counted = RadixSortUnique<T, TIndex>::Compute(context, input, idx,
+            axis, &uniq_size_out, serial, num_outputs, output_counter,
+            output);
+        if (!counted) {
+          ComputeInternalWithHashMap<T, TIndex, DefaultHashMap>
+              (context, input, idx, axis, &uniq_size_out, N, serial, output);
+        }
+        break;
+      case AUTO:
+        if (selector != nullptr && RadixSortable<T>::value && !serial) {
+          counted = AutoCompute<T, TIndex>(context, input, idx, axis,
+              &uniq_size_out, num_buckets, num_outputs, output_counter,
+              selector, output);
+        } else {
+          ComputeInternalWithHashMap<T, TIndex, DefaultHashMap>
+              (context, input, idx, axis, &uniq_size_out, N, serial, output);
+        }
+        break;
       default:
         ComputeInternalWithHashMap<T, TIndex, DefaultHashMap>
             (context, input, idx, axis, &uniq_size_out, N, serial, output);
@@ -712,35 +1106,39 @@ void UniqueInternal(OpKernelContext* context, const Tensor& input,
   } else {
     MultipleElements<T, TIndex>(context, input, idx, output, &uniq_size_out, axis, new_sizes);
   }
+  if (!context->status().ok()) return;
 
-  CheckCountOutput<TIndex>(context, output_counter, idx, num_outputs, uniq_size_out);
+  if (!counted) {
+    CheckCountOutput<TIndex>(context, output_counter, idx, num_outputs, uniq_size_out);
+  }
 }
 
 template<typename T, typename TIndex>
 void UniqueWithoutAxis(OpKernelContext* context, const Tensor& input,
     Tensor* idx, Tensor* output, Tensor* output_counter, int num_outputs,
     int64 partition_size, bool serial, int64 unique_ratio_hint,
-    UniqueMaps map_flag) {
+    UniqueMaps map_flag, UniqueAlgorithmSelector* selector = nullptr) {
   int64 axis = 0;
   std::vector<int64> new_sizes{1, input.NumElements(), 1};
   OP_REQUIRES(context, TensorShapeUtils::IsVector(input.shape()),
               errors::InvalidArgument("unique expects a 1D vector."));
   UniqueInternal<T, TIndex>(context, input, idx, output,
       output_counter, num_outputs, partition_size, serial,
-      axis, unique_ratio_hint, new_sizes, map_flag);
+      axis, unique_ratio_hint, new_sizes, map_flag, selector);
 }
 
 template<typename T, typename TIndex>
 void UniqueWithAxis(OpKernelContext* context, const Tensor& input,
     const Tensor& axis_tensor, Tensor* idx, Tensor* output,
     Tensor* output_counter, int num_outputs, int64 partition_size,
-    bool serial, int64 unique_ratio_hint, UniqueMaps map_flag) {
+    bool serial, int64 unique_ratio_hint, UniqueMaps map_flag,
+    UniqueAlgorithmSelector* selector = nullptr) {
   int64 axis = 0;
   std::vector<int64> new_sizes{1, input.NumElements(), 1};
   NewSizes(context, input, axis_tensor, new_sizes, axis);
   UniqueInternal<T, TIndex>(context, input, idx, output,
       output_counter, num_outputs, partition_size, serial,
-      axis, unique_ratio_hint, new_sizes, map_flag);
+      axis, unique_ratio_hint, new_sizes, map_flag, selector);
 }
 
 }  // namespace tensorflow
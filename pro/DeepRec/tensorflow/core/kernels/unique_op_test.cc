@@ -13,6 +13,8 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <cmath>
+#include <cstdlib>
 #include <functional>
 #include <memory>
 
@@ -180,6 +182,80 @@ BENCHMARK(BM_Unique_INT32_Repeat)
     ->ArgPair(64 * 1024, 64 * 1024 * 1024)
     ->ArgPair(1024 * 1024, 64 * 1024 * 1024);
 
+// Uniform ids in [0, max_int), or power law ids concentrated on the small
+// ones if 'skewed'.
+TensorProto GetRandomInt64TensorProto(int dim, int max_int, bool skewed) {
+  TensorProto tensor_proto;
+  tensor_proto.set_dtype(DT_INT64);
+  tensor_proto.mutable_tensor_shape()->add_dim()->set_size(dim);
+  tensor_proto.mutable_tensor_shape()->set_unknown_rank(false);
+  for (int i = 0; i < dim; ++i) {
+    int64 int_val;
+    if (skewed) {
+      const double u = static_cast<double>(std::rand()) / RAND_MAX;
+      int_val = static_cast<int64>(std::pow(u, 4.0) * (max_int - 1));
+    } else {
+      int_val = std::rand() % max_int;
+    }
+    tensor_proto.add_int64_val(int_val);
+  }
+  return tensor_proto;
+}
+
+// Runs UniqueWithCounts over int64 ids with the implementation set by
+// DEEPREC_UNIQUE_OP_HASH_MAP.
+static void BM_Unique_INT64_WithAlgorithm(int iters, int dim, int max_int,
+                                          bool skewed, const char* algorithm) {
+  testing::StopTiming();
+  setenv("DEEPREC_UNIQUE_OP_HASH_MAP", algorithm, 1);
+  Graph* g = new Graph(OpRegistry::Global());
+
+  Tensor input(DT_INT64, TensorShape({dim}));
+  CHECK(input.FromProto(GetRandomInt64TensorProto(dim, max_int, skewed)));
+
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "UniqueWithCounts")
+                  .Input(test::graph::Constant(g, input))
+                  .Attr("T", DT_INT64)
+                  .Finalize(g, &node));
+
+  testing::BytesProcessed(static_cast<int64>(iters) * dim * sizeof(int64));
+  testing::UseRealTime();
+  testing::StartTiming();
+  test::Benchmark("cpu", g).Run(iters);
+  unsetenv("DEEPREC_UNIQUE_OP_HASH_MAP");
+}
+
+// Batch sizes from 16K to 4M ids, with about 1/64, 1/2 and all of the ids
+// unique.
+#define BM_UNIQUE_INT64_ARGS(BM)                  \
+  BENCHMARK(BM)                                   \
+      ->ArgPair(16 * 1024, 256)                   \
+      ->ArgPair(16 * 1024, 16 * 1024)             \
+      ->ArgPair(16 * 1024, 1024 * 1024 * 1024)    \
+      ->ArgPair(256 * 1024, 4 * 1024)             \
+      ->ArgPair(256 * 1024, 256 * 1024)           \
+      ->ArgPair(256 * 1024, 1024 * 1024 * 1024)   \
+      ->ArgPair(4 * 1024 * 1024, 64 * 1024)       \
+      ->ArgPair(4 * 1024 * 1024, 4 * 1024 * 1024) \
+      ->ArgPair(4 * 1024 * 1024, 1024 * 1024 * 1024)
+
+#define BM_UNIQUE_INT64_ALGORITHM(ALGO)                                    \
+  static void BM_Unique_INT64_##ALGO(int iters, int dim, int max_int) {    \
+    BM_Unique_INT64_WithAlgorithm(iters, dim, max_int, false, #ALGO);      \
+  }                                                                        \
+  static void BM_Unique_INT64_Skewed_##ALGO(int iters, int dim,            \
+                                            int max_int) {                 \
+    BM_Unique_INT64_WithAlgorithm(iters, dim, max_int, true, #ALGO);       \
+  }                                                                        \
+  BM_UNIQUE_INT64_ARGS(BM_Unique_INT64_##ALGO);                            \
+  BM_UNIQUE_INT64_ARGS(BM_Unique_INT64_Skewed_##ALGO)
+
+BM_UNIQUE_INT64_ALGORITHM(GOOGLE);
+BM_UNIQUE_INT64_ALGORITHM(MULTIMAP);
+BM_UNIQUE_INT64_ALGORITHM(SORT);
+BM_UNIQUE_INT64_ALGORITHM(AUTO);
+
 BENCHMARK(BM_Unique_STRING)
     ->Arg(32)
     ->Arg(256)
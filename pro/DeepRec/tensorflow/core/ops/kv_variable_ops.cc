@@ -170,6 +170,7 @@ REGISTER_OP("KvVarIsInitializedOp")
     .Input("resource: resource")
     .Output("is_initialized: bool")
     .Attr("Tkeys: {int64,int32,string}")
+    .Attr("dtype: type = DT_FLOAT")
     .SetShapeFn(tensorflow::shape_inference::ScalarShape)
     .Doc(R"doc(
 Checks whether a resource handle-based variable has been initialized.
@@ -193,6 +194,7 @@ REGISTER_OP("KvVariableShape")
     .Output("output: out_type")
     .Attr("out_type: {int32, int64} = DT_INT32")
     .Attr("Tkeys: {int64,int32,string}")
+    .Attr("dtype: type = DT_FLOAT")
     .SetShapeFn(KvVariableShapeShapeFn)
     .Doc(R"doc(
 Returns the shape of the variable pointed to by `resource`.
@@ -208,6 +210,33 @@ shape(t) ==> [2, 2, 3]
 
 )doc");
 
+REGISTER_OP("KvResourceStatistics")
+    .Input("resource: resource")
+    .Output("statistics: int64")
+    .Output("hot_keys: Tkeys")
+    .Output("hot_counts: int64")
+    .Attr("Tkeys: {int64, int32}")
+    .Attr("dtype: type")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      c->set_output(0, c->Vector(c->UnknownDim()));
+      c->set_output(1, c->Vector(c->UnknownDim()));
+      c->set_output(2, c->Vector(c->UnknownDim()));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Returns the lookup statistics of the EmbeddingVariable pointed to by
+`resource`, accumulated since it was created.
+
+statistics: counters in the order of embedding::EmbeddingStatistic, i.e.
+  batches, ids, unique ids, new ids, tier0 hits, tier1 hits, disk read bytes,
+  cache evictions, shrink evictions, shrink eviction bytes, LevelDB reads,
+  read misses, read micros, writes and write micros, and elapsed micros
+  since the first batch.
+hot_keys: approximate heavy hitters, the most frequent id first.
+hot_counts: estimated frequency of `hot_keys`.
+)doc");
+
 REGISTER_OP("DestroyKvResourceOp")
     .Input("resource: resource")
     .Attr("ignore_lookup_error: bool = true")
@@ -318,6 +347,149 @@ Produces an output tensor with shape `indices.shape + params.shape[1:]` where:
 
 )doc");
 
+REGISTER_OP("KvResourcePrefetch")
+    .Input("resource: resource")
+    .Input("indices: Tkeys")
+    .Output("output: Tkeys")
+    .Attr("dtype: type")
+    .Attr("Tkeys: {int64,int32}")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeAndType handle_shape_and_type;
+      TF_RETURN_IF_ERROR(
+          ValidateVariableResourceHandle(c, &handle_shape_and_type));
+      c->set_output(0, c->input(1));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Brings `indices` into the first storage tier of the variable pointed to by
+`resource` ahead of their KvResourceGather, new ids are created with the
+default value of the variable. Inserted by SmartStage in the staged subgraph, so that the storage
+latency of the next batch is hidden behind the computation of the current
+one.
+
+output: `indices`, forwarded to the KvResourceGather.
+)doc");
+
+REGISTER_OP("KvResourceEmbeddingLookupSparse")
+    .Input("resource: resource")
+    .Input("sp_values: Tkeys")
+    .Input("sp_indices: int64")
+    .Input("sp_dense_shape: int64")
+    .Output("output: dtype")
+    .Output("unique_keys: Tkeys")
+    .Output("unique_idx: int32")
+    .Attr("combiner: {'sqrtn', 'mean', 'sum'} = 'mean'")
+    .Attr("dtype: {float, double}")
+    .Attr("Tkeys: {int64, int32}")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeAndType handle_shape_and_type;
+      TF_RETURN_IF_ERROR(
+          ValidateVariableResourceHandle(c, &handle_shape_and_type));
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &unused));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 2, &unused));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &unused));
+
+      DimensionHandle emb_dim = c->UnknownDim();
+      if (c->RankKnown(handle_shape_and_type.shape) &&
+          c->Rank(handle_shape_and_type.shape) > 0) {
+        emb_dim = c->Dim(handle_shape_and_type.shape, -1);
+      }
+      c->set_output(0, c->MakeShape({c->UnknownDim(), emb_dim}));
+      c->set_output(1, c->Vector(c->UnknownDim()));
+      c->set_output(2, c->Vector(c->Dim(c->input(1), 0)));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Looks up and combines the embeddings of a 2-D SparseTensor of ids.
+
+Equivalent to Unique + KvResourceGather + SparseSegment{Sum,Mean,SqrtN}
+over the rows of the SparseTensor, but every distinct id is looked up once
+and the rows are reduced directly into `output`, without the intermediate
+gathered tensors.
+
+sp_values: ids of the SparseTensor.
+sp_indices: indices of the SparseTensor, the first column is the row.
+sp_dense_shape: dense shape of the SparseTensor, `output` has
+  `sp_dense_shape[0]` rows, empty rows are zero.
+output: combined embeddings, [sp_dense_shape[0], embedding_dim].
+unique_keys: distinct ids of `sp_values`.
+unique_idx: position of each `sp_values` in `unique_keys`.
+)doc");
+
+REGISTER_OP("KvResourceStringEmbeddingLookupSparse")
+    .Input("resource: resource")
+    .Input("sp_values: string")
+    .Input("sp_indices: int64")
+    .Input("sp_dense_shape: int64")
+    .Output("output: dtype")
+    .Output("unique_keys: int64")
+    .Output("unique_idx: int32")
+    .Attr("combiner: {'sqrtn', 'mean', 'sum'} = 'mean'")
+    .Attr("dtype: {float, double}")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeAndType handle_shape_and_type;
+      TF_RETURN_IF_ERROR(
+          ValidateVariableResourceHandle(c, &handle_shape_and_type));
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &unused));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 2, &unused));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &unused));
+
+      DimensionHandle emb_dim = c->UnknownDim();
+      if (c->RankKnown(handle_shape_and_type.shape) &&
+          c->Rank(handle_shape_and_type.shape) > 0) {
+        emb_dim = c->Dim(handle_shape_and_type.shape, -1);
+      }
+      c->set_output(0, c->MakeShape({c->UnknownDim(), emb_dim}));
+      c->set_output(1, c->Vector(c->UnknownDim()));
+      c->set_output(2, c->Vector(c->Dim(c->input(1), 0)));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+KvResourceEmbeddingLookupSparse of a 2-D SparseTensor of strings.
+
+Every string is hashed into an int64 id as StringToHash64 does, without
+bucketing, and the ids are deduplicated, looked up and combined in the same
+op. The gradient is KvResourceEmbeddingLookupSparseGrad.
+
+sp_values: strings of the SparseTensor.
+sp_indices: indices of the SparseTensor, the first column is the row.
+sp_dense_shape: dense shape of the SparseTensor, `output` has
+  `sp_dense_shape[0]` rows, empty rows are zero.
+output: combined embeddings, [sp_dense_shape[0], embedding_dim].
+unique_keys: distinct ids of the hashed `sp_values`.
+unique_idx: position of each `sp_values` in `unique_keys`.
+)doc");
+
+REGISTER_OP("KvResourceEmbeddingLookupSparseGrad")
+    .Input("gradients: dtype")
+    .Input("sp_indices: int64")
+    .Input("unique_keys: Tkeys")
+    .Input("unique_idx: int32")
+    .Output("output: dtype")
+    .Attr("combiner: {'sqrtn', 'mean', 'sum'} = 'mean'")
+    .Attr("dtype: {float, double}")
+    .Attr("Tkeys: {int64, int32}")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle grad_shape;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 2, &grad_shape));
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 2, &unused));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &unused));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &unused));
+      c->set_output(0, c->MakeShape({c->Dim(c->input(2), 0),
+                                     c->Dim(grad_shape, 1)}));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Gradient of KvResourceEmbeddingLookupSparse w.r.t. the embeddings of
+`unique_keys`, each distinct id gets one row of accumulated gradient.
+
+gradients: gradient of the `output` of KvResourceEmbeddingLookupSparse.
+output: [size(unique_keys), embedding_dim].
+)doc");
+
 REGISTER_OP("KvResourceScatterAdd")
     .Input("resource: resource")
     .Input("indices: Tkeys")
@@ -22,6 +22,7 @@ limitations under the License.
 
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/shape_inference.h"
+#include "tensorflow/core/util/tensor_buffer_statistics.h"
 
 namespace tensorflow {
 
@@ -68,4 +69,15 @@ REGISTER_OP("TensorBufferSize")
     .SetShapeFn(shape_inference::ScalarShape)
     .SetIsStateful();
 
+REGISTER_OP("TensorBufferStatistics")
+    .Output("statistics: int64")
+    .Attr("container: string = ''")
+    .Attr("shared_name: string = ''")
+    .Attr("shared_capacity: int >= 1 = 1")
+    .SetShapeFn([](shape_inference::InferenceContext* c) {
+      c->set_output(0, c->Vector(tensor_buffer::kNumStatistics));
+      return Status::OK();
+    })
+    .SetIsStateful();
+
 }
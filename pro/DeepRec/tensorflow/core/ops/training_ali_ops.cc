@@ -94,11 +94,13 @@ static Status KvResourceApplyAdagradShapeFn(InferenceContext* c, bool sparse) {
 REGISTER_OP("KvResourceSparseApplyAdagrad")
     .Input("var: resource")
     .Input("accum: resource")
-    .Input("lr: T")
+    .Input("lr: Tscalar")
     .Input("grad: T")
     .Input("indices: Tindices")
     .Input("global_step: Tstep")
     .Attr("T: numbertype")
+    // Type of lr, float for the half and bfloat16 EmbeddingVariables.
+    .Attr("Tscalar: {float, double} = DT_FLOAT")
     .Attr("Tindices: {int32, int64}")
     .Attr("Tstep: {int32, int64}")
     .Attr("use_locking: bool = false")
@@ -424,16 +426,19 @@ REGISTER_OP("KvResourceSparseApplyAdam")
     .Input("var: resource")
     .Input("m: resource")
     .Input("v: resource")
-    .Input("beta1_power: T")
-    .Input("beta2_power: T")
-    .Input("lr: T")
-    .Input("beta1: T")
-    .Input("beta2: T")
-    .Input("epsilon: T")
+    .Input("beta1_power: Tscalar")
+    .Input("beta2_power: Tscalar")
+    .Input("lr: Tscalar")
+    .Input("beta1: Tscalar")
+    .Input("beta2: Tscalar")
+    .Input("epsilon: Tscalar")
     .Input("grad: T")
     .Input("indices: Tindices")
     .Input("global_step: Tstep")
     .Attr("T: numbertype")
+    // Type of the hyperparameters, float for the half and bfloat16
+    // EmbeddingVariables too, e.g. beta2 0.999 is 1.0 in bfloat16.
+    .Attr("Tscalar: {float, double} = DT_FLOAT")
     .Attr("Tindices: {int32, int64, string}")
     .Attr("Tstep: {int32, int64}")
     .Attr("use_locking: bool = false")
@@ -497,11 +502,13 @@ static Status KvApplyGradientDescentShapeFn(InferenceContext* c) {
 
 REGISTER_OP("KvResourceSparseApplyGradientDescent")
     .Input("var: resource")
-    .Input("alpha: T")
+    .Input("alpha: Tscalar")
     .Input("grad: T")
     .Input("indices: Tindices")
     .Input("global_step: Tstep")
     .Attr("T: numbertype")
+    // Type of alpha, float for the half and bfloat16 EmbeddingVariables.
+    .Attr("Tscalar: {float, double} = DT_FLOAT")
     .Attr("Tindices: {int32, int64}")
     .Attr("Tstep: {int32, int64}")
     .Attr("use_locking: bool = false")
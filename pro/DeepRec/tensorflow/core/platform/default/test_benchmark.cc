@@ -190,6 +190,17 @@ void Benchmark::Run(const char* pattern) {
         LOG(ERROR) << s.ToString();
         exit(EXIT_FAILURE);
       }
+      if (bytes_processed > 0) {
+        s = reporter.SetProperty("bytes_per_second",
+                                 bytes_processed / seconds);
+      }
+      if (s.ok() && !label.empty()) {
+        s = reporter.SetProperty("label", label);
+      }
+      if (!s.ok()) {
+        LOG(ERROR) << s.ToString();
+        exit(EXIT_FAILURE);
+      }
       s = reporter.Close();
       if (!s.ok()) {
         LOG(ERROR) << s.ToString();
@@ -0,0 +1,39 @@
+/* Copyright 2019 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_UTIL_TENSOR_BUFFER_STATISTICS_H_
+#define TENSORFLOW_CORE_UTIL_TENSOR_BUFFER_STATISTICS_H_
+
+namespace tensorflow {
+namespace tensor_buffer {
+
+// Layout of the statistics tensor of TensorBufferStatistics, shared by the
+// op shape function and the kernel.
+enum Statistics {
+  kCapacity = 0,
+  kSize,
+  kPutCount,
+  kPutStallCount,
+  kPutStallMicros,
+  kTakeCount,
+  kTakeStallCount,
+  kTakeStallMicros,
+  kNumStatistics,
+};
+
+}  // namespace tensor_buffer
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_UTIL_TENSOR_BUFFER_STATISTICS_H_
@@ -0,0 +1,92 @@
+# Copyright 2021 Alibaba Group Holding Limited. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Benchmarks for `ParquetDataset`."""
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+import os
+import tempfile
+import time
+
+import numpy as np
+import pandas as pd
+
+from tensorflow.python.client import session
+from tensorflow.python.data.experimental.ops import parquet_dataset_ops
+from tensorflow.python.data.ops import dataset_ops
+from tensorflow.python.framework import ops
+from tensorflow.python.platform import gfile
+from tensorflow.python.platform import googletest
+from tensorflow.python.platform import test
+
+
+class ParquetDatasetBenchmark(test.Benchmark):
+  """Benchmarks for `ParquetDataset`."""
+
+  def _set_up(self, num_cols, num_rows=200000, row_group_size=10000):
+    gfile.MakeDirs(googletest.GetTempDir())
+    self._temp_dir = tempfile.mkdtemp(dir=googletest.GetTempDir())
+    self._num_rows = num_rows
+    self._filename = os.path.join(self._temp_dir, 'file%d.parquet' % num_cols)
+    df = pd.DataFrame(
+        np.random.randint(0, 1 << 30, size=(num_rows, num_cols),
+                          dtype=np.int64),
+        columns=['col%d' % i for i in range(num_cols)])
+    df['list'] = [np.arange(i % 8, dtype=np.int64) for i in range(num_rows)]
+    df.to_parquet(self._filename, row_group_size=row_group_size)
+
+  def _tear_down(self):
+    gfile.DeleteRecursively(self._temp_dir)
+
+  def _run_benchmark(self, num_cols, num_threads, batch_size=1024):
+    os.environ['PARQUET_READ_PARALLELISM'] = str(num_threads)
+    try:
+      deltas = []
+      for _ in range(5):
+        with ops.Graph().as_default():
+          dataset = parquet_dataset_ops.ParquetDataset(
+              self._filename, batch_size=batch_size)
+          options = dataset_ops.Options()
+          options.experimental_optimization.apply_default_optimizations = False
+          dataset = dataset.with_options(options)
+          next_element = dataset_ops.make_one_shot_iterator(
+              dataset).get_next()
+          with session.Session() as sess:
+            start = time.time()
+            for _ in range(self._num_rows // batch_size):
+              sess.run(next_element)
+            deltas.append(time.time() - start)
+      median_wall_time = np.median(deltas)
+      rows_per_sec = self._num_rows // batch_size * batch_size / median_wall_time
+      self.report_benchmark(
+          iters=self._num_rows // batch_size,
+          wall_time=median_wall_time,
+          extras={'rows_per_sec': rows_per_sec},
+          name='parquet_with_cols_%d_threads_%d' % (num_cols, num_threads))
+    finally:
+      del os.environ['PARQUET_READ_PARALLELISM']
+
+  def benchmark_parquet_dataset(self):
+    for num_cols in [16, 256]:
+      self._set_up(num_cols)
+      for num_threads in [1, 2, 4, 8, 16]:
+        self._run_benchmark(num_cols, num_threads)
+      self._tear_down()
+
+
+if __name__ == '__main__':
+  test.main()
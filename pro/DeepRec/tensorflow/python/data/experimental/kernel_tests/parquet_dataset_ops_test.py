@@ -192,6 +192,90 @@ class ParquetDatasetTest(test_base.DatasetTestBase):
       with self.assertRaises(tf.errors.OutOfRangeError):
         sess.run(batch)
 
+  def test_read_row_groups_in_parallel(self):
+    batch_size = 32
+    filename = os.path.join(self._workspace, 'test_row_groups.parquet')
+    # Row groups of 50 rows, so that some batches span two row groups.
+    self._df.to_parquet(filename, row_group_size=50)
+    os.environ['PARQUET_READ_PARALLELISM'] = '4'
+    try:
+      with tf.Graph().as_default() as graph:
+        ds = parquet_dataset_ops.ParquetDataset(
+          filename,
+          batch_size=batch_size,
+          fields=[parquet_dataset_ops.DataFrame.Field('A', tf.int64),
+                  parquet_dataset_ops.DataFrame.Field('C', tf.int64)])
+        batch = tf.data.make_one_shot_iterator(ds).get_next()
+
+      a = self._df['A']
+      c = self._df['C']
+      with tf.Session(graph=graph) as sess:
+        for i in xrange((len(self._df) + batch_size - 1) // batch_size):
+          result = sess.run(batch)
+          start_row = i * batch_size
+          end_row = (i + 1) * batch_size
+          np.testing.assert_equal(result['A'], a[start_row:end_row].to_numpy())
+          np.testing.assert_equal(result['C'], c[start_row:end_row].to_numpy())
+        with self.assertRaises(tf.errors.OutOfRangeError):
+          sess.run(batch)
+    finally:
+      del os.environ['PARQUET_READ_PARALLELISM']
+
+  def test_read_list_row_groups_in_parallel(self):
+    batch_size = 32
+    num_rows = 200
+    filename = os.path.join(self._workspace, 'test_list_row_groups.parquet')
+    rng = np.random.RandomState(0)
+    lists = [
+      rng.randint(0, 100, size=rng.randint(0, 4)).tolist()
+      for _ in xrange(num_rows)]
+    ragged = [
+      [rng.randint(0, 100, size=rng.randint(0, 3)).tolist()
+       for _ in xrange(rng.randint(0, 3))]
+      for _ in xrange(num_rows)]
+    df = pd.DataFrame({'L': lists, 'R': ragged})
+    # Row groups of 50 rows, so that batches are sliced from the middle of
+    # row groups and some of them span two row groups.
+    df.to_parquet(filename, row_group_size=50)
+
+    def splits(rows):
+      return np.cumsum([0] + [len(r) for r in rows])
+
+    os.environ['PARQUET_READ_PARALLELISM'] = '4'
+    try:
+      with tf.Graph().as_default() as graph:
+        ds = parquet_dataset_ops.ParquetDataset(
+          filename,
+          batch_size=batch_size,
+          fields=[parquet_dataset_ops.DataFrame.Field('L', tf.int64, 1),
+                  parquet_dataset_ops.DataFrame.Field('R', tf.int64, 2)])
+        batch = tf.data.make_one_shot_iterator(ds).get_next()
+
+      with tf.Session(graph=graph) as sess:
+        for i in xrange((num_rows + batch_size - 1) // batch_size):
+          result = sess.run(batch)
+          start_row = i * batch_size
+          end_row = (i + 1) * batch_size
+          rows = lists[start_row:end_row]
+          np.testing.assert_equal(
+            result['L'].values, [v for r in rows for v in r])
+          self.assertEqual(len(result['L'].nested_row_splits), 1)
+          np.testing.assert_equal(
+            result['L'].nested_row_splits[0], splits(rows))
+          rows = ragged[start_row:end_row]
+          inner_rows = [l for r in rows for l in r]
+          np.testing.assert_equal(
+            result['R'].values, [v for l in inner_rows for v in l])
+          self.assertEqual(len(result['R'].nested_row_splits), 2)
+          np.testing.assert_equal(
+            result['R'].nested_row_splits[0], splits(rows))
+          np.testing.assert_equal(
+            result['R'].nested_row_splits[1], splits(inner_rows))
+        with self.assertRaises(tf.errors.OutOfRangeError):
+          sess.run(batch)
+    finally:
+      del os.environ['PARQUET_READ_PARALLELISM']
+
 
 if __name__ == "__main__":
     test.main()
@@ -173,6 +173,12 @@ class UniqueTest(test.TestCase):
   def testUniqueDenseHashMap(self):
     self.RunUniqueWithDifferentMaps('GOOGLE')
 
+  def testUniqueSort(self):
+    self.RunUniqueWithDifferentMaps('SORT')
+
+  def testUniqueAuto(self):
+    self.RunUniqueWithDifferentMaps('AUTO')
+
 class UniqueWithCountsTest(test.TestCase):
 
   def testInt32(self):
@@ -278,6 +284,42 @@ class UniqueWithCountsTest(test.TestCase):
   def testUniqueWithCountsDenseHashMap(self):
     self.RunUniqueWithCountsWithDifferentMaps('GOOGLE')
 
+  def testUniqueWithCountsSort(self):
+    self.RunUniqueWithCountsWithDifferentMaps('SORT')
+
+  def testUniqueWithCountsAuto(self):
+    self.RunUniqueWithCountsWithDifferentMaps('AUTO')
+
+  def testSortKeepsFirstOccurrenceOrder(self):
+    recover_env = False
+    if 'DEEPREC_UNIQUE_OP_HASH_MAP' in os.environ:
+      recover_env = True
+      old_env = os.environ['DEEPREC_UNIQUE_OP_HASH_MAP']
+    os.environ['DEEPREC_UNIQUE_OP_HASH_MAP'] = 'SORT'
+
+    x = np.array([5, 3, 5, -1, 3, 1 << 40], dtype=np.int64)
+    with self.cached_session() as sess:
+      y, idx, count = array_ops.unique_with_counts(x)
+      tf_y, tf_idx, tf_count = sess.run([y, idx, count])
+    self.assertAllEqual(tf_y, np.array([5, 3, -1, 1 << 40]))
+    self.assertAllEqual(tf_idx, np.array([0, 1, 0, 2, 1, 3]))
+    self.assertAllEqual(tf_count, np.array([2, 2, 1, 1]))
+
+    x = np.random.randint(-1000, high=1000, size=700000).astype(np.int64)
+    with self.cached_session() as sess:
+      y, idx, count = array_ops.unique_with_counts(x)
+      tf_y, tf_idx, tf_count = sess.run([y, idx, count])
+    _, first_index, expected_count = np.unique(
+        x, return_index=True, return_counts=True)
+    order = np.argsort(first_index)
+    self.assertAllEqual(tf_y, x[np.sort(first_index)])
+    self.assertAllEqual(tf_y[tf_idx], x)
+    self.assertAllEqual(tf_count, expected_count[order])
+
+    del os.environ['DEEPREC_UNIQUE_OP_HASH_MAP']
+    if recover_env:
+      os.environ['DEEPREC_UNIQUE_OP_HASH_MAP'] = old_env
+
 
 if __name__ == '__main__':
   test.main()
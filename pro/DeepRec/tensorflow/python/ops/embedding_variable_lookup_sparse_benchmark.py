@@ -0,0 +1,157 @@
+# Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Benchmark fused EmbeddingVariable lookup sparse against the unfused chain.
+
+The unfused chain is Unique + KvResourceGather + SparseSegmentReduction as
+built by embedding_lookup_sparse, the fused one is
+KvResourceEmbeddingLookupSparse. For string features the unfused chain starts
+with StringToHashBucketFast and the fused one is
+KvResourceStringEmbeddingLookupSparse. Both forward and backward are measured.
+"""
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+import time
+
+import numpy as np
+
+from tensorflow.core.protobuf import config_pb2
+from tensorflow.python.client import session as session_lib
+from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import ops
+from tensorflow.python.framework import sparse_tensor
+from tensorflow.python.ops import embedding_ops
+from tensorflow.python.ops import fused_embedding_ops
+from tensorflow.python.ops import gradients_impl
+from tensorflow.python.ops import init_ops
+from tensorflow.python.ops import math_ops
+from tensorflow.python.ops import string_ops
+from tensorflow.python.ops import variable_scope
+from tensorflow.python.ops import variables
+from tensorflow.python.platform import test
+
+
+def build_graph(batch_size, ids_per_row, num_ids, embedding_dim, combiner,
+                fused, string_ids=False):
+  """Build a lookup sparse of a [batch_size, ids_per_row] SparseTensor.
+
+  Args:
+    batch_size: rows of the SparseTensor.
+    ids_per_row: ids in every row.
+    num_ids: ids are drawn from [0, num_ids) with a zipf like distribution.
+    embedding_dim: dimension of the EmbeddingVariable.
+    combiner: "sum", "mean" or "sqrtn".
+    fused: if True use the fused op.
+    string_ids: if True the ids are strings like user/item ids.
+
+  Returns:
+    The embeddings and the gradient w.r.t. the EmbeddingVariable.
+  """
+  var = variable_scope.get_embedding_variable(
+      "var", embedding_dim=embedding_dim,
+      initializer=init_ops.ones_initializer(dtypes.float32))
+  nnz = batch_size * ids_per_row
+  ids = np.random.zipf(1.2, nnz).astype(np.int64) % num_ids
+  indices = np.stack([np.repeat(np.arange(batch_size), ids_per_row),
+                      np.tile(np.arange(ids_per_row), batch_size)], axis=1)
+  if string_ids:
+    values = np.array(["item_%d" % i for i in ids], dtype=object)
+    if not fused:
+      values = string_ops.string_to_hash_bucket_fast(values, 1 << 62)
+  else:
+    values = ids
+  sp_ids = sparse_tensor.SparseTensor(
+      indices=indices.astype(np.int64), values=values,
+      dense_shape=[batch_size, ids_per_row])
+  if fused:
+    emb = fused_embedding_ops.fused_embedding_variable_lookup_sparse(
+        var, sp_ids, combiner=combiner)
+  else:
+    emb = embedding_ops.embedding_lookup_sparse(
+        var, sp_ids, None, combiner=combiner)
+  grad = gradients_impl.gradients(math_ops.reduce_sum(emb), [var])[0]
+  return emb, grad.values
+
+
+class EmbeddingVariableLookupSparseBenchmark(test.Benchmark):
+  """Benchmark fused and unfused EmbeddingVariable lookup sparse."""
+
+  def _run_graph(self, batch_size, ids_per_row, num_ids, embedding_dim,
+                 combiner, fused, num_iters, string_ids=False):
+    """Run the graph and report its execution time and allocated bytes.
+
+    Returns:
+      The duration of the run in seconds.
+    """
+    graph = ops.Graph()
+    with graph.as_default():
+      outputs = build_graph(batch_size, ids_per_row, num_ids, embedding_dim,
+                            combiner, fused, string_ids)
+      init = variables.global_variables_initializer()
+      ev_init = ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS)
+    with session_lib.Session(graph=graph) as session:
+      session.run(ev_init)
+      session.run(init)
+      _ = session.run(outputs)  # warm up, ids are inserted here.
+      run_options = config_pb2.RunOptions(
+          trace_level=config_pb2.RunOptions.FULL_TRACE)
+      run_metadata = config_pb2.RunMetadata()
+      session.run(outputs, options=run_options, run_metadata=run_metadata)
+      allocated_bytes = 0
+      peak_bytes = 0
+      for dev_stats in run_metadata.step_stats.dev_stats:
+        for node_stats in dev_stats.node_stats:
+          for mem in node_stats.memory:
+            allocated_bytes += mem.total_bytes
+            peak_bytes = max(peak_bytes, mem.allocator_bytes_in_use)
+      start_time = time.time()
+      for _ in range(num_iters):
+        _ = session.run(outputs)
+      duration = time.time() - start_time
+
+    name = ("ev_lookup_sparse_{string}{fused}_batch_{batch}_ids_{ids}"
+            "_dim_{dim}_{combiner}").format(
+                string="string_" if string_ids else "",
+                fused="fused" if fused else "unfused", batch=batch_size,
+                ids=ids_per_row, dim=embedding_dim, combiner=combiner)
+    print("%s - %f secs - allocated %d bytes - peak %d bytes" %
+          (name, duration / num_iters, allocated_bytes, peak_bytes))
+    self.report_benchmark(
+        name=name, iters=num_iters, wall_time=duration / num_iters,
+        extras={"allocated_bytes": allocated_bytes,
+                "peak_bytes": peak_bytes})
+    return duration
+
+  def benchmark_ev_lookup_sparse(self):
+    shapes = [(512, 10, 64), (2048, 50, 16), (2048, 50, 64), (8192, 20, 32)]
+    for batch_size, ids_per_row, embedding_dim in shapes:
+      for combiner in ["sum", "mean"]:
+        for fused in [False, True]:
+          self._run_graph(batch_size, ids_per_row, 100000, embedding_dim,
+                          combiner, fused, 20)
+
+  def benchmark_ev_string_lookup_sparse(self):
+    # User ids: one per row out of many, item ids: tens per row.
+    shapes = [(2048, 1, 16), (2048, 50, 16), (8192, 20, 32)]
+    for batch_size, ids_per_row, embedding_dim in shapes:
+      for fused in [False, True]:
+        self._run_graph(batch_size, ids_per_row, 1000000, embedding_dim,
+                        "mean", fused, 20, string_ids=True)
+
+
+if __name__ == "__main__":
+  test.main()
@@ -23,6 +23,8 @@ from tensorflow.python.ops.check_ops import assert_equal
 from tensorflow.python.platform import googletest
 from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import embedding_ops
+from tensorflow.python.ops import fused_embedding_ops
+from tensorflow.python.ops import gen_kv_variable_ops
 from tensorflow.python.ops import kv_variable_ops
 from tensorflow.python.ops import math_ops
 from tensorflow.python.ops import init_ops
@@ -30,6 +32,7 @@ from tensorflow.python.ops import nn_ops
 from tensorflow.python.ops import partitioned_variables
 from tensorflow.python.ops import variable_scope
 from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import errors
 from tensorflow.python.framework import meta_graph
 from tensorflow.python.framework import sparse_tensor
 from tensorflow.core.framework.embedding import config_pb2
@@ -963,6 +966,160 @@ class EmbeddingVariableTest(test_util.TensorFlowTestCase):
       for j in range(0, 3):
         self.assertEqual(emb1.tolist()[i][j], emb2.tolist()[i][j])
 
+  def testEmbeddingVariableForFusedLookupSparse(self):
+    print("testEmbeddingVariableForFusedLookupSparse")
+    def runTestFusedLookup(self, combiner, fused):
+      with ops.Graph().as_default() as g:
+        var = variable_scope.get_embedding_variable("var_1",
+              embedding_dim = 3,
+              initializer=init_ops.ones_initializer(dtypes.float32))
+        sp_ids = sparse_tensor.SparseTensor(
+              indices=[[0,0],[0,1],[0,2],[1,0],[2,0],[2,1],[3,0]],
+              values=math_ops.cast([1,3,1,5,3,7,1], dtypes.int64),
+              dense_shape=[4, 3])
+        if fused:
+          emb = fused_embedding_ops.fused_embedding_variable_lookup_sparse(
+              var, sp_ids, combiner=combiner)
+        else:
+          emb = embedding_ops.embedding_lookup_sparse(
+              var, sp_ids, None, combiner=combiner)
+        fun = math_ops.multiply(emb, [[1.0, 2.0, 3.0]], name='multiply')
+        loss = math_ops.reduce_sum(fun, name='reduce_sum')
+        opt = gradient_descent.GradientDescentOptimizer(0.1)
+        g_v = opt.compute_gradients(loss)
+        train_op = opt.apply_gradients(g_v)
+        init = variables.global_variables_initializer()
+        with self.session(graph=g) as sess:
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_SLOT_OPS))
+          sess.run([init])
+          for _ in range(3):
+            r, _ = sess.run([emb, train_op])
+          return r
+    for combiner in ["sum", "mean", "sqrtn"]:
+      emb1 = runTestFusedLookup(self, combiner, True)
+      emb2 = runTestFusedLookup(self, combiner, False)
+      self.assertAllClose(emb1, emb2)
+
+  def testEmbeddingVariableForFusedStringLookupSparse(self):
+    print("testEmbeddingVariableForFusedStringLookupSparse")
+    def runTestFusedLookup(self, combiner, fused):
+      with ops.Graph().as_default() as g:
+        var = variable_scope.get_embedding_variable("var_1",
+              embedding_dim = 3,
+              initializer=init_ops.random_normal_initializer(seed=1))
+        indices = [[0,0],[0,1],[0,2],[1,0],[2,0],[2,1],[3,0]]
+        values = ["u1","i3","u1","i5","i3","u7",""]
+        if fused:
+          sp_ids = sparse_tensor.SparseTensor(
+                indices=indices, values=values, dense_shape=[5, 3])
+          emb = fused_embedding_ops.fused_embedding_variable_lookup_sparse(
+              var, sp_ids, combiner=combiner)
+        else:
+          sp_ids = sparse_tensor.SparseTensor(
+                indices=indices,
+                values=string_ops.string_to_hash64(values),
+                dense_shape=[5, 3])
+          emb = embedding_ops.embedding_lookup_sparse(
+              var, sp_ids, None, combiner=combiner)
+          emb = array_ops.pad(emb, [[0, 1], [0, 0]])
+        fun = math_ops.multiply(emb, [[1.0, 2.0, 3.0]], name='multiply')
+        loss = math_ops.reduce_sum(fun, name='reduce_sum')
+        opt = adagrad.AdagradOptimizer(0.1)
+        g_v = opt.compute_gradients(loss)
+        train_op = opt.apply_gradients(g_v)
+        init = variables.global_variables_initializer()
+        with self.session(graph=g) as sess:
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_SLOT_OPS))
+          sess.run([init])
+          for _ in range(3):
+            r, _ = sess.run([emb, train_op])
+          return r
+    for combiner in ["sum", "mean", "sqrtn"]:
+      emb1 = runTestFusedLookup(self, combiner, True)
+      emb2 = runTestFusedLookup(self, combiner, False)
+      self.assertAllClose(emb1, emb2)
+      self.assertAllEqual(emb1[4], [0.0, 0.0, 0.0])
+
+  def testEmbeddingVariableForFusedLookupSparseInvalidInput(self):
+    print("testEmbeddingVariableForFusedLookupSparseInvalidInput")
+    def runFusedLookup(indices, values, dense_shape):
+      with ops.Graph().as_default() as g:
+        var = variable_scope.get_embedding_variable("var_1",
+              embedding_dim = 3,
+              initializer=init_ops.ones_initializer(dtypes.float32))
+        sp_ids = sparse_tensor.SparseTensor(
+              indices=array_ops.reshape(
+                  math_ops.cast(indices, dtypes.int64), [-1, 2]),
+              values=math_ops.cast(values, dtypes.int64),
+              dense_shape=dense_shape)
+        emb = fused_embedding_ops.fused_embedding_variable_lookup_sparse(
+            var, sp_ids, combiner="sum")
+        with self.session(graph=g) as sess:
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_SLOT_OPS))
+          return sess.run(emb)
+    # Without ids dense_shape[0] is the only size of the output.
+    with self.assertRaisesRegexp(errors.InvalidArgumentError,
+                                 "is negative"):
+      runFusedLookup([], [], [-1, 3])
+    with self.assertRaisesRegexp(errors.InvalidArgumentError,
+                                 "is not in"):
+      runFusedLookup([[0, 0], [2, 0]], [1, 2], [2, 3])
+    self.assertAllEqual(runFusedLookup([], [], [0, 3]).shape, [0, 3])
+
+  def testEmbeddingVariableForStatistics(self):
+    print("testEmbeddingVariableForStatistics")
+    # Every id is recorded in the hot id sketch.
+    os.environ["TF_EV_HOT_ID_SAMPLE_RATE"] = "1"
+    with ops.Graph().as_default() as g:
+      var = variable_scope.get_embedding_variable("var_1",
+            embedding_dim = 3,
+            initializer=init_ops.ones_initializer(dtypes.float32))
+      sp_ids = sparse_tensor.SparseTensor(
+            indices=[[0,0],[0,1],[1,0],[1,1]],
+            values=math_ops.cast([1,3,1,5], dtypes.int64),
+            dense_shape=[2, 2])
+      emb = fused_embedding_ops.fused_embedding_variable_lookup_sparse(
+          var, sp_ids, combiner="sum")
+      stats = var.statistics()
+      init = variables.global_variables_initializer()
+      with self.session(graph=g) as sess:
+        sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+        sess.run([init])
+        sess.run(emb)
+        sess.run(emb)
+        r = sess.run(stats)
+    del os.environ["TF_EV_HOT_ID_SAMPLE_RATE"]
+    self.assertEqual(r["batches"], 2)
+    self.assertEqual(r["ids"], 8)
+    self.assertEqual(r["unique_ids"], 6)
+    self.assertEqual(r["new_ids"], 3)
+    self.assertEqual(r["tier0_hits"], 3)
+    self.assertAllClose(r["unique_ratio"], 0.75)
+    self.assertEqual(r["hot_keys"][0], 1)
+    self.assertGreaterEqual(r["hot_counts"][0], 4)
+
+  def testEmbeddingVariableForPrefetch(self):
+    print("testEmbeddingVariableForPrefetch")
+    with ops.Graph().as_default() as g:
+      var = variable_scope.get_embedding_variable("var_1",
+            embedding_dim = 3,
+            initializer=init_ops.ones_initializer(dtypes.float32))
+      ids = math_ops.cast([5,1,3,1], dtypes.int64)
+      prefetched = gen_kv_variable_ops.kv_resource_prefetch(
+          var.handle, ids, dtype=dtypes.float32)
+      emb = embedding_ops.embedding_lookup(var, prefetched)
+      keys, _, _, _ = var.export()
+      init = variables.global_variables_initializer()
+      with self.session(graph=g) as sess:
+        sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+        sess.run([init])
+        self.assertAllEqual([5,1,3,1], sess.run(prefetched))
+        self.assertAllEqual([1,3,5], sorted(sess.run(keys)))
+        self.assertAllClose(np.ones([4,3]), sess.run(emb))
+
   def testEmbeddingVariableForAdagrad(self):
     print("testEmbeddingVariableForAdagrad")
     def runTestAdagrad(self, var):
@@ -996,6 +1153,96 @@ class EmbeddingVariableTest(test_util.TensorFlowTestCase):
       for j in range(0, 3):
         self.assertEqual(emb1.tolist()[i][j], emb2.tolist()[i][j])
 
+  def testEmbeddingVariableForReducedPrecision(self):
+    print("testEmbeddingVariableForReducedPrecision")
+    def runTestAdagrad(self, value_dtype):
+      with ops.Graph().as_default() as g:
+        var = variable_scope.get_embedding_variable("var_1",
+              embedding_dim = 3,
+              value_dtype=value_dtype,
+              initializer=init_ops.ones_initializer(value_dtype))
+        emb = embedding_ops.embedding_lookup(var, math_ops.cast([0,1,2,5,6,7], dtypes.int64))
+        self.assertEqual(dtypes.float32, emb.dtype)
+        fun = math_ops.multiply(emb, 2.0, name='multiply')
+        loss = math_ops.reduce_sum(fun, name='reduce_sum')
+        gs = training_util.get_or_create_global_step()
+        opt = adagrad.AdagradOptimizer(0.1)
+        g_v = opt.compute_gradients(loss)
+        train_op = opt.apply_gradients(g_v)
+        init = variables.global_variables_initializer()
+        with self.session(graph=g) as sess:
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_SLOT_OPS))
+          sess.run([init])
+          for _ in range(5):
+            r, _, _ = sess.run([emb, train_op, loss])
+          return r
+    emb_fp32 = runTestAdagrad(self, dtypes.float32)
+    emb_bf16 = runTestAdagrad(self, dtypes.bfloat16)
+    emb_fp16 = runTestAdagrad(self, dtypes.float16)
+    self.assertAllClose(emb_fp32, emb_bf16, atol=2e-2)
+    self.assertAllClose(emb_fp32, emb_fp16, atol=5e-3)
+
+  def testEmbeddingVariableForReducedPrecisionGradientDescent(self):
+    print("testEmbeddingVariableForReducedPrecisionGradientDescent")
+    def runTestGradientDescent(self, value_dtype):
+      with ops.Graph().as_default() as g:
+        var = variable_scope.get_embedding_variable("var_1",
+              embedding_dim = 3,
+              value_dtype=value_dtype,
+              initializer=init_ops.ones_initializer(value_dtype))
+        emb = embedding_ops.embedding_lookup(var, math_ops.cast([0,1,2,5,6,7], dtypes.int64))
+        fun = math_ops.multiply(emb, 2.0, name='multiply')
+        loss = math_ops.reduce_sum(fun, name='reduce_sum')
+        gs = training_util.get_or_create_global_step()
+        # 0.003 is 0.00299 in bfloat16.
+        opt = gradient_descent.GradientDescentOptimizer(0.003)
+        g_v = opt.compute_gradients(loss)
+        train_op = opt.apply_gradients(g_v)
+        init = variables.global_variables_initializer()
+        with self.session(graph=g) as sess:
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_SLOT_OPS))
+          sess.run([init])
+          for _ in range(5):
+            r, _, _ = sess.run([emb, train_op, loss])
+          return r
+    emb_fp32 = runTestGradientDescent(self, dtypes.float32)
+    emb_bf16 = runTestGradientDescent(self, dtypes.bfloat16)
+    emb_fp16 = runTestGradientDescent(self, dtypes.float16)
+    self.assertAllClose(emb_fp32, emb_bf16, atol=1e-2)
+    self.assertAllClose(emb_fp32, emb_fp16, atol=5e-3)
+
+  def testEmbeddingVariableForReducedPrecisionAdam(self):
+    print("testEmbeddingVariableForReducedPrecisionAdam")
+    def runTestAdam(self, value_dtype):
+      with ops.Graph().as_default() as g:
+        var = variable_scope.get_embedding_variable("var_1",
+              embedding_dim = 3,
+              value_dtype=value_dtype,
+              initializer=init_ops.ones_initializer(value_dtype))
+        emb = embedding_ops.embedding_lookup(var, math_ops.cast([0,1,2,5,6,7], dtypes.int64))
+        # The gradient of the second column is 0, epsilon keeps it finite.
+        fun = math_ops.multiply(emb, [2.0, 0.0, 1.0], name='multiply')
+        loss = math_ops.reduce_sum(fun, name='reduce_sum')
+        gs = training_util.get_or_create_global_step()
+        opt = adam.AdamOptimizer(0.1)
+        g_v = opt.compute_gradients(loss)
+        train_op = opt.apply_gradients(g_v)
+        init = variables.global_variables_initializer()
+        with self.session(graph=g) as sess:
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_VAR_OPS))
+          sess.run(ops.get_collection(ops.GraphKeys.EV_INIT_SLOT_OPS))
+          sess.run([init])
+          for _ in range(5):
+            r, _, _ = sess.run([emb, train_op, loss])
+          return r
+    emb_fp32 = runTestAdam(self, dtypes.float32)
+    emb_bf16 = runTestAdam(self, dtypes.bfloat16)
+    emb_fp16 = runTestAdam(self, dtypes.float16)
+    self.assertAllClose(emb_fp32, emb_bf16, atol=2e-2)
+    self.assertAllClose(emb_fp32, emb_fp16, atol=5e-3)
+
   def testEmbeddingVariableForAdagradDecay(self):
     print("testEmbeddingVariableForAdagradDecay")
     with ops.device('/cpu:0'):
@@ -1946,6 +2193,39 @@ class EmbeddingVariableTest(test_util.TensorFlowTestCase):
         for j in range(0, 30):
           self.assertAllCloseAccordingToType(emb1.tolist()[i][j], emb2.tolist()[i][j])
 
+  def testEmbeddingVariableForDRAMAndLevelDBSmallCache(self):
+    print("testEmbeddingVariableForDRAMAndLevelDBSmallCache")
+    db_directory = self.get_temp_dir()
+    # The DRAM tier holds fewer rows than the ids in a batch.
+    emb_var = variable_scope.get_embedding_variable("var_1",
+          embedding_dim = 30,
+          initializer=init_ops.ones_initializer(dtypes.float32),
+          ev_option = variables.EmbeddingVariableOption(storage_option=variables.StorageOption(storage_type=config_pb2.StorageType.DRAM_LEVELDB,
+                                                                                               storage_path=db_directory,
+                                                                                               storage_size=[512])))
+    ids = array_ops.placeholder(dtypes.int64, name="ids")
+    emb = embedding_ops.embedding_lookup(emb_var, ids)
+    loss = math_ops.reduce_sum(emb, name='reduce_sum')
+    opt = gradient_descent.GradientDescentOptimizer(0.1)
+    train_op = opt.minimize(loss)
+    init = variables.global_variables_initializer()
+    with self.test_session() as sess:
+      sess.run([init])
+      for i in xrange(10):
+        sess.run([train_op], feed_dict={ids: [j for j in range(i * 4, i * 4 + 9)]})
+      # The ids are updated in several batches and evicted in between,
+      # none of the updates is lost.
+      expected = np.ones([45, 30])
+      for i in xrange(10):
+        for j in range(i * 4, i * 4 + 9):
+          expected[j] -= 0.1
+      r = sess.run(emb, feed_dict={ids: [j for j in range(45)]})
+      self.assertAllCloseAccordingToType(r, expected)
+      r = sess.run(emb, feed_dict={ids: [100, 101, 102]})
+      self.assertAllEqual(r.shape, [3, 30])
+      # New ids get the default value.
+      self.assertAllCloseAccordingToType(r, np.ones([3, 30]))
+
   def testEmbeddingVariableForDRAMAndSSD(self):
     print("testEmbeddingVariableForDRAMAndSSD")
     def runTestAdagrad(self, var, g):
@@ -10,6 +10,7 @@ from tensorflow.python.ops import variables
 from tensorflow.python.ops import array_ops
 from tensorflow.python.framework import sparse_tensor
 from tensorflow.python.ops import gen_fused_embedding_ops
+from tensorflow.python.ops import gen_kv_variable_ops
 from tensorflow.python.ops.kv_variable_ops import EmbeddingVariable
 from tensorflow.python.ops.gen_fused_embedding_ops import fused_embedding_sparse_pre_look_up
 from tensorflow.python.ops.gen_fused_embedding_ops import fused_embedding_sparse_post_look_up
@@ -85,6 +86,61 @@ def fused_embedding_lookup_sparse(params,
   return emb_vectors
 
 
+def fused_embedding_variable_lookup_sparse(params,
+                                           sp_ids,
+                                           combiner="mean",
+                                           name=None):
+  """Fused version of `embedding_lookup_sparse` for an EmbeddingVariable.
+
+  Dedups `sp_ids`, looks up each distinct id once and reduces the rows with
+  `combiner` in a single op, instead of the Unique, KvResourceGather and
+  SparseSegmentReduction chain.
+
+  String `sp_ids` are hashed into int64 ids in the same op, with the hash of
+  `StringToHash64` and without bucketing, so `params` must have int64 keys.
+
+  Args:
+    params: An `EmbeddingVariable`, or a list with exactly one of them.
+    sp_ids: 2-D `SparseTensor` of ids or strings.
+    combiner: One of "mean", "sqrtn" and "sum".
+    name: Optional name for the op.
+
+  Returns:
+    A dense tensor of shape `[sp_ids.dense_shape[0], embedding_dim]`, rows
+    without any id are zero.
+  """
+  if isinstance(params, list):
+    if len(params) != 1:
+      raise ValueError("For EmbeddingVariable, do not support partition now")
+    params = params[0]
+  if not isinstance(params, EmbeddingVariable):
+    raise TypeError("params must be an EmbeddingVariable")
+  if not isinstance(sp_ids, sparse_tensor.SparseTensor):
+    raise TypeError("sp_ids must be SparseTensor")
+  if combiner not in ("mean", "sqrtn", "sum"):
+    raise ValueError("combiner must be one of 'mean', 'sqrtn' or 'sum'")
+
+  with ops.name_scope(name, "fused_embedding_variable_lookup_sparse",
+                      [params, sp_ids]) as name:
+    with ops.colocate_with(params):
+      if sp_ids.dtype == dtypes.string:
+        if params._invalid_key_type != dtypes.int64:
+          raise TypeError("EmbeddingVariable looked up by strings must have "
+                          "int64 keys, got %s" % params._invalid_key_type)
+        embeddings, _, _ = (
+            gen_kv_variable_ops.kv_resource_string_embedding_lookup_sparse(
+                params.handle, sp_ids.values, sp_ids.indices,
+                sp_ids.dense_shape, combiner=combiner, dtype=params.dtype,
+                name=name))
+      else:
+        embeddings, _, _ = (
+            gen_kv_variable_ops.kv_resource_embedding_lookup_sparse(
+                params.handle, sp_ids.values, sp_ids.indices,
+                sp_ids.dense_shape, combiner=combiner, dtype=params.dtype,
+                name=name))
+  return embeddings
+
+
 @ops.RegisterGradient("FusedEmbeddingSparsePostLookUp")
 def fused_embedding_sparse_post_look_up_grad(op, top_grad_emb_vec, _):
   num_partitions = op.get_attr("num_partitions")
@@ -293,13 +293,19 @@ class EmbeddingVariable(resource_variable_ops.ResourceVariable):
     self._storage_path = evconfig.storage_path
     self._storage_size = evconfig.storage_size
     self._default_value_dim = evconfig.default_value_dim
+    # Persistent PMem EV keeps whole rows in the PMem file, the variable is
+    # parsed like ReadBoolFromEnvVar does on the C++ side.
+    persistent_pmem = self._storage_type == config_pb2.StorageType.PMEM_LIBPMEM and \
+        os.environ.get("TF_EV_PMEM_PERSISTENT", "0").lower() in ("1", "true")
     if (isinstance(evconfig.filter_strategy, variables.CounterFilter)  and self._filter_freq != 0) or \
        self._steps_to_live not in [0, None] or self._record_version or \
-       self._storage_type in multi_level_list or self._record_freq:
+       self._storage_type in multi_level_list or self._record_freq or \
+       persistent_pmem:
       if self._block_num not in [1, None] and self._storage_type in multi_level_list:
         raise ValueError("Dynamic-dimension Embedding and Multi-level EV can't be enabled together") 
       if self._block_num not in [1, None] or \
-          (self._filter_freq != 0 and self._storage_type not in multi_level_list):
+          (self._filter_freq != 0 and self._storage_type not in multi_level_list and
+           not persistent_pmem):
         self._layout = "normal"
       else:
         self._layout = "normal_contiguous"
@@ -386,7 +392,8 @@ class EmbeddingVariable(resource_variable_ops.ResourceVariable):
         with ops.name_scope("IsInitialized"):
           self._is_initialized_op = (
               gen_kv_variable_ops.kv_var_is_initialized_op(self._handle,
-                                                           Tkeys=self._invalid_key_type))
+                                                           Tkeys=self._invalid_key_type,
+                                                           dtype=self._dtype))
         if initial_value is not None:
           with ops.name_scope("Assign") as n, ops.colocate_with(self._handle):
             with ops.control_dependencies(None if self._is_primary else [self._primary.initializer]):
@@ -622,12 +629,59 @@ class EmbeddingVariable(resource_variable_ops.ResourceVariable):
   def total_count(self):
     """The shape of this variable."""
     return gen_kv_variable_ops.kv_variable_shape(self._handle,
-		    Tkeys=self._invalid_key_type)
+		    Tkeys=self._invalid_key_type, dtype=self.dtype)
 
   def export(self):
     return gen_kv_variable_ops.kv_resource_export(self._handle,
 		    self._invalid_key_type, self.dtype)
 
+  def statistics(self, name=None):
+    """Lookup statistics of this variable since it was created.
+
+    The counters are collected by the lookup ops unless `TF_EV_STATISTICS=0`,
+    the number of heavy hitters is set by `TF_EV_HOT_ID_TOP_K`.
+
+    Returns:
+      A dict of scalar tensors: the raw counters, "ids_per_sec",
+      "new_id_rate", "unique_ratio", "tier0_hit_rate" and
+      "disk_read_hit_rate", plus "hot_keys" and "hot_counts" for the
+      approximate most frequent ids.
+    """
+    with ops.name_scope(name, "EmbeddingVariableStatistics", [self._handle]):
+      statistics, hot_keys, hot_counts = (
+          gen_kv_variable_ops.kv_resource_statistics(
+              self._handle, Tkeys=self._invalid_key_type, dtype=self.dtype))
+      result = dict(zip(_EV_STATISTICS, array_ops.unstack(
+          statistics, num=len(_EV_STATISTICS))))
+      def _ratio(x, y):
+        return math_ops.div_no_nan(math_ops.cast(x, dtypes.float64),
+                                   math_ops.cast(y, dtypes.float64))
+      result["ids_per_sec"] = _ratio(result["ids"],
+                                     result["elapsed_micros"]) * 1e6
+      result["new_id_rate"] = _ratio(result["new_ids"], result["unique_ids"])
+      result["unique_ratio"] = _ratio(result["unique_ids"], result["ids"])
+      result["tier0_hit_rate"] = _ratio(result["tier0_hits"],
+                                        result["unique_ids"])
+      result["disk_read_hit_rate"] = _ratio(
+          result["disk_reads"] - result["disk_read_misses"],
+          result["disk_reads"])
+      result["hot_keys"] = hot_keys
+      result["hot_counts"] = hot_counts
+    return result
+
+  def statistics_summary(self, collections=None):
+    """Adds the scalar `statistics()` of this variable as summaries."""
+    from tensorflow.python.summary import summary  # pylint: disable=g-import-not-at-top
+    result = self.statistics()
+    summaries = []
+    with ops.name_scope(self._handle_name.split(":")[0]):
+      for key in sorted(result):
+        if key in ("hot_keys", "hot_counts"):
+          continue
+        summaries.append(summary.scalar(key, result[key],
+                                        collections=collections))
+    return summaries
+
   @property
   def steps_to_live(self):
     return self._steps_to_live
@@ -731,10 +785,10 @@ class EmbeddingVariable(resource_variable_ops.ResourceVariable):
       if self._trainable:
         tape.variable_accessed(self)
       if ev_init_value is not None:
-        default_value = ev_init_value
+        default_value = math_ops.cast(ev_init_value, self._dtype)
         is_use_default_value_tensor = True
       else:
-        default_value = ops.convert_to_tensor(1.0)
+        default_value = ops.convert_to_tensor(1.0, dtype=self._dtype)
         is_use_default_value_tensor = False
       if counts != None:
         value = gen_kv_variable_ops.kv_resource_gather_v1(self._handle,
@@ -747,6 +801,10 @@ class EmbeddingVariable(resource_variable_ops.ResourceVariable):
               default_value,
               is_use_default_value_tensor,
               name=name)
+      if self._dtype in (dtypes.bfloat16, dtypes.float16):
+        # Values stored in reduced precision are looked up as float32, the
+        # gradient is cast back to the dtype of the variable.
+        return math_ops.cast(value, dtypes.float32)
     return array_ops.identity(value)
 
   def to_proto(self, export_scope=None):
@@ -900,6 +958,15 @@ class DynamicEmbeddingVariable(resource_variable_ops.ResourceVariable):
     return len(self._ev_list)
 
 
+# Order of the statistics of KvResourceStatistics,
+# see embedding::EmbeddingStatistic.
+_EV_STATISTICS = ["batches", "ids", "unique_ids", "new_ids", "tier0_hits",
+                  "tier1_hits", "disk_read_bytes", "cache_evictions",
+                  "shrink_evictions", "shrink_eviction_bytes",
+                  "disk_reads", "disk_read_misses", "disk_read_micros",
+                  "disk_writes", "disk_write_micros", "elapsed_micros"]
+
+
 def _dense_var_to_tensor(var, dtype=None, name=None, as_ref=False):
   return var._dense_var_to_tensor(dtype=dtype, name=name, as_ref=as_ref)  # pylint: disable=protected-access
 
@@ -918,6 +985,9 @@ EmbeddingVariable._OverloadAllOperators()
 ops.register_dense_tensor_like_type(EmbeddingVariable)
 
 
+ops.NotDifferentiable("KvResourceStatistics")
+
+
 @ops.RegisterGradient("ReadKvVariableOp")
 def _ReadGrad(_, grad):
   """Gradient for read op."""
@@ -962,3 +1032,19 @@ def _GatherV1Grad(op, grad):
   indices = array_ops.reshape(indices, size)
   return [ops.IndexedSlices(values, indices, params_shape), None, None, None]
 
+
+@ops.RegisterGradient("KvResourceEmbeddingLookupSparse")
+@ops.RegisterGradient("KvResourceStringEmbeddingLookupSparse")
+def _EmbeddingLookupSparseGrad(op, grad, *unused_grads):
+  """Gradient for fused embedding lookup sparse op."""
+  handle = op.inputs[0]
+  while handle.op.type != "KvVarHandleOp":
+    handle = handle.op.inputs[0]
+  params_shape = ops.convert_to_tensor(
+      tensor_shape.TensorShape(handle.op.get_attr("shape")))
+  unique_keys = op.outputs[1]
+  values = gen_kv_variable_ops.kv_resource_embedding_lookup_sparse_grad(
+      grad, op.inputs[2], unique_keys, op.outputs[2],
+      combiner=op.get_attr("combiner"))
+  return [ops.IndexedSlices(values, unique_keys, params_shape),
+          None, None, None]
@@ -34,8 +34,10 @@ from tensorflow.python.ops.prefetch_runner import PrefetchRunner
 ops.NotDifferentiable('TensorBufferPut')
 ops.NotDifferentiable('TensorBufferTake')
 ops.NotDifferentiable('TensorBufferCancel')
+ops.NotDifferentiable('TensorBufferStatistics')
 
 PREFETCH = "prefetch"
+PREFETCH_STATISTICS = "prefetch_statistics"
 
 @tf_export(v1=["make_prefetch_hook"])
 def make_prefetch_hook(daemon=True, start=True):
@@ -76,8 +78,10 @@ def staged(
       default.
     num_clients: (Optional.) Number of clients of prefetched sample. 1 by
       default.
-    timeout_millis: (Optional.) Max milliseconds put op can take, 5 min by
-      default.
+    timeout_millis: (Optional.) Milliseconds after which a put op stalled by
+      a full buffer logs a warning, 5 min by default. The put op keeps
+      waiting until the sample is buffered or the prefetching is cancelled,
+      so that no sample is dropped.
     closed_exception_types: (Optional.) Exception types indicating that the
       prefetching is normally finished. Defaults to
       `(tf.errors.OutOfRangeError, StopIteration)`.
@@ -133,6 +137,9 @@ def staged(
       close_fetching = gen_tensor_buffer_ops.tensor_buffer_close(
           shared_name=name,
           shared_capacity=capacity)
+      statistics = gen_tensor_buffer_ops.tensor_buffer_statistics(
+          shared_name=name,
+          shared_capacity=capacity)
       next_tensors = gen_tensor_buffer_ops.tensor_buffer_take(
           dtypes=tensor_dtypes,
           shared_name=name,
@@ -173,6 +180,7 @@ def staged(
       closed_exception_types=closed_exception_types,
       ignored_exception_types=ignored_exception_types)
   ops.add_to_collection(PREFETCH, runner)
+  ops.add_to_collection(PREFETCH_STATISTICS, statistics)
   return prefetched
 
 @tf_export(v1=["prefetch_join"])
@@ -200,8 +208,10 @@ def prefetch_join(
     capacity: (Optional.) Max number of samples to keep in the buffer.
     num_clients: (Optional.) Number of clients of prefetched sample. 1 by
       default.
-    timeout_millis: (Optional.) Max milliseconds put op can take, 5 min by
-      default.
+    timeout_millis: (Optional.) Milliseconds after which a put op stalled by
+      a full buffer logs a warning, 5 min by default. The put op keeps
+      waiting until the sample is buffered or the prefetching is cancelled,
+      so that no sample is dropped.
     closed_exception_types: (Optional.) Exception types indicating that the
       prefetching is normally finished. Defaults to
       `(tf.errors.OutOfRangeError, StopIteration)`.
@@ -230,6 +240,9 @@ def prefetch_join(
       close_fetching = gen_tensor_buffer_ops.tensor_buffer_close(
           shared_name=name,
           shared_capacity=capacity)
+      statistics = gen_tensor_buffer_ops.tensor_buffer_statistics(
+          shared_name=name,
+          shared_capacity=capacity)
 
   thread_to_tensor_dtypes = []
   thread_to_tensor_shapes = []
@@ -315,4 +328,5 @@ def prefetch_join(
       closed_exception_types=closed_exception_types,
       ignored_exception_types=ignored_exception_types)
   ops.add_to_collection(PREFETCH, runner)
+  ops.add_to_collection(PREFETCH_STATISTICS, statistics)
   return prefetched
@@ -18,6 +18,8 @@ from __future__ import absolute_import
 from __future__ import division
 from __future__ import print_function
 
+import time
+
 from six.moves import xrange # pylint: disable=redefined-builtin
 
 from tensorflow.python.framework import dtypes
@@ -26,6 +28,8 @@ from tensorflow.python.framework import ops
 from tensorflow.python.framework import sparse_tensor
 from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import parsing_ops
+from tensorflow.python.ops import state_ops
+from tensorflow.python.ops import variables
 from tensorflow.python.platform import test
 from tensorflow.python.training import coordinator
 from tensorflow.python.training import monitored_session
@@ -309,6 +313,32 @@ class PrefetchTest(test.TestCase):
       sess.run(y)
       sess.close()
 
+  def test_no_sample_dropped_when_full(self):
+    capacity = 2
+    num_samples = 10
+    with ops.Graph().as_default() as graph:
+      with ops.device('/cpu:0'):
+        counter = variables.Variable(0, dtype=dtypes.int64)
+        x = state_ops.assign_add(counter, 1)
+        y = prefetch.staged(
+            x, capacity=capacity, num_threads=1, timeout_millis=1)
+      statistics = ops.get_collection(prefetch.PREFETCH_STATISTICS)[0]
+      init_op = variables.global_variables_initializer()
+
+    with self.test_session(graph=graph) as sess:
+      sess.run(init_op)
+      coord = coordinator.Coordinator()
+      prefetch.make_prefetch_hook().create_threads(sess, coord)
+      # Keep the buffer full long enough to stall the put op many times.
+      time.sleep(0.1)
+      for i in xrange(num_samples):
+        self.assertEqual(i + 1, sess.run(y))
+      stats = sess.run(statistics)
+      self.assertEqual(capacity, stats[0])
+      self.assertEqual(num_samples, stats[5])
+      self.assertGreater(stats[3], 0)
+      coord.request_stop()
+
 # pylint: enable=missing-docstring
 
 if __name__ == '__main__':
@@ -18,6 +18,7 @@ from __future__ import absolute_import
 from __future__ import division
 from __future__ import print_function
 
+from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import ops
 from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import gen_array_ops
@@ -140,10 +141,14 @@ class AdagradOptimizer(optimizer.Optimizer):
     acc = self.get_slot(var, "accumulator")
     if isinstance(var, kv_variable_ops.EmbeddingVariable):
       global_step = training_util.get_or_create_global_step()
+      # The learning rate stays in float for half and bfloat16 variables.
+      lr_dtype = grad.dtype
+      if lr_dtype in (dtypes.float16, dtypes.bfloat16):
+        lr_dtype = dtypes.float32
       return training_ops.kv_resource_sparse_apply_adagrad(
         var.handle,
         acc.handle,
-        math_ops.cast(self._learning_rate_tensor, grad.dtype),
+        math_ops.cast(self._learning_rate_tensor, lr_dtype),
         grad,
         indices,
         global_step,
@@ -18,6 +18,7 @@ from __future__ import division
 from __future__ import print_function
 
 from tensorflow.python.eager import context
+from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import ops
 from tensorflow.python.ops import control_flow_ops
 from tensorflow.python.ops import kv_variable_ops
@@ -272,14 +273,17 @@ class AdamOptimizer(optimizer.Optimizer):
     beta1_power, beta2_power = self._get_beta_accumulators()
     if isinstance(var, kv_variable_ops.EmbeddingVariable):
       global_step = training_util.get_or_create_global_step()
+      # The hyperparameters stay in float for half and bfloat16 variables,
+      # e.g. beta2 0.999 is 1.0 in bfloat16.
+      scalar_dtype = dtypes.float32
       return training_ops.kv_resource_sparse_apply_adam(
         var.handle, m.handle, v.handle,
-        math_ops.cast(beta1_power, grad.dtype),
-        math_ops.cast(beta2_power, grad.dtype),
-        math_ops.cast(self._lr_t, grad.dtype),
-        math_ops.cast(self._beta1_t, grad.dtype),
-        math_ops.cast(self._beta2_t, grad.dtype),
-        math_ops.cast(self._epsilon_t, grad.dtype),
+        math_ops.cast(beta1_power, scalar_dtype),
+        math_ops.cast(beta2_power, scalar_dtype),
+        math_ops.cast(self._lr_t, scalar_dtype),
+        math_ops.cast(self._beta1_t, scalar_dtype),
+        math_ops.cast(self._beta2_t, scalar_dtype),
+        math_ops.cast(self._epsilon_t, scalar_dtype),
         grad, indices, global_step, use_locking=self._use_locking)
     else:
       return self._resource_apply_sparse_shared(grad, var, indices,
@@ -18,6 +18,7 @@ from __future__ import absolute_import
 from __future__ import division
 from __future__ import print_function
 
+from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import ops
 from tensorflow.python.ops import gen_hash_training_ops
 from tensorflow.python.ops import kv_variable_ops
@@ -71,9 +72,12 @@ class GradientDescentOptimizer(optimizer.Optimizer):
   def _resource_apply_sparse_duplicate_indices(self, grad, handle, indices):
     if isinstance(handle, kv_variable_ops.EmbeddingVariable):
       global_step = training_util.get_or_create_global_step()
+      # The learning rate stays in float for half and bfloat16 variables.
+      lr_dtype = grad.dtype.base_dtype
+      if lr_dtype in (dtypes.float16, dtypes.bfloat16):
+        lr_dtype = dtypes.float32
       return training_ops.kv_resource_sparse_apply_gradient_descent(
-          handle.handle, math_ops.cast(self._learning_rate_tensor,
-                                       grad.dtype.base_dtype),
+          handle.handle, math_ops.cast(self._learning_rate_tensor, lr_dtype),
           grad, indices, global_step, use_locking=self._use_locking)
     else:
       return resource_variable_ops.resource_scatter_add(
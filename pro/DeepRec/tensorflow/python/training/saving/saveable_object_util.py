@@ -173,7 +173,7 @@ class EmbeddingVariableSaveable(saveable_object.SaveableObject):
 
     specs = []
     specs.append(saveable_object.SaveSpec(unused_tensor, "", name + "-keys", dtype=self.key_type, device=var.device))
-    specs.append(saveable_object.SaveSpec(unused_tensor, "", name + "-values", dtype=dtypes.float32, device=var.device))
+    specs.append(saveable_object.SaveSpec(unused_tensor, "", name + "-values", dtype=self.dtype, device=var.device))
     specs.append(saveable_object.SaveSpec(unused_tensor, "", name + "-versions", dtype=dtypes.int64, device=var.device))
     specs.append(saveable_object.SaveSpec(unused_tensor, "", name + "-freqs", dtype=dtypes.int64, device=var.device))
     # pylint: disable=protected-access